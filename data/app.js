@@ -10,6 +10,24 @@ export async function postJSON(url, body) {
   if (!r.ok) throw new Error(`${url} → ${r.status}`);
   return r.json().catch(()=> ({}));
 }
+// Live telemetry via Server-Sent Events (/api/events).
+// Keeps one merged state {ip, link, relays, DPM1:[..], ...} and calls
+// onUpdate(state, changedKeys) after the snapshot and after every delta.
+export function liveStatus(onUpdate, onError){
+  const state = {};
+  const es = new EventSource('/api/events');
+  const merge = (e, reset) => {
+    const d = JSON.parse(e.data);
+    if (reset) Object.keys(state).forEach(k => delete state[k]);
+    Object.assign(state, d);
+    onUpdate(state, reset ? null : Object.keys(d));
+  };
+  es.addEventListener('snapshot', e => merge(e, true));
+  es.addEventListener('dpm',      e => merge(e, false));
+  es.addEventListener('relays',   e => merge(e, false));
+  es.onerror = () => onError && onError();   // browser reconnects by itself
+  return es;
+}
 export function $(sel, root=document){ return root.querySelector(sel); }
 export function $all(sel, root=document){ return [...root.querySelectorAll(sel)]; }
 
@@ -10,6 +10,11 @@ namespace App {
   inline constexpr const char* MQTT_USER  = "";   // optional
   inline constexpr const char* MQTT_PASS  = "";   // optional
 
+  // HTTP basic auth for the REST write endpoints (web_api.h); changed
+  // via /api/settings or cmd/net, stored in net_cfg
+  inline constexpr const char* API_USER   = "admin";
+  inline constexpr const char* API_PASS   = "dpm-admin";
+
   // Base MQTT topic for this device
   inline constexpr const char* BASE_TOPIC = "DPM_Control";
   inline constexpr const char* DEVICE_HOST = "TEST_DPM";  
@@ -2,6 +2,7 @@
 #include <Arduino.h>
 #include <Preferences.h>
 #include <ModbusMaster.h>
+#include "energy_ctrl.h"
 
 // ========================= User wiring (edit to your board) =========================
 
@@ -15,6 +16,21 @@
 extern int ROWS;                 // <<< actual number of detected devices
 #define DPMS_SIZE (MAX_DPMS + 1) // backing array size for dpms[], cfg tables
 
+// ========================= Current setpoint quantisation ============================
+#ifndef DPM_CUR_RES_MA
+#define DPM_CUR_RES_MA 1       // DPM current register resolution (mA per LSB)
+#endif
+#ifndef DPM_CUR_MIN_STEP_MA
+#define DPM_CUR_MIN_STEP_MA 10 // default ramp step that is worth a Modbus write (mA)
+#endif
+#ifndef DPM_CUR_REFRESH_MS
+#define DPM_CUR_REFRESH_MS 5000 // RUN: rewrite an unchanged setpoint after this (lost writes)
+#endif
+
+// ========================= Temperature defaults (per DPM, persisted) ================
+#define DPM_TEMP_WARN 45 // °C: derating starts
+#define DPM_TEMP_CRIT 50 // °C: hard limit → OVERHEAT
+
 // ========================= DPM state struct (your fields kept) ======================
 enum DPMControlMode
 {
@@ -70,8 +86,25 @@ struct DPMState
   double energy_total = 0.0;  // lifetime
   double energy_anode = 0.0;  // since anode change
   double energy_target = 0.0; // expected (for energy mode)
+  double energy_target_cfg = 0.0; // configured target (J), 0 = V × I × runtime
   unsigned long last_energy_ms = 0;
   double anode_threshold = 100000.0; // J threshold for service alert
+  EnergyCtrl ectrl;                  // closed-loop current for MODE_ENERGY
+  // --- THERMAL MANAGEMENT (see thermal_mgr.h) ---
+  int temp_warn = DPM_TEMP_WARN; // derating starts here (°C)
+  int temp_crit = DPM_TEMP_CRIT; // hard limit → OVERHEAT (°C)
+  struct ThermalState
+  {
+    float temp_f = 0.0f;         // filtered temperature (°C)
+    float slope = 0.0f;          // filtered slope (°C/s)
+    unsigned long last_ms = 0;   // last sample
+    unsigned long step_ms = 0;   // last derate step
+    uint8_t derate_pct = 100;    // current scale (100 = no derating)
+    unsigned long lost_ms = 0;   // runtime extension for lost charge (ms)
+    float lost_frac = 0.0f;      // sub-ms remainder of lost_ms
+    Status resume = Status::IDLE; // state to return to after OVERHEAT
+    bool out_off = false;        // OVERHEAT: output switch-off written
+  } thermal;
   // --- OPERATOR INFO ---
   int user = 888;  // last known operator number
   int line_id = 0;  // NEW: Galvanic line identifier (0 = none, 1 = Line1, 2 = Line2 ...)
@@ -87,6 +120,16 @@ struct DPMState
     int pulse_high = 0;             // ON current (mA)
     int pulse_low = 0;              // OFF current (mA)
     unsigned long pulse_period = 0; // full period (ms)
+    // --- ramp write quantisation ---
+    int min_step = DPM_CUR_MIN_STEP_MA; // smallest current change worth a write (mA)
+    unsigned long min_interval = 0;  // write rate cap (ms between writes, 0 = off)
+    int step_size = 0;               // effective quantisation step (mA)
+    uint32_t step_count = 0;         // quantised levels between start and end
+    uint32_t step_k = 0;             // index of the next level to write
+    unsigned long next_ms = 0;       // elapsed ms at which level step_k is due
+    unsigned long last_write_ms = 0; // millis() of last current write
+    int last_written = -1;           // last current sent to the DPM (mA)
+    uint16_t writes = 0;             // current writes since curve start
   } curve;
 };
 
@@ -115,8 +158,6 @@ constexpr uint32_t MODBUS_DEFAULT_CFG = SERIAL_8N1; // 8N1 by default
 extern HardwareSerial modbus;
 extern ModbusMaster DPM_1;
 //******************************************************** Variables *************************************************************************************** */
-#define DPM_TEMP_WARN 45 //
-#define DPM_TEMP_CRIT 50 //
 
 // ========================= Public functions =========================================
 
@@ -128,6 +169,8 @@ void http_begin(); // register handlers and start server
 // Helpers to show cfg names in UI (provided by modbus_scan.cpp)
 
 void handle_StateMachine();
+void dpm_curve_begin(int id); // (re)start curve timing + precompute ramp steps
+int dpm_live_cur_set(int id); // setpoint in force: energy controller output while it owns it, else cur_set
 void loadConfig();
 void saveConfig();
 void printConfig();
@@ -1,5 +1,7 @@
 #pragma once
 #include <Arduino.h>
+#include <string.h>
+#include <type_traits>
 
 // -----------------------------------------------------------
 // Debug Level System
@@ -9,18 +11,223 @@
 // 2 = WARNINGS + ERRORS
 // 3 = INFO + WARNINGS + ERRORS (verbose)
 // -----------------------------------------------------------
+// DEBUG_LEVEL is the compile-time ceiling; below it each module has a
+// runtime level (log_set_level, /cmd/log). The module is the leading
+// "[TAG]" of the format string ("[MQTT] ..." → MQTT), untagged
+// messages belong to "*" (default level).
+//
+// DBG_* never format or touch Serial in the caller. A record (format
+// pointer + arguments in binary, strings copied) goes into a lock-free
+// ring; logTask (low priority) formats and prints it. A full ring
+// drops the record and counts it. Repeats of a call site (same
+// arguments within LOG_RATE_WINDOW_MS) and more than LOG_RATE_BURST
+// records per call site and window are suppressed before they take a
+// ring slot; one summary record follows when the window ends. The last LOG_RTC_LINES printed lines are kept in
+// RTC memory and shown again after a reset (not after power-on).
+//
+// Format strings must be literals (pointers are stored, not copied).
+// -----------------------------------------------------------
 
 #ifndef DEBUG_LEVEL
 #define DEBUG_LEVEL 2   // default if not overridden
 #endif
 
+#ifndef LOG_RING_SLOTS
+#define LOG_RING_SLOTS 64       // records in flight (power of 2)
+#endif
+#ifndef LOG_ARG_BYTES
+#define LOG_ARG_BYTES 80        // encoded arguments per record
+#endif
+#ifndef LOG_RATE_WINDOW_MS
+#define LOG_RATE_WINDOW_MS 1000 // rate limit / repeat window per call site
+#endif
+#ifndef LOG_RATE_BURST
+#define LOG_RATE_BURST 10       // records per call site and window
+#endif
+#ifndef LOG_RTC_LINES
+#define LOG_RTC_LINES 16        // post-mortem lines kept across a reset
+#endif
+#ifndef LOG_RTC_LINE
+#define LOG_RTC_LINE 96         // bytes per post-mortem line
+#endif
+
+// -----------------------------------------------------------
+// Call site (one static per DBG_* expansion)
+// -----------------------------------------------------------
+struct LogSite
+{
+  uint8_t module;      // 0 = not resolved yet, else module index + 1
+  uint8_t level;       // of the call site, for the suppression summary
+  const char *fmt;     // for the suppression summary
+  // rate limit (producers, under a spinlock)
+  uint8_t burst;       // records printed in the current window
+  uint16_t suppressed; // records not printed in the current window
+  uint32_t windowMs;   // window start
+  uint32_t lastMs;     // last record (printed or not)
+  uint32_t lastHash;   // arguments of the last record
+};
+
+// -----------------------------------------------------------
+// Public API
+// -----------------------------------------------------------
+// Start logTask; prints the previous boot's post-mortem lines first
+void log_begin();
+// Runtime level 0..3 for a module ("MQTT", "ETH", ... or "*" = default);
+// level < 0 makes a module follow the default again
+bool log_set_level(const char *module, int level);
+// "*=3 MQTT=1 ..." (modules with their own level)
+size_t log_levels(char *buf, size_t len);
+uint32_t log_dropped(); // records lost to a full ring since boot
+// Post-mortem lines of the previous boot (oldest first); count returned
+int log_postmortem(void (*cb)(const char *line));
+
+// Remote copy (log_remote.h): logTask also hands every line at or below
+// `level` from a module in `mask` (bit = log_module_id()) to tap, with
+// its own level, independent of the serial levels. nullptr: off.
+typedef void (*LogTap)(uint8_t level, const char *line, size_t n);
+void log_set_tap(LogTap tap, int level, uint32_t mask);
+int log_module_id(const char *module); // "*" = 0; -1 invalid / table full
+
+// -----------------------------------------------------------
+// Record path (used by the macros)
+// -----------------------------------------------------------
+struct LogRec
+{
+  uint32_t ms;
+  const char *fmt;
+  LogSite *site;
+  uint8_t level;
+  uint8_t len;                 // bytes used in args
+  uint8_t args[LOG_ARG_BYTES]; // tag + value, see LogEnc
+};
+
+bool log_enabled(LogSite &site, uint8_t level, const char *fmt);
+// Rate limit per call site; false: suppressed (counted, summarised later)
+bool log_admit(LogSite &site, uint32_t ms, const uint8_t *args, size_t len);
+LogRec *log_claim(uint32_t &pos);       // nullptr: ring full (counted)
+void log_commit(uint32_t pos);
+
+// Argument encoding: 'i'/'u' 32-bit, 'I'/'U' 64-bit, 'd' double,
+// 's' length byte + bytes, 'p' pointer. Arguments that do not fit are
+// dropped (printed as "?").
+struct LogEnc
+{
+  uint8_t *p, *end;
+
+  void raw(char tag, const void *v, size_t n)
+  {
+    if (p + 1 + n > end)
+    {
+      p = end;
+      return;
+    }
+    *p++ = (uint8_t)tag;
+    memcpy(p, v, n);
+    p += n;
+  }
+
+  void str(const char *s)
+  {
+    if (!s)
+      s = "(null)";
+    size_t n = strlen(s);
+    if (p + 2 > end)
+    {
+      p = end;
+      return;
+    }
+    if (n > (size_t)(end - p - 2))
+      n = end - p - 2; // truncated copy
+    if (n > 255)
+      n = 255;
+    *p++ = 's';
+    *p++ = (uint8_t)n;
+    memcpy(p, s, n);
+    p += n;
+  }
+
+  template <typename T>
+  void put(const T &v)
+  {
+    using D = typename std::decay<T>::type;
+    if constexpr (std::is_convertible<D, const char *>::value)
+      str(v);
+    else if constexpr (std::is_pointer<D>::value)
+    {
+      const uintptr_t u = (uintptr_t)v;
+      raw('p', &u, sizeof(u));
+    }
+    else if constexpr (std::is_floating_point<D>::value)
+    {
+      const double d = v;
+      raw('d', &d, sizeof(d));
+    }
+    else if constexpr (std::is_enum<D>::value)
+      put((typename std::underlying_type<D>::type)v);
+    else
+    {
+      static_assert(std::is_integral<D>::value, "DBG_*: unsupported argument type");
+      if (sizeof(D) <= 4)
+      {
+        if (std::is_signed<D>::value)
+        {
+          const int32_t x = (int32_t)v;
+          raw('i', &x, 4);
+        }
+        else
+        {
+          const uint32_t x = (uint32_t)v;
+          raw('u', &x, 4);
+        }
+      }
+      else if (std::is_signed<D>::value)
+      {
+        const int64_t x = (int64_t)v;
+        raw('I', &x, 8);
+      }
+      else
+      {
+        const uint64_t x = (uint64_t)v;
+        raw('U', &x, 8);
+      }
+    }
+  }
+};
+
+template <typename... A>
+inline void log_emit(LogSite &site, uint8_t level, const char *fmt, const A &...a)
+{
+  if (!log_enabled(site, level, fmt))
+    return;
+  // Encoded on the stack first: a suppressed record never takes a slot
+  uint8_t args[LOG_ARG_BYTES];
+  LogEnc e{args, args + sizeof(args)};
+  (e.put(a), ...);
+  const uint8_t len = (uint8_t)(e.p - args);
+  const uint32_t ms = millis();
+  if (!log_admit(site, ms, len ? args : nullptr, len))
+    return;
+  uint32_t pos;
+  LogRec *r = log_claim(pos);
+  if (!r)
+    return;
+  r->ms = ms;
+  r->fmt = fmt;
+  r->site = &site;
+  r->level = level;
+  memcpy(r->args, args, len);
+  r->len = len;
+  log_commit(pos);
+}
+
 // -----------------------------------------------------------
-// Base macro
+// Base macro (label kept for compatibility, the level names the line)
 // -----------------------------------------------------------
 #define DBG_PRINT(level, label, fmt, ...) \
     do { \
         if (DEBUG_LEVEL >= level) { \
-            Serial.printf("[%s] " fmt, label, ##__VA_ARGS__); \
+            static LogSite _log_site; \
+            log_emit(_log_site, level, "" fmt, ##__VA_ARGS__); \
         } \
     } while (0)
 
@@ -0,0 +1,94 @@
+#pragma once
+#include <Arduino.h>
+#include "json_stream.h"
+#include "mqtt_client.h"
+#include "watchdog.h"
+
+// -----------------------------------------------------------
+// Runtime diagnostics (own low-priority task)
+// -----------------------------------------------------------
+// diagTask samples every DIAG_SAMPLE_MS:
+//   - per task (uxTaskGetSystemState): priority, core, minimum free
+//     stack ever (bytes) and CPU share over the last interval in
+//     ‰ of one core (FreeRTOS run-time stats; omitted if not compiled
+//     in, which is the case with the prebuilt arduino-esp32 2.x
+//     libraries: enabling it needs the core built from ESP-IDF)
+//   - qModbusCmd / qMqttPublish: depth now and the peak seen by the
+//     DIAG_TICK_MS poll during the interval, plus capacity
+//   - internal heap: free, minimum ever, largest free block and the
+//     fragmentation (1 - largest / free) in %
+// The supervisor's deadline statistics (watchdog.h) are added to every
+// report as "watchdog".
+// The last DIAG_HISTORY samples of heap and queue peaks are kept.
+//
+// Published every DIAG_PUBLISH_MS on <base>/<device>/diag (via the
+// MQTT queue, MSG_DIAG), on request with /cmd/diag, and served by
+// GET /api/diag (with the history).
+// -----------------------------------------------------------
+
+#ifndef DIAG_TICK_MS
+#define DIAG_TICK_MS 100        // queue-depth / heap poll
+#endif
+#ifndef DIAG_SAMPLE_MS
+#define DIAG_SAMPLE_MS 5000     // task stats interval
+#endif
+#ifndef DIAG_PUBLISH_MS
+#define DIAG_PUBLISH_MS 60000   // MQTT diagnostics period (0 = on request only)
+#endif
+#ifndef DIAG_MAX_TASKS
+#define DIAG_MAX_TASKS 32       // uxTaskGetSystemState() fails if more exist
+#endif
+#ifndef DIAG_HISTORY
+#define DIAG_HISTORY 30         // samples kept for /api/diag
+#endif
+
+struct DiagTask
+{
+  char name[16];
+  uint8_t prio;
+  int8_t core;        // -1: not pinned
+  uint16_t cpu;       // ‰ of one core over the interval
+  uint32_t stackFree; // high-water mark: minimum free bytes ever
+};
+
+struct DiagQueue
+{
+  uint8_t depth, peak, size;
+};
+
+struct DiagPoint
+{
+  uint32_t heapFree, heapLargest;
+  uint8_t mqttPeak, modbusPeak;
+};
+
+struct DiagSnap
+{
+  uint32_t ms;          // time of the sample
+  uint32_t intervalMs;  // CPU shares cover this interval
+  bool cpuValid;
+  uint8_t taskCount;
+  DiagTask task[DIAG_MAX_TASKS];
+  DiagQueue qModbus, qMqtt;
+  uint32_t heapFree, heapMin, heapLargest;
+  uint8_t fragPct;
+};
+
+void diag_start_task();            // start_system_tasks(), after the queues
+
+// Piecewise JSON writer (web_json.h style): diag_cursor_begin() takes
+// a copy of the last sample (and the history), then diag_json() is
+// called until it returns false, so all pieces describe one sample.
+struct DiagCursor
+{
+  DiagSnap snap;
+  WdStats wd[WDT_MAX_TASKS];
+  uint8_t wdCount;
+  DiagPoint hist[DIAG_HISTORY]; // oldest first
+  uint8_t histCount;            // 0: history not included
+  uint8_t phase, i;
+};
+void diag_cursor_begin(DiagCursor &c, bool history);
+bool diag_json(JsonStream &w, DiagCursor &c);
+
+bool diag_mqtt_publish(MqttClient &mqtt); // mqttTask (MSG_DIAG)
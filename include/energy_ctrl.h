@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+
+// -----------------------------------------------------------
+// Closed-loop energy controller (MODE_ENERGY)
+// -----------------------------------------------------------
+// Projects the energy still to go onto the remaining runtime and
+// derives the current needed at the live voltage (feed-forward).
+// A slow integral term trims systematic shortfall (DPM not reaching
+// the commanded current, voltage sag, ...). Output is clamped to the
+// configured bounds with conditional integration (anti-windup) and
+// rate-limited, so Modbus writes stay rare.
+//
+// Plain C++ without Arduino dependencies: the same code can be fed
+// recorded V/I curves in a host simulation.
+// -----------------------------------------------------------
+
+#ifndef ECTRL_PERIOD_MS
+#define ECTRL_PERIOD_MS      1000u  // controller update / max write rate
+#endif
+#ifndef ECTRL_MIN_HORIZON_S
+#define ECTRL_MIN_HORIZON_S  5.0    // never plan over less than this (s)
+#endif
+#ifndef ECTRL_MAX_SLEW_MA
+#define ECTRL_MAX_SLEW_MA    200    // max setpoint change per update (mA)
+#endif
+#ifndef ECTRL_DEADBAND_MA
+#define ECTRL_DEADBAND_MA    10     // smaller changes are not written (mA)
+#endif
+#ifndef ECTRL_KI
+#define ECTRL_KI             0.05   // integral gain on current shortfall (1/s)
+#endif
+#ifndef ECTRL_DEFAULT_MIN_MA
+#define ECTRL_DEFAULT_MIN_MA 100
+#endif
+#ifndef ECTRL_DEFAULT_MAX_MA
+#define ECTRL_DEFAULT_MAX_MA 20000  // same limit as /settings
+#endif
+
+struct EnergyCtrl
+{
+  int cur_min = ECTRL_DEFAULT_MIN_MA; // lower bound (mA)
+  int cur_max = ECTRL_DEFAULT_MAX_MA; // upper bound (mA)
+  double integ = 0.0;                 // integral trim (mA)
+  int out = 0;                        // last commanded current (mA)
+  uint32_t last_ms = 0;               // time of last update
+  uint16_t adjustments = 0;           // setpoint changes this run
+};
+
+// One sample of the process as seen by the controller
+struct EnergyCtrlInput
+{
+  uint32_t now_ms;     // monotonic time
+  uint32_t elapsed_ms; // time since run start
+  uint32_t runtime_ms; // planned runtime
+  double energy_j;     // integrated energy of this batch
+  double target_j;     // energy target of this batch
+  int volt_mv;         // measured voltage
+  int cur_ma;          // measured current
+};
+
+// Start a run with the given initial setpoint
+void energy_ctrl_reset(EnergyCtrl &c, int start_cur, uint32_t now_ms);
+
+// Run one controller step. Returns true when c.out changed and must be
+// written to the DPM.
+bool energy_ctrl_update(EnergyCtrl &c, const EnergyCtrlInput &in);
@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+// -----------------------------------------------------------
+// W5500 TCP throughput benchmark (/cmd/ethbench)
+// -----------------------------------------------------------
+// Connects to scripts/eth_bench_server.py and measures both ways:
+//   TX  "DPMBENCH <bytes>\n" + <bytes> from the device, timed to flush()
+//   RX  the server sends <bytes> back, timed from the first byte
+// Runs once in its own task; with plain=true the library EthernetClient
+// is used instead of W5500Client (baseline). The result is logged and
+// sent as an "eth_bench" event ("tx=<kB/s> rx=<kB/s> ...").
+// -----------------------------------------------------------
+
+#ifndef ETH_BENCH_CHUNK
+#define ETH_BENCH_CHUNK 1460   // bytes per write() (one TCP segment)
+#endif
+
+// false if a benchmark is running or the arguments are invalid
+bool eth_bench_begin(const char *host, uint16_t port, uint32_t bytes, bool plain);
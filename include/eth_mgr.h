@@ -3,21 +3,44 @@
 #include <Client.h>
 #include <IPAddress.h>
 
+// ---- Tunables (override in platformio.ini via -DNAME=value) ----
+#ifndef ETH_IRQ_ENABLE
+#define ETH_IRQ_ENABLE   1      // W5500 INTn on PIN_IRQ for socket events
+#endif
+#ifndef ETH_PIN_CS
+#define ETH_PIN_CS       16     // W5500 chip select (Waveshare ESP32-S3-ETH)
+#endif
+#ifndef ETH_LINK_POLL_MS
+#define ETH_LINK_POLL_MS 1000   // PHY link has no interrupt on the W5500 (1 SPI read)
+#endif
+
 // Bring up Ethernet (DHCP). If DHCP fails and staticFallback==true,
-// we’ll use the provided static params.
+// we’ll use the provided static params. dhcp==false skips DHCP and
+// uses the static params directly.
 bool eth_setup(bool staticFallback = false,
                IPAddress ip   = IPAddress(0,0,0,0),
                IPAddress gw   = IPAddress(0,0,0,0),
                IPAddress mask = IPAddress(255,255,255,0),
-               IPAddress dns  = IPAddress(0,0,0,0));
+               IPAddress dns  = IPAddress(0,0,0,0),
+               bool dhcp      = true);
 
 // Call this regularly from loop()
 void eth_loop();
 
+// ethTask: sleep until a W5500 socket interrupt (CON / DISCON / RECV)
+// or timeout_ms. Sockets with an event are passed as a bitmask (bit n =
+// socket n) to the callback, which runs in the calling task.
+// Without ETH_IRQ_ENABLE (or before the chip is up) this is a delay.
+void eth_wait_event(uint32_t timeout_ms);
+void eth_on_socket_event(void (*cb)(uint8_t sockets));
+bool eth_irq_active();   // interrupt armed: socket users may stop polling
+
 // Helpers
 bool       eth_link_up();
 IPAddress  eth_ip();
+bool       eth_link_cached();   // no SPI access (updated by eth_loop)
+IPAddress  eth_ip_cached();
 
-// Generic client you can pass to PubSubClient etc.
+// Generic client you can pass to MqttClient etc.
 Client&    eth_client();
 
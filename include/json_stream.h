@@ -0,0 +1,70 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------
+// Streaming JSON writer over a fixed buffer
+// -----------------------------------------------------------
+// Writes objects/arrays with automatic commas into a caller-owned
+// buffer. The buffer can be drained and clear()ed at any point while
+// the nesting state is kept, so large documents go out in chunks with
+// constant memory (see web_json.h). Overflow is sticky: the writer
+// stops and overflow() reports it instead of emitting broken output.
+//
+// Plain C++ without Arduino dependencies (host tests).
+// -----------------------------------------------------------
+
+#ifndef JSON_STREAM_DEPTH
+#define JSON_STREAM_DEPTH 16   // max nesting (bit stack)
+#endif
+
+class JsonStream
+{
+public:
+  JsonStream(char *buf, size_t cap) : buf_(buf), cap_(cap) {}
+
+  // Buffer access
+  const char *data() const { return buf_; }
+  size_t size() const { return len_; }
+  size_t total() const { return total_; } // bytes written incl. drained
+  bool overflow() const { return overflow_; }
+  void clear() { len_ = 0; }              // drained: keep nesting state
+
+  // Containers (the key variants are for use inside an object)
+  JsonStream &obj(const char *key = nullptr);
+  JsonStream &arr(const char *key = nullptr);
+  JsonStream &end();
+
+  // Values (array element, or key/value inside an object)
+  JsonStream &val(long v);
+  JsonStream &val(unsigned long v);
+  JsonStream &val(int v) { return val((long)v); }
+  JsonStream &val(unsigned v) { return val((unsigned long)v); }
+  JsonStream &val(double v, int decimals = 3);
+  JsonStream &val(bool v);
+  JsonStream &val(const char *s);            // escaped string, nullptr → null
+  JsonStream &raw(const char *json, size_t n); // pre-serialised value
+
+  template <typename T>
+  JsonStream &kv(const char *key, T v) { return key_(key).val(v); }
+  JsonStream &kv(const char *key, double v, int decimals) { return key_(key).val(v, decimals); }
+  JsonStream &kvRaw(const char *key, const char *json, size_t n) { return key_(key).raw(json, n); }
+
+private:
+  JsonStream &key_(const char *key);
+  void sep_();                 // comma before the next element
+  void str_(const char *s);    // escaped string, no separator
+  void put_(char c);
+  void put_(const char *s, size_t n);
+  void open_(char c, bool isArray);
+
+  char *buf_;
+  size_t cap_;
+  size_t len_ = 0;
+  size_t total_ = 0;
+  uint32_t first_ = 1;    // bit d: next element at depth d is the first
+  uint32_t isArr_ = 0;    // bit d: container at depth d is an array
+  uint8_t depth_ = 0;
+  bool afterKey_ = false; // value follows a key: no comma
+  bool overflow_ = false;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+#include "mqtt_client.h"
+
+// -----------------------------------------------------------
+// Line groups: DPMs sharing a line_id act as one unit across
+// all controllers of a galvanic line.
+// -----------------------------------------------------------
+// Subscribes to:
+//   <base>/line/+/cmd     payload: {"cmd":"start"|"stop"|"set"|"user", ...}
+//     start / stop        relays of all local DPMs of that line ON / OFF
+//     set                 {"volt":mV,"cur":mA,"runtime":s,"idle":mA}
+//                         fields optional; any field that is negative,
+//                         not an integer or out of range rejects all
+//     user                {"user":n}
+// The result is a queued "line_cmd" event (OK / REJECTED) per controller.
+// Publishes aggregated telemetry per local line to:
+//   <base>/line/<n>/<dev>/telemetry
+// -----------------------------------------------------------
+
+void line_group_mqtt_subscribe(MqttClient &mqtt, const String &baseTopic);
+
+// Route incoming MQTT messages; returns true if handled.
+bool line_group_mqtt_handle(const char *topic, const byte *payload, unsigned int len);
+
+// Publish one telemetry message per line that has local members.
+bool line_group_publish_telemetry(MqttClient &mqtt);
+
+// Group settings vs. the state machine: "set" changes all members under
+// this lock and stateTask holds it for one FSM pass, so a pass sees the
+// old or the new values of every member (both cores). A mutex: the FSM
+// pass blocks (queues, logging). line_group_init() before the tasks;
+// timeout_ms = portMAX_DELAY waits forever.
+void line_group_init();
+bool line_group_lock(uint32_t timeout_ms);
+void line_group_unlock();
+
+// Bitmask of local DPMs (bit id-1) that belong to line n. MAX_DPMS (8)
+// per controller, so a line spans controllers, not a wider mask.
+uint8_t line_group_members(int line);
@@ -0,0 +1,69 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "mqtt_client.h"
+#include "net_mgr.h"
+
+// -----------------------------------------------------------
+// Remote log: the debug_log lines, forwarded in batches
+// -----------------------------------------------------------
+// Off after every boot; switched on at runtime (/cmd/log "remote").
+// logTask copies each line that passes the remote filter (own level,
+// module list) into a message buffer and never waits; mqttTask sends
+// a batch every LOG_REMOTE_BATCH_MS when its publish queue is idle:
+//
+//   mqtt    one QoS0 message per batch on <base>/<device>/log
+//   syslog  one UDP datagram per line (RFC 5424, facility local0)
+//           to an IPv4 host, on the current network path
+//
+// A token bucket caps the forwarded bytes per second; lines that do
+// not fit the buffer meanwhile are counted and reported in the next
+// batch. After the first MQTT session of a boot the reset reason and
+// the previous boot's post-mortem lines (debug_log.h) are published
+// once, retained, on <base>/<device>/log/boot.
+// -----------------------------------------------------------
+
+#ifndef LOG_REMOTE_BUF
+#define LOG_REMOTE_BUF 4096       // bytes queued between logTask and mqttTask
+#endif
+#ifndef LOG_REMOTE_BATCH
+#define LOG_REMOTE_BATCH 1024     // max bytes per MQTT batch
+#endif
+#ifndef LOG_REMOTE_BATCH_MS
+#define LOG_REMOTE_BATCH_MS 2000  // batch period
+#endif
+#ifndef LOG_REMOTE_BPS
+#define LOG_REMOTE_BPS 1024       // default bandwidth cap (bytes/s)
+#endif
+#ifndef LOG_SYSLOG_PORT
+#define LOG_SYSLOG_PORT 514
+#endif
+
+enum LogSink : uint8_t
+{
+  LOG_SINK_OFF,
+  LOG_SINK_MQTT,
+  LOG_SINK_SYSLOG
+};
+
+struct LogRemoteCfg
+{
+  LogSink sink;
+  uint8_t level;      // 1..3, independent of the serial levels
+  char modules[64];   // "MQTT,ETH"; "" = all modules
+  uint32_t bps;       // bandwidth cap, bytes/s
+  char host[16];      // syslog collector (IPv4)
+  uint16_t port;
+};
+
+// Apply {"sink":"mqtt|syslog|off","level":n,"modules":"A,B",
+// "bps":n,"host":"a.b.c.d","port":n}; missing keys keep their value.
+// Returns false (nothing changed) on bad input.
+bool log_remote_from_json(JsonObjectConst o);
+const LogRemoteCfg &log_remote_cfg();
+// "mqtt level=2 modules=MQTT,ETH bps=1024 sent=.. lost=.."
+size_t log_remote_describe(char *buf, size_t len);
+
+// mqttTask, every pass. idle: no telemetry waiting (queue empty, boot
+// burst and offline store done); only then is a batch sent.
+void log_remote_loop(MqttClient &mqtt, NetPath path, bool idle);
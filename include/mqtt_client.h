@@ -0,0 +1,207 @@
+#pragma once
+#include <Arduino.h>
+#include <Client.h>
+
+// -----------------------------------------------------------
+// Minimal MQTT 3.1.1 client with a non-blocking connection manager
+// -----------------------------------------------------------
+// Replaces PubSubClient, whose connect() waits for the TCP handshake
+// and the CONNACK inside one call (up to the socket timeout). Here
+// loop() advances a state machine and returns at once:
+//
+//   OFFLINE ──(backoff expired)──> TCP connect ──> CONNACK wait ──> ONLINE
+//      ^                                │                │            │
+//      └──── fail: backoff ×2 + jitter ─┴─ timeout ──────┴─ lost ─────┘
+//
+//   - the TCP connect is bounded by MQTT_TCP_CONNECT_MS, set on the
+//     socket by the owner (the Arduino Ethernet API has no asynchronous
+//     connect; the W5500 sends the SYN retries itself). Host names are
+//     resolved by the socket's connect(host, port); use an IP address
+//     to keep DNS out of the loop
+//   - the CONNACK wait is a state with its own timeout
+//   - reconnect delay: MQTT_BACKOFF_MIN_MS doubling up to
+//     MQTT_BACKOFF_MAX_MS, each delay randomised to [d/2, d]
+//   - incoming packets are assembled incrementally from what the
+//     socket has buffered, so a half-received packet never blocks
+//
+// QoS1 publish (at least once): the encoded PUBLISH is copied into one
+// of MQTT_INFLIGHT_MAX slots and kept until the broker's PUBACK. Slots
+// survive a lost session; after the next CONNACK all of them are sent
+// again with DUP, oldest first. While online an unacknowledged packet
+// is resent after MQTT_QOS1_RETRY_MS; if it is still unacknowledged
+// MQTT_QOS1_MAX_TRIES sends later the session is treated as dead. With
+// the window full publish() returns false (the caller keeps the
+// message). A QoS1 packet larger than a slot is refused (false, logged),
+// never sent as QoS0; callers drop it unless the window is full.
+//
+// Streamed publish (QoS0, PubSubClient API): beginPublish() with the
+// payload length, the payload through write() / print() (e.g.
+// serializeJson(doc, mqtt) after measureJson(doc)), then endPublish().
+// The bytes are collected in the tx buffer and written to the socket
+// one buffer at a time, so a payload is bounded by the protocol
+// (256 MB), not by setBufferSize(). setBufferSize() only limits
+// incoming packets and the non-streamed publish() copy.
+//
+// Publish / subscribe keep the PubSubClient signatures. All calls must
+// come from one task (mqttTask); the callback runs inside loop(). The
+// first loop() call records that task: publish / subscribe / disconnect
+// from any other task are refused (false) and logged.
+// -----------------------------------------------------------
+
+#ifndef MQTT_TCP_CONNECT_MS
+#define MQTT_TCP_CONNECT_MS     1000   // wait for ESTABLISHED per attempt
+#endif
+#ifndef MQTT_CONNACK_TIMEOUT_MS
+#define MQTT_CONNACK_TIMEOUT_MS 5000   // CONNECT sent → CONNACK
+#endif
+#ifndef MQTT_BACKOFF_MIN_MS
+#define MQTT_BACKOFF_MIN_MS     1000   // first retry delay
+#endif
+#ifndef MQTT_BACKOFF_MAX_MS
+#define MQTT_BACKOFF_MAX_MS     60000  // retry delay cap
+#endif
+#ifndef MQTT_INFLIGHT_MAX
+#define MQTT_INFLIGHT_MAX       8      // QoS1 publishes awaiting PUBACK
+#endif
+#ifndef MQTT_INFLIGHT_SLOT
+#define MQTT_INFLIGHT_SLOT      640    // bytes per slot (whole PUBLISH packet)
+#endif
+#ifndef MQTT_QOS1_RETRY_MS
+#define MQTT_QOS1_RETRY_MS      10000  // no PUBACK within this: resend (DUP)
+#endif
+#ifndef MQTT_QOS1_MAX_TRIES
+#define MQTT_QOS1_MAX_TRIES     3      // sends per session before reconnecting
+#endif
+
+class MqttClient : public Print
+{
+public:
+  typedef void (*Callback)(char *topic, uint8_t *payload, unsigned int length);
+
+  // Connection phase
+  enum Phase : uint8_t { OFFLINE, TCP_CONNECT, CONNACK_WAIT, ONLINE };
+
+  // state(): same codes as PubSubClient (log compatibility)
+  enum Rc : int8_t
+  {
+    RC_CONNECTION_TIMEOUT = -4, // CONNACK or keepalive timeout
+    RC_CONNECTION_LOST = -3,
+    RC_CONNECT_FAILED = -2,     // TCP / DNS
+    RC_DISCONNECTED = -1,
+    RC_CONNECTED = 0            // 1..5: broker refused (CONNACK code)
+  };
+
+  explicit MqttClient(Client &client) : client_(&client) {}
+
+  // Pointers are kept, not copied: they must stay valid
+  MqttClient &setServer(const char *host, uint16_t port);
+  MqttClient &setCallback(Callback cb);
+  MqttClient &setKeepAlive(uint16_t seconds);
+  bool setBufferSize(uint16_t size); // rx + tx buffers + QoS1 slots (heap, once)
+
+  // Enable auto-connect with these credentials / will (pointers kept)
+  void begin(const char *id, const char *user, const char *pass,
+             const char *willTopic, uint8_t willQos, bool willRetain,
+             const char *willMessage);
+
+  // Drive connect / receive / keepalive; never waits for the network
+  void loop();
+
+  bool connected() const { return phase_ == ONLINE; }
+  Phase phase() const { return phase_; }
+  int state() const { return rc_; }
+  uint32_t retryInMs() const; // 0 unless waiting in OFFLINE
+
+  // Send DISCONNECT and close; the next attempt follows the backoff
+  void disconnect();
+  // Drop the backoff wait (network came up, settings changed)
+  void reconnectNow();
+  // Move to another transport (network failover): closes the session
+  void setClient(Client &client);
+
+  // qos 0 or 1; QoS1: true once the packet is in the in-flight window,
+  // false when the window is full or the packet exceeds a slot
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length,
+               bool retained, uint8_t qos = 0);
+  bool publish(const char *topic, const char *payload, bool retained = false);
+  bool subscribe(const char *topic, uint8_t qos = 0);
+
+  // Streamed publish; endPublish() is false (and the session is closed)
+  // if fewer bytes than announced were written or the socket took only
+  // part of a chunk (then write() returns short as well)
+  bool beginPublish(const char *topic, size_t length, bool retained);
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  bool endPublish();
+
+  uint8_t inflight() const { return inflight_; }
+  bool inflightFull() const { return inflight_ >= MQTT_INFLIGHT_MAX; }
+  uint32_t resent() const { return resent_; } // DUP sends since boot
+
+private:
+  void startConnect_();
+  void fail_(int8_t rc);
+  bool sendConnect_();
+  void poll_();                      // read what the socket has
+  void handlePacket_();
+  bool write_(const uint8_t *p, size_t n);
+  size_t header_(uint8_t *dst, uint8_t type, uint32_t remaining);
+  uint16_t nextId_();
+  bool owner_(const char *what) const; // caller is the loop() task
+
+  // QoS1 in-flight window
+  struct Inflight
+  {
+    uint16_t id;               // packet id, 0 = free
+    uint16_t len;              // encoded PUBLISH
+    uint8_t tries;             // sends in this session
+    uint32_t sentMs;
+    uint32_t seq;              // publish order (resend oldest first)
+  };
+  uint8_t *slotBuf_(const Inflight &f) { return pool_ + (&f - slots_) * MQTT_INFLIGHT_SLOT; }
+  void send_(Inflight &f);     // (re)send, DUP from the second send on
+  void resendAll_();           // after CONNACK
+  bool retryInflight_();       // false if a packet ran out of tries
+  void puback_(uint16_t id);
+
+  Client *client_;
+  TaskHandle_t task_ = nullptr; // loop() task
+  Callback cb_ = nullptr;
+  const char *host_ = nullptr;
+  uint16_t port_ = 1883;
+  uint16_t keepAlive_ = 15;
+  const char *id_ = nullptr, *user_ = nullptr, *pass_ = nullptr;
+  const char *willTopic_ = nullptr, *willMsg_ = nullptr;
+  uint8_t willQos_ = 0;
+  bool willRetain_ = false;
+  bool enabled_ = false;
+
+  Phase phase_ = OFFLINE;
+  int8_t rc_ = RC_DISCONNECTED;
+  uint32_t phaseMs_ = 0;      // entered the current phase
+  uint32_t retryAt_ = 0;      // OFFLINE: next attempt
+  uint8_t fails_ = 0;         // consecutive failed attempts
+  uint32_t lastIn_ = 0, lastOut_ = 0;
+  bool pingOutstanding_ = false;
+  uint16_t packetId_ = 0;
+
+  // Receive assembly: fixed header → remaining length → body
+  uint8_t *rx_ = nullptr, *tx_ = nullptr;
+  uint16_t bufSize_ = 0;
+  uint8_t rxStage_ = 0;       // header byte / length bytes / body
+  uint8_t rxHdr_ = 0;
+  uint8_t rxShift_ = 0;       // remaining-length decoder
+  uint32_t rxLen_ = 0;        // remaining length
+  uint32_t rxGot_ = 0;        // body bytes received
+
+  // Streamed publish: payload bytes still announced, bytes staged in tx_
+  uint32_t streamLeft_ = 0;
+  uint16_t streamFill_ = 0;
+  bool streaming_ = false;
+
+  Inflight slots_[MQTT_INFLIGHT_MAX] = {};
+  uint8_t *pool_ = nullptr;   // MQTT_INFLIGHT_MAX × MQTT_INFLIGHT_SLOT
+  uint8_t inflight_ = 0;
+  uint32_t seq_ = 0;
+  uint32_t resent_ = 0;
+};
@@ -3,7 +3,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <ArduinoJson.h>
-#include <PubSubClient.h>
+#include "mqtt_client.h"
 // -------------------------------------------------------------------
 // Message queue types
 // -------------------------------------------------------------------
@@ -12,26 +12,57 @@ enum MqttMsgType
     MSG_STATUS,
     MSG_INFLUX,
     MSG_CONFIG,
-    MSG_EVENT
+    MSG_EVENT,
+    MSG_LINE,     // aggregated line-group telemetry
+    MSG_RELAY,    // relay state changed (driver task)
+    MSG_OTA,      // OTA progress/result (eventType + value)
+    MSG_NET,      // W5500 socket event: service the connection now
+    MSG_DIAG,     // task / queue / heap diagnostics (diag.h)
+    MSG_RUN,      // finished run record (value = seq, read from /runs.bin)
+    MSG_PARAM,    // parameter change line on <base>/<device>/influx (message)
+    MSG_RECONNECT // device alias changed: new topics, new session
 };
 
+// Strings are copied into the message, so producers may pass buffers
+// on their stack; longer text is truncated
 struct MqttMsg
 {
     MqttMsgType type;     // Message type (e.g. MSG_EVENT, MSG_CMD, etc.)
     bool retained;        // MQTT retain flag
 
     // --- Event-specific fields ---
-    const char *eventType; // "relay_switched", "service_due", "run_start", etc.
-    int user;              // user ID (integer, not string)
-    int id;                // DPM number (1–8)
-    const char *state;     // optional: "ON", "OFF", "RUN", "STOP", etc.
-    const char *message;   // optional: human-readable text, may be NULL
-
-    // --- Optional: future extensibility ---
-    const char *cluster;   // optional: "Cluster01" (can auto-fill from App::CLUSTER_NAME)
-    const char *device;    // optional: "TEST_DPM" (auto from DEVICE_HOST)
+    int user;             // user ID (integer, not string)
+    int id;               // DPM number (1–8)
+    int value;            // MSG_OTA: percent / bytes / HTTP status; MSG_RUN: seq
+    char eventType[32];   // "relay_switched", "service_due", "run_start", etc.
+    char state[16];       // optional: "ON", "OFF", "RUN", "STOP", etc.
+    char message[96];     // optional: human-readable text
 };
 
+// Events / OTA reports queued while the broker is unreachable are kept
+// in a ring of this size and sent after the reconnect (oldest dropped)
+#ifndef MQTT_STORE_EVENTS
+#define MQTT_STORE_EVENTS 16
+#endif
+
+// QoS per message class. QoS1 publishes wait in the client's in-flight
+// window (mqtt_client.h) until the broker's PUBACK and are resent after
+// a reconnect. Telemetry (status, config, influx) is republished
+// periodically and streamed with QoS0, so its size is not bounded by a
+// buffer.
+#ifndef MQTT_QOS_EVENT
+#define MQTT_QOS_EVENT 1     // events and OTA reports (mqtt_publish_event)
+#endif
+#ifndef MQTT_QOS_RUN
+#define MQTT_QOS_RUN 1       // finished run records
+#endif
+
+// Idle wait of mqttTask while the W5500 interrupt reports socket events
+// (keepalive / backoff resolution); 20 ms polling otherwise
+#ifndef MQTT_IRQ_IDLE_MS
+#define MQTT_IRQ_IDLE_MS 1000
+#endif
+
 // -------------------------------------------------------------------
 // Get user name for event logging
 // -------------------------------------------------------------------
@@ -39,37 +70,34 @@ static String g_currentUser = "system"; // Default user name
 
 // Global publish queue (created in start_system_tasks)
 extern QueueHandle_t qMqttPublish;
-extern PubSubClient mqtt;     // MQTT client instance
+extern MqttClient mqtt;       // MQTT client instance
 extern String DEVICE_HOST;    // Host alias used in topics
 extern bool g_modbusScanDone;
 // start the centralized mqtt task
 void start_mqtt_task();
 
-// regular init/disconnect
-void mqtt_init();
-void mqtt_disconnect();
-bool mqtt_connected();
-
-// Queue-based publish requests (implemented in mqtt_if.cpp)
+// Queue-based publish requests (implemented in mqtt_if.cpp). Any task;
+// nothing outside mqttTask touches the client or the socket.
 void mqtt_request_status(bool retained);
 void mqtt_request_influx();
 void mqtt_request_config();
+void mqtt_request_line();
+void mqtt_request_relay();
+void mqtt_request_diag();
+void mqtt_request_run(uint32_t seq);       // record is in /runs.bin
+void mqtt_request_param(int dpm, const char *fields); // influx "param_change" line
+void mqtt_request_reconnect();             // re-read the alias, new session
+// Queues the event (false: queue full); kept while the broker is away
+bool mqtt_publish_event(const char *type, int user, int dpm, const char *state, const char *message);
+
+// mqttTask only (publish handlers, callbacks run inside mqtt.loop())
 bool mqtt_publish_status(bool retained = false);
 bool mqtt_publish_config();
 bool mqtt_publish_influx();
-bool mqtt_publish_event(const char *type, int user, int dpm, const char *state, const char *message);
-
-//bool mqtt_publish_event(const char *type, int user, int id);
-
-
-// Existing public API
-void mqtt_init();
+bool mqtt_send_event(const char *type, int user, int dpm, const char *state, const char *message);
 void mqtt_disconnect();
 void mqtt_try_connect_with_backoff(bool immediate = false);
-bool mqtt_connected();
-bool mqtt_publish_event(const char *type, int user, int dpm, const char *state, const char *message);
-
-
-
-
 
+// regular init
+void mqtt_init();
+bool mqtt_connected();
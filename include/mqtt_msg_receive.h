@@ -10,8 +10,24 @@ extern bool mqtt_publish_event(const char *type, int user, int dpm,
 extern bool mqtt_publish_status(bool retained);
 extern void saveConfig();
 
+// ---- Command layer tunables ----
+#ifndef CMD_ARENA_SIZE
+#define CMD_ARENA_SIZE  2048   // static JSON arena per command (bytes)
+#endif
+#ifndef CMD_LOCK_MS
+#define CMD_LOCK_MS     2000   // max wait for the command lock
+#endif
+
 // Public entry point for MQTT message callback
 void onMqttMessage(char *topic, byte *payload, unsigned int length);
 
+// Transport-agnostic command layer (MQTT + REST share the handlers).
+// topic is a full MQTT topic or a REST pseudo-topic
+// "<base>/<dev>/cmd/<name>[/<id>]". Serialised by one mutex; the body
+// is parsed into a static arena. Returns true if a handler took it.
+void cmd_init();
+bool cmd_dispatch(const char *topic, const byte *payload, unsigned int length);
+bool cmd_known(const char *topic);   // a /cmd/ handler exists for topic
+
 // Utility: extract DPM number from topic suffix ".../3" -> 3
 int extract_dpm_id_from_topic(const char *topic);
@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "json_stream.h"
+
+// -----------------------------------------------------------
+// Network / broker settings (Preferences namespace "net_cfg")
+// -----------------------------------------------------------
+// Defaults come from app_settings.h. Changes are stored at once and
+// take effect on the next boot (MQTT server, static IP) – except the
+// device alias, which handle_topic already applies live.
+// -----------------------------------------------------------
+
+struct NetCfg
+{
+  char mqtt_host[64];
+  uint16_t mqtt_port;
+  char mqtt_user[32];
+  char mqtt_pass[32];
+  bool dhcp;          // false: static address below
+  uint32_t ip, gw, mask, dns;
+  char api_user[32];  // REST write access (basic auth)
+  char api_pass[32];
+};
+
+// Load once at boot (before eth_setup / mqtt_init)
+void net_cfg_load();
+
+// Current settings (storage stays valid: MqttClient keeps the host pointer)
+const NetCfg &net_cfg();
+
+// JSON view for /api/settings (passwords are never returned)
+void net_cfg_write(JsonStream &w);
+
+// Validate + persist from JSON. Missing keys keep their value, an empty
+// password keeps the stored one (the API password can not be cleared). Returns false (nothing saved) on bad input.
+bool net_cfg_from_json(JsonObjectConst o);
@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+
+// -----------------------------------------------------------
+// Network path manager: W5500 Ethernet primary, WiFi STA standby
+// -----------------------------------------------------------
+// Both links are kept up. net_mgr_loop() (ethTask, 100 ms) selects the
+// path the MQTT session should use:
+//
+//   ETH  ──(link / IP lost)────────────────────> WIFI (if associated)
+//   WIFI ──(ETH up for NET_FAILBACK_HOLD_MS)───> ETH
+//   NONE ──(first usable link, ETH preferred)──> ETH / WIFI
+//
+// mqttTask follows net_path(): it closes the session on the old socket
+// and reconnects on the new one without the backoff wait. The time from
+// the switch decision to the MQTT session on the new path is reported
+// as a "net_failover" event and kept for net_last_failover_ms().
+// -----------------------------------------------------------
+
+#ifndef NET_FAILBACK_HOLD_MS
+#define NET_FAILBACK_HOLD_MS 5000 // ETH must stay up this long before failback
+#endif
+
+enum NetPath : uint8_t
+{
+  NET_NONE,
+  NET_ETH,
+  NET_WIFI
+};
+
+void net_mgr_begin();   // setup(), after eth_setup(): WiFi STA in standby
+void net_mgr_loop();    // ethTask: eth_loop + wifi_loop + path choice
+
+NetPath net_path();                 // selected path (any task)
+const char *net_path_name(NetPath p);
+
+// mqttTask: MQTT session is up on path p. Returns the failover time in
+// ms if a switch was pending (0 otherwise); *from = the path left.
+uint32_t net_mgr_session_up(NetPath p, NetPath *from);
+uint32_t net_last_failover_ms(); // 0 = no failover since boot
@@ -0,0 +1,74 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------
+// Delta firmware patches ("DPMDELTA", made by scripts/make_delta.py)
+// -----------------------------------------------------------
+// File layout (little endian):
+//   "DPMDELTA" u32 version
+//   u32 src_size  u8 src_sha256[32]   image the patch applies to
+//   u32 dst_size  u8 dst_sha256[32]   image it produces
+//   raw deflate stream of ops:
+//     0x01 COPY   u32 src_off u32 len           dst = src
+//     0x02 ADD    u32 src_off u32 len <len B>   dst = src + diff (mod 256)
+//     0x03 INSERT u32 len <len B>               dst = literal bytes
+//     0x00 END
+// The source is read from the running app partition. DeltaApply
+// consumes the already inflated op stream in pieces of any size, so
+// it keeps no state beyond the current op (the caller inflates).
+//
+// Plain C++ without Arduino dependencies (host tests).
+// -----------------------------------------------------------
+
+#define DELTA_MAGIC     "DPMDELTA"
+#define DELTA_VERSION   1
+#define DELTA_HDR_SIZE  (8 + 4 + 4 + 32 + 4 + 32)
+
+struct DeltaHdr
+{
+  uint32_t src_size;
+  uint8_t src_sha[32];
+  uint32_t dst_size;
+  uint8_t dst_sha[32];
+};
+
+// n >= 8: does p start with the magic?
+bool delta_is_patch(const uint8_t *p, size_t n);
+// n >= DELTA_HDR_SIZE; false on bad magic / version
+bool delta_parse_header(const uint8_t *p, size_t n, DeltaHdr &h);
+
+enum DeltaResult { DELTA_MORE, DELTA_DONE, DELTA_ERR };
+
+class DeltaApply
+{
+public:
+  typedef bool (*ReadSrc)(void *ctx, uint32_t off, uint8_t *dst, size_t n);
+  typedef bool (*WriteOut)(void *ctx, const uint8_t *p, size_t n);
+
+  void begin(const DeltaHdr &h, ReadSrc rd, WriteOut wr, void *ctx);
+
+  // Feed inflated op bytes; DELTA_DONE after END (output size checked)
+  DeltaResult feed(const uint8_t *p, size_t n);
+
+  uint32_t out() const { return out_; }
+  const char *error() const { return err_; }
+
+private:
+  DeltaResult fail_(const char *why);
+  bool emit_src_(uint32_t n, const uint8_t *diff); // COPY / ADD chunk
+
+  ReadSrc rd_ = nullptr;
+  WriteOut wr_ = nullptr;
+  void *ctx_ = nullptr;
+  uint32_t srcSize_ = 0, dstSize_ = 0;
+  uint32_t out_ = 0;
+  uint8_t op_ = 0;        // current op, 0 = reading an op header
+  uint8_t hdr_[9];        // op byte + args
+  uint8_t hdrLen_ = 0;
+  uint32_t srcOff_ = 0;   // COPY / ADD source position
+  uint32_t left_ = 0;     // bytes left in the current op
+  bool done_ = false;
+  const char *err_ = nullptr;
+  uint8_t tmp_[256];      // source chunk
+};
@@ -1,34 +1,50 @@
 #pragma once
 #include <Arduino.h>
-#include <PubSubClient.h>
+#include "mqtt_client.h"
 #include <Wire.h>
-// Init the TCA9554 expander and reset all relays OFF.
+// ---- Driver tunables ----
+#ifndef RELAY_COALESCE_MS
+#define RELAY_COALESCE_MS  20    // requests within this window → one I2C write
+#endif
+#ifndef RELAY_VERIFY_MS
+#define RELAY_VERIFY_MS    1000  // periodic readback of REG_CONFIG/OUTPUT/INPUT
+#endif
+
+// Init the TCA9554 expander and reset all relays OFF (or to 'mask',
+// e.g. the state saved before a planned reboot).
+// Starts the relay driver task, which owns the I2C bus from now on.
 // Requires Wire.begin(42,41,100000) to have been called already.
-void relay_if_init();
+void relay_if_init(uint8_t mask = 0xFF);
 
 // Optional: invert polarity in software (default false / active-HIGH).
 void relay_if_set_inverted(bool inverted);
 
-// Programmatic control
+// Programmatic control (asynchronous: updates the requested mask and
+// wakes the driver task; returns false only for invalid arguments)
 bool relay_if_set(uint8_t relay, bool on);   // relay 1..8
 bool relay_if_toggle(uint8_t relay);
 bool relay_if_write_mask(uint8_t mask);      // bit=1 => ON
-uint8_t relay_if_read_mask();                // cached shadow, not a register read
+uint8_t relay_if_read_mask();                // requested mask, not a register read
+uint8_t relay_if_hw_mask();                  // last mask written + verified on the expander
+uint32_t relay_if_fault_count();             // I2C errors / expander resets seen
 
 // MQTT glue (topics derived from base + device)
 // Subscribes to:
 //   <base>/<dev>/relay/<n>/set  (n=1..8)   payload: ON/OFF/1/0/TOGGLE
 //   <base>/<dev>/relays/set     payload: 0..255 or 0x00..0xFF
-void relay_if_mqtt_subscribe(PubSubClient& mqtt,
+void relay_if_mqtt_subscribe(MqttClient& mqtt,
                              const String& baseTopic,
                              const String& deviceHost);
 
-// Publish retained states to:
+// Publish retained states (only channels that changed, unless all=true) to:
 //   <base>/<dev>/relay/<n>      payload: ON/OFF
-void relay_if_mqtt_publish_states(PubSubClient& mqtt);
+//   <base>/<dev>/relays         payload: 0..255 (bit=1 => ON)
+// Called from the MQTT task when the driver reports a change.
+void relay_if_mqtt_publish_states(MqttClient& mqtt, bool all = false);
 
 // Route incoming MQTT messages; returns true if handled.
-bool relay_if_mqtt_handle(PubSubClient& mqtt,
+// Requests are handed to relay_seq (interlocked with the DPM current).
+bool relay_if_mqtt_handle(MqttClient& mqtt,
                           const String& baseTopic,
                           const String& deviceHost,
                           char* topic, byte* payload, unsigned int len);
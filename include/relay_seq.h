@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+#include "relay_if.h"
+
+// -----------------------------------------------------------
+// Interlocked relay / DPM sequencing
+// -----------------------------------------------------------
+// A relay request becomes a per-relay plan instead of an immediate
+// switch, so contacts never open or close under load:
+//   OFF: current 0 → wait I < RSEQ_CUR_LOW_MA → relay off → confirm
+//        (if the current does not drop in time: DPM output off first)
+//   ON : output off + idle current → relay on → confirm → output on
+// While a plan runs the DPM is parked in CHECK_CONTACT. On confirm the
+// FSM continues as before (WAIT_CURRENT / DPM_OFF). Every missed step
+// deadline is published as an event.
+// Plans of several relays run in parallel; the Modbus queue and the
+// relay driver task serialise the bus traffic.
+// -----------------------------------------------------------
+
+#ifndef RSEQ_CUR_LOW_MA
+#define RSEQ_CUR_LOW_MA    50    // current considered "no load" (mA)
+#endif
+#ifndef RSEQ_RAMPDOWN_MS
+#define RSEQ_RAMPDOWN_MS   3000  // deadline for the current to drop
+#endif
+#ifndef RSEQ_OUTPUT_OFF_MS
+#define RSEQ_OUTPUT_OFF_MS 1000  // extra time after forcing the output off
+#endif
+#ifndef RSEQ_CONFIRM_MS
+#define RSEQ_CONFIRM_MS    500   // deadline for the expander to confirm
+#endif
+
+// Request a relay state (relay 1..8). Thread-safe, returns immediately;
+// the plan is executed by relay_seq_tick().
+bool relay_seq_request(uint8_t relay, bool on);
+bool relay_seq_request_mask(uint8_t mask);   // bit=1 => ON
+
+// Target state incl. pending plans (for TOGGLE)
+uint8_t relay_seq_target_mask();
+
+// True while a plan for this relay is running
+bool relay_seq_busy(uint8_t relay);
+
+// Advance all plans (called from stateTask before the FSM)
+void relay_seq_tick();
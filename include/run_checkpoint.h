@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+
+// -----------------------------------------------------------
+// Run checkpoint across a planned reboot (OTA activation)
+// -----------------------------------------------------------
+// The DPMs are external Modbus supplies and the TCA9554 keeps its
+// outputs through an ESP reset, so a batch keeps running physically
+// while the controller reboots. Before the reboot the open runs (FSM
+// state, elapsed time, energy, curve, run record) and the relay mask
+// are stored in Preferences; on the next boot they are restored and
+// the runs continue. The reboot gap counts as run time, its energy is
+// not measured (energy mode makes up for it).
+//
+// A checkpoint is only restored after a software reset and is erased
+// when read, so a later power cycle starts clean.
+// -----------------------------------------------------------
+
+// Number of DPMs with an open run (RUN / CHECK_ENERGY / paused in OVERHEAT)
+int checkpoint_runs_open();
+
+// True while a relay plan is switching a contact (never reboot then)
+bool checkpoint_relays_busy();
+
+// Store the open runs + relay mask; returns the number of runs saved.
+// Call right before esp_restart(). The snapshot itself is taken by
+// stateTask between two FSM steps (checkpoint_tick), so dpms[] and the
+// run records are consistent; no runs are saved if it does not answer
+// within CKPT_SNAPSHOT_MS.
+int checkpoint_save();
+
+// stateTask, after each FSM step: take a requested snapshot
+void checkpoint_tick();
+
+#ifndef CKPT_SNAPSHOT_MS
+#define CKPT_SNAPSHOT_MS 1000
+#endif
+
+// Boot side, from task_system_start:
+//   checkpoint_load()      after loadConfig(); true if one is pending
+//   checkpoint_relay_mask() initial mask for relay_if_init()
+//   checkpoint_restore()   after initStatemachine(); returns runs resumed
+bool checkpoint_load();
+uint8_t checkpoint_relay_mask();
+int checkpoint_restore();
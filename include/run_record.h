@@ -0,0 +1,88 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+// -----------------------------------------------------------
+// Per-DPM batch (run) records
+// -----------------------------------------------------------
+// A record is opened at run start, updated incrementally on every
+// Modbus sample (Welford mean/variance, min/max, Ah/Wh, time per FSM
+// state) and closed at run end. Closed records are kept in a LittleFS
+// ring of the last RUN_HISTORY_MAX runs (served on /api/runs); mqttTask
+// reads them back from there and publishes one compact JSON message on
+// <base>/<dev>/run (MSG_RUN). A record that finds the history file busy
+// (RUN_LOCK_MS) waits in RAM and is stored by the next run_record_tick().
+// -----------------------------------------------------------
+
+#ifndef RUN_HISTORY_MAX
+#define RUN_HISTORY_MAX 32
+#endif
+
+#define RUN_STATE_COUNT (static_cast<int>(DPMState::Status::CHECK_ENERGY) + 1)
+
+struct RunRecord
+{
+  uint32_t seq = 0;           // running number (persisted)
+  uint8_t dpm = 0;            // DPM index
+  uint8_t mode = 0;           // DPMControlMode
+  uint8_t active = 0;         // 1 while the run is open
+  uint8_t end_reason = 0;     // RunEnd
+  int32_t user = 0;           // operator
+  int32_t line_id = 0;        // galvanic line
+  uint32_t start_ms = 0;      // millis() at start
+  uint32_t duration_ms = 0;   // total run time
+  uint32_t samples = 0;       // Modbus samples seen
+  double cur_mean = 0.0;      // Welford running mean (mA)
+  double cur_m2 = 0.0;        // Welford sum of squared deviations
+  int32_t cur_min = INT32_MAX;
+  int32_t cur_max = INT32_MIN;
+  int32_t volt_min = INT32_MAX;
+  int32_t volt_max = INT32_MIN;
+  int32_t temp_max = INT32_MIN;
+  double ah = 0.0;            // charge (Ah)
+  double wh = 0.0;            // energy (Wh)
+  double energy_target = 0.0; // J (energy mode)
+  uint16_t setpoint_changes = 0;
+  int32_t last_set = -1;      // internal: last seen cur_set
+  uint32_t last_sample_ms = 0; // internal: dt source
+  uint32_t state_ms[RUN_STATE_COUNT] = {0};
+};
+
+enum RunEnd : uint8_t
+{
+  RUN_END_DONE = 0,       // time / energy reached
+  RUN_END_ENERGY_LATE,    // energy reached in CHECK_ENERGY
+  RUN_END_ENERGY_TIMEOUT, // CHECK_ENERGY timed out
+  RUN_END_ABORTED         // relay off / overheat / reset
+};
+
+// Creates the history file lock; task_system_start(), before any run
+void run_record_init();
+
+// Lifecycle (called by the state machine)
+void run_record_begin(int id);
+void run_record_end(int id, RunEnd reason);
+// stateTask, every pass: stores records that run_record_end() could not
+// (history file busy), oldest first
+void run_record_tick();
+
+// Continue an open record saved before a reboot (run_checkpoint)
+void run_record_resume(int id, const RunRecord &r);
+
+// Incremental update (called by readModbus after each good sample)
+void run_record_sample(int id);
+
+// Live record (read-only) of a DPM. Sampled by modbusTask while other
+// tasks read it: only single fields (active) are safe to read here.
+const RunRecord &run_record_current(int id);
+// Consistent copy of the live record; returns its active flag
+bool run_record_snapshot(int id, RunRecord &out);
+
+// History (LittleFS). idx 0 = newest. Returns false if out of range.
+size_t run_record_history_count();
+bool run_record_history_get(size_t idx, RunRecord &out);
+// Record with this sequence number, if still in the ring
+bool run_record_history_find(uint32_t seq, RunRecord &out);
+
+// Compact JSON of one record; returns bytes written (0 on overflow)
+size_t run_record_to_json(const RunRecord &r, char *buf, size_t len);
@@ -0,0 +1,49 @@
+#pragma once
+#include "config.h"
+
+// -----------------------------------------------------------
+// Predictive thermal management per DPM
+// -----------------------------------------------------------
+// Tracks the filtered temperature and its slope, predicts the time
+// to reach temp_crit and derates the current in steps so the DPM
+// stays below the limit instead of dropping a batch. Charge lost by
+// derating is given back by extending the run (lost_ms).
+// OVERHEAT remains as the last resort at temp_crit.
+// -----------------------------------------------------------
+
+#ifndef THERM_ALPHA
+#define THERM_ALPHA        0.3f  // EMA weight of a new temperature sample
+#endif
+#ifndef THERM_SLOPE_ALPHA
+#define THERM_SLOPE_ALPHA  0.1f  // EMA weight of a new slope sample
+#endif
+#ifndef THERM_HORIZON_S
+#define THERM_HORIZON_S    120   // derate if critical is predicted within (s)
+#endif
+#ifndef THERM_STEP_PCT
+#define THERM_STEP_PCT     5     // derate / recover step (%)
+#endif
+#ifndef THERM_STEP_MS
+#define THERM_STEP_MS      10000 // min time between steps (ms)
+#endif
+#ifndef THERM_MIN_PCT
+#define THERM_MIN_PCT      30    // never derate below (%)
+#endif
+#ifndef THERM_HYST_C
+#define THERM_HYST_C       2     // recover below temp_warn - hysteresis
+#endif
+
+// Feed one Modbus sample (called by readModbus after a good read)
+void thermal_on_sample(int id);
+
+// Reset the runtime extension at run start
+void thermal_run_begin(int id);
+
+// Scale a current setpoint by the active derating
+int thermal_apply(int id, int cur);
+
+// Inverse of thermal_apply (measured current → value before derating)
+int thermal_unscale(int id, int cur);
+
+// Predicted seconds until temp_crit (-1 if not rising)
+int thermal_time_to_crit(int id);
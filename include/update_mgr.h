@@ -1,3 +1,79 @@
 #pragma once
-void update_mgr_begin(const char* url, const char* md5 = nullptr, bool reboot = true);
+#include <Arduino.h>
 
+// -----------------------------------------------------------
+// OTA firmware update (own task)
+// -----------------------------------------------------------
+// update_mgr_begin() only queues the job; otaTask downloads it:
+//   - double-buffered: otaTask fills one OTA_BUF_SIZE buffer from the
+//     socket while flashTask (other core) programs the other one and
+//     erases sectors ahead of the write pointer when it is idle
+//   - streamed into the inactive OTA slot, SHA-256 over the stream
+//   - a dropped connection is resumed with "Range: bytes=<n>-"
+//     (up to OTA_MAX_RESUMES times; servers without Range support
+//     are handled by skipping the bytes already written)
+//   - the body may also be a DPMDELTA patch (ota_delta.h): it is
+//     inflated with the ROM tinfl (32 KB dictionary, heap, only while
+//     applying) and applied against the running partition; the patch
+//     must name the running image's SHA-256, the result must match the
+//     image hash in the patch
+//   - progress / result go through the MQTT publish queue (MSG_OTA),
+//     so mqttTask keeps serving keepalives during the download; the
+//     completion event carries the measured end-to-end throughput
+// With reboot=true the download and flash run while production
+// continues; the reboot itself waits until no DPM has an open run (or
+// deadline_s passed) and no relay is being switched. Open runs and the
+// relay mask are checkpointed and resumed after boot (run_checkpoint.h).
+// After reboot the new image runs in "pending verify" state. otaTask
+// checks it once per loop pass: it is confirmed once Modbus devices are
+// found and MQTT is connected, otherwise the previous image is booted
+// again after OTA_HEALTH_TIMEOUT_MS; new OTA jobs are refused meanwhile
+// (ota_verify_pending). With CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE this
+// uses the ESP-IDF app rollback; the stock arduino build (option off)
+// runs a software trial boot from Preferences "ota" instead, which also
+// rolls back after OTA_TRIAL_BOOTS_MAX unconfirmed boots.
+// -----------------------------------------------------------
+
+#ifndef OTA_BUF_SIZE
+#define OTA_BUF_SIZE          4096    // per buffer, ×2 (static); one flash sector
+#endif
+#ifndef OTA_ERASE_AHEAD
+#define OTA_ERASE_AHEAD       4       // sectors erased ahead of the writes
+#endif
+#ifndef OTA_READ_TIMEOUT_MS
+#define OTA_READ_TIMEOUT_MS   10000   // no data for this long → reconnect
+#endif
+#ifndef OTA_MAX_RESUMES
+#define OTA_MAX_RESUMES       5       // reconnect attempts per download
+#endif
+#ifndef OTA_RETRY_DELAY_MS
+#define OTA_RETRY_DELAY_MS    2000    // pause before a resume attempt
+#endif
+#ifndef OTA_PROGRESS_STEP
+#define OTA_PROGRESS_STEP     5       // progress event every n percent
+#endif
+#ifndef OTA_REBOOT_DEADLINE_S
+#define OTA_REBOOT_DEADLINE_S 3600    // default: reboot with open runs after this
+#endif
+#ifndef OTA_REBOOT_POLL_MS
+#define OTA_REBOOT_POLL_MS    1000    // readiness check period while waiting
+#endif
+#ifndef OTA_HEALTH_TIMEOUT_MS
+#define OTA_HEALTH_TIMEOUT_MS 180000  // new image must be healthy within this
+#endif
+
+// Start the OTA task (from start_system_tasks)
+void update_mgr_start_task();
+
+// Queue a download. sha256 (64 hex, of the resulting image also for
+// delta patches) is verified before the image is activated; md5 (32 hex) is still accepted for older tooling.
+// deadline_s: longest wait for a reboot window without open runs.
+// Returns false if the arguments are invalid or an update is running.
+bool update_mgr_begin(const char *url, const char *sha256 = nullptr,
+                      const char *md5 = nullptr, bool reboot = true,
+                      uint32_t deadline_s = OTA_REBOOT_DEADLINE_S);
+
+bool update_mgr_busy();
+
+// mqttTask side of MSG_OTA: formats and publishes one OTA event
+bool update_mgr_mqtt_publish(const char *type, int value);
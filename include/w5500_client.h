@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+#include <Ethernet.h>
+
+// -----------------------------------------------------------
+// W5500 TCP client with burst SPI data transfers
+// -----------------------------------------------------------
+// The Arduino Ethernet library moves socket data through W5100.write()
+// one SPI.transfer() per byte (SPI_HAS_TRANSFER_BUF is not set on the
+// ESP32 core) at a fixed 14 MHz. W5500Client keeps the library for
+// everything around the data (socket allocation, connect, stop, DNS,
+// DHCP) and replaces the data path:
+//
+//   write()  Sn_TX_FSR → one burst frame into the TX buffer at
+//            Sn_TX_WR → Sn_TX_WR += n → SEND; SEND_OK of the previous
+//            send is only awaited before the next SEND (pipelined)
+//   read()   Sn_RX_RSR cached, one burst frame out of the RX buffer;
+//            Sn_RX_RD / RECV are committed when the cached data is used
+//            up or half the socket buffer is consumed
+//
+// Frames run at W5500_SPI_HZ through SPI.writeBytes / transferBytes
+// (64-byte FIFO blocks). The Arduino SPI driver has no DMA mode and
+// the bus is shared with the Ethernet library, so DMA is not used.
+// W5500 only (variable data length mode, socket buffer wrap done by
+// the chip). Drop-in for EthernetClient wherever a Client is passed.
+// -----------------------------------------------------------
+
+#ifndef W5500_SPI_HZ
+#define W5500_SPI_HZ 26000000  // pins go through the GPIO matrix; 40 MHz on short traces
+#endif
+
+class W5500Client : public EthernetClient
+{
+public:
+  W5500Client() = default;
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  void stop() override;
+
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+
+private:
+  void reset_();
+  bool sock_(uint8_t &s) const;     // socket index if open
+  void commitRx_(uint8_t s);        // Sn_RX_RD + RECV (inside a transaction)
+
+  bool sending_ = false;            // SEND issued, SEND_OK not yet seen
+  bool rdValid_ = false;            // rxRd_ mirrors Sn_RX_RD
+  uint16_t rxRd_ = 0;               // local read pointer
+  uint16_t rxAvail_ = 0;            // bytes known to be in the RX buffer
+  uint16_t rxUncommitted_ = 0;      // read locally, RX_RD not yet written
+};
@@ -1,13 +1,61 @@
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
+
+// -----------------------------------------------------------
+// Task supervisor on top of the ESP-IDF task WDT
+// -----------------------------------------------------------
+// Each watched task registers once with its check-in period and the
+// latency it may add on top (blocking socket / Modbus / flash calls),
+// then calls watchdog_feed() every loop. A check-in later than
+// period + max latency is a deadline miss; per task the supervisor
+// keeps check-ins, mean / max gap, misses and the worst overrun.
+//
+// Only the supervisor (watchdogTask, watchdog_supervise()) is known to
+// the hardware task WDT. It resets the WDT while every *critical* task
+// is within its deadline; a stalled critical task stops the feeding
+// and the task WDT resets the chip after its timeout. Non-critical
+// tasks are tracked and logged only.
+//
+// While a critical task is overdue the supervisor keeps a record of
+// it (task, time since its last check-in) in RTC memory; after the
+// reset it is reported once (watchdog_last_stall(), boot log report).
+// -----------------------------------------------------------
+
+#ifndef WDT_MAX_TASKS
+#define WDT_MAX_TASKS 16
+#endif
+#ifndef WDT_TIMEOUT_S
+#define WDT_TIMEOUT_S 3   // hardware task WDT (supervisor only)
+#endif
 
 void watchdog_start(uint32_t timeout_sec, bool panic = true);
 
 // Call at the beginning of each FreeRTOS task you want watched
-void watchdog_register_this_task();
+void watchdog_register_this_task(uint32_t period_ms, uint32_t max_latency_ms, bool critical = true);
 
-// Optional: remove current task from WDT
+// Optional: remove current task from supervision
 void watchdog_unregister_this_task();
 
-// Feed (reset) the WDT for *current* task
-void watchdog_feed();
\ No newline at end of file
+// Check-in of the *current* task (no-op for unregistered tasks)
+void watchdog_feed();
+
+// watchdogTask: deadline check + hardware WDT reset when healthy
+void watchdog_supervise();
+
+struct WdStats
+{
+  char name[16];
+  uint32_t periodMs, limitMs; // limit = period + max latency
+  bool critical;
+  bool late;                  // overdue right now
+  uint32_t ageMs;             // since the last check-in
+  uint32_t checkins;
+  uint32_t meanMs, maxMs;     // gap between check-ins
+  uint32_t misses;            // check-ins after the limit
+  uint32_t worstMs;           // largest gap beyond the limit
+};
+uint8_t watchdog_stats(WdStats *out, uint8_t max); // count filled
+
+// Stall that led to the last reset (false: none)
+bool watchdog_last_stall(char *task, size_t len, uint32_t *stalledMs);
@@ -0,0 +1,36 @@
+#pragma once
+#include <ESPAsyncWebServer.h>
+
+// -----------------------------------------------------------
+// Local REST API (same command handlers as MQTT, see cmd_dispatch)
+// -----------------------------------------------------------
+//   GET  /api/settings           network / broker settings
+//   POST /api/settings           → cmd/net
+//   GET  /api/relays             {"mask":hw,"target":requested,"faults":n}
+//   POST /api/relay  {id,state}  → cmd/relay
+//   POST /api/relays {mask}      → cmd/relay
+//   POST /api/dpm    {addr,...}  → cmd/settings
+//   POST /api/cmd/<name>[/<id>]  → cmd/<name>[/<id>]
+//        (curve, mode, reset, user, line, thermal, ota, net, relay)
+// POST bodies go into a fixed slot pool (no heap per request) and are
+// executed by httpTask; the reply is 202 and the result shows up in
+// the event stream. 413 = body too large, 503 = all slots busy.
+// Every POST needs HTTP basic auth (api_user / api_pass of net_cfg.h,
+// active after restart like the other net settings); 401 otherwise.
+// -----------------------------------------------------------
+
+#ifndef API_BODY_MAX
+#define API_BODY_MAX   512   // bytes per request body
+#endif
+#ifndef API_SLOTS
+#define API_SLOTS      4     // requests waiting for httpTask
+#endif
+#ifndef API_SLOT_TTL_MS
+#define API_SLOT_TTL_MS 5000 // reclaim slots of aborted uploads
+#endif
+
+// Register the endpoints (called from http_begin)
+void web_api_begin(AsyncWebServer &srv);
+
+// Execute queued commands (called from http_poll / httpTask)
+void web_api_poll();
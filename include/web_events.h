@@ -0,0 +1,30 @@
+#pragma once
+#include <ESPAsyncWebServer.h>
+
+// -----------------------------------------------------------
+// Live telemetry push for the web UI (Server-Sent Events)
+// -----------------------------------------------------------
+// GET /api/events  (text/event-stream)
+//   event "snapshot": full state on connect
+//       {"ip":"..","link":true,"relays":N,"DPM1":[...],"DPM2":[...]}
+//   event "dpm":      only the DPMs that changed since the last push
+//       {"DPM3":[...]}
+//   event "relays":   {"relays":N} when the relay mask changes
+// DPM arrays use the MQTT status layout:
+//   [state, dpm_state, volt_act, cur_act, temp_act, remain,
+//    volt_set, cur_set, idle_cur, last_ms, runtime]
+// Deltas are computed in httpTask and serialised once for all clients.
+// -----------------------------------------------------------
+
+#ifndef WEB_EVENTS_PERIOD_MS
+#define WEB_EVENTS_PERIOD_MS  200   // diff interval (= Modbus read period)
+#endif
+#ifndef WEB_EVENTS_RETRY_MS
+#define WEB_EVENTS_RETRY_MS   2000  // browser reconnect delay
+#endif
+
+// Register /api/events on the server (called from http_begin)
+void web_events_begin(AsyncWebServer &srv);
+
+// Diff + push (called from http_poll / httpTask)
+void web_events_poll();
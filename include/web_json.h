@@ -0,0 +1,23 @@
+#pragma once
+#include <ESPAsyncWebServer.h>
+#include <functional>
+#include "json_stream.h"
+
+// -----------------------------------------------------------
+// Chunked JSON responses for all HTTP JSON endpoints
+// -----------------------------------------------------------
+// The generator is called with an empty JsonStream over a fixed
+// WEB_JSON_BUF buffer and writes the next piece of the document
+// (e.g. one device); it returns false after the last piece. Pieces
+// are copied into the TCP send buffer as it drains, so memory use is
+// constant regardless of the number of devices or records.
+// A piece larger than WEB_JSON_BUF aborts the response (logged).
+// -----------------------------------------------------------
+
+#ifndef WEB_JSON_BUF
+#define WEB_JSON_BUF 768   // largest single piece (one run record ≈ 500 B)
+#endif
+
+typedef std::function<bool(JsonStream &w)> WebJsonGen;
+
+void web_json_send(AsyncWebServerRequest *req, WebJsonGen gen, int code = 200);
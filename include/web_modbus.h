@@ -1,6 +1,14 @@
 #pragma once
 #include "config.h"
 
-// Start the tiny HTTP server (handlers in web_modbus.cpp)
+// ---- HTTP tunables ----
+#ifndef HTTP_ASSETS_MAX
+#define HTTP_ASSETS_MAX       16     // static files indexed at http_begin()
+#endif
+#ifndef HTTP_ASSET_MAX_AGE_S
+#define HTTP_ASSET_MAX_AGE_S  3600   // Cache-Control max-age for js/css (s)
+#endif
+
+// Start the async HTTP server (handlers in web_modbus.cpp)
 void http_begin();
-void http_poll();    // <-- add this
+void http_poll();    // periodic work from httpTask (server itself is async)
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# eth_bench_server.py
+# -------------------------------------------------------------------
+# Counterpart of /cmd/ethbench (src/eth_bench.cpp): accepts the
+# device's connection, receives "DPMBENCH <bytes>\n" + <bytes>, then
+# sends <bytes> back. Prints the rates seen from the host side.
+#
+#   python scripts/eth_bench_server.py [--port 5201]
+#
+# Prints the /cmd/ethbench payloads to publish (W5500Client and the
+# library EthernetClient as baseline).
+# -------------------------------------------------------------------
+
+import argparse
+import json
+import socket
+import time
+
+
+def lan_ip():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.connect(("10.255.255.255", 1))
+        return s.getsockname()[0]
+    except OSError:
+        return "127.0.0.1"
+    finally:
+        s.close()
+
+
+def recv_line(conn):
+    line = b""
+    while not line.endswith(b"\n"):
+        c = conn.recv(1)
+        if not c:
+            raise ConnectionError("closed before header")
+        line += c
+    return line.decode().strip()
+
+
+def serve_one(conn, peer):
+    conn.settimeout(10)
+    hdr = recv_line(conn)
+    magic, n = hdr.split()
+    if magic != "DPMBENCH":
+        raise ValueError(f"bad header {hdr!r}")
+    n = int(n)
+
+    got = 0
+    t0 = None
+    while got < n:
+        chunk = conn.recv(65536)
+        if not chunk:
+            break
+        if t0 is None:
+            t0 = time.perf_counter()
+        got += len(chunk)
+    t_rx = time.perf_counter() - t0 if t0 else 0
+
+    block = bytes(range(256)) * 256
+    sent = 0
+    t1 = time.perf_counter()
+    while sent < n:
+        sent += conn.send(block[: min(len(block), n - sent)])
+    t_tx = time.perf_counter() - t1
+
+    def rate(b, t):
+        return b / t / 1024 if t > 0 else 0
+
+    print(f"{peer[0]}: device→host {got} B {rate(got, t_rx):.0f} kB/s, "
+          f"host→device {sent} B {rate(sent, t_tx):.0f} kB/s (host view)")
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--port", type=int, default=5201)
+    args = ap.parse_args()
+
+    ip = lan_ip()
+    for plain in (False, True):
+        print("publish to <base>/<device>/cmd/ethbench:",
+              json.dumps({"host": ip, "port": args.port, "kb": 1024, "plain": plain}))
+
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(("", args.port))
+    srv.listen(1)
+    print(f"listening on {ip}:{args.port}")
+    while True:
+        conn, peer = srv.accept()
+        with conn:
+            try:
+                serve_one(conn, peer)
+            except (OSError, ValueError) as e:
+                print(f"{peer[0]}: {e}")
+
+
+if __name__ == "__main__":
+    main()
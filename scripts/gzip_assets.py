@@ -0,0 +1,76 @@
+# gzip_assets.py
+# -------------------------------------------------------------------
+# Pre-build script: compresses every file in data/ into data_gz/www/<name>.gz
+# data_gz/ is the LittleFS image source (see data_dir in platformio.ini);
+# the web server only serves /www, the rest of LittleFS stays private.
+# mtime=0 in the gzip header keeps the output (and its CRC → ETag)
+# identical as long as the source file does not change.
+# -------------------------------------------------------------------
+
+Import("env")
+import os, gzip, io
+
+print("🐍 gzip_assets.py running...")
+
+project_dir = env.subst("$PROJECT_DIR")
+src_dir = os.path.join(project_dir, "data")
+img_dir = os.path.join(project_dir, "data_gz")
+dst_dir = os.path.join(img_dir, "www")
+
+# Files that are stored as-is (already compressed / binary)
+SKIP_EXT = (".gz", ".png", ".jpg", ".jpeg", ".ico", ".bin")
+
+
+def gzip_bytes(raw):
+    buf = io.BytesIO()
+    with gzip.GzipFile(filename="", mode="wb", fileobj=buf, compresslevel=9, mtime=0) as gz:
+        gz.write(raw)
+    return buf.getvalue()
+
+
+def build_assets():
+    if not os.path.isdir(src_dir):
+        print(f"⚠️ no data dir: {src_dir}")
+        return
+    os.makedirs(dst_dir, exist_ok=True)
+
+    wanted = set()
+    total_in = total_out = 0
+    for name in sorted(os.listdir(src_dir)):
+        src = os.path.join(src_dir, name)
+        if not os.path.isfile(src):
+            continue
+        out_name = name if name.lower().endswith(SKIP_EXT) else name + ".gz"
+        dst = os.path.join(dst_dir, out_name)
+        wanted.add(out_name)
+
+        with open(src, "rb") as f:
+            raw = f.read()
+        data = raw if out_name == name else gzip_bytes(raw)
+        total_in += len(raw)
+        total_out += len(data)
+
+        # Only rewrite on change → no needless FS image rebuilds
+        if os.path.exists(dst):
+            with open(dst, "rb") as f:
+                if f.read() == data:
+                    continue
+        with open(dst, "wb") as f:
+            f.write(data)
+        print(f"📦 {name}: {len(raw)} → {len(data)} bytes")
+
+    # Remove assets whose source was deleted
+    for name in os.listdir(dst_dir):
+        if name not in wanted:
+            os.remove(os.path.join(dst_dir, name))
+            print(f"🗑️ removed stale {name}")
+    # Files of the old flat layout (image root) are not served any more
+    for name in os.listdir(img_dir):
+        if os.path.isfile(os.path.join(img_dir, name)):
+            os.remove(os.path.join(img_dir, name))
+            print(f"🗑️ removed {name} (assets live in www/)")
+
+    print(f"✅ assets: {total_in} → {total_out} bytes")
+
+
+build_assets()
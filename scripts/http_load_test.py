@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# http_load_test.py
+# -------------------------------------------------------------------
+# Host-side HTTP load test for the controller web UI / API.
+# Runs N keep-alive clients in parallel for a fixed time and reports
+# requests/s and latency percentiles per path.
+#
+#   python scripts/http_load_test.py 192.168.4.1 -c 4 -d 20
+#   python scripts/http_load_test.py 192.168.4.1 --paths /app.js /api/status
+#   python scripts/http_load_test.py 192.168.4.1 --revalidate   (If-None-Match)
+# -------------------------------------------------------------------
+
+import argparse
+import http.client
+import threading
+import time
+
+DEFAULT_PATHS = ["/", "/app.js", "/style.css", "/api/status"]
+
+
+def percentile(sorted_vals, p):
+    if not sorted_vals:
+        return 0.0
+    k = (len(sorted_vals) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(sorted_vals) - 1)
+    return sorted_vals[lo] + (sorted_vals[hi] - sorted_vals[lo]) * (k - lo)
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.lat = {}      # path -> [ms]
+        self.status = {}   # status -> count
+        self.errors = 0
+        self.bytes = 0
+
+    def add(self, path, ms, status, nbytes):
+        with self.lock:
+            self.lat.setdefault(path, []).append(ms)
+            self.status[status] = self.status.get(status, 0) + 1
+            self.bytes += nbytes
+
+    def error(self):
+        with self.lock:
+            self.errors += 1
+
+
+def worker(args, stats, stop_at, wid):
+    etags = {}
+    conn = None
+    i = wid
+    while time.monotonic() < stop_at:
+        path = args.paths[i % len(args.paths)]
+        i += 1
+        headers = {"Accept-Encoding": "gzip"}
+        if args.revalidate and path in etags:
+            headers["If-None-Match"] = etags[path]
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            t0 = time.perf_counter()
+            conn.request("GET", path, headers=headers)
+            resp = conn.getresponse()
+            body = resp.read()
+            ms = (time.perf_counter() - t0) * 1000.0
+            if resp.getheader("ETag"):
+                etags[path] = resp.getheader("ETag")
+            stats.add(path, ms, resp.status, len(body))
+            if resp.getheader("Connection", "").lower() == "close":
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException):
+            stats.error()
+            if conn:
+                conn.close()
+            conn = None
+            time.sleep(0.05)
+    if conn:
+        conn.close()
+
+
+def main():
+    ap = argparse.ArgumentParser(description="HTTP load test (req/s, p99)")
+    ap.add_argument("host")
+    ap.add_argument("--port", type=int, default=80)
+    ap.add_argument("-c", "--concurrency", type=int, default=4)
+    ap.add_argument("-d", "--duration", type=float, default=10.0, help="seconds")
+    ap.add_argument("--timeout", type=float, default=5.0)
+    ap.add_argument("--paths", nargs="+", default=DEFAULT_PATHS)
+    ap.add_argument("--revalidate", action="store_true",
+                    help="send If-None-Match with the last ETag (browser cache)")
+    args = ap.parse_args()
+
+    stats = Stats()
+    start = time.monotonic()
+    stop_at = start + args.duration
+    threads = [threading.Thread(target=worker, args=(args, stats, stop_at, w), daemon=True)
+               for w in range(args.concurrency)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - start
+
+    all_lat = sorted(ms for v in stats.lat.values() for ms in v)
+    total = len(all_lat)
+    print(f"host={args.host}:{args.port} clients={args.concurrency} "
+          f"duration={elapsed:.1f}s revalidate={args.revalidate}")
+    print(f"{'path':<20} {'n':>6} {'p50 ms':>8} {'p99 ms':>8} {'max ms':>8}")
+    for path in args.paths:
+        v = sorted(stats.lat.get(path, []))
+        print(f"{path:<20} {len(v):>6} {percentile(v, 50):>8.1f} "
+              f"{percentile(v, 99):>8.1f} {(v[-1] if v else 0):>8.1f}")
+    print(f"{'total':<20} {total:>6} {percentile(all_lat, 50):>8.1f} "
+          f"{percentile(all_lat, 99):>8.1f} {(all_lat[-1] if all_lat else 0):>8.1f}")
+    print(f"requests/s: {total / elapsed:.1f}   KiB/s: {stats.bytes / 1024 / elapsed:.1f}   "
+          f"errors: {stats.errors}   status: {dict(sorted(stats.status.items()))}")
+
+
+if __name__ == "__main__":
+    main()
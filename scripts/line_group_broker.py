@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+# line_group_broker.py
+# -------------------------------------------------------------------
+# MQTT 3.1.1 broker stand-in for line groups (src/line_group.cpp).
+# Several controllers connect at once; PUBLISH is routed to matching
+# subscriptions (+ / # wildcards, delivered QoS0), QoS1 is acknowledged.
+#
+# Once --expect controllers are connected and subscribed, each --cmd
+# is published on <base>/line/<n>/cmd and the replies are checked:
+#
+#   - every controller answers with one "line_cmd" event, state "OK"
+#     or "REJECTED" as given by --want (per command, default OK)
+#   - aggregated telemetry on <base>/line/<n>/<dev>/telemetry arrives
+#     from every controller
+#
+#   python scripts/line_group_broker.py --line 2 --expect 2 \
+#       --cmd '{"cmd":"set","cur":1500,"runtime":600}' \
+#       --cmd '{"cmd":"set","cur":-5}' --want OK --want REJECTED
+#
+# Exit code 0 when all checks passed, 1 otherwise. Point the devices'
+# MQTT host (/cmd/net) at this machine; their line_id must be <n>.
+# -------------------------------------------------------------------
+
+import argparse
+import json
+import socket
+import struct
+import sys
+import threading
+import time
+
+from mqtt_loss_broker import packet, recv_packet
+
+
+def topic_matches(filt, topic):
+    f, t = filt.split("/"), topic.split("/")
+    for i, part in enumerate(f):
+        if part == "#":
+            return True
+        if i >= len(t) or (part != "+" and part != t[i]):
+            return False
+    return len(f) == len(t)
+
+
+class Broker:
+    def __init__(self, base, line):
+        self.lock = threading.Lock()
+        self.subs = {}          # conn → [filters]
+        self.events = []        # (device, type, state, message)
+        self.telemetry = {}     # device → last payload
+        self.base, self.line = base, line
+
+    def route(self, topic, payload):
+        with self.lock:
+            targets = [c for c, fs in self.subs.items() if any(topic_matches(f, topic) for f in fs)]
+        tl = topic.encode()
+        pkt = packet(0x30, struct.pack(">H", len(tl)) + tl + payload)
+        for c in targets:
+            try:
+                c.sendall(pkt)
+            except OSError:
+                pass
+
+    def note(self, topic, payload):
+        parts = topic.split("/")
+        if len(parts) == 3 and parts[0] == self.base and parts[2] == "event":
+            try:
+                ev = json.loads(payload)
+            except ValueError:
+                return
+            if ev.get("type") == "line_cmd":
+                with self.lock:
+                    self.events.append((ev.get("device"), ev.get("state"), ev.get("message")))
+                print(f"  event {ev.get('device')}: {ev.get('state')} {ev.get('message')}")
+        elif len(parts) == 5 and parts[1] == "line" and parts[2] == str(self.line) and parts[4] == "telemetry":
+            with self.lock:
+                self.telemetry[parts[3]] = payload
+            print(f"  telemetry {parts[3]}: {payload[:100]!r}")
+
+    def line_subscribers(self):
+        want = f"{self.base}/line/{self.line}/cmd"
+        with self.lock:
+            return sum(1 for fs in self.subs.values() if any(topic_matches(f, want) for f in fs))
+
+
+def serve(conn, peer, br):
+    with br.lock:
+        br.subs[conn] = []
+    try:
+        while True:
+            hdr, body = recv_packet(conn)
+            kind = hdr >> 4
+            if kind == 1:    # CONNECT
+                conn.sendall(packet(0x20, b"\x00\x00"))
+                print(f"{peer[0]}: CONNECT")
+            elif kind == 8:  # SUBSCRIBE: granted QoS0 (routing is QoS0)
+                pid, i, filters = body[:2], 2, []
+                while i < len(body):
+                    (tl,) = struct.unpack(">H", body[i:i + 2])
+                    filters.append(body[i + 2:i + 2 + tl].decode(errors="replace"))
+                    i += 2 + tl + 1
+                with br.lock:
+                    br.subs[conn] += filters
+                conn.sendall(packet(0x90, pid + b"\x00" * len(filters)))
+            elif kind == 12:  # PINGREQ
+                conn.sendall(packet(0xD0))
+            elif kind == 14:  # DISCONNECT
+                return
+            elif kind == 3:   # PUBLISH
+                qos = (hdr >> 1) & 3
+                (tl,) = struct.unpack(">H", body[:2])
+                topic = body[2:2 + tl].decode(errors="replace")
+                off = 2 + tl
+                if qos:
+                    conn.sendall(packet(0x40, body[off:off + 2]))
+                    off += 2
+                br.note(topic, body[off:])
+                br.route(topic, body[off:])
+    except (OSError, ConnectionError) as e:
+        print(f"{peer[0]}: {e}")
+    finally:
+        with br.lock:
+            br.subs.pop(conn, None)
+        conn.close()
+
+
+def run_checks(br, args):
+    t0 = time.time()
+    while br.line_subscribers() < args.expect:
+        if time.time() - t0 > args.timeout:
+            print(f"✗ only {br.line_subscribers()} of {args.expect} controllers subscribed")
+            return False
+        time.sleep(0.2)
+
+    ok = True
+    wants = args.want + ["OK"] * (len(args.cmd) - len(args.want))
+    for cmd, want in zip(args.cmd, wants):
+        with br.lock:
+            br.events.clear()
+            br.telemetry.clear()
+        print(f"→ line {args.line}: {cmd} (want {want})")
+        br.route(f"{args.base}/line/{args.line}/cmd", cmd.encode())
+        t0 = time.time()
+        while time.time() - t0 < args.timeout:
+            with br.lock:
+                done = len(br.events) >= args.expect and len(br.telemetry) >= args.expect
+            if done:
+                break
+            time.sleep(0.2)
+        with br.lock:
+            events, telem = list(br.events), dict(br.telemetry)
+        states = [s for _, s, _ in events]
+        if len(events) != args.expect or any(s != want for s in states):
+            print(f"✗ events: {events}")
+            ok = False
+        if len(telem) < args.expect:
+            print(f"✗ telemetry from {sorted(telem)} only")
+            ok = False
+    return ok
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--base", default="DPM_Control")
+    ap.add_argument("--line", type=int, required=True)
+    ap.add_argument("--expect", type=int, default=1, help="controllers with members on the line")
+    ap.add_argument("--cmd", action="append", default=[], help="JSON command (repeatable)")
+    ap.add_argument("--want", action="append", default=[], help="OK / REJECTED per --cmd")
+    ap.add_argument("--timeout", type=float, default=90.0, help="s per step (telemetry is periodic)")
+    args = ap.parse_args()
+
+    br = Broker(args.base, args.line)
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(("", args.port))
+    srv.listen(8)
+    print(f"listening on :{args.port}")
+
+    def accept():
+        while True:
+            conn, peer = srv.accept()
+            threading.Thread(target=serve, args=(conn, peer, br), daemon=True).start()
+
+    threading.Thread(target=accept, daemon=True).start()
+    try:
+        ok = run_checks(br, args)
+    except KeyboardInterrupt:
+        ok = False
+    print("✓ all checks passed" if ok else "✗ failed")
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
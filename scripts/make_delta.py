@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+# make_delta.py
+# -------------------------------------------------------------------
+# Delta firmware patches for /cmd/ota (format: include/ota_delta.h).
+# bsdiff-style: matches against the old image become COPY/ADD ops
+# (ADD = byte differences, mostly zero after relinking), the rest is
+# INSERTed; the op stream is raw-deflated (32 KB window, as on the
+# device).
+#
+#   python scripts/make_delta.py old.bin new.bin -o new.dpmdelta --verify
+#   python scripts/make_delta.py --apply old.bin new.dpmdelta -o out.bin
+#   python scripts/make_delta.py --selftest
+#
+# Also imported by rename_firmware.py (make_patch / verify_patch).
+# -------------------------------------------------------------------
+
+import argparse
+import hashlib
+import os
+import random
+import struct
+import sys
+import zlib
+
+MAGIC = b"DPMDELTA"
+VERSION = 1
+OP_END, OP_COPY, OP_ADD, OP_INSERT = 0, 1, 2, 3
+
+K = 16          # seed match length
+STEP = 4        # index every STEP-th source position
+SLACK = 16      # approximate extension stops this far below the best score
+
+
+# ===================================================================
+# Diff
+# ===================================================================
+def _exact_len(a, i, b, j):
+    n = min(len(a) - i, len(b) - j)
+    k = 0
+    while k + 256 <= n and a[i + k:i + k + 256] == b[j + k:j + k + 256]:
+        k += 256
+    while k < n and a[i + k] == b[j + k]:
+        k += 1
+    return k
+
+
+def _approx_len(a, i, b, j):
+    """Extend while matches outweigh mismatches (relocated code)."""
+    n = min(len(a) - i, len(b) - j)
+    score = best = best_len = 0
+    k = 0
+    while k < n:
+        score += 1 if a[i + k] == b[j + k] else -1
+        k += 1
+        if score > best:
+            best, best_len = score, k
+        elif score < best - SLACK:
+            break
+    return best_len
+
+
+def diff_ops(old, new):
+    """Yield (op, src_off, data_or_len) tuples."""
+    index = {}
+    for j in range(0, len(old) - K + 1, STEP):
+        index[old[j:j + K]] = j
+
+    i = lit = 0
+    n = len(new)
+    while i <= n - K:
+        j = index.get(new[i:i + K])
+        if j is None:
+            i += 1
+            continue
+        # grow backwards into the pending literal (index is sparse)
+        while i > lit and j > 0 and new[i - 1] == old[j - 1]:
+            i -= 1
+            j -= 1
+        length = _exact_len(new, i, old, j)
+        if length < K:
+            i += 1
+            continue
+        length += _approx_len(new, i + length, old, j + length)
+
+        if lit < i:
+            yield (OP_INSERT, 0, new[lit:i])
+        seg_new = new[i:i + length]
+        seg_old = old[j:j + length]
+        if seg_new == seg_old:
+            yield (OP_COPY, j, length)
+        else:
+            yield (OP_ADD, j, bytes((x - y) & 0xFF for x, y in zip(seg_new, seg_old)))
+        i += length
+        lit = i
+    if lit < n:
+        yield (OP_INSERT, 0, new[lit:])
+
+
+def make_patch(old, new):
+    co = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+    out = [MAGIC, struct.pack("<II", VERSION, len(old)), hashlib.sha256(old).digest(),
+           struct.pack("<I", len(new)), hashlib.sha256(new).digest()]
+    for op, src, data in diff_ops(old, new):
+        if op == OP_COPY:
+            out.append(co.compress(struct.pack("<BII", OP_COPY, src, data)))
+        elif op == OP_ADD:
+            out.append(co.compress(struct.pack("<BII", OP_ADD, src, len(data)) + data))
+        else:
+            out.append(co.compress(struct.pack("<BI", OP_INSERT, len(data)) + data))
+    out.append(co.compress(bytes([OP_END])))
+    out.append(co.flush())
+    return b"".join(out)
+
+
+# ===================================================================
+# Reference apply (same checks as DeltaApply on the device)
+# ===================================================================
+def apply_patch(old, patch):
+    if patch[:8] != MAGIC:
+        raise ValueError("not a DPMDELTA patch")
+    version, src_size = struct.unpack_from("<II", patch, 8)
+    src_sha = patch[16:48]
+    dst_size, = struct.unpack_from("<I", patch, 48)
+    dst_sha = patch[52:84]
+    if version != VERSION:
+        raise ValueError(f"version {version}")
+    if len(old) < src_size or hashlib.sha256(old[:src_size]).digest() != src_sha:
+        raise ValueError("base image mismatch")
+    old = old[:src_size]
+
+    ops = zlib.decompress(patch[84:], -15)
+    out = bytearray()
+    p = 0
+    while True:
+        op = ops[p]
+        p += 1
+        if op == OP_END:
+            break
+        if op == OP_INSERT:
+            ln, = struct.unpack_from("<I", ops, p)
+            p += 4
+            out += ops[p:p + ln]
+            p += ln
+            continue
+        src, ln = struct.unpack_from("<II", ops, p)
+        p += 8
+        if src + ln > src_size:
+            raise ValueError("source range")
+        if op == OP_COPY:
+            out += old[src:src + ln]
+        elif op == OP_ADD:
+            out += bytes((x + y) & 0xFF for x, y in zip(old[src:src + ln], ops[p:p + ln]))
+            p += ln
+        else:
+            raise ValueError(f"bad op {op}")
+    if p != len(ops):
+        raise ValueError("data after END")
+    if len(out) != dst_size or hashlib.sha256(out).digest() != dst_sha:
+        raise ValueError("result hash mismatch")
+    return bytes(out)
+
+
+def verify_patch(old, new, patch):
+    return apply_patch(old, patch) == new
+
+
+# ===================================================================
+# Self test: synthetic "relinked" images
+# ===================================================================
+def _mutate(rng, base):
+    img = bytearray(base)
+    for _ in range(40):                     # code inserted / removed
+        at = rng.randrange(len(img))
+        if rng.random() < 0.5:
+            img[at:at] = rng.randbytes(rng.randrange(1, 400))
+        else:
+            del img[at:at + rng.randrange(1, 400)]
+    for w in range(0, len(img) - 4, 64):    # shifted pointers
+        if rng.random() < 0.3:
+            v, = struct.unpack_from("<I", img, w)
+            struct.pack_into("<I", img, w, (v + 0x40) & 0xFFFFFFFF)
+    return bytes(img)
+
+
+def selftest():
+    rng = random.Random(1)
+    words = [rng.randbytes(rng.randrange(4, 24)) for _ in range(3000)]
+    base = b"".join(rng.choice(words) for _ in range(40000))[:400000]
+    cases = [
+        ("identical", base, base),
+        ("relinked", base, _mutate(rng, base)),
+        ("unrelated", base, rng.randbytes(50000)),
+        ("empty-new", base, b""),
+    ]
+    ok = True
+    for name, old, new in cases:
+        patch = make_patch(old, new)
+        good = verify_patch(old, new, patch)
+        ok &= good
+        print(f"{'✅' if good else '❌'} {name:<10} {len(new):>7} B → patch {len(patch):>7} B")
+    try:                                    # wrong base must be refused
+        apply_patch(base[1:] + b"x", make_patch(base, cases[1][2]))
+        print("❌ wrong base accepted")
+        ok = False
+    except ValueError:
+        print("✅ wrong base refused")
+    return ok
+
+
+def main():
+    ap = argparse.ArgumentParser(description="DPMDELTA patch tool")
+    ap.add_argument("old", nargs="?")
+    ap.add_argument("new", nargs="?", help="new image (or patch with --apply)")
+    ap.add_argument("-o", "--out")
+    ap.add_argument("--verify", action="store_true", help="apply the patch and compare")
+    ap.add_argument("--apply", action="store_true", help="old + patch → image")
+    ap.add_argument("--selftest", action="store_true")
+    args = ap.parse_args()
+
+    if args.selftest:
+        sys.exit(0 if selftest() else 1)
+    if not args.old or not args.new:
+        ap.error("old and new are required")
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    if args.apply:
+        img = apply_patch(old, new)
+        if args.out:
+            with open(args.out, "wb") as f:
+                f.write(img)
+        print(f"✅ applied: {len(img)} B sha256 {hashlib.sha256(img).hexdigest()}")
+        return
+
+    patch = make_patch(old, new)
+    out = args.out or os.path.splitext(args.new)[0] + ".dpmdelta"
+    with open(out, "wb") as f:
+        f.write(patch)
+    print(f"📦 {out}: {len(new)} → {len(patch)} B ({100.0 * len(patch) / max(1, len(new)):.1f}%)")
+    print(f"   image sha256 {hashlib.sha256(new).hexdigest()}")
+    if args.verify:
+        if not verify_patch(old, new, patch):
+            print("❌ verify failed")
+            sys.exit(1)
+        print("✅ verified")
+
+
+if __name__ == "__main__":
+    main()
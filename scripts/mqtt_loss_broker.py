@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+# mqtt_loss_broker.py
+# -------------------------------------------------------------------
+# MQTT 3.1.1 broker stand-in with injected packet loss, to check the
+# QoS1 in-flight window of src/mqtt_client.cpp. Accepts one client at
+# a time, answers CONNECT / SUBSCRIBE / PINGREQ and acknowledges QoS1
+# publishes, except when told to lose them:
+#
+#   --drop-publish P   a QoS1 PUBLISH is ignored (no record, no PUBACK)
+#   --drop-puback P    a QoS1 PUBLISH is recorded but not acknowledged
+#   --kill-every N     the connection is closed on every N-th PUBLISH
+#                      (before it is recorded)
+#
+#   python scripts/mqtt_loss_broker.py --drop-puback 0.2 --kill-every 25
+#
+# Point the device's MQTT host (/cmd/net) at this machine. Every
+# received PUBLISH is printed; Ctrl-C prints, per topic, how many
+# distinct QoS1 payloads arrived and how many were duplicates (DUP).
+# Loss must show up as duplicates only, never as missing payloads.
+# -------------------------------------------------------------------
+
+import argparse
+import random
+import socket
+import struct
+from collections import defaultdict
+
+
+def recv_exact(conn, n):
+    buf = b""
+    while len(buf) < n:
+        c = conn.recv(n - len(buf))
+        if not c:
+            raise ConnectionError("closed")
+        buf += c
+    return buf
+
+
+def recv_packet(conn):
+    hdr = recv_exact(conn, 1)[0]
+    rem, shift = 0, 0
+    while True:
+        b = recv_exact(conn, 1)[0]
+        rem |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    return hdr, recv_exact(conn, rem) if rem else b""
+
+
+def packet(hdr, body=b""):
+    out, rem = bytearray([hdr]), len(body)
+    while True:
+        b = rem & 0x7F
+        rem >>= 7
+        out.append(b | 0x80 if rem else b)
+        if not rem:
+            return bytes(out) + body
+
+
+class Stats:
+    def __init__(self):
+        self.seen = defaultdict(set)      # topic → distinct QoS1 payloads
+        self.dups = defaultdict(int)      # topic → repeated QoS1 payloads
+        self.qos0 = defaultdict(int)
+        self.dropped = self.unacked = self.kills = 0
+
+    def report(self):
+        print("\n--- summary ---")
+        print(f"dropped PUBLISH {self.dropped}, withheld PUBACK {self.unacked}, "
+              f"killed connections {self.kills}")
+        for t in sorted(set(self.seen) | set(self.qos0)):
+            print(f"{t}: qos1 distinct={len(self.seen[t])} dup={self.dups[t]} qos0={self.qos0[t]}")
+
+
+def serve(conn, peer, args, st, rnd):
+    publishes = 0
+    while True:
+        hdr, body = recv_packet(conn)
+        kind = hdr >> 4
+        if kind == 1:    # CONNECT
+            conn.sendall(packet(0x20, b"\x00\x00"))
+            print(f"{peer[0]}: CONNECT")
+        elif kind == 8:  # SUBSCRIBE: grant QoS1 for every filter
+            pid, n = body[:2], 0
+            i = 2
+            while i < len(body):
+                (tl,) = struct.unpack(">H", body[i:i + 2])
+                i += 2 + tl + 1
+                n += 1
+            conn.sendall(packet(0x90, pid + b"\x01" * n))
+        elif kind == 12:  # PINGREQ
+            conn.sendall(packet(0xD0))
+        elif kind == 14:  # DISCONNECT
+            print(f"{peer[0]}: DISCONNECT")
+            return
+        elif kind == 3:   # PUBLISH
+            publishes += 1
+            if args.kill_every and publishes % args.kill_every == 0:
+                st.kills += 1
+                print(f"{peer[0]}: ✂ closing connection")
+                return
+            qos, dup = (hdr >> 1) & 3, bool(hdr & 0x08)
+            (tl,) = struct.unpack(">H", body[:2])
+            topic = body[2:2 + tl].decode(errors="replace")
+            off = 2 + tl
+            pid = None
+            if qos:
+                (pid,) = struct.unpack(">H", body[off:off + 2])
+                off += 2
+            payload = body[off:]
+            if not qos:
+                st.qos0[topic] += 1
+                if args.verbose:
+                    print(f"  q0 {topic} {payload[:80]!r}")
+                continue
+            if rnd.random() < args.drop_publish:
+                st.dropped += 1
+                print(f"  q1 id={pid} dup={int(dup)} {topic} ✗ lost")
+                continue
+            if payload in st.seen[topic]:
+                st.dups[topic] += 1
+            st.seen[topic].add(payload)
+            print(f"  q1 id={pid} dup={int(dup)} {topic} {payload[:80]!r}")
+            if rnd.random() < args.drop_puback:
+                st.unacked += 1
+                print(f"    ✗ PUBACK {pid} withheld")
+                continue
+            conn.sendall(packet(0x40, struct.pack(">H", pid)))
+        # PUBACK (4) for our QoS1 deliveries: we never publish to the client
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--drop-publish", type=float, default=0.0)
+    ap.add_argument("--drop-puback", type=float, default=0.0)
+    ap.add_argument("--kill-every", type=int, default=0)
+    ap.add_argument("--seed", type=int, default=None)
+    ap.add_argument("-v", "--verbose", action="store_true", help="print QoS0 publishes")
+    args = ap.parse_args()
+
+    rnd = random.Random(args.seed)
+    st = Stats()
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(("", args.port))
+    srv.listen(1)
+    print(f"listening on :{args.port}")
+    try:
+        while True:
+            conn, peer = srv.accept()
+            with conn:
+                try:
+                    serve(conn, peer, args, st, rnd)
+                except (OSError, ConnectionError) as e:
+                    print(f"{peer[0]}: {e}")
+    except KeyboardInterrupt:
+        st.report()
+
+
+if __name__ == "__main__":
+    main()
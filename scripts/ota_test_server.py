@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+# ota_test_server.py
+# -------------------------------------------------------------------
+# Local stand-in for the firmware server, to exercise the OTA task.
+# Serves one image with Range support and can misbehave on purpose:
+#
+#   python scripts/ota_test_server.py .pio/build/esp32s3-usb/firmware.bin
+#   python scripts/ota_test_server.py fw.bin --drop-after 200000   (resume)
+#   python scripts/ota_test_server.py fw.bin --drop-after 200000 --no-range
+#   python scripts/ota_test_server.py fw.bin --corrupt             (SHA fail)
+#
+# Prints the SHA-256 and the /cmd/ota payload to publish.
+# -------------------------------------------------------------------
+
+import argparse
+import hashlib
+import http.server
+import json
+import re
+import socket
+import time
+
+
+def lan_ip():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.connect(("10.255.255.255", 1))
+        return s.getsockname()[0]
+    except OSError:
+        return "127.0.0.1"
+    finally:
+        s.close()
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    image = b""
+    args = None
+    drops_left = 0
+
+    def log_message(self, fmt, *a):
+        print(f"{time.strftime('%H:%M:%S')} {self.client_address[0]} {fmt % a}")
+
+    def do_GET(self):
+        data = self.image
+        start, code = 0, 200
+        rng = self.headers.get("Range")
+        if rng and not self.args.no_range:
+            m = re.match(r"bytes=(\d+)-$", rng)
+            if not m or int(m.group(1)) >= len(data):
+                self.send_response(416)
+                self.send_header("Content-Range", f"bytes */{len(data)}")
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            start, code = int(m.group(1)), 206
+
+        body = data[start:]
+        self.send_response(code)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("Accept-Ranges", "none" if self.args.no_range else "bytes")
+        if code == 206:
+            self.send_header("Content-Range", f"bytes {start}-{len(data) - 1}/{len(data)}")
+        self.end_headers()
+
+        limit = len(body)
+        if Handler.drops_left > 0 and self.args.drop_after < limit:
+            Handler.drops_left -= 1
+            limit = self.args.drop_after
+            print(f"  ✂️  dropping connection after {limit} bytes (from {start})")
+
+        sent = 0
+        chunk = 1460
+        while sent < limit:
+            n = min(chunk, limit - sent)
+            self.wfile.write(body[sent:sent + n])
+            sent += n
+            if self.args.delay_ms:
+                time.sleep(self.args.delay_ms / 1000.0)
+        if limit < len(body):
+            self.close_connection = True
+            self.connection.shutdown(socket.SHUT_RDWR)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="OTA test server (Range, drops)")
+    ap.add_argument("image")
+    ap.add_argument("--port", type=int, default=8070)
+    ap.add_argument("--drop-after", type=int, default=0,
+                    help="close the connection after N body bytes")
+    ap.add_argument("--drops", type=int, default=1, help="how many requests to cut")
+    ap.add_argument("--no-range", action="store_true", help="ignore Range (always 200)")
+    ap.add_argument("--corrupt", action="store_true", help="flip one byte (hash mismatch)")
+    ap.add_argument("--delay-ms", type=float, default=0, help="pause per 1460-byte chunk")
+    ap.add_argument("--topic", default="<base>/<device>/cmd/ota")
+    args = ap.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    sha = hashlib.sha256(image).hexdigest()
+    if args.corrupt:
+        image = bytearray(image)
+        image[len(image) // 2] ^= 0xFF
+        image = bytes(image)
+
+    Handler.image = image
+    Handler.args = args
+    Handler.drops_left = args.drops if args.drop_after > 0 else 0
+
+    name = args.image.replace("\\", "/").split("/")[-1]
+    url = f"http://{lan_ip()}:{args.port}/{name}"
+    print(f"image  : {args.image} ({len(image)} bytes)")
+    print(f"sha256 : {sha}")
+    print(f"publish: {args.topic}")
+    print("  " + json.dumps({"url": url, "sha256": sha, "reboot": True}))
+
+    srv = http.server.ThreadingHTTPServer(("", args.port), Handler)
+    try:
+        srv.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -3,12 +3,17 @@
 # Safe post-build rename script for PlatformIO ESP32 projects
 # Waits for firmware.bin, renames with version & timestamp,
 # archives to firmware_builds and optional export dir.
+# Also writes a delta patch from the previous archived build
+# (firmware_<new>_<ts>.from_<old>.dpmdelta, see make_delta.py).
 # -------------------------------------------------------------------
 
 Import("env")
-import os, time, shutil
+import os, re, sys, time, shutil
 from datetime import datetime
 
+sys.path.insert(0, os.path.join(env["PROJECT_DIR"], "scripts"))
+import make_delta
+
 print("🐍 rename_firmware.py running...")
 
 # -------------------------------------------------------------------
@@ -22,6 +27,41 @@ def get_version_from_flags():
             return val
     return "vUnknown"
 
+# -------------------------------------------------------------------
+# Delta patch against the previous archived build
+# -------------------------------------------------------------------
+ARCHIVE_RE = re.compile(r"^firmware_(.+)_(\d{8}_\d{4})\.bin$")
+
+def previous_build(archive_dir, new_name):
+    """Newest archived image other than new_name → (version, path)."""
+    best = None
+    for name in os.listdir(archive_dir):
+        m = ARCHIVE_RE.match(name)
+        if not m or name == new_name:
+            continue
+        if best is None or m.group(2) > best[0]:
+            best = (m.group(2), m.group(1), os.path.join(archive_dir, name))
+    return (best[1], best[2]) if best else (None, None)
+
+def write_delta(archive_dir, new_name, fw_version, timestamp):
+    old_version, old_path = previous_build(archive_dir, new_name)
+    if not old_path:
+        print("ℹ️ No previous build, no delta patch")
+        return None
+    with open(old_path, "rb") as f:
+        old = f.read()
+    with open(os.path.join(archive_dir, new_name), "rb") as f:
+        new = f.read()
+    patch = make_delta.make_patch(old, new)
+    if not make_delta.verify_patch(old, new, patch):
+        print("❌ Delta patch failed verification, not written")
+        return None
+    delta_name = f"firmware_{fw_version}_{timestamp}.from_{old_version}.dpmdelta"
+    with open(os.path.join(archive_dir, delta_name), "wb") as f:
+        f.write(patch)
+    print(f"🧩 Delta: {delta_name} ({len(patch)} B, {100.0 * len(patch) / max(1, len(new)):.1f}% of image)")
+    return delta_name
+
 # -------------------------------------------------------------------
 # Main rename logic
 # -------------------------------------------------------------------
@@ -56,11 +96,20 @@ def rename_after_build(source, target, env):
         shutil.copy2(new_path, os.path.join(archive_dir, new_name))
         print(f"📦 Archived to: {archive_dir}")
 
+        # --- Delta patch (only valid for devices running the previous build) ---
+        delta_name = None
+        try:
+            delta_name = write_delta(archive_dir, new_name, fw_version, timestamp)
+        except Exception as e:
+            print(f"⚠️ Delta patch skipped: {e}")
+
         # --- Optional external export directory ---
         export_dir = env.GetProjectOption("custom_firmware_export_dir", None)
         if export_dir:
             os.makedirs(export_dir, exist_ok=True)
             shutil.copy2(new_path, os.path.join(export_dir, new_name))
+            if delta_name:
+                shutil.copy2(os.path.join(archive_dir, delta_name), os.path.join(export_dir, delta_name))
             print(f"🌍 Exported to: {export_dir}")
         else:
             print("ℹ️ No external export directory defined")
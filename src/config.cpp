@@ -30,6 +30,12 @@ void saveConfig() {
     prefs.putInt(("ct_"  + String(id)).c_str(), dpms[id].curve.type); // save curve type
     prefs.putInt(("usr_" + String(id)).c_str(), dpms[id].user);
     prefs.putInt(("lid_" + String(id)).c_str(), dpms[id].line_id); // Galvanic line ID   
+    prefs.putInt(("md_"  + String(id)).c_str(), static_cast<int>(dpms[id].mode));
+    prefs.putDouble(("etc_" + String(id)).c_str(), dpms[id].energy_target_cfg);
+    prefs.putInt(("emn_" + String(id)).c_str(), dpms[id].ectrl.cur_min);
+    prefs.putInt(("emx_" + String(id)).c_str(), dpms[id].ectrl.cur_max);
+    prefs.putInt(("tw_"  + String(id)).c_str(), dpms[id].temp_warn);
+    prefs.putInt(("tc_"  + String(id)).c_str(), dpms[id].temp_crit);
   }  
   DBG_INFO("✅ Saved dpms[] to Preferences");
   prefs.end();
@@ -64,6 +70,13 @@ void loadConfig() {
     dpms[id].curve.type  = prefs.getInt(("ct_" + String(id)).c_str(), 0); // load curve type
     dpms[id].user        = prefs.getInt(("usr_" + String(id)).c_str(), 0); //user ID 
     dpms[id].line_id     = prefs.getInt(("lid_" + String(id)).c_str(), 0); //line id          
+    dpms[id].mode        = static_cast<DPMControlMode>(
+                             prefs.getInt(("md_" + String(id)).c_str(), MODE_TIME));
+    dpms[id].energy_target_cfg = prefs.getDouble(("etc_" + String(id)).c_str(), 0.0);
+    dpms[id].ectrl.cur_min = prefs.getInt(("emn_" + String(id)).c_str(), ECTRL_DEFAULT_MIN_MA);
+    dpms[id].ectrl.cur_max = prefs.getInt(("emx_" + String(id)).c_str(), ECTRL_DEFAULT_MAX_MA);
+    dpms[id].temp_warn   = prefs.getInt(("tw_" + String(id)).c_str(), DPM_TEMP_WARN);
+    dpms[id].temp_crit   = prefs.getInt(("tc_" + String(id)).c_str(), DPM_TEMP_CRIT);
   }
   DBG_INFO("📥 Loaded dpms[] from Preferences");
   prefs.end();  
@@ -0,0 +1,692 @@
+#include "debug_log.h"
+#include "watchdog.h"
+#include <atomic>
+#include <esp_attr.h>   // RTC_NOINIT_ATTR
+#include <esp_system.h> // esp_reset_reason(), esp_register_shutdown_handler()
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#ifndef LOG_MODULES
+#define LOG_MODULES 32          // distinct "[TAG]"s incl. "*"
+#endif
+#ifndef LOG_DRAIN_MS
+#define LOG_DRAIN_MS 20         // logTask poll period when the ring is empty
+#endif
+#define LOG_WD_LATENCY_MS 2000  // lowest priority: starved while busy, tracked only
+
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS: power of 2");
+static_assert(LOG_ARG_BYTES <= 255, "LogRec::len is 8 bit");
+
+static const char *LEVEL_NAMES[] = {"", "ERROR", "WARN ", "INFO "};
+
+// ===========================================================
+// [SECTION LOG] Ring: bounded MPSC queue (Vyukov), one record per cell
+// ===========================================================
+// cell.seq holds (sequence - index) so that the zero-initialised ring
+// is valid before log_begin(): cell i is free for position p when its
+// sequence equals p, filled when it equals p + 1.
+struct LogCell
+{
+  std::atomic<uint32_t> seq;
+  LogRec rec;
+};
+
+static LogCell s_ring[LOG_RING_SLOTS];
+static std::atomic<uint32_t> s_head{0};    // next position to claim (producers)
+static uint32_t s_tail = 0;                // next position to print (consumer)
+static std::atomic<uint32_t> s_dropped{0};
+static std::atomic<bool> s_consumer{false}; // logTask / shutdown handler
+
+static inline uint32_t cell_seq(uint32_t i)
+{
+  return s_ring[i].seq.load(std::memory_order_acquire) + i;
+}
+
+static inline void cell_set(uint32_t i, uint32_t seq)
+{
+  s_ring[i].seq.store(seq - i, std::memory_order_release);
+}
+
+LogRec *log_claim(uint32_t &pos)
+{
+  pos = s_head.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    const uint32_t i = pos & (LOG_RING_SLOTS - 1);
+    const int32_t d = (int32_t)(cell_seq(i) - pos);
+    if (d == 0)
+    {
+      if (s_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        return &s_ring[i].rec;
+    }
+    else if (d < 0)
+    {
+      s_dropped.fetch_add(1, std::memory_order_relaxed); // full: never wait
+      return nullptr;
+    }
+    else
+    {
+      pos = s_head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void log_commit(uint32_t pos)
+{
+  cell_set(pos & (LOG_RING_SLOTS - 1), pos + 1);
+}
+
+// Consumer side: the oldest committed record or nullptr
+static LogRec *ring_peek()
+{
+  const uint32_t i = s_tail & (LOG_RING_SLOTS - 1);
+  return cell_seq(i) == s_tail + 1 ? &s_ring[i].rec : nullptr;
+}
+
+static void ring_pop()
+{
+  cell_set(s_tail & (LOG_RING_SLOTS - 1), s_tail + LOG_RING_SLOTS);
+  s_tail++;
+}
+
+uint32_t log_dropped() { return s_dropped.load(std::memory_order_relaxed); }
+
+// ===========================================================
+// [SECTION LOG] Modules: "[TAG]" prefix → runtime level
+// ===========================================================
+struct LogModule
+{
+  char name[12];
+  int8_t level; // -1: follow "*"
+};
+
+static LogModule s_mods[LOG_MODULES] = {{"*", DEBUG_LEVEL}};
+static uint8_t s_modCount = 1;
+static portMUX_TYPE s_modMux = portMUX_INITIALIZER_UNLOCKED;
+
+static_assert(LOG_MODULES <= 32, "tap mask is 32 bit");
+static std::atomic<LogTap> s_tap{nullptr};
+static std::atomic<int8_t> s_tapLevel{-1};
+static std::atomic<uint32_t> s_tapMask{0};
+
+static inline bool tap_wants(uint8_t mod, uint8_t level)
+{
+  return level <= s_tapLevel.load(std::memory_order_relaxed) &&
+         ((s_tapMask.load(std::memory_order_relaxed) >> mod) & 1u);
+}
+
+// Index of the module (added if new); 0 = "*" for no tag / table full
+static uint8_t module_index(const char *name, size_t n)
+{
+  if (!n || n >= sizeof(s_mods[0].name))
+    return 0;
+  uint8_t idx = 0;
+  portENTER_CRITICAL(&s_modMux);
+  for (uint8_t m = 1; m < s_modCount && !idx; m++)
+    if (!strncasecmp(s_mods[m].name, name, n) && !s_mods[m].name[n])
+      idx = m;
+  if (!idx && s_modCount < LOG_MODULES)
+  {
+    idx = s_modCount++;
+    memcpy(s_mods[idx].name, name, n);
+    s_mods[idx].name[n] = 0;
+    s_mods[idx].level = -1;
+  }
+  portEXIT_CRITICAL(&s_modMux);
+  return idx;
+}
+
+static inline int8_t module_level(uint8_t mod)
+{
+  const int8_t lvl = s_mods[mod].level;
+  return lvl < 0 ? s_mods[0].level : lvl;
+}
+
+bool log_enabled(LogSite &site, uint8_t level, const char *fmt)
+{
+  if (!site.module) // first record of this call site
+  {
+    const char *end = fmt[0] == '[' ? strchr(fmt, ']') : nullptr;
+    site.module = 1 + (end ? module_index(fmt + 1, end - fmt - 1) : 0);
+    site.level = level;
+    site.fmt = fmt;
+  }
+  return level <= module_level(site.module - 1) || tap_wants(site.module - 1, level);
+}
+
+void log_set_tap(LogTap tap, int level, uint32_t mask)
+{
+  s_tap.store(nullptr);
+  s_tapLevel.store(tap ? (int8_t)level : -1);
+  s_tapMask.store(mask);
+  s_tap.store(tap);
+}
+
+int log_module_id(const char *module)
+{
+  if (!module)
+    return -1;
+  if (!strcmp(module, "*"))
+    return 0;
+  const uint8_t m = module_index(module, strlen(module));
+  return m ? m : -1;
+}
+
+bool log_set_level(const char *module, int level)
+{
+  if (!module || level > 3)
+    return false;
+  if (!strcmp(module, "*"))
+  {
+    s_mods[0].level = level < 0 ? DEBUG_LEVEL : level;
+    return true;
+  }
+  const uint8_t m = module_index(module, strlen(module));
+  if (!m)
+    return false;
+  s_mods[m].level = level < 0 ? -1 : level;
+  return true;
+}
+
+size_t log_levels(char *buf, size_t len)
+{
+  size_t n = snprintf(buf, len, "*=%d", s_mods[0].level);
+  for (uint8_t m = 1; m < s_modCount && n < len; m++)
+    if (s_mods[m].level >= 0)
+      n += snprintf(buf + n, len - n, " %s=%d", s_mods[m].name, s_mods[m].level);
+  return n < len ? n : len - 1;
+}
+
+// ===========================================================
+// [SECTION LOG] Formatter: printf conversions over encoded arguments
+// ===========================================================
+struct LogDec
+{
+  const uint8_t *p, *end;
+
+  // Next argument: tag + value bytes; false when exhausted
+  bool next(char &tag, const uint8_t *&v, size_t &n)
+  {
+    if (p >= end)
+      return false;
+    tag = (char)*p++;
+    switch (tag)
+    {
+    case 'i': case 'u': n = 4; break;
+    case 'p': n = sizeof(uintptr_t); break;
+    case 'I': case 'U': case 'd': n = 8; break;
+    case 's': n = p < end ? *p++ : 0; break;
+    default: p = end; return false;
+    }
+    if (p + n > end)
+    {
+      p = end;
+      return false;
+    }
+    v = p;
+    p += n;
+    return true;
+  }
+
+  bool i64(long long &out)
+  {
+    char t;
+    const uint8_t *v;
+    size_t n;
+    if (!next(t, v, n))
+      return false;
+    int32_t i32; uint32_t u32; int64_t i64v; uint64_t u64; double d; uintptr_t up;
+    switch (t)
+    {
+    case 'i': memcpy(&i32, v, 4); out = i32; return true;
+    case 'u': memcpy(&u32, v, 4); out = u32; return true;
+    case 'p': memcpy(&up, v, sizeof(up)); out = (long long)up; return true;
+    case 'I': memcpy(&i64v, v, 8); out = i64v; return true;
+    case 'U': memcpy(&u64, v, 8); out = (long long)u64; return true;
+    case 'd': memcpy(&d, v, 8); out = (long long)d; return true;
+    default: return false;
+    }
+  }
+
+  bool dbl(double &out)
+  {
+    const uint8_t *save = p;
+    char t;
+    const uint8_t *v;
+    size_t n;
+    if (p < end && *p == 'd' && next(t, v, n))
+    {
+      memcpy(&out, v, 8);
+      return true;
+    }
+    p = save;
+    long long x;
+    if (!i64(x))
+      return false;
+    out = (double)x;
+    return true;
+  }
+};
+
+struct LogOut
+{
+  char *buf;
+  size_t cap, n;
+  void put(const char *s, size_t k)
+  {
+    if (n + k >= cap)
+      k = n + 1 < cap ? cap - 1 - n : 0;
+    memcpy(buf + n, s, k);
+    n += k;
+    buf[n] = 0;
+  }
+};
+
+static size_t log_format(const LogRec &r, char *out, size_t cap)
+{
+  LogOut o{out, cap, 0};
+  out[0] = 0;
+  o.put("[", 1);
+  const char *lvl = LEVEL_NAMES[r.level & 3];
+  o.put(lvl, strlen(lvl));
+  o.put("] ", 2);
+
+  LogDec a{r.args, r.args + r.len};
+  const char *f = r.fmt;
+  static char tmp[128]; // static: only the consumer formats (shutdown stack)
+  while (*f)
+  {
+    const char *pct = strchr(f, '%');
+    if (!pct)
+    {
+      o.put(f, strlen(f));
+      break;
+    }
+    o.put(f, pct - f);
+    f = pct + 1;
+    if (*f == '%')
+    {
+      o.put("%", 1);
+      f++;
+      continue;
+    }
+
+    // %[flags][width][.precision][length]conv → own spec, own length
+    char spec[24] = "%";
+    size_t sn = 1;
+    while (*f && strchr("-+ #0", *f) && sn < 6)
+      spec[sn++] = *f++;
+    for (int part = 0; part < 2; part++)
+    {
+      if (part == 1)
+      {
+        if (*f != '.')
+          break;
+        spec[sn++] = *f++;
+      }
+      if (*f == '*')
+      {
+        long long w = 0;
+        a.i64(w);
+        sn += snprintf(spec + sn, sizeof(spec) - sn - 4, "%d", (int)w);
+        f++;
+      }
+      else
+        while (*f >= '0' && *f <= '9' && sn < sizeof(spec) - 5)
+          spec[sn++] = *f++;
+    }
+    while (*f && strchr("hljztLq", *f))
+      f++;
+    const char conv = *f ? *f++ : 0;
+
+    int k = -1;
+    switch (conv)
+    {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+    {
+      long long v;
+      if (!a.i64(v))
+        break;
+      if (conv == 'c')
+      {
+        spec[sn++] = 'c';
+        spec[sn] = 0;
+        k = snprintf(tmp, sizeof(tmp), spec, (int)v);
+        break;
+      }
+      spec[sn++] = 'l';
+      spec[sn++] = 'l';
+      spec[sn++] = conv;
+      spec[sn] = 0;
+      k = (conv == 'd' || conv == 'i') ? snprintf(tmp, sizeof(tmp), spec, v)
+                                       : snprintf(tmp, sizeof(tmp), spec, (unsigned long long)v);
+      break;
+    }
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+    {
+      double v;
+      if (!a.dbl(v))
+        break;
+      spec[sn++] = conv;
+      spec[sn] = 0;
+      k = snprintf(tmp, sizeof(tmp), spec, v);
+      break;
+    }
+    case 's':
+    {
+      char t;
+      const uint8_t *v;
+      size_t n;
+      if (!a.next(t, v, n) || t != 's')
+        break;
+      static char s[256];
+      memcpy(s, v, n);
+      s[n] = 0;
+      spec[sn++] = 's';
+      spec[sn] = 0;
+      if (sn == 2) // plain %s: no copy through snprintf
+      {
+        o.put(s, n);
+        continue;
+      }
+      k = snprintf(tmp, sizeof(tmp), spec, s);
+      break;
+    }
+    case 'p':
+    {
+      long long v;
+      if (!a.i64(v))
+        break;
+      k = snprintf(tmp, sizeof(tmp), "%p", (void *)(uintptr_t)v);
+      break;
+    }
+    default:
+      break;
+    }
+    if (k < 0)
+      o.put("?", 1); // missing / mismatched argument
+    else
+      o.put(tmp, (size_t)k < sizeof(tmp) ? (size_t)k : sizeof(tmp) - 1);
+  }
+  return o.n;
+}
+
+// ===========================================================
+// [SECTION LOG] Post-mortem lines in RTC memory
+// ===========================================================
+static const uint32_t RTC_MAGIC = 0x4C4F4731; // "LOG1"
+
+struct LogRtc
+{
+  uint32_t magic;
+  uint16_t head, count;
+  char line[LOG_RTC_LINES][LOG_RTC_LINE];
+};
+
+RTC_NOINIT_ATTR static LogRtc s_rtc;
+static char *s_pm = nullptr; // copy of the previous boot's lines
+static int s_pmCount = 0;
+static esp_reset_reason_t s_pmReason = ESP_RST_UNKNOWN;
+
+static void rtc_store(const char *line, size_t n)
+{
+  if (s_rtc.magic != RTC_MAGIC) // before log_begin(): indexes not valid
+    return;
+  while (n && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+    n--;
+  if (n >= LOG_RTC_LINE)
+    n = LOG_RTC_LINE - 1;
+  const uint16_t i = (s_rtc.head + s_rtc.count) % LOG_RTC_LINES;
+  memcpy(s_rtc.line[i], line, n);
+  s_rtc.line[i][n] = 0;
+  if (s_rtc.count < LOG_RTC_LINES)
+    s_rtc.count++;
+  else
+    s_rtc.head = (s_rtc.head + 1) % LOG_RTC_LINES;
+}
+
+static void rtc_take_previous()
+{
+  s_pmReason = esp_reset_reason();
+  const bool valid = s_rtc.magic == RTC_MAGIC && s_rtc.head < LOG_RTC_LINES &&
+                     s_rtc.count <= LOG_RTC_LINES;
+  if (valid && s_pmReason != ESP_RST_POWERON && s_rtc.count &&
+      (s_pm = (char *)malloc(s_rtc.count * LOG_RTC_LINE)) != nullptr)
+  {
+    for (int k = 0; k < s_rtc.count; k++)
+    {
+      char *dst = s_pm + k * LOG_RTC_LINE;
+      memcpy(dst, s_rtc.line[(s_rtc.head + k) % LOG_RTC_LINES], LOG_RTC_LINE);
+      dst[LOG_RTC_LINE - 1] = 0;
+    }
+    s_pmCount = s_rtc.count;
+  }
+  s_rtc.head = s_rtc.count = 0;
+  s_rtc.magic = RTC_MAGIC;
+}
+
+int log_postmortem(void (*cb)(const char *line))
+{
+  for (int k = 0; cb && k < s_pmCount; k++)
+    cb(s_pm + k * LOG_RTC_LINE);
+  return s_pmCount;
+}
+
+// ===========================================================
+// [SECTION LOG] Rate limit (producers, before a slot is claimed)
+// ===========================================================
+static LogSite *s_pending[16]; // sites with suppressed records
+static uint8_t s_pendingCount = 0;
+static portMUX_TYPE s_rateMux = portMUX_INITIALIZER_UNLOCKED; // sites + s_pending
+
+static uint32_t args_hash(const uint8_t *args, size_t len)
+{
+  uint32_t h = 2166136261u; // FNV-1a
+  for (size_t i = 0; i < len; i++)
+    h = (h ^ args[i]) * 16777619u;
+  return h ^ (uint32_t)len;
+}
+
+// Under s_rateMux: the site's suppressed count, window reset
+static uint16_t site_take(LogSite &s)
+{
+  const uint16_t n = s.suppressed;
+  s.suppressed = 0;
+  s.burst = 0;
+  return n;
+}
+
+static void pending_remove(uint8_t k)
+{
+  memmove(s_pending + k, s_pending + k + 1, (--s_pendingCount - k) * sizeof(s_pending[0]));
+}
+
+// Summary record: count + the start of the call site's format string,
+// at the site's level (shown / tapped wherever its records would be)
+static const char SUPPRESSED_FMT[] = "[LOG] ↳ %u× suppressed: %s\n";
+
+static void log_suppressed(LogSite &s, uint16_t n)
+{
+  uint32_t pos;
+  LogRec *r = log_claim(pos);
+  if (!r)
+    return;
+  const char *f = s.fmt ? s.fmt : "";
+  char head[49];
+  size_t fl = strcspn(f, "\n");
+  if (fl >= sizeof(head))
+    fl = sizeof(head) - 1;
+  memcpy(head, f, fl);
+  head[fl] = 0;
+  r->ms = millis();
+  r->fmt = SUPPRESSED_FMT;
+  r->site = &s;
+  r->level = s.level;
+  LogEnc e{r->args, r->args + sizeof(r->args)};
+  e.put((unsigned)n);
+  e.put((const char *)head);
+  r->len = (uint8_t)(e.p - r->args);
+  log_commit(pos);
+}
+
+bool log_admit(LogSite &s, uint32_t ms, const uint8_t *args, size_t len)
+{
+  const uint32_t h = args_hash(args, len);
+  LogSite *evicted = nullptr;
+  uint16_t closed = 0, evictedN = 0;
+  portENTER_CRITICAL(&s_rateMux);
+  if (ms - s.windowMs >= LOG_RATE_WINDOW_MS)
+  {
+    if (s.suppressed)
+      for (uint8_t k = 0; k < s_pendingCount; k++)
+        if (s_pending[k] == &s)
+        {
+          pending_remove(k);
+          break;
+        }
+    closed = site_take(s);
+    s.windowMs = ms;
+  }
+  const bool repeat = s.burst && h == s.lastHash && ms - s.lastMs < LOG_RATE_WINDOW_MS;
+  s.lastHash = h;
+  s.lastMs = ms;
+  const bool admit = !repeat && s.burst < LOG_RATE_BURST;
+  if (admit)
+    s.burst++;
+  else if (!s.suppressed++)
+  {
+    if (s_pendingCount == sizeof(s_pending) / sizeof(s_pending[0]))
+    {
+      evicted = s_pending[0];
+      evictedN = site_take(*evicted);
+      pending_remove(0);
+    }
+    s_pending[s_pendingCount++] = &s;
+  }
+  portEXIT_CRITICAL(&s_rateMux);
+
+  if (closed)
+    log_suppressed(s, closed); // ahead of this window's first record
+  if (evictedN)
+    log_suppressed(*evicted, evictedN);
+  return admit;
+}
+
+// logTask: summaries of sites that went quiet after a suppressed record
+static void rate_sweep(uint32_t now)
+{
+  LogSite *due[sizeof(s_pending) / sizeof(s_pending[0])];
+  uint16_t dueN[sizeof(s_pending) / sizeof(s_pending[0])];
+  uint8_t n = 0;
+  portENTER_CRITICAL(&s_rateMux);
+  for (uint8_t k = 0; k < s_pendingCount;)
+  {
+    LogSite &s = *s_pending[k];
+    if (now - s.windowMs < LOG_RATE_WINDOW_MS)
+    {
+      k++;
+      continue;
+    }
+    due[n] = &s;
+    dueN[n++] = site_take(s);
+    pending_remove(k);
+  }
+  portEXIT_CRITICAL(&s_rateMux);
+  for (uint8_t k = 0; k < n; k++)
+    log_suppressed(*due[k], dueN[k]);
+}
+
+// ===========================================================
+// [SECTION LOG] Drain: print
+// ===========================================================
+static uint32_t s_droppedShown = 0;
+
+// live: logTask (serial + tap); otherwise the shutdown handler (RTC only)
+static void out_line(const char *line, size_t n, bool serial, uint8_t tapLevel = 0)
+{
+  if (serial)
+    Serial.write((const uint8_t *)line, n);
+  if (tapLevel)
+    if (LogTap tap = s_tap.load(std::memory_order_acquire))
+      tap(tapLevel, line, n);
+  rtc_store(line, n);
+}
+
+static void log_handle(const LogRec &r, bool live)
+{
+  // Enabled for serial, the tap or both (log_enabled)
+  const uint8_t mod = r.site->module - 1;
+  static char line[256];
+  const size_t n = log_format(r, line, sizeof(line));
+  out_line(line, n, live && r.level <= module_level(mod),
+           live && tap_wants(mod, r.level) ? r.level : 0);
+}
+
+// Everything committed so far; false if another consumer is active
+static bool log_drain(bool live)
+{
+  bool idle = false;
+  if (!s_consumer.compare_exchange_strong(idle, true, std::memory_order_acquire))
+    return false;
+  while (LogRec *r = ring_peek())
+  {
+    log_handle(*r, live);
+    ring_pop();
+  }
+  s_consumer.store(false, std::memory_order_release);
+  return true;
+}
+
+static void log_sweep()
+{
+  rate_sweep(millis());
+
+  const uint32_t d = log_dropped();
+  if (d != s_droppedShown)
+  {
+    char line[80];
+    const int n = snprintf(line, sizeof(line), "[WARN ] [LOG] ⚠️ %lu record(s) dropped (ring full)\n",
+                           (unsigned long)(d - s_droppedShown));
+    out_line(line, n, true, s_tapLevel.load() >= 0 ? 2 : 0);
+    s_droppedShown = d;
+  }
+}
+
+static void logTask(void *)
+{
+  if (s_pmCount)
+  {
+    Serial.printf("[WARN ] [LOG] post-mortem: last %d line(s) before reset (reason %d)\n",
+                  s_pmCount, (int)s_pmReason);
+    for (int k = 0; k < s_pmCount; k++)
+      Serial.printf("  | %s\n", s_pm + k * LOG_RTC_LINE);
+  }
+  watchdog_register_this_task(LOG_DRAIN_MS, LOG_WD_LATENCY_MS, false);
+  for (;;)
+  {
+    log_drain(true);
+    log_sweep();
+    watchdog_feed();
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+  }
+}
+
+// esp_restart(): records still in the ring go to RTC (not printed)
+static void log_shutdown()
+{
+  for (int i = 0; i < 10 && !log_drain(false); i++)
+    delay(1);
+}
+
+// ===========================================================
+// [SECTION LOG] Start (first thing in setup())
+// ===========================================================
+void log_begin()
+{
+#if ARDUINO_USB_CDC_ON_BOOT && ARDUINO_USB_MODE
+  Serial.setTxTimeoutMs(0); // no USB host: drop output instead of waiting
+#endif
+  rtc_take_previous();
+  esp_register_shutdown_handler(log_shutdown);
+  xTaskCreatePinnedToCore(logTask, "logTask", 4096, nullptr, 1, nullptr, 0);
+}
@@ -0,0 +1,337 @@
+#include "diag.h"
+#include "app_settings.h"
+#include "debug_log.h"
+#include "mqtt_if.h"   // qMqttPublish, mqtt_request_diag(), DEVICE_HOST
+#include "tasks_if.h"  // qModbusCmd
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#define DIAG_HEAP_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static DiagSnap s_snap;                 // last sample (under s_mux)
+static DiagPoint s_hist[DIAG_HISTORY];  // ring (under s_mux)
+static uint8_t s_histHead = 0, s_histCount = 0;
+
+// diagTask only
+static DiagSnap s_work;
+static uint8_t s_peakMqtt = 0, s_peakModbus = 0;
+
+// ===========================================================
+// [SECTION DIAG] Sampling
+// ===========================================================
+static void queue_poll(QueueHandle_t q, DiagQueue &out, uint8_t &peak)
+{
+  if (!q)
+    return;
+  const UBaseType_t n = uxQueueMessagesWaiting(q);
+  out.depth = (uint8_t)(n < 255 ? n : 255);
+  out.size = (uint8_t)(n + uxQueueSpacesAvailable(q));
+  if (out.depth > peak)
+    peak = out.depth;
+}
+
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t s_ts[DIAG_MAX_TASKS];
+static struct
+{
+  UBaseType_t num;
+  uint32_t runtime;
+} s_prev[DIAG_MAX_TASKS];
+static uint8_t s_prevCount = 0;
+static uint32_t s_prevTotal = 0;
+
+// Run-time counter of task `num` at the previous sample (0 if new)
+static uint32_t prev_runtime(UBaseType_t num)
+{
+  for (uint8_t k = 0; k < s_prevCount; k++)
+    if (s_prev[k].num == num)
+      return s_prev[k].runtime;
+  return 0;
+}
+
+static void sample_tasks(DiagSnap &s)
+{
+  uint32_t total = 0;
+  const UBaseType_t n = uxTaskGetSystemState(s_ts, DIAG_MAX_TASKS, &total);
+  if (!n)
+  {
+    static bool warned = false;
+    if (!warned)
+      DBG_WARN("[DIAG] ⚠️ more than %d tasks, raise DIAG_MAX_TASKS\n", DIAG_MAX_TASKS);
+    warned = true;
+    s.taskCount = 0;
+    return;
+  }
+
+#if configGENERATE_RUN_TIME_STATS
+  const uint32_t dTotal = total - s_prevTotal;
+  s.cpuValid = s_prevCount && dTotal;
+#else
+  s.cpuValid = false;
+#endif
+  s.taskCount = 0;
+  for (UBaseType_t k = 0; k < n; k++)
+  {
+    const TaskStatus_t &t = s_ts[k];
+    DiagTask &d = s.task[s.taskCount++];
+    snprintf(d.name, sizeof(d.name), "%s", t.pcTaskName);
+    d.prio = (uint8_t)t.uxCurrentPriority;
+#if configTASKLIST_INCLUDE_COREID
+    d.core = (t.xCoreID == 0 || t.xCoreID == 1) ? (int8_t)t.xCoreID : -1;
+#else
+    d.core = -1;
+#endif
+    d.stackFree = t.usStackHighWaterMark; // bytes on ESP-IDF (StackType_t = uint8_t)
+#if configGENERATE_RUN_TIME_STATS
+    const uint64_t dt = t.ulRunTimeCounter - prev_runtime(t.xTaskNumber);
+    d.cpu = s.cpuValid ? (uint16_t)(dt * 1000 / dTotal) : 0;
+#else
+    d.cpu = 0;
+#endif
+  }
+
+  // Stable order for consumers: by name
+  for (uint8_t a = 1; a < s.taskCount; a++)
+    for (uint8_t b = a; b && strcmp(s.task[b - 1].name, s.task[b].name) > 0; b--)
+    {
+      const DiagTask tmp = s.task[b];
+      s.task[b] = s.task[b - 1];
+      s.task[b - 1] = tmp;
+    }
+
+  for (UBaseType_t k = 0; k < n; k++)
+  {
+    s_prev[k].num = s_ts[k].xTaskNumber;
+    s_prev[k].runtime = s_ts[k].ulRunTimeCounter;
+  }
+  s_prevCount = (uint8_t)n;
+  s_prevTotal = total;
+}
+#else
+static void sample_tasks(DiagSnap &s)
+{
+  s.taskCount = 0; // needs configUSE_TRACE_FACILITY
+  s.cpuValid = false;
+}
+#endif
+
+static void sample(uint32_t now, uint32_t lastMs)
+{
+  DiagSnap &s = s_work;
+  s.ms = now;
+  s.intervalMs = now - lastMs;
+  sample_tasks(s);
+  s.qModbus.peak = s_peakModbus;
+  s.qMqtt.peak = s_peakMqtt;
+  s.heapFree = heap_caps_get_free_size(DIAG_HEAP_CAPS);
+  s.heapMin = heap_caps_get_minimum_free_size(DIAG_HEAP_CAPS);
+  s.heapLargest = heap_caps_get_largest_free_block(DIAG_HEAP_CAPS);
+  s.fragPct = s.heapFree ? (uint8_t)(100 - (uint64_t)s.heapLargest * 100 / s.heapFree) : 0;
+
+  const DiagPoint p = {s.heapFree, s.heapLargest, s_peakMqtt, s_peakModbus};
+  portENTER_CRITICAL(&s_mux);
+  s_snap = s;
+  s_hist[(s_histHead + s_histCount) % DIAG_HISTORY] = p;
+  if (s_histCount < DIAG_HISTORY)
+    s_histCount++;
+  else
+    s_histHead = (s_histHead + 1) % DIAG_HISTORY;
+  portEXIT_CRITICAL(&s_mux);
+
+  s_peakModbus = s.qModbus.depth;
+  s_peakMqtt = s.qMqtt.depth;
+}
+
+static void diagTask(void *)
+{
+  watchdog_register_this_task(DIAG_TICK_MS, 1000, false); // tracked only
+  TickType_t last = xTaskGetTickCount();
+  uint32_t sampleMs = millis(), publishMs = millis();
+  for (;;)
+  {
+    queue_poll(qModbusCmd, s_work.qModbus, s_peakModbus);
+    queue_poll(qMqttPublish, s_work.qMqtt, s_peakMqtt);
+
+    const uint32_t now = millis();
+    if (now - sampleMs >= DIAG_SAMPLE_MS)
+    {
+      sample(now, sampleMs);
+      sampleMs = now;
+    }
+    if (DIAG_PUBLISH_MS && now - publishMs >= DIAG_PUBLISH_MS)
+    {
+      mqtt_request_diag();
+      publishMs = now;
+    }
+    watchdog_feed();
+    vTaskDelayUntil(&last, pdMS_TO_TICKS(DIAG_TICK_MS));
+  }
+}
+
+void diag_start_task()
+{
+#if !configGENERATE_RUN_TIME_STATS
+  // Stock arduino-esp32 2.x libraries: no per-task run time counters
+  DBG_WARN("[DIAG] ⚠️ no FreeRTOS run-time stats in this build: cpu_pm not reported\n");
+#endif
+  xTaskCreatePinnedToCore(diagTask, "diagTask", 3072, nullptr, 1, nullptr, 1);
+}
+
+// ===========================================================
+// [SECTION DIAG] JSON (GET /api/diag, MQTT <base>/<device>/diag)
+// ===========================================================
+void diag_cursor_begin(DiagCursor &c, bool history)
+{
+  portENTER_CRITICAL(&s_mux);
+  c.snap = s_snap;
+  c.histCount = history ? s_histCount : 0;
+  for (uint8_t k = 0; k < c.histCount; k++)
+    c.hist[k] = s_hist[(s_histHead + k) % DIAG_HISTORY];
+  portEXIT_CRITICAL(&s_mux);
+  c.wdCount = watchdog_stats(c.wd, WDT_MAX_TASKS);
+  c.phase = 0;
+  c.i = 0;
+}
+
+static void queue_json(JsonStream &w, const char *key, const DiagQueue &q)
+{
+  w.obj(key).kv("depth", (unsigned)q.depth).kv("peak", (unsigned)q.peak).kv("size", (unsigned)q.size).end();
+}
+
+bool diag_json(JsonStream &w, DiagCursor &c)
+{
+  const DiagSnap &s = c.snap;
+  switch (c.phase)
+  {
+  case 0:
+    w.obj()
+        .kv("ms", (unsigned long)s.ms)
+        .kv("interval_ms", (unsigned long)s.intervalMs);
+    w.obj("heap")
+        .kv("free", (unsigned long)s.heapFree)
+        .kv("min", (unsigned long)s.heapMin)
+        .kv("largest", (unsigned long)s.heapLargest)
+        .kv("frag_pct", (unsigned)s.fragPct)
+        .end();
+    w.obj("queues");
+    queue_json(w, "modbus", s.qModbus);
+    queue_json(w, "mqtt", s.qMqtt);
+    w.end().arr("tasks");
+    c.phase = 1;
+    return true;
+  case 1:
+    if (c.i < s.taskCount)
+    {
+      const DiagTask &t = s.task[c.i++];
+      w.obj().kv("name", t.name).kv("prio", (unsigned)t.prio).kv("core", (int)t.core);
+      if (s.cpuValid)
+        w.kv("cpu_pm", (unsigned)t.cpu);
+      w.kv("stack_free", (unsigned long)t.stackFree).end();
+      return true;
+    }
+    w.end().arr("watchdog");
+    c.phase = 2;
+    c.i = 0;
+    return true;
+  case 2:
+    if (c.i < c.wdCount)
+    {
+      const WdStats &d = c.wd[c.i++];
+      w.obj()
+          .kv("name", d.name)
+          .kv("critical", d.critical)
+          .kv("period_ms", (unsigned long)d.periodMs)
+          .kv("limit_ms", (unsigned long)d.limitMs)
+          .kv("age_ms", (unsigned long)d.ageMs)
+          .kv("late", d.late)
+          .kv("checkins", (unsigned long)d.checkins)
+          .kv("mean_ms", (unsigned long)d.meanMs)
+          .kv("max_ms", (unsigned long)d.maxMs)
+          .kv("misses", (unsigned long)d.misses)
+          .kv("worst_ms", (unsigned long)d.worstMs)
+          .end();
+      return true;
+    }
+    w.end();
+    if (!c.histCount)
+    {
+      w.end();
+      return false;
+    }
+    w.obj("history").kv("period_ms", (unsigned long)DIAG_SAMPLE_MS);
+    c.phase = 3;
+    c.i = 0;
+    return true;
+  default:
+  {
+    // One array per piece: heap_free, heap_largest, mqtt_peak, modbus_peak
+    static const char *const KEYS[] = {"heap_free", "heap_largest", "mqtt_peak", "modbus_peak"};
+    w.arr(KEYS[c.i]);
+    for (uint8_t k = 0; k < c.histCount; k++)
+    {
+      const DiagPoint &p = c.hist[k];
+      const unsigned long v = c.i == 0 ? p.heapFree : c.i == 1 ? p.heapLargest
+                            : c.i == 2 ? p.mqttPeak : p.modbusPeak;
+      w.val(v);
+    }
+    w.end();
+    if (++c.i < 4)
+      return true;
+    w.end().end();
+    return false;
+  }
+  }
+}
+
+// Two passes over the same cursor: length, then the bytes
+bool diag_mqtt_publish(MqttClient &mqtt)
+{
+  if (!mqtt.connected())
+    return false;
+  static DiagCursor c; // mqttTask only; too large for its stack budget
+  diag_cursor_begin(c, false);
+  const String topic = String(App::BASE_TOPIC) + "/" + DEVICE_HOST + "/diag";
+
+  char buf[384];
+  size_t total = 0;
+  for (int pass = 0; pass < 2; pass++)
+  {
+    JsonStream w(buf, sizeof(buf));
+    c.phase = c.i = 0;
+    bool more = true;
+    while (more)
+    {
+      more = diag_json(w, c);
+      if (w.overflow())
+      {
+        DBG_ERROR("[DIAG] ❌ piece larger than %u bytes\n", (unsigned)sizeof(buf));
+        if (pass)
+          mqtt.endPublish(); // short stream: the client closes the session
+        return false;
+      }
+      if (pass && mqtt.write((const uint8_t *)w.data(), w.size()) != w.size())
+      {
+        // Socket write failed: the client has closed the session
+        mqtt.endPublish();
+        DBG_ERROR("[PUB FAIL] ❌ %s (write failed)\n", topic.c_str());
+        return false;
+      }
+      w.clear();
+    }
+    if (!pass)
+    {
+      total = w.total();
+      if (!mqtt.beginPublish(topic.c_str(), total, false))
+        return false;
+    }
+  }
+  const bool ok = mqtt.endPublish();
+  if (ok)
+    DBG_INFO("[PUB OK] ✅ %s (%u bytes)\n", topic.c_str(), (unsigned)total);
+  else
+    DBG_ERROR("[PUB FAIL] ❌ %s (%u bytes)\n", topic.c_str(), (unsigned)total);
+  return ok;
+}
@@ -0,0 +1,79 @@
+#include "energy_ctrl.h"
+
+// --------------------------------------------------------------------
+// ✅ NOTE: No Arduino / FreeRTOS includes on purpose – this file is
+// shared with host-side simulations (recorded load curves).
+// --------------------------------------------------------------------
+
+static inline int clampi(int v, int lo, int hi)
+{
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// =====================================================================
+// [SECTION ENERGY CTRL] Reset at run start
+// =====================================================================
+void energy_ctrl_reset(EnergyCtrl &c, int start_cur, uint32_t now_ms)
+{
+  if (c.cur_max < c.cur_min)
+    c.cur_max = c.cur_min;
+  c.integ = 0.0;
+  c.out = clampi(start_cur, c.cur_min, c.cur_max);
+  c.last_ms = now_ms;
+  c.adjustments = 0;
+}
+
+// =====================================================================
+// [SECTION ENERGY CTRL] One controller step
+// =====================================================================
+bool energy_ctrl_update(EnergyCtrl &c, const EnergyCtrlInput &in)
+{
+  uint32_t dt_ms = in.now_ms - c.last_ms;
+  if (dt_ms < ECTRL_PERIOD_MS)
+    return false;
+  c.last_ms = in.now_ms;
+
+  double to_go = in.target_j - in.energy_j;
+  if (to_go <= 0.0)
+    return false; // FSM finishes the run
+
+  double volt = in.volt_mv / 1000.0;
+  if (volt < 0.1)
+    return false; // no usable voltage reading yet
+
+  // --- Feed-forward: current that delivers the rest on time ---
+  double remain_s = 0.0;
+  if (in.runtime_ms > in.elapsed_ms)
+    remain_s = (in.runtime_ms - in.elapsed_ms) / 1000.0;
+  if (remain_s < ECTRL_MIN_HORIZON_S)
+    remain_s = ECTRL_MIN_HORIZON_S;
+  double ff_ma = to_go / remain_s / volt * 1000.0;
+
+  // --- Integral trim: delivered current vs. the feed-forward need ---
+  // (not vs. the setpoint: a DPM that delivers a fixed fraction of the
+  // setpoint would leave a constant error and wind the integral up)
+  double u = ff_ma + c.integ;
+  double err = ff_ma - (double)in.cur_ma; // >0 → DPM falls short
+  bool satHi = u >= c.cur_max && err > 0;
+  bool satLo = u <= c.cur_min && err < 0;
+  if (!satHi && !satLo) // conditional integration (anti-windup)
+  {
+    c.integ += ECTRL_KI * err * (dt_ms / 1000.0);
+    double lim = (double)(c.cur_max - c.cur_min);
+    if (c.integ > lim)
+      c.integ = lim;
+    if (c.integ < -lim)
+      c.integ = -lim;
+    u = ff_ma + c.integ;
+  }
+
+  // --- Bounds, slew limit, deadband ---
+  int target = clampi((int)(u + 0.5), c.cur_min, c.cur_max);
+  int delta = clampi(target - c.out, -ECTRL_MAX_SLEW_MA, ECTRL_MAX_SLEW_MA);
+  if (delta > -ECTRL_DEADBAND_MA && delta < ECTRL_DEADBAND_MA)
+    return false;
+
+  c.out += delta;
+  c.adjustments++;
+  return true;
+}
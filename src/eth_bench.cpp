@@ -0,0 +1,130 @@
+#include "eth_bench.h"
+#include <Ethernet.h>
+#include "w5500_client.h"
+#include "mqtt_if.h"
+#include "debug_log.h"
+
+// ===========================================================
+// [SECTION ETH BENCH] Job (one at a time)
+// ===========================================================
+struct BenchJob
+{
+  char host[64];
+  uint16_t port;
+  uint32_t bytes;
+  bool plain;
+};
+
+static BenchJob s_job;
+static volatile bool s_busy = false;
+static char s_result[96];           // event text, valid until the next run
+static uint8_t s_buf[ETH_BENCH_CHUNK];
+
+static uint32_t kbps(uint32_t bytes, uint32_t us)
+{
+  return us ? (uint32_t)((uint64_t)bytes * 1000000ULL / us / 1024) : 0;
+}
+
+static void bench_post(const char *state)
+{
+  mqtt_publish_event("eth_bench", 0, 0, state, s_result);
+}
+
+// ===========================================================
+// [SECTION ETH BENCH] Task
+// ===========================================================
+static void benchTask(void *)
+{
+  static W5500Client fast;
+  static EthernetClient plain;
+  Client &c = s_job.plain ? static_cast<Client &>(plain) : fast;
+  const char *kind = s_job.plain ? "EthernetClient" : "W5500Client";
+
+  DBG_INFO("[BENCH] 🚀 %s → %s:%u, %lu bytes each way\n",
+           kind, s_job.host, s_job.port, (unsigned long)s_job.bytes);
+
+  if (!c.connect(s_job.host, s_job.port))
+  {
+    snprintf(s_result, sizeof(s_result), "%s: connect to %s:%u failed", kind, s_job.host, s_job.port);
+    DBG_ERROR("[BENCH] ❌ %s\n", s_result);
+    bench_post("FAIL");
+    s_busy = false;
+    vTaskDelete(nullptr);
+  }
+
+  char hdr[32];
+  const int hl = snprintf(hdr, sizeof(hdr), "DPMBENCH %lu\n", (unsigned long)s_job.bytes);
+  c.write((const uint8_t *)hdr, hl);
+
+  // --- TX: device → server ---
+  for (size_t i = 0; i < sizeof(s_buf); i++)
+    s_buf[i] = (uint8_t)i;
+  uint32_t sent = 0;
+  const uint32_t tx0 = micros();
+  while (sent < s_job.bytes && c.connected())
+  {
+    uint32_t n = s_job.bytes - sent;
+    if (n > sizeof(s_buf))
+      n = sizeof(s_buf);
+    const size_t w = c.write(s_buf, n);
+    if (w == 0)
+      break;
+    sent += w;
+  }
+  c.flush(); // until the TX buffer is empty
+  const uint32_t txUs = micros() - tx0;
+
+  // --- RX: server → device ---
+  uint32_t got = 0, rx0 = 0;
+  uint32_t lastData = millis();
+  while (got < s_job.bytes && millis() - lastData < 5000)
+  {
+    const int r = c.read(s_buf, sizeof(s_buf));
+    if (r > 0)
+    {
+      if (!got)
+        rx0 = micros();
+      got += (uint32_t)r;
+      lastData = millis();
+      continue;
+    }
+    if (!c.connected())
+      break;
+    vTaskDelay(1);
+  }
+  const uint32_t rxUs = got ? micros() - rx0 : 0;
+  c.stop();
+
+  const bool ok = sent == s_job.bytes && got == s_job.bytes;
+  snprintf(s_result, sizeof(s_result), "%s tx=%lu kB/s rx=%lu kB/s (%lu/%lu B)",
+           kind, (unsigned long)kbps(sent, txUs), (unsigned long)kbps(got, rxUs),
+           (unsigned long)sent, (unsigned long)got);
+  if (ok)
+    DBG_INFO("[BENCH] ✅ %s\n", s_result);
+  else
+    DBG_WARN("[BENCH] ⚠️ incomplete: %s\n", s_result);
+  bench_post(ok ? "OK" : "FAIL");
+
+  s_busy = false;
+  vTaskDelete(nullptr);
+}
+
+// ===========================================================
+// [SECTION ETH BENCH] Start (command handler)
+// ===========================================================
+bool eth_bench_begin(const char *host, uint16_t port, uint32_t bytes, bool plain)
+{
+  if (s_busy || !host || !*host || strlen(host) >= sizeof(s_job.host) || !port || !bytes)
+    return false;
+  s_busy = true;
+  strcpy(s_job.host, host);
+  s_job.port = port;
+  s_job.bytes = bytes;
+  s_job.plain = plain;
+  if (xTaskCreatePinnedToCore(benchTask, "ethBench", 4096, nullptr, 1, nullptr, 0) != pdPASS)
+  {
+    s_busy = false;
+    return false;
+  }
+  return true;
+}
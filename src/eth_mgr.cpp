@@ -1,47 +1,166 @@
 #include "eth_mgr.h"
 #include <SPI.h>
 #include <Ethernet.h>   // Arduino Ethernet (W5500)
+#include <utility/w5100.h>  // W5100.read/write: interrupt registers
 #include <esp_mac.h>    // esp_read_mac()
-#include "net_client.h"
+#include "w5500_client.h"
 #include "debug_log.h"
 
-static EthernetClient ethClient;
-
 
 // ----- Waveshare ESP32-S3-ETH W5500 pins -----
 static constexpr int PIN_SCK  = 15;
 static constexpr int PIN_MISO = 14;
 static constexpr int PIN_MOSI = 13;
-static constexpr int PIN_CS   = 16;
-static constexpr int PIN_IRQ  = 12;     // not used by Ethernet.h
+static constexpr int PIN_CS   = ETH_PIN_CS;
+static constexpr int PIN_IRQ  = 12;     // INTn, active low (not used by Ethernet.h)
 static constexpr int PIN_RST  = -1;     // set to -1 if not wired
 
 // ----- Internals -----
-static EthernetClient g_eth;
+static W5500Client g_eth;
 static bool g_started = false;
 static bool g_use_static = false;
+static bool g_dhcp = true;
 static IPAddress g_ip, g_gw, g_mask, g_dns;
 static unsigned long g_next_dhcp_try = 0;
 static EthernetLinkStatus g_last_link = Unknown;
+static volatile uint32_t g_ip_cached = 0;   // last known IP (for other tasks)
+static uint32_t g_link_poll_ms = 0;
+
+// ----- W5500 interrupt -----
+// Common registers: SIR (socket flags), SIMR (mask). Socket n registers
+// sit at 0x1000 + n*0x100 in the address space of utility/w5100.h.
+static constexpr uint16_t W5500_SIR    = 0x0017;
+static constexpr uint16_t W5500_SIMR   = 0x0018;
+static constexpr uint16_t W5500_SN_IR  = 0x0002;
+static constexpr uint16_t W5500_SN_IMR = 0x002C;
+static constexpr uint8_t  W5500_SOCKS  = 8;
+// CON | DISCON | RECV. SEND_OK and TIMEOUT stay with the library
+// (its send loops wait for them and clear them itself).
+static constexpr uint8_t  SN_EVENTS    = 0x07;
+
+static constexpr uint16_t sn_reg(uint8_t s, uint16_t reg) { return 0x1000 + s * 0x100 + reg; }
+
+static volatile bool g_irq_armed = false;
+static volatile TaskHandle_t g_irq_task = nullptr;
+static volatile uint32_t g_irq_count = 0;
+static void (*g_sock_cb)(uint8_t) = nullptr;
+
+#ifdef ETH_SPI_STATS
+// Linked with -Wl,--wrap=_ZN8SPIClass16beginTransactionE11SPISettings
+// (env:esp32s3-spistats): counts every transaction on the bus; the W5500
+// is the only SPI device.
+static volatile uint32_t g_spi_tx = 0;
+extern "C" void __real__ZN8SPIClass16beginTransactionE11SPISettings(SPIClass *spi, SPISettings s);
+extern "C" void __wrap__ZN8SPIClass16beginTransactionE11SPISettings(SPIClass *spi, SPISettings s)
+{
+  g_spi_tx++;
+  __real__ZN8SPIClass16beginTransactionE11SPISettings(spi, s);
+}
+
+static void eth_stats_report() {
+  static uint32_t t0 = 0, tx0 = 0, irq0 = 0;
+  const uint32_t now = millis();
+  if (now - t0 < 10000) return;
+  if (t0) {
+    const uint32_t dt = now - t0;
+    DBG_INFO("[ETH] 📊 SPI %lu tx/s, IRQ %lu/s (%s)\n",
+             (unsigned long)((g_spi_tx - tx0) * 1000ULL / dt),
+             (unsigned long)((g_irq_count - irq0) * 1000ULL / dt),
+             g_irq_armed ? "irq" : "polling");
+  }
+  t0 = now;
+  tx0 = g_spi_tx;
+  irq0 = g_irq_count;
+}
+#endif
 
 
 Client& eth_client() { return g_eth; }
 
+static void IRAM_ATTR eth_isr() {
+  g_irq_count++;
+  TaskHandle_t t = g_irq_task;
+  if (!t) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(t, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+// Enable the socket interrupts (again after every Ethernet.begin():
+// the chip reset clears the masks)
+static void eth_irq_arm() {
+#if ETH_IRQ_ENABLE
+  if (Ethernet.hardwareStatus() != EthernetW5500) return; // W5500 register map
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  for (uint8_t s = 0; s < W5500_SOCKS; s++) {
+    W5100.write(sn_reg(s, W5500_SN_IMR), SN_EVENTS);
+    W5100.write(sn_reg(s, W5500_SN_IR), SN_EVENTS);   // drop stale flags
+  }
+  W5100.write(W5500_SIMR, 0xFF);
+  SPI.endTransaction();
+  if (!g_irq_armed) {
+    pinMode(PIN_IRQ, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(PIN_IRQ), eth_isr, FALLING);
+    g_irq_armed = true;
+    DBG_INFO("[ETH] ⚡ W5500 IRQ armed on GPIO%d\n", PIN_IRQ);
+  }
+#endif
+}
+
+// INTn stays low while an enabled flag is set: clear and dispatch until
+// no socket reports an event
+static void eth_irq_service() {
+  for (int pass = 0; pass < 4; pass++) {
+    uint8_t ev = 0;
+    SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+    const uint8_t sir = W5100.read(W5500_SIR);
+    for (uint8_t s = 0; s < W5500_SOCKS; s++) {
+      if (!(sir & (1u << s))) continue;
+      const uint8_t ir = W5100.read(sn_reg(s, W5500_SN_IR)) & SN_EVENTS;
+      if (!ir) continue;
+      W5100.write(sn_reg(s, W5500_SN_IR), ir);        // write 1 to clear
+      ev |= (uint8_t)(1u << s);
+    }
+    SPI.endTransaction();
+    if (!ev) return;
+    if (g_sock_cb) g_sock_cb(ev);
+  }
+}
+
+void eth_on_socket_event(void (*cb)(uint8_t sockets)) { g_sock_cb = cb; }
+
+bool eth_irq_active() { return g_irq_armed; }
+
+void eth_wait_event(uint32_t timeout_ms) {
+  if (!g_irq_armed) {
+    vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+    return;
+  }
+  g_irq_task = xTaskGetCurrentTaskHandle();
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+  // Level check (GPIO, no SPI) also catches an edge lost while clearing
+  if (digitalRead(PIN_IRQ) == LOW) eth_irq_service();
+}
+
 static void dhcp_start_or_static() {
   uint8_t mac[6]; esp_read_mac(mac, ESP_MAC_ETH);
 
-  int ok = Ethernet.begin(mac);          // DHCP
+  int ok = g_dhcp ? Ethernet.begin(mac) : 0;   // DHCP
   if (ok == 0 && g_use_static && g_ip != IPAddress(0,0,0,0)) {
     // static fallback
     IPAddress dns = (g_dns != IPAddress(0,0,0,0)) ? g_dns : g_gw;
     Ethernet.begin(mac, g_ip, dns, g_gw, g_mask);
   }
+  g_ip_cached = (uint32_t)Ethernet.localIP();
+  eth_irq_arm();
 }
 
 bool eth_setup(bool staticFallback,
-               IPAddress ip, IPAddress gw, IPAddress mask, IPAddress dns)
+               IPAddress ip, IPAddress gw, IPAddress mask, IPAddress dns,
+               bool dhcp)
 {
-  g_use_static = staticFallback;
+  g_use_static = staticFallback || !dhcp;
+  g_dhcp = dhcp;
   g_ip   = ip;
   g_gw   = gw;
   g_mask = mask;
@@ -57,18 +176,31 @@ bool eth_setup(bool staticFallback,
   g_started = true;
   g_last_link = Ethernet.linkStatus();
 
-  DBG_INFO("[ETH] IP=");   Serial.println(Ethernet.localIP());
-  DBG_INFO("[ETH] LINK="); Serial.println(g_last_link == LinkON ? "UP" : "DOWN");
+  IPAddress local = Ethernet.localIP();
+  DBG_INFO("[ETH] IP=%u.%u.%u.%u LINK=%s\n", local[0], local[1], local[2], local[3],
+           g_last_link == LinkON ? "UP" : "DOWN");
 
-  return Ethernet.localIP() != IPAddress(0,0,0,0);
-  gNetClient = &ethClient;
+  return local != IPAddress(0,0,0,0);
 }
 
 void eth_loop() {
   if (!g_started) return;
 
-  // Keep DHCP lease fresh
-  Ethernet.maintain();
+#ifdef ETH_SPI_STATS
+  eth_stats_report();
+#endif
+
+  // Keep DHCP lease fresh (SPI only when the lease is renewed)
+  if (Ethernet.maintain() != 0)   // != DHCP_CHECK_NONE
+    g_ip_cached = (uint32_t)Ethernet.localIP();
+
+  // The PHY link has no interrupt (IR/SIR only carry IP conflict,
+  // unreachable, PPPoE and socket events): poll PHYCFGR at
+  // ETH_LINK_POLL_MS. A lost link is seen that much later, well inside
+  // the failover hold time.
+  const uint32_t now_ms = millis();
+  if (now_ms - g_link_poll_ms < ETH_LINK_POLL_MS) return;
+  g_link_poll_ms = now_ms;
 
   // Detect link changes and (re)start DHCP if needed
   EthernetLinkStatus st = Ethernet.linkStatus();
@@ -93,3 +225,12 @@ bool eth_link_up() {
 IPAddress eth_ip() {
   return Ethernet.localIP();
 }
+
+// Cached by eth_loop(): safe from tasks that must not touch the SPI bus
+bool eth_link_cached() {
+  return g_last_link == LinkON;
+}
+
+IPAddress eth_ip_cached() {
+  return IPAddress((uint32_t)g_ip_cached);
+}
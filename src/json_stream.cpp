@@ -0,0 +1,210 @@
+#include "json_stream.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// --------------------------------------------------------------------
+// ✅ NOTE: No Arduino / FreeRTOS includes on purpose – host testable.
+// --------------------------------------------------------------------
+
+// =====================================================================
+// [SECTION JSON STREAM] Low level output
+// =====================================================================
+void JsonStream::put_(char c)
+{
+  if (overflow_ || len_ + 1 > cap_)
+  {
+    overflow_ = true;
+    return;
+  }
+  buf_[len_++] = c;
+  total_++;
+}
+
+void JsonStream::put_(const char *s, size_t n)
+{
+  if (overflow_ || len_ + n > cap_)
+  {
+    overflow_ = true;
+    return;
+  }
+  memcpy(buf_ + len_, s, n);
+  len_ += n;
+  total_ += n;
+}
+
+void JsonStream::sep_()
+{
+  if (afterKey_)
+  {
+    afterKey_ = false;
+    return;
+  }
+  const uint32_t bit = 1u << depth_;
+  if (first_ & bit)
+    first_ &= ~bit;
+  else
+    put_(',');
+}
+
+// =====================================================================
+// [SECTION JSON STREAM] Containers
+// =====================================================================
+void JsonStream::open_(char c, bool isArray)
+{
+  put_(c);
+  if (depth_ + 1 >= JSON_STREAM_DEPTH)
+  {
+    overflow_ = true;
+    return;
+  }
+  depth_++;
+  const uint32_t bit = 1u << depth_;
+  first_ |= bit;
+  if (isArray)
+    isArr_ |= bit;
+  else
+    isArr_ &= ~bit;
+}
+
+JsonStream &JsonStream::obj(const char *key)
+{
+  if (key)
+    key_(key);
+  sep_();
+  open_('{', false);
+  return *this;
+}
+
+JsonStream &JsonStream::arr(const char *key)
+{
+  if (key)
+    key_(key);
+  sep_();
+  open_('[', true);
+  return *this;
+}
+
+JsonStream &JsonStream::end()
+{
+  if (depth_ == 0)
+    return *this;
+  put_((isArr_ & (1u << depth_)) ? ']' : '}');
+  depth_--;
+  return *this;
+}
+
+// =====================================================================
+// [SECTION JSON STREAM] Keys and values
+// =====================================================================
+JsonStream &JsonStream::key_(const char *key)
+{
+  sep_();
+  str_(key);
+  put_(':');
+  afterKey_ = true;
+  return *this;
+}
+
+// Digits right-aligned into t[24]; returns the first digit
+static char *utoa_(unsigned long v, char *end)
+{
+  do
+  {
+    *--end = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  return end;
+}
+
+JsonStream &JsonStream::val(long v)
+{
+  char t[24];
+  char *e = t + sizeof(t);
+  char *p = utoa_(v < 0 ? 0ul - (unsigned long)v : (unsigned long)v, e);
+  if (v < 0)
+    *--p = '-';
+  sep_();
+  put_(p, (size_t)(e - p));
+  return *this;
+}
+
+JsonStream &JsonStream::val(unsigned long v)
+{
+  char t[24];
+  char *e = t + sizeof(t);
+  char *p = utoa_(v, e);
+  sep_();
+  put_(p, (size_t)(e - p));
+  return *this;
+}
+
+JsonStream &JsonStream::val(double v, int decimals)
+{
+  sep_();
+  if (!isfinite(v))
+  {
+    put_("null", 4);
+    return *this;
+  }
+  char t[32];
+  int n = snprintf(t, sizeof(t), "%.*f", decimals, v);
+  put_(t, n > 0 && n < (int)sizeof(t) ? (size_t)n : 0);
+  return *this;
+}
+
+JsonStream &JsonStream::val(bool v)
+{
+  sep_();
+  if (v)
+    put_("true", 4);
+  else
+    put_("false", 5);
+  return *this;
+}
+
+void JsonStream::str_(const char *s)
+{
+  put_('"');
+  for (;;)
+  {
+    // Copy runs that need no escaping in one go
+    const char *run = s;
+    while ((unsigned char)*s >= 0x20 && *s != '"' && *s != '\\')
+      ++s;
+    if (s != run)
+      put_(run, (size_t)(s - run));
+    const unsigned char c = (unsigned char)*s;
+    if (!c)
+      break;
+    if (c == '"' || c == '\\')
+    {
+      put_('\\');
+      put_((char)c);
+    }
+    else
+    {
+      char t[8];
+      put_(t, (size_t)snprintf(t, sizeof(t), "\\u%04x", c));
+    }
+    ++s;
+  }
+  put_('"');
+}
+
+JsonStream &JsonStream::val(const char *s)
+{
+  sep_();
+  if (s)
+    str_(s);
+  else
+    put_("null", 4);
+  return *this;
+}
+
+JsonStream &JsonStream::raw(const char *json, size_t n)
+{
+  sep_();
+  put_(json, n);
+  return *this;
+}
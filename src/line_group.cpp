@@ -0,0 +1,244 @@
+#include "line_group.h"
+#include <ArduinoJson.h>
+#include "app_settings.h"
+#include "config.h"
+#include "mqtt_if.h"
+#include "mqtt_msg_receive.h"
+#include "relay_seq.h"
+#include "debug_log.h"
+#include <freertos/semphr.h>
+
+// One bit per local DPM: a controller drives at most MAX_DPMS (8)
+static_assert(MAX_DPMS <= 8, "line_group_members() returns a uint8_t mask");
+
+#ifndef LINE_LOCK_MS
+#define LINE_LOCK_MS 500 // "set" waits this long for the FSM pass to end
+#endif
+
+static SemaphoreHandle_t s_lock = nullptr;
+
+// ===========================================================
+// [SECTION LINE] Group settings lock (line_set vs. stateTask)
+// ===========================================================
+void line_group_init()
+{
+  if (!s_lock)
+    s_lock = xSemaphoreCreateMutex();
+}
+
+bool line_group_lock(uint32_t timeout_ms)
+{
+  const TickType_t t = timeout_ms == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+  return s_lock && xSemaphoreTake(s_lock, t) == pdTRUE;
+}
+
+void line_group_unlock()
+{
+  xSemaphoreGive(s_lock);
+}
+
+// ===========================================================
+// [SECTION LINE] Membership
+// ===========================================================
+uint8_t line_group_members(int line)
+{
+  uint8_t mask = 0;
+  if (line <= 0)
+    return 0;
+  const int n = (ROWS < MAX_DPMS) ? ROWS : MAX_DPMS;
+  for (int id = 1; id <= n; id++)
+    if (dpms[id].line_id == line)
+      mask |= (uint8_t)(1u << (id - 1));
+  return mask;
+}
+
+// ===========================================================
+// [SECTION LINE] Topic helpers: "<base>/line/<n>/cmd" -> n
+// ===========================================================
+static int parse_line_topic(const char *topic)
+{
+  const size_t bl = strlen(App::BASE_TOPIC);
+  if (strncmp(topic, App::BASE_TOPIC, bl) != 0 || strncmp(topic + bl, "/line/", 6) != 0)
+    return -1;
+  const char *p = topic + bl + 6;
+  char *end = nullptr;
+  long n = strtol(p, &end, 10);
+  if (end == p || strcmp(end, "/cmd") != 0 || n <= 0)
+    return -1;
+  return (int)n;
+}
+
+void line_group_mqtt_subscribe(MqttClient &mqtt, const String &baseTopic)
+{
+  mqtt.subscribe((baseTopic + "/line/+/cmd").c_str(), 1);
+}
+
+// ===========================================================
+// [SECTION LINE] Relay start/stop for all members (interlocked)
+// ===========================================================
+static void line_switch(uint8_t members, bool on)
+{
+  for (uint8_t i = 1; i <= MAX_DPMS; i++)
+    if (members & (1u << (i - 1)))
+      relay_seq_request(i, on); // plans run in parallel
+}
+
+// ===========================================================
+// [SECTION LINE] Group settings: validate all, then apply all
+// ===========================================================
+// Absent → -1 (unchanged); present → an integer in [0, max], else false
+static bool line_field(JsonObjectConst o, const char *key, long max, long &out)
+{
+  JsonVariantConst v = o[key];
+  out = -1;
+  if (v.isNull())
+    return true;
+  if (!v.is<long>())
+    return false;
+  out = v.as<long>();
+  return out >= 0 && out <= max;
+}
+
+static bool line_set(uint8_t members, JsonObjectConst o)
+{
+  long volt, cur, runtime, idle;
+
+  // reject the whole command if any value is out of range or not a number
+  if (!line_field(o, "volt", 20000, volt) || !line_field(o, "cur", 20000, cur) ||  // mV / mA
+      !line_field(o, "idle", 20000, idle) ||
+      !line_field(o, "runtime", UINT32_MAX / 1000, runtime)) // s, runtime × 1000 fits in ms
+    return false;
+
+  // field updates for all members are seen by the FSM as one step
+  if (!line_group_lock(LINE_LOCK_MS))
+  {
+    DBG_WARN("[LINE] ⚠️ state machine busy, set rejected\n");
+    return false;
+  }
+  for (int id = 1; id <= MAX_DPMS; id++)
+  {
+    if (!(members & (1u << (id - 1))))
+      continue;
+    if (volt >= 0) dpms[id].volt_set = volt;
+    if (cur >= 0) dpms[id].cur_set = cur;
+    if (runtime >= 0) dpms[id].runtime = runtime;
+    if (idle >= 0) dpms[id].idle_cur = idle;
+  }
+  line_group_unlock();
+
+  for (int id = 1; id <= MAX_DPMS; id++)
+  {
+    if (!(members & (1u << (id - 1))))
+      continue;
+    if (volt >= 0) dpm_write_voltage((uint8_t)id, (uint16_t)volt);
+    if (cur >= 0) dpm_write_current((uint8_t)id, (uint16_t)cur);
+  }
+  saveConfig();
+  return true;
+}
+
+// ===========================================================
+// [SECTION LINE] MQTT command entry
+// ===========================================================
+bool line_group_mqtt_handle(const char *topic, const byte *payload, unsigned int len)
+{
+  const int line = parse_line_topic(topic);
+  if (line < 0)
+    return false;
+
+  const uint8_t members = line_group_members(line);
+  if (!members)
+    return true; // not ours, other controllers handle it
+
+  StaticJsonDocument<256> doc;
+  if (deserializeJson(doc, payload, len))
+  {
+    DBG_WARN("[LINE] %d: bad JSON\n", line);
+    return true;
+  }
+  JsonObjectConst o = doc.as<JsonObjectConst>();
+  const char *cmd = o["cmd"] | "";
+  const int user = o["user"] | 0;
+  bool ok = true;
+
+  if (!strcmp(cmd, "start"))
+    line_switch(members, true);
+  else if (!strcmp(cmd, "stop"))
+    line_switch(members, false);
+  else if (!strcmp(cmd, "set"))
+    ok = line_set(members, o);
+  else if (!strcmp(cmd, "user") && user > 0)
+  {
+    for (int id = 1; id <= MAX_DPMS; id++)
+      if (members & (1u << (id - 1)))
+        dpms[id].user = user;
+    saveConfig();
+  }
+  else
+    ok = false;
+
+  char text[48];
+  snprintf(text, sizeof(text), "Line %d %s mask=0x%02X", line, cmd, members);
+  mqtt_publish_event("line_cmd", user, 0, ok ? "OK" : "REJECTED", text); // queued: we may be in the MQTT callback
+  mqtt_request_status(true);
+  DBG_INFO("[LINE] %s (%s)\n", text, ok ? "ok" : "rejected");
+  return true;
+}
+
+// ===========================================================
+// [SECTION LINE] Aggregated telemetry per local line
+// ===========================================================
+bool line_group_publish_telemetry(MqttClient &mqtt)
+{
+  if (!mqtt.connected())
+    return false;
+
+  bool ok = true;
+  uint8_t done = 0; // DPMs already accounted for
+  const int n = (ROWS < MAX_DPMS) ? ROWS : MAX_DPMS;
+  for (int id = 1; id <= n; id++)
+  {
+    const int line = dpms[id].line_id;
+    if (line <= 0 || (done & (1u << (id - 1))))
+      continue;
+    const uint8_t members = line_group_members(line);
+    done |= members;
+
+    long cur_ma = 0;
+    double power_w = 0.0, energy_j = 0.0, energy_kwh = 0.0;
+    int running = 0, count = 0;
+    for (int k = 1; k <= n; k++)
+    {
+      if (!(members & (1u << (k - 1))))
+        continue;
+      count++;
+      if (dpms[k].state == DPMState::Status::RUN ||
+          dpms[k].state == DPMState::Status::CHECK_ENERGY)
+        running++;
+      if (dpms[k].valid)
+      {
+        cur_ma += dpms[k].cur_act;
+        power_w += (dpms[k].volt_act / 1000.0) * (dpms[k].cur_act / 1000.0);
+      }
+      energy_j += dpms[k].energy_temp;
+      energy_kwh += dpms[k].energy_total;
+    }
+
+    StaticJsonDocument<256> doc;
+    doc["device"] = DEVICE_HOST;
+    doc["line"] = line;
+    doc["dpms"] = count;
+    doc["running"] = running;
+    doc["cur_ma"] = cur_ma;
+    doc["power_w"] = roundf(power_w * 100) / 100;
+    doc["energy_j"] = roundf(energy_j);
+    doc["energy_kwh"] = energy_kwh;
+
+    char buf[256];
+    size_t len = serializeJson(doc, buf, sizeof(buf));
+    String topic = String(App::BASE_TOPIC) + "/line/" + String(line) + "/" +
+                   DEVICE_HOST + "/telemetry";
+    ok &= mqtt.publish(topic.c_str(), (const uint8_t *)buf, len, false);
+  }
+  return ok;
+}
@@ -0,0 +1,368 @@
+#include "log_remote.h"
+#include "app_settings.h"
+#include "debug_log.h"
+#include "mqtt_if.h"     // DEVICE_HOST
+#include "watchdog.h"    // watchdog_last_stall()
+#include <atomic>
+#include <esp_system.h>  // esp_reset_reason()
+#include <Ethernet.h>    // EthernetUDP
+#include <WiFiUdp.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/message_buffer.h>
+
+#ifndef LOG_SYSLOG_LOCAL_PORT
+#define LOG_SYSLOG_LOCAL_PORT 5140 // source port of the syslog datagrams
+#endif
+
+static LogRemoteCfg s_cfg = {LOG_SINK_OFF, 2, "", LOG_REMOTE_BPS, "", LOG_SYSLOG_PORT};
+
+// logTask → mqttTask: one message per line, level byte + text
+static MessageBufferHandle_t s_mb = nullptr;
+static std::atomic<uint32_t> s_lost{0}; // lines not forwarded (buffer full / send failed)
+static uint32_t s_lostShown = 0;
+static uint32_t s_sent = 0;             // lines forwarded since boot
+
+// Line taken out of the buffer that did not fit the last batch
+static uint8_t s_carry[1 + 256];
+static size_t s_carryLen = 0;
+
+static uint32_t s_tokens = 0; // token bucket (bytes)
+static uint32_t s_refillMs = 0;
+static uint32_t s_batchMs = 0;
+static bool s_bootSent = false;
+
+static EthernetUDP s_udpEth;
+static WiFiUDP s_udpWifi;
+static NetPath s_udpPath = NET_NONE; // path with an open UDP socket
+
+// ===========================================================
+// [SECTION LOG Remote] Tap (logTask): filter is applied by debug_log
+// ===========================================================
+static void remote_tap(uint8_t level, const char *line, size_t n)
+{
+  static uint8_t msg[1 + 256];
+  if (n > sizeof(msg) - 1)
+    n = sizeof(msg) - 1;
+  msg[0] = level;
+  memcpy(msg + 1, line, n);
+  if (!xMessageBufferSend(s_mb, msg, n + 1, 0))
+    s_lost.fetch_add(1, std::memory_order_relaxed);
+}
+
+// ===========================================================
+// [SECTION LOG Remote] Configuration (/cmd/log "remote")
+// ===========================================================
+static const char *sink_name(LogSink s)
+{
+  return s == LOG_SINK_MQTT ? "mqtt" : s == LOG_SINK_SYSLOG ? "syslog" : "off";
+}
+
+// "MQTT, ETH" → module bit mask; "" = all. 0 on an invalid name.
+static uint32_t modules_mask(const char *list)
+{
+  if (!*list)
+    return 0xFFFFFFFFu;
+  uint32_t mask = 0;
+  while (*list)
+  {
+    list += strspn(list, ", ");
+    const size_t n = strcspn(list, ", ");
+    if (!n)
+      break;
+    char name[12];
+    if (n >= sizeof(name))
+      return 0;
+    memcpy(name, list, n);
+    name[n] = 0;
+    const int id = log_module_id(name);
+    if (id < 0)
+      return 0;
+    mask |= 1u << id;
+    list += n;
+  }
+  return mask;
+}
+
+bool log_remote_from_json(JsonObjectConst o)
+{
+  LogRemoteCfg c = s_cfg;
+
+  if (o["sink"].is<const char *>())
+  {
+    const char *s = o["sink"];
+    if (!strcasecmp(s, "mqtt"))
+      c.sink = LOG_SINK_MQTT;
+    else if (!strcasecmp(s, "syslog"))
+      c.sink = LOG_SINK_SYSLOG;
+    else if (!strcasecmp(s, "off"))
+      c.sink = LOG_SINK_OFF;
+    else
+      return false;
+  }
+  if (o["level"].is<int>())
+  {
+    const int l = o["level"];
+    if (l < 1 || l > 3)
+      return false;
+    c.level = (uint8_t)l;
+  }
+  if (o["modules"].is<const char *>())
+  {
+    const char *m = o["modules"];
+    if (strlen(m) >= sizeof(c.modules))
+      return false;
+    strcpy(c.modules, m);
+  }
+  if (o["bps"].is<uint32_t>())
+  {
+    c.bps = o["bps"];
+    if (c.bps < 64)
+      return false;
+  }
+  if (o["host"].is<const char *>())
+  {
+    const char *h = o["host"];
+    IPAddress ip;
+    if (strlen(h) >= sizeof(c.host) || !ip.fromString(h))
+      return false;
+    strcpy(c.host, h);
+  }
+  if (o["port"].is<uint16_t>())
+    c.port = o["port"];
+  if (c.sink == LOG_SINK_SYSLOG && (!c.host[0] || !c.port))
+    return false;
+
+  const uint32_t mask = modules_mask(c.modules);
+  if (!mask)
+    return false;
+
+  if (c.sink != LOG_SINK_OFF && !s_mb && !(s_mb = xMessageBufferCreate(LOG_REMOTE_BUF)))
+    return false;
+
+  s_cfg = c;
+  log_set_tap(c.sink != LOG_SINK_OFF ? remote_tap : nullptr, c.level, mask);
+  s_tokens = c.bps;
+  s_refillMs = millis();
+  DBG_INFO("[LOG] 📡 remote %s level=%u modules=%s bps=%lu\n", sink_name(c.sink), c.level,
+           c.modules[0] ? c.modules : "*", (unsigned long)c.bps);
+  return true;
+}
+
+const LogRemoteCfg &log_remote_cfg() { return s_cfg; }
+
+size_t log_remote_describe(char *buf, size_t len)
+{
+  int n = snprintf(buf, len, "%s level=%u modules=%s bps=%lu sent=%lu lost=%lu",
+                   sink_name(s_cfg.sink), s_cfg.level, s_cfg.modules[0] ? s_cfg.modules : "*",
+                   (unsigned long)s_cfg.bps, (unsigned long)s_sent,
+                   (unsigned long)s_lost.load(std::memory_order_relaxed));
+  if (n > 0 && s_cfg.sink == LOG_SINK_SYSLOG)
+    n += snprintf(buf + n, len - n, " host=%s:%u", s_cfg.host, s_cfg.port);
+  return n < 0 ? 0 : ((size_t)n < len ? n : len - 1);
+}
+
+// ===========================================================
+// [SECTION LOG Remote] Sender (mqttTask)
+// ===========================================================
+// Next line (level byte + text) without taking it; 0 = buffer empty
+static size_t peek_line()
+{
+  if (!s_carryLen)
+    s_carryLen = xMessageBufferReceive(s_mb, s_carry, sizeof(s_carry), 0);
+  return s_carryLen;
+}
+
+static size_t lost_notice(char *buf, size_t len)
+{
+  const uint32_t lost = s_lost.load(std::memory_order_relaxed);
+  if (lost == s_lostShown)
+    return 0;
+  const int n = snprintf(buf, len, "[WARN ] [LOG] ⚠️ %lu line(s) not forwarded\n",
+                         (unsigned long)(lost - s_lostShown));
+  s_lostShown = lost;
+  return n < 0 ? 0 : ((size_t)n < len ? n : len - 1);
+}
+
+static void send_mqtt(MqttClient &mqtt)
+{
+  static char batch[LOG_REMOTE_BATCH];
+  const String topic = String(App::BASE_TOPIC) + "/" + DEVICE_HOST + "/log";
+  const uint32_t budget = s_tokens > topic.length() + 4 ? s_tokens - topic.length() - 4 : 0;
+
+  size_t n = lost_notice(batch, sizeof(batch));
+  uint32_t lines = 0;
+  while (size_t m = peek_line())
+  {
+    const size_t text = m - 1;
+    if (n + text > sizeof(batch) || n + text > budget)
+      break;
+    memcpy(batch + n, s_carry + 1, text);
+    n += text;
+    s_carryLen = 0;
+    lines++;
+  }
+  if (!n)
+    return;
+
+  bool ok = mqtt.beginPublish(topic.c_str(), n, false);
+  if (ok)
+  {
+    mqtt.write((const uint8_t *)batch, n);
+    ok = mqtt.endPublish();
+  }
+  s_tokens -= (n + topic.length() + 4 < s_tokens) ? n + topic.length() + 4 : s_tokens;
+  if (ok)
+    s_sent += lines;
+  else
+    s_lost.fetch_add(lines, std::memory_order_relaxed);
+}
+
+static UDP *syslog_udp(NetPath path)
+{
+  UDP *u = path == NET_WIFI ? static_cast<UDP *>(&s_udpWifi) : &s_udpEth;
+  if (s_udpPath != path)
+  {
+    if (s_udpPath != NET_NONE)
+      (s_udpPath == NET_WIFI ? static_cast<UDP *>(&s_udpWifi) : &s_udpEth)->stop();
+    s_udpPath = u->begin(LOG_SYSLOG_LOCAL_PORT) ? path : NET_NONE;
+  }
+  return s_udpPath == path ? u : nullptr;
+}
+
+static bool syslog_send(UDP &u, IPAddress ip, uint8_t level, const char *text, size_t n)
+{
+  // <PRI>1 TIMESTAMP HOSTNAME APP PROCID MSGID SD MSG, local0
+  static const uint8_t SEV[] = {6, 3, 4, 6};
+  char hdr[64];
+  const int h = snprintf(hdr, sizeof(hdr), "<%u>1 - %s dpm - - - ",
+                         16 * 8 + SEV[level & 3], DEVICE_HOST.c_str());
+  while (n && (text[n - 1] == '\n' || text[n - 1] == '\r'))
+    n--;
+  if (!u.beginPacket(ip, s_cfg.port))
+    return false;
+  u.write((const uint8_t *)hdr, h < (int)sizeof(hdr) ? h : sizeof(hdr) - 1);
+  u.write((const uint8_t *)text, n);
+  return u.endPacket();
+}
+
+static void send_syslog(NetPath path)
+{
+  IPAddress ip;
+  UDP *u = syslog_udp(path);
+  if (!u || !ip.fromString(s_cfg.host))
+    return;
+
+  char notice[64];
+  if (const size_t k = lost_notice(notice, sizeof(notice)))
+    syslog_send(*u, ip, 2, notice, k);
+
+  uint32_t used = 0;
+  while (size_t m = peek_line())
+  {
+    const size_t cost = m - 1 + 32 + DEVICE_HOST.length();
+    if (used + cost > LOG_REMOTE_BATCH || cost > s_tokens)
+      break;
+    if (syslog_send(*u, ip, s_carry[0], (const char *)s_carry + 1, m - 1))
+      s_sent++;
+    else
+      s_lost.fetch_add(1, std::memory_order_relaxed);
+    s_carryLen = 0;
+    used += cost;
+    s_tokens -= cost;
+  }
+}
+
+// ===========================================================
+// [SECTION LOG Remote] Boot report: reset reason + post-mortem lines
+// ===========================================================
+static const char *reset_reason_name(esp_reset_reason_t r)
+{
+  switch (r)
+  {
+  case ESP_RST_POWERON: return "POWERON";
+  case ESP_RST_EXT: return "EXT";
+  case ESP_RST_SW: return "SW";
+  case ESP_RST_PANIC: return "PANIC";
+  case ESP_RST_INT_WDT: return "INT_WDT";
+  case ESP_RST_TASK_WDT: return "TASK_WDT";
+  case ESP_RST_WDT: return "WDT";
+  case ESP_RST_DEEPSLEEP: return "DEEPSLEEP";
+  case ESP_RST_BROWNOUT: return "BROWNOUT";
+  case ESP_RST_SDIO: return "SDIO";
+  default: return "UNKNOWN";
+  }
+}
+
+static JsonArray s_pmLines;
+static void pm_line(const char *line) { s_pmLines.add(line); }
+
+static bool boot_report(MqttClient &mqtt)
+{
+  JsonDocument doc;
+  const esp_reset_reason_t r = esp_reset_reason();
+  doc["reason"] = reset_reason_name(r);
+  doc["code"] = (int)r;
+  doc["fw"] = FW_VERSION_STRING;
+  char task[16];
+  uint32_t stalledMs;
+  if (watchdog_last_stall(task, sizeof(task), &stalledMs))
+  {
+    doc["stall"]["task"] = task;
+    doc["stall"]["ms"] = stalledMs;
+  }
+  s_pmLines = doc["lines"].to<JsonArray>();
+  const int lines = log_postmortem(pm_line);
+
+  // Retained: the last boot stays visible to clients that connect later
+  const String topic = String(App::BASE_TOPIC) + "/" + DEVICE_HOST + "/log/boot";
+  const size_t n = measureJson(doc);
+  bool ok = mqtt.beginPublish(topic.c_str(), n, true);
+  if (ok)
+  {
+    serializeJson(doc, mqtt);
+    ok = mqtt.endPublish();
+  }
+  if (ok)
+    DBG_INFO("[LOG] 📤 boot report: reset %s, %d post-mortem line(s)\n", reset_reason_name(r), lines);
+  return ok;
+}
+
+void log_remote_loop(MqttClient &mqtt, NetPath path, bool idle)
+{
+  if (!idle)
+    return;
+  if (!s_bootSent && mqtt.connected())
+    s_bootSent = boot_report(mqtt);
+  if (!s_mb)
+    return;
+
+  const uint32_t now = millis();
+  const uint32_t cap = s_cfg.bps > LOG_REMOTE_BATCH ? s_cfg.bps : LOG_REMOTE_BATCH;
+  const uint64_t add = (uint64_t)(now - s_refillMs) * s_cfg.bps / 1000;
+  if (add)
+  {
+    s_tokens = (uint32_t)(s_tokens + add < cap ? s_tokens + add : cap);
+    s_refillMs = now;
+  }
+
+  if (s_cfg.sink == LOG_SINK_OFF)
+  {
+    // Switched off: discard what the tap queued before
+    while (peek_line())
+      s_carryLen = 0;
+    if (s_udpPath != NET_NONE)
+    {
+      (s_udpPath == NET_WIFI ? static_cast<UDP *>(&s_udpWifi) : &s_udpEth)->stop();
+      s_udpPath = NET_NONE;
+    }
+    return;
+  }
+  if (now - s_batchMs < LOG_REMOTE_BATCH_MS)
+    return;
+  s_batchMs = now;
+
+  if (s_cfg.sink == LOG_SINK_MQTT && mqtt.connected())
+    send_mqtt(mqtt);
+  else if (s_cfg.sink == LOG_SINK_SYSLOG && path != NET_NONE)
+    send_syslog(path);
+}
@@ -12,6 +12,11 @@
 #include "modbus_if.h"
 #include "tasks_if.h"
 #include "debug_log.h"
+#include "net_cfg.h"
+#include "mqtt_msg_receive.h"
+#include "run_checkpoint.h"
+#include "net_mgr.h"
+#include "run_record.h"
 // RS485 on UART1 (pins from your config)
 #define TXD1 17
 #define RXD1 18
@@ -37,9 +42,13 @@ void task_system_start(void *pv)
 
     loadConfig();
     printConfig();
+    run_record_init();  // /runs.bin lock (stateTask / HTTP / MQTT)
+    checkpoint_load();  // runs saved before an OTA reboot?
+    cmd_init();       // shared MQTT/REST command layer
     http_begin();
     mqtt_init();
-    relay_if_init();  
+    relay_if_init(checkpoint_relay_mask());  // keep the relays as they were
+    checkpoint_restore();
     initStatemachine();
 
     DBG_INFO("[SYS] ✅ System initialization complete\n");
@@ -52,20 +61,24 @@ void setup()
 {
   RS485_SERIAL.begin(9600, SERIAL_8N1, RXD1, TXD1);
   Serial.begin(115200);
+  log_begin();                     // logTask: DBG_* output + post-mortem lines
   delay(150);
-  watchdog_start(3 /*seconds*/);   // e.g. 3s global timeout
-  if (!eth_setup())
+  watchdog_start(WDT_TIMEOUT_S);    // hardware task WDT (watchdog.h, build flag)
+  net_cfg_load();                  // MQTT server + IP settings (Preferences)
+  const NetCfg &nc = net_cfg();
+  if (!eth_setup(nc.ip != 0, IPAddress(nc.ip), IPAddress(nc.gw),
+                 IPAddress(nc.mask), IPAddress(nc.dns), nc.dhcp))
   {
-    DBG_ERROR("[ETH] ❌ DHCP failed (no static fallback)");
+    DBG_ERROR("[ETH] ❌ no IP (DHCP failed / no static address)");
   }
   // Bring up WiFi as AP (or switch to STA if you prefer)
   WiFi.mode(WIFI_AP);
   WiFi.softAP(WIFI_SSID, WIFI_PASS);
   DBG_INFO("[WiFi] ✅ AP IP: %s\n", WiFi.softAPIP().toString().c_str());
+  net_mgr_begin();                 // + WiFi STA as MQTT standby path
 
   Wire.begin(42, 41, 100000);// I2C relay setting
   start_system_tasks(); // start FreeRTOS tasks
-  // wifi_setup();
   init_modbus_async_begin(); 
   // 🔹 Launch the waiting/init task
     xTaskCreatePinnedToCore(
@@ -6,6 +6,8 @@
 #include "statemachine_mgr.h"
 #include "mqtt_if.h"
 #include "debug_log.h"
+#include "run_record.h"
+#include "thermal_mgr.h"
 
 // =====================================================================
 // External globals (declared once in globals.cpp, shared everywhere)
@@ -203,27 +205,10 @@ void readModbus()
 
       // Reset error counter, recover from DEFECT if needed
       dpms[id].error_cnt = 0;
+      run_record_sample(id); // batch statistics (no-op outside a run)
 
-      // --- State checks ---
-      // --- Temperature logic ---
-      if (dpms[id].temp_act >= DPM_TEMP_CRIT)
-      {
-        // Critical → force OFF and mark OVERHEAT
-        dpms[id].state = DPMState::Status::OVERHEAT; // ✅ updated
-      }
-      else if (dpms[id].temp_act >= DPM_TEMP_WARN)
-      {
-        // Warning only
-        dpms[id].state = DPMState::Status::TEMP_HIGH; // ✅ updated
-      }
-      else
-      {
-        // Recover from TEMP_HIGH/OVERHEAT/DEFECT back to RUN
-        if (dpms[id].state == DPMState::Status::TEMP_HIGH) // ✅ updated
-        {
-          dpms[id].state = DPMState::Status::RUN; // ✅ updated
-        }
-      }
+      // --- Temperature: slope tracking, derating, OVERHEAT last resort ---
+      thermal_on_sample(id);
     }
     else
     {
@@ -0,0 +1,698 @@
+#include "mqtt_client.h"
+#include <esp_system.h> // esp_random()
+#include "debug_log.h"
+
+// MQTT 3.1.1 packet types (upper nibble of the fixed header)
+enum : uint8_t
+{
+  PKT_CONNECT = 1,
+  PKT_CONNACK = 2,
+  PKT_PUBLISH = 3,
+  PKT_PUBACK = 4,
+  PKT_SUBSCRIBE = 8,
+  PKT_SUBACK = 9,
+  PKT_PINGREQ = 12,
+  PKT_PINGRESP = 13,
+  PKT_DISCONNECT = 14
+};
+
+enum : uint8_t { RX_HDR, RX_LEN, RX_BODY };
+
+static const char *PHASE_NAMES[] = {"offline", "tcp", "connack", "online"};
+
+// Length-prefixed UTF-8 string; false if it does not fit
+static bool put_str(uint8_t *buf, size_t cap, size_t &n, const char *s)
+{
+  const size_t len = strlen(s);
+  if (len > 0xFFFF || n + 2 + len > cap)
+    return false;
+  buf[n++] = (uint8_t)(len >> 8);
+  buf[n++] = (uint8_t)len;
+  memcpy(buf + n, s, len);
+  n += len;
+  return true;
+}
+
+// =====================================================================
+// [SECTION MQTT Client] Setup
+// =====================================================================
+MqttClient &MqttClient::setServer(const char *host, uint16_t port)
+{
+  host_ = host;
+  port_ = port;
+  return *this;
+}
+
+MqttClient &MqttClient::setCallback(Callback cb)
+{
+  cb_ = cb;
+  return *this;
+}
+
+MqttClient &MqttClient::setKeepAlive(uint16_t seconds)
+{
+  keepAlive_ = seconds;
+  return *this;
+}
+
+bool MqttClient::setBufferSize(uint16_t size)
+{
+  if (rx_)
+    return size == bufSize_; // allocated once, never moved
+  rx_ = (uint8_t *)malloc(size);
+  tx_ = (uint8_t *)malloc(size);
+  pool_ = (uint8_t *)malloc(MQTT_INFLIGHT_MAX * MQTT_INFLIGHT_SLOT);
+  if (!rx_ || !tx_ || !pool_)
+  {
+    free(rx_);
+    free(tx_);
+    free(pool_);
+    rx_ = tx_ = pool_ = nullptr;
+    return false;
+  }
+  bufSize_ = size;
+  return true;
+}
+
+void MqttClient::begin(const char *id, const char *user, const char *pass,
+                       const char *willTopic, uint8_t willQos, bool willRetain,
+                       const char *willMessage)
+{
+  id_ = id;
+  user_ = user;
+  pass_ = pass;
+  willTopic_ = willTopic;
+  willMsg_ = willMessage;
+  willQos_ = willQos;
+  willRetain_ = willRetain;
+  enabled_ = true;
+  retryAt_ = millis();
+}
+
+uint32_t MqttClient::retryInMs() const
+{
+  if (phase_ != OFFLINE || !enabled_)
+    return 0;
+  const int32_t d = (int32_t)(retryAt_ - millis());
+  return d > 0 ? (uint32_t)d : 0;
+}
+
+void MqttClient::reconnectNow()
+{
+  fails_ = 0;
+  retryAt_ = millis();
+}
+
+void MqttClient::setClient(Client &client)
+{
+  if (&client == client_)
+    return;
+  disconnect();
+  client_ = &client;
+}
+
+// =====================================================================
+// [SECTION MQTT Client] Connection state machine
+// =====================================================================
+void MqttClient::loop()
+{
+  if (!task_)
+    task_ = xTaskGetCurrentTaskHandle();
+  const uint32_t now = millis();
+  switch (phase_)
+  {
+  case OFFLINE:
+    if (enabled_ && rx_ && host_ && (int32_t)(now - retryAt_) >= 0)
+      startConnect_();
+    return;
+
+  case TCP_CONNECT: // transient inside startConnect_()
+    return;
+
+  case CONNACK_WAIT:
+    if (!client_->connected())
+    {
+      fail_(RC_CONNECTION_LOST);
+      return;
+    }
+    poll_();
+    if (phase_ == CONNACK_WAIT && now - phaseMs_ > MQTT_CONNACK_TIMEOUT_MS)
+      fail_(RC_CONNECTION_TIMEOUT);
+    return;
+
+  case ONLINE:
+  {
+    if (!client_->connected())
+    {
+      fail_(RC_CONNECTION_LOST);
+      return;
+    }
+    poll_();
+    if (phase_ != ONLINE)
+      return;
+
+    if (inflight_ && !retryInflight_())
+    {
+      fail_(RC_CONNECTION_TIMEOUT); // PUBACKs stopped: half-open link
+      return;
+    }
+
+    const uint32_t t = millis(); // poll_() may have moved lastIn_
+    const uint32_t ka = keepAlive_ * 1000UL;
+    if (ka && (t - lastIn_ > ka || t - lastOut_ > ka))
+    {
+      if (pingOutstanding_)
+      {
+        fail_(RC_CONNECTION_TIMEOUT);
+        return;
+      }
+      const uint8_t ping[2] = {PKT_PINGREQ << 4, 0};
+      write_(ping, sizeof(ping));
+      lastIn_ = t;
+      pingOutstanding_ = true;
+    }
+    return;
+  }
+  }
+}
+
+void MqttClient::startConnect_()
+{
+  phase_ = TCP_CONNECT;
+  phaseMs_ = millis();
+  client_->stop(); // stale socket from the last session
+
+  IPAddress ip;
+  const int ok = ip.fromString(host_) ? client_->connect(ip, port_)
+                                      : client_->connect(host_, port_);
+  if (ok != 1)
+  {
+    fail_(RC_CONNECT_FAILED);
+    return;
+  }
+  rxStage_ = RX_HDR;
+  if (!sendConnect_())
+  {
+    fail_(RC_CONNECTION_LOST);
+    return;
+  }
+  phase_ = CONNACK_WAIT;
+  phaseMs_ = millis();
+}
+
+// Close the socket and schedule the next attempt (backoff with jitter)
+void MqttClient::fail_(int8_t rc)
+{
+  const Phase was = phase_;
+  client_->stop();
+  phase_ = OFFLINE;
+  rc_ = rc;
+  pingOutstanding_ = false;
+  rxStage_ = RX_HDR;
+  streaming_ = false; // a streamed publish in progress is lost
+  streamLeft_ = 0;
+  streamFill_ = 0;
+
+  uint32_t d = (uint32_t)MQTT_BACKOFF_MIN_MS << (fails_ < 16 ? fails_ : 16);
+  if (d > MQTT_BACKOFF_MAX_MS || d < MQTT_BACKOFF_MIN_MS)
+    d = MQTT_BACKOFF_MAX_MS;
+  d = d / 2 + esp_random() % (d / 2 + 1);
+  if (fails_ < 255)
+    fails_++;
+  retryAt_ = millis() + d;
+  DBG_WARN("[MQTT] ⚠️ %s failed (rc=%d), retry #%u in %lu ms\n",
+           PHASE_NAMES[was], rc, fails_, (unsigned long)d);
+}
+
+bool MqttClient::sendConnect_()
+{
+  // Variable header + payload after room for the fixed header (≤ 5 B)
+  uint8_t *p = tx_ + 5;
+  const size_t cap = bufSize_ - 5;
+  static const uint8_t VH[] = {0, 4, 'M', 'Q', 'T', 'T', 4};
+  size_t n = sizeof(VH);
+  memcpy(p, VH, n);
+
+  uint8_t flags = 0x02; // clean session
+  if (willTopic_)
+    flags |= 0x04 | (uint8_t)((willQos_ & 3) << 3) | (willRetain_ ? 0x20 : 0);
+  if (user_)
+    flags |= pass_ ? 0xC0 : 0x80;
+  p[n++] = flags;
+  p[n++] = (uint8_t)(keepAlive_ >> 8);
+  p[n++] = (uint8_t)keepAlive_;
+
+  bool ok = put_str(p, cap, n, id_ ? id_ : "");
+  if (willTopic_)
+    ok = ok && put_str(p, cap, n, willTopic_) && put_str(p, cap, n, willMsg_ ? willMsg_ : "");
+  if (user_)
+    ok = ok && put_str(p, cap, n, user_);
+  if (user_ && pass_)
+    ok = ok && put_str(p, cap, n, pass_);
+  if (!ok)
+    return false;
+
+  uint8_t hdr[5];
+  const size_t hl = header_(hdr, PKT_CONNECT << 4, n);
+  memcpy(p - hl, hdr, hl);
+  return write_(p - hl, hl + n);
+}
+
+void MqttClient::disconnect()
+{
+  if (!owner_("disconnect"))
+    return;
+  if (phase_ == ONLINE)
+  {
+    const uint8_t pkt[2] = {PKT_DISCONNECT << 4, 0};
+    write_(pkt, sizeof(pkt));
+  }
+  client_->stop();
+  phase_ = OFFLINE;
+  rc_ = RC_DISCONNECTED;
+  pingOutstanding_ = false;
+  retryAt_ = millis() + MQTT_BACKOFF_MIN_MS;
+}
+
+// =====================================================================
+// [SECTION MQTT Client] Receive: assemble packets from buffered bytes
+// =====================================================================
+void MqttClient::poll_()
+{
+  int avail = client_->available();
+  while (avail > 0 && phase_ >= CONNACK_WAIT)
+  {
+    if (rxStage_ == RX_HDR)
+    {
+      rxHdr_ = (uint8_t)client_->read();
+      avail--;
+      rxLen_ = 0;
+      rxShift_ = 0;
+      rxGot_ = 0;
+      rxStage_ = RX_LEN;
+      continue;
+    }
+    if (rxStage_ == RX_LEN)
+    {
+      const int b = client_->read();
+      avail--;
+      rxLen_ |= (uint32_t)(b & 0x7F) << rxShift_;
+      rxShift_ += 7;
+      if (b & 0x80)
+      {
+        if (rxShift_ > 21) // more than 4 length bytes: corrupt stream
+          fail_(RC_CONNECTION_LOST);
+        continue;
+      }
+      rxStage_ = RX_BODY;
+      if (rxLen_)
+        continue;
+    }
+    else
+    {
+      // Body: into rx_ while it fits, the rest of an oversize packet is dropped
+      size_t want = rxLen_ - rxGot_;
+      if (want > (size_t)avail)
+        want = (size_t)avail;
+      int r;
+      if (rxGot_ < bufSize_)
+      {
+        if (want > bufSize_ - rxGot_)
+          want = bufSize_ - rxGot_;
+        r = client_->read(rx_ + rxGot_, want);
+      }
+      else
+      {
+        uint8_t junk[64];
+        r = client_->read(junk, want < sizeof(junk) ? want : sizeof(junk));
+      }
+      if (r <= 0)
+        return;
+      rxGot_ += (uint32_t)r;
+      avail -= r;
+      if (rxGot_ < rxLen_)
+        continue;
+    }
+
+    // Packet complete
+    rxStage_ = RX_HDR;
+    lastIn_ = millis();
+    if (rxLen_ <= bufSize_)
+      handlePacket_();
+    else
+      DBG_WARN("[MQTT] ⚠️ dropped %lu B packet (buffer %u B)\n",
+               (unsigned long)rxLen_, bufSize_);
+  }
+}
+
+void MqttClient::handlePacket_()
+{
+  switch (rxHdr_ >> 4)
+  {
+  case PKT_CONNACK:
+    if (phase_ != CONNACK_WAIT || rxLen_ < 2)
+      return;
+    if (rx_[1] != 0)
+    {
+      fail_((int8_t)rx_[1]); // refused (auth, id, ...): back off as well
+      return;
+    }
+    DBG_INFO("[MQTT] ✅ CONNACK after %lu ms\n", (unsigned long)(millis() - phaseMs_));
+    phase_ = ONLINE;
+    rc_ = RC_CONNECTED;
+    fails_ = 0;
+    lastIn_ = lastOut_ = millis();
+    pingOutstanding_ = false;
+    resendAll_();
+    return;
+
+  case PKT_PUBLISH:
+  {
+    if (phase_ != ONLINE || rxLen_ < 2)
+      return;
+    const uint8_t qos = (rxHdr_ >> 1) & 3;
+    const uint16_t tl = (uint16_t)((rx_[0] << 8) | rx_[1]);
+    const size_t off = 2 + tl + (qos ? 2 : 0);
+    if (off > rxLen_ || tl >= bufSize_)
+      return;
+    const uint16_t id = qos ? (uint16_t)((rx_[2 + tl] << 8) | rx_[3 + tl]) : 0;
+
+    // Topic one slot down to make room for the terminator
+    memmove(rx_, rx_ + 2, tl);
+    rx_[tl] = 0;
+    if (cb_)
+      cb_((char *)rx_, rx_ + off, rxLen_ - off);
+
+    if (qos && phase_ == ONLINE) // we subscribe with QoS ≤ 1
+    {
+      const uint8_t ack[4] = {PKT_PUBACK << 4, 2, (uint8_t)(id >> 8), (uint8_t)id};
+      write_(ack, sizeof(ack));
+    }
+    return;
+  }
+
+  case PKT_PUBACK:
+    if (rxLen_ >= 2)
+      puback_((uint16_t)((rx_[0] << 8) | rx_[1]));
+    return;
+
+  case PKT_PINGRESP:
+    pingOutstanding_ = false;
+    return;
+
+  default: // SUBACK: nothing waits for it
+    return;
+  }
+}
+
+// =====================================================================
+// [SECTION MQTT Client] Send
+// =====================================================================
+size_t MqttClient::header_(uint8_t *dst, uint8_t type, uint32_t remaining)
+{
+  size_t n = 0;
+  dst[n++] = type;
+  do
+  {
+    uint8_t b = remaining & 0x7F;
+    remaining >>= 7;
+    dst[n++] = remaining ? (uint8_t)(b | 0x80) : b;
+  } while (remaining);
+  return n;
+}
+
+bool MqttClient::owner_(const char *what) const
+{
+  if (!task_ || task_ == xTaskGetCurrentTaskHandle())
+    return true;
+  DBG_ERROR("[MQTT] ❌ %s from %s refused (mqttTask only)\n", what, pcTaskGetName(nullptr));
+  return false;
+}
+
+// A short write leaves a partial packet on the wire: the broker would
+// read the next packet as its rest, so the session is closed at once
+// (CONNECT failures are handled by the caller)
+bool MqttClient::write_(const uint8_t *p, size_t n)
+{
+  const size_t w = client_->write(p, n);
+  lastOut_ = millis();
+  if (w == n)
+    return true;
+  if (phase_ == ONLINE)
+  {
+    DBG_WARN("[MQTT] ⚠️ socket took %u of %u B\n", (unsigned)w, (unsigned)n);
+    fail_(RC_CONNECTION_LOST);
+  }
+  return false;
+}
+
+// Never an id still waiting for its PUBACK
+uint16_t MqttClient::nextId_()
+{
+  for (;;)
+  {
+    if (++packetId_ == 0)
+      packetId_ = 1;
+    bool used = false;
+    for (const Inflight &f : slots_)
+      used |= f.id == packetId_;
+    if (!used)
+      return packetId_;
+  }
+}
+
+bool MqttClient::publish(const char *topic, const uint8_t *payload, unsigned int length,
+                         bool retained, uint8_t qos)
+{
+  if (!connected() || streaming_ || !owner_("publish")) // tx_ holds a streamed packet
+    return false;
+  const size_t tl = strlen(topic);
+
+  if (qos)
+  {
+    // Never downgraded to QoS0: the caller asked for delivery
+    const uint32_t rem = 2 + tl + 2 + length;
+    uint8_t hdr[5];
+    const size_t hl = header_(hdr, (PKT_PUBLISH << 4) | 0x02 | (retained ? 1 : 0), rem);
+    if (!pool_ || hl + rem > MQTT_INFLIGHT_SLOT)
+    {
+      DBG_ERROR("[MQTT] ❌ %s: %u B does not fit a %u B QoS1 slot, not sent\n",
+                topic, length, pool_ ? (unsigned)MQTT_INFLIGHT_SLOT : 0u);
+      return false;
+    }
+    Inflight *f = nullptr;
+    for (Inflight &s : slots_)
+      if (!s.id)
+      {
+        f = &s;
+        break;
+      }
+    if (!f)
+      return false; // window full
+
+    uint8_t *p = slotBuf_(*f);
+    size_t n = hl;
+    memcpy(p, hdr, hl);
+    p[n++] = (uint8_t)(tl >> 8);
+    p[n++] = (uint8_t)tl;
+    memcpy(p + n, topic, tl);
+    n += tl;
+    f->id = nextId_();
+    p[n++] = (uint8_t)(f->id >> 8);
+    p[n++] = (uint8_t)f->id;
+    memcpy(p + n, payload, length);
+    f->len = (uint16_t)(n + length);
+    f->tries = 0;
+    f->seq = ++seq_;
+    inflight_++;
+    send_(*f); // a failed write is repaired by the resend after reconnect
+    return true;
+  }
+
+  const uint32_t rem = 2 + tl + length;
+  uint8_t hdr[5];
+  const size_t hl = header_(hdr, (PKT_PUBLISH << 4) | (retained ? 1 : 0), rem);
+  if (hl + 2 + tl > bufSize_)
+    return false;
+
+  size_t n = hl;
+  memcpy(tx_, hdr, hl);
+  tx_[n++] = (uint8_t)(tl >> 8);
+  tx_[n++] = (uint8_t)tl;
+  memcpy(tx_ + n, topic, tl);
+  n += tl;
+
+  // One socket write (one TCP segment) when the whole packet fits
+  if (n + length <= bufSize_)
+  {
+    memcpy(tx_ + n, payload, length);
+    return write_(tx_, n + length);
+  }
+  return write_(tx_, n) && write_(payload, length);
+}
+
+bool MqttClient::publish(const char *topic, const char *payload, bool retained)
+{
+  return publish(topic, (const uint8_t *)payload, strlen(payload), retained);
+}
+
+// =====================================================================
+// [SECTION MQTT Client] Streamed publish (QoS0)
+// =====================================================================
+bool MqttClient::beginPublish(const char *topic, size_t length, bool retained)
+{
+  if (!connected() || streaming_ || !owner_("beginPublish"))
+    return false;
+  const size_t tl = strlen(topic);
+  const uint32_t rem = 2 + tl + length;
+  if (rem > 268435455UL) // 4-byte remaining length
+    return false;
+  uint8_t hdr[5];
+  const size_t hl = header_(hdr, (PKT_PUBLISH << 4) | (retained ? 1 : 0), rem);
+  if (hl + 2 + tl > bufSize_)
+    return false;
+
+  size_t n = hl;
+  memcpy(tx_, hdr, hl);
+  tx_[n++] = (uint8_t)(tl >> 8);
+  tx_[n++] = (uint8_t)tl;
+  memcpy(tx_ + n, topic, tl);
+  streamFill_ = (uint16_t)(n + tl);
+  streamLeft_ = length;
+  streaming_ = true;
+  return true;
+}
+
+size_t MqttClient::write(uint8_t b)
+{
+  return write(&b, 1);
+}
+
+size_t MqttClient::write(const uint8_t *buf, size_t size)
+{
+  if (!streaming_)
+    return 0;
+  if (size > streamLeft_)
+    size = streamLeft_; // never more than announced in the header
+  size_t done = 0;
+  while (done < size)
+  {
+    if (streamFill_ == bufSize_)
+    {
+      if (!write_(tx_, streamFill_))
+        return done; // session closed (fail_), endPublish() reports it
+      streamFill_ = 0;
+    }
+    size_t k = size - done;
+    if (k > (size_t)(bufSize_ - streamFill_))
+      k = bufSize_ - streamFill_;
+    memcpy(tx_ + streamFill_, buf + done, k);
+    streamFill_ += k;
+    done += k;
+  }
+  streamLeft_ -= done;
+  return done;
+}
+
+bool MqttClient::endPublish()
+{
+  if (!streaming_)
+    return false; // never started, or the session failed mid-stream
+  streaming_ = false;
+  const bool ok = !streamFill_ || write_(tx_, streamFill_);
+  streamFill_ = 0;
+  if (!ok)
+    return false; // session closed by write_()
+  if (streamLeft_)
+  {
+    // The broker still waits for the rest of the packet: unusable stream
+    DBG_WARN("[MQTT] ⚠️ streamed publish %lu B short\n", (unsigned long)streamLeft_);
+    streamLeft_ = 0;
+    fail_(RC_CONNECTION_LOST);
+    return false;
+  }
+  return true;
+}
+
+bool MqttClient::subscribe(const char *topic, uint8_t qos)
+{
+  if (!connected() || !owner_("subscribe"))
+    return false;
+  uint8_t *p = tx_ + 5;
+  const size_t cap = bufSize_ - 5;
+  const uint16_t id = nextId_();
+  size_t n = 0;
+  p[n++] = (uint8_t)(id >> 8);
+  p[n++] = (uint8_t)id;
+  if (!put_str(p, cap - 1, n, topic))
+    return false;
+  p[n++] = qos > 1 ? 1 : qos;
+
+  uint8_t hdr[5];
+  const size_t hl = header_(hdr, (PKT_SUBSCRIBE << 4) | 0x02, n);
+  memcpy(p - hl, hdr, hl);
+  return write_(p - hl, hl + n);
+}
+
+// =====================================================================
+// [SECTION MQTT Client] QoS1 in-flight window
+// =====================================================================
+void MqttClient::send_(Inflight &f)
+{
+  uint8_t *p = slotBuf_(f);
+  if (p[0] & 0x08)
+    resent_++;
+  write_(p, f.len);
+  p[0] |= 0x08; // any later send is a duplicate
+  f.tries++;
+  f.sentMs = millis();
+}
+
+// New session: everything not acknowledged goes out again in publish order
+void MqttClient::resendAll_()
+{
+  if (!inflight_)
+    return;
+  DBG_INFO("[MQTT] 🔁 resending %u unacknowledged QoS1 publish(es)\n", inflight_);
+  uint32_t last = 0;
+  for (uint8_t k = 0; k < inflight_; k++)
+  {
+    Inflight *next = nullptr;
+    for (Inflight &f : slots_)
+      if (f.id && f.seq > last && (!next || f.seq < next->seq))
+        next = &f;
+    if (!next)
+      break;
+    last = next->seq;
+    next->tries = 0;
+    send_(*next);
+  }
+}
+
+bool MqttClient::retryInflight_()
+{
+  const uint32_t now = millis();
+  for (Inflight &f : slots_)
+  {
+    if (!f.id || now - f.sentMs < MQTT_QOS1_RETRY_MS)
+      continue;
+    if (f.tries >= MQTT_QOS1_MAX_TRIES)
+    {
+      DBG_WARN("[MQTT] ⚠️ no PUBACK for id %u after %u sends\n", f.id, f.tries);
+      return false;
+    }
+    send_(f);
+  }
+  return true;
+}
+
+void MqttClient::puback_(uint16_t id)
+{
+  for (Inflight &f : slots_)
+    if (f.id == id)
+    {
+      f.id = 0;
+      inflight_--;
+      return;
+    }
+}
@@ -6,15 +6,24 @@
 #include <esp_system.h> // esp_fill_random()
 #include <Arduino.h>    // millis(), String
 #include <Ethernet.h>   // W5500 via Arduino Ethernet lib
-#include <PubSubClient.h>
+#include <WiFi.h>       // WiFi STA standby path
+#include "mqtt_client.h"
 #include <Preferences.h> // NVS for UUID
 #include <cstdio>
 #include "watchdog.h"
 #include "update_mgr.h"
 #include "net_client.h"
 #include "relay_if.h"
+#include "net_cfg.h"
+#include "net_mgr.h"
+#include "eth_mgr.h"
+#include "w5500_client.h"
 #include "mqtt_msg_receive.h"
+#include "line_group.h"
 #include "debug_log.h"
+#include "log_remote.h"
+#include "diag.h"
+#include "run_record.h"
 
 // -------------------------------------------------------------------
 // Global network client instance
@@ -24,8 +33,11 @@ QueueHandle_t qMqttPublish = nullptr; // actual definition
 // -------------------------------------------------------------------
 // MQTT transport + client
 // -------------------------------------------------------------------
-static EthernetClient eth_net; // underlying transport
-PubSubClient mqtt(eth_net);    // PubSubClient on top of Ethernet
+static W5500Client eth_net;    // underlying transport (primary, burst SPI)
+static WiFiClient wifi_net;    // standby transport (net_mgr failover)
+MqttClient mqtt(eth_net);      // MQTT client, follows net_path()
+static NetPath g_mqttPath = NET_ETH;
+static volatile bool s_netWake = false; // MSG_NET queued, not yet taken
 
 // -------------------------------------------------------------------
 // MQTT topics (set in mqtt_init())
@@ -45,6 +57,12 @@ String DEVICE_HOST;           // namespace for topics
 static uint32_t g_mqttConnectedMs = 0;
 static bool g_bootBurstPending = false;
 static uint8_t g_pubFailCount = 0;
+static bool g_online = false; // mqtt.connected() at the last mqttTask pass
+
+// Offline store: events / OTA reports queued while the broker is away
+static MqttMsg s_store[MQTT_STORE_EVENTS];
+static uint8_t s_storeHead = 0, s_storeCount = 0;
+static uint32_t s_storeDropped = 0;
 
 // -------------------------------------------------------------------
 // Helper: check if topic == "<ns>/<DEVICE_HOST>/settings"
@@ -113,26 +131,36 @@ String get_device_host()
     return "DPM" + mac_hex12();
 }
 // -------------------------------------------------------------------
-// Connectivity check
+// Transport: move the session to the path net_mgr selected
 // -------------------------------------------------------------------
-static inline bool eth_connected()
+static void mqtt_follow_path(NetPath p)
 {
-    return Ethernet.linkStatus() == LinkON &&
-           Ethernet.localIP() != IPAddress(0, 0, 0, 0);
+    if (p == NET_NONE || p == g_mqttPath)
+        return;
+    DBG_INFO("[MQTT] 🔀 transport %s → %s\n", net_path_name(g_mqttPath), net_path_name(p));
+    g_mqttPath = p;
+    gNetClient = (p == NET_WIFI) ? static_cast<Client *>(&wifi_net) : &eth_net;
+    mqtt.setClient(*gNetClient); // closes the old session
+    mqtt.reconnectNow();
 }
 bool mqtt_connected() { return mqtt.connected(); }
 
 // -------------------------------------------------------------------
-// Generic JSON publisher (used for status/config/event)
+// Generic JSON publisher (used for status/config), streamed from the
+// serializer into the socket: no payload copy, no size limit
 // -------------------------------------------------------------------
 static inline bool publishJson(const String &topic, JsonDocument &doc, bool retained)
 {
     if (!mqtt.connected())
         return false;
 
-    char buf[1024];
-    size_t n = serializeJson(doc, buf, sizeof(buf));
-    bool ok = mqtt.publish(topic.c_str(), (const uint8_t *)buf, n, retained);
+    const size_t n = measureJson(doc);
+    bool ok = mqtt.beginPublish(topic.c_str(), n, retained);
+    if (ok)
+    {
+        serializeJson(doc, mqtt);
+        ok = mqtt.endPublish();
+    }
 
     if (ok)
         DBG_INFO("[PUB OK] ✅ %s (%u bytes)\n", topic.c_str(), (unsigned)n);
@@ -197,7 +225,7 @@ bool mqtt_publish_status(bool retained)
         arr.add(dpms[id].temp_act);
         arr.add(dpms[id].remain_time);
         arr.add(dpms[id].volt_set);
-        arr.add(dpms[id].cur_set);
+        arr.add(dpm_live_cur_set(id));
         arr.add(dpms[id].idle_cur);
         arr.add(dpms[id].last_ms);
         arr.add(dpms[id].runtime);
@@ -213,62 +241,68 @@ bool mqtt_publish_status(bool retained)
 // [SECTION MQTT Publish] Influx line protocol publisher
 // ===========================================================
 
+// One line per running DPM, formatted twice (length, then streamed) from
+// a snapshot so both passes see the same values
+struct InfluxRow
+{
+    int id, volt, curr, temp, user;
+    double energy_total, energy_anode, energy_temp;
+};
+
+static size_t influx_line(char *buf, size_t cap, const InfluxRow &r)
+{
+    const int n = snprintf(buf, cap,
+                           "dpm,device=%s,dpm=%d volt=%d,curr=%d,temp=%d,"
+                           "energy_total=%.2f,energy_anode=%.2f,energy_temp=%.2f,user=%d\n",
+                           DEVICE_HOST.c_str(), r.id, r.volt, r.curr, r.temp,
+                           r.energy_total, r.energy_anode, r.energy_temp, r.user);
+    return n < (int)cap ? (size_t)n : cap - 1; // both passes truncate alike
+}
+
 bool mqtt_publish_influx()
 {
 
     if (!mqtt_connected())
         return false;
 
-    static String payload;
-    payload.reserve(1024);
-    payload.remove(0); // clear string, keep capacity
-
-    for (int id = 1; id <= ROWS; id++)
+    InfluxRow rows[MAX_DPMS];
+    int count = 0;
+    for (int id = 1; id <= ROWS && count < MAX_DPMS; id++)
     {
         if (dpms[id].valid && dpms[id].state == DPMState::Status::RUN && dpms[id].cur_act > 0)
         { // ✅ updated
-
-            // Build one line of Influx line protocol
-            payload += F("dpm,device=");
-            payload += DEVICE_HOST;
-            payload += F(",dpm=");
-            payload += id;
-            payload += F(" volt=");
-            payload += dpms[id].volt_act;
-            payload += F(",curr=");
-            payload += dpms[id].cur_act;
-            payload += F(",temp=");
-            payload += dpms[id].temp_act;
-            payload += ",energy_total=";
-            payload += dpms[id].energy_total;
-            payload += ",energy_anode=";
-            payload += dpms[id].energy_anode;
-            payload += ",energy_temp=";
-            payload += dpms[id].energy_temp;
-            payload += ",user=";
-            payload += dpms[id].user;
-            payload += '\n'; // newline terminator
+            rows[count++] = {id, dpms[id].volt_act, dpms[id].cur_act, dpms[id].temp_act,
+                             dpms[id].user, dpms[id].energy_total, dpms[id].energy_anode,
+                             dpms[id].energy_temp};
         }
     }
 
-    if (payload.isEmpty())
+    if (!count)
         return false;
 
+    char line[192];
+    size_t len = 0;
+    for (int i = 0; i < count; i++)
+        len += influx_line(line, sizeof(line), rows[i]);
+
     String topic = String(App::BASE_TOPIC) + "/" + DEVICE_HOST + "/influx";
-    bool ok = mqtt.publish(topic.c_str(), payload.c_str(), false);
+    bool ok = mqtt.beginPublish(topic.c_str(), len, false);
+    for (int i = 0; ok && i < count; i++)
+        mqtt.write((const uint8_t *)line, influx_line(line, sizeof(line), rows[i]));
+    ok = ok && mqtt.endPublish();
 
     if (ok)
-        DBG_INFO("[PUB OK] ✅ %s (%u bytes)\n", topic.c_str(), payload.length());
+        DBG_INFO("[PUB OK] ✅ %s (%u bytes)\n", topic.c_str(), (unsigned)len);
     else
-        DBG_WARN("[PUB FAIL] ❌ %s (%u bytes)\n", topic.c_str(), payload.length());
+        DBG_WARN("[PUB FAIL] ❌ %s (%u bytes)\n", topic.c_str(), (unsigned)len);
     return ok;
 }
 
 // ===========================================================
-// [SECTION MQTT Publish] Event line protocol publisher
+// [SECTION MQTT Publish] Event line protocol publisher (mqttTask)
 // ===========================================================
-bool mqtt_publish_event(const char *type, int user, int dpm,
-                        const char *state, const char *message)
+bool mqtt_send_event(const char *type, int user, int dpm,
+                     const char *state, const char *message)
 {
     if (!mqtt_connected())
         return false;
@@ -307,7 +341,7 @@ bool mqtt_publish_event(const char *type, int user, int dpm,
     char buf[512];
     size_t n = serializeJson(doc, buf, sizeof(buf));
 
-    bool ok = mqtt.publish(topic.c_str(), (const uint8_t *)buf, n, false);
+    bool ok = mqtt.publish(topic.c_str(), (const uint8_t *)buf, n, false, MQTT_QOS_EVENT);
 
     if (ok)
         DBG_INFO("[MQTT_Send_Event] ✅ %s | Line=%s | DPM=%d | State=%s\n",
@@ -319,6 +353,56 @@ bool mqtt_publish_event(const char *type, int user, int dpm,
     return ok;
 }
 
+// ===========================================================
+// [SECTION MQTT Publish] Run record publisher (one message per batch)
+// ===========================================================
+// The record is read back from the history ring, so a queued or stored
+// MSG_RUN only carries its sequence number. true = done with it (sent,
+// or gone from the ring); false = retry later.
+static bool mqtt_send_run(uint32_t seq)
+{
+    if (!mqtt_connected())
+        return false;
+
+    RunRecord r;
+    if (!run_record_history_find(seq, r))
+    {
+        DBG_WARN("[MQTT] ⚠️ run #%lu no longer in history, not published\n", (unsigned long)seq);
+        return true;
+    }
+    char json[512];
+    const size_t len = run_record_to_json(r, json, sizeof(json));
+    if (!len)
+    {
+        DBG_ERROR("[MQTT] ❌ run #%lu: JSON larger than %u B\n", (unsigned long)seq, (unsigned)sizeof(json));
+        return true;
+    }
+
+    String topic = String(App::BASE_TOPIC) + "/" + DEVICE_HOST + "/run";
+    bool ok = mqtt.publish(topic.c_str(), (const uint8_t *)json, len, false, MQTT_QOS_RUN);
+
+    if (ok)
+        DBG_INFO("[PUB OK] ✅ %s (%u bytes)\n", topic.c_str(), (unsigned)len);
+    else
+        DBG_ERROR("[PUB FAIL] ❌ %s (%u bytes)\n", topic.c_str(), (unsigned)len);
+    return ok;
+}
+
+// ===========================================================
+// [SECTION MQTT Publish] Parameter change line (influx topic)
+// ===========================================================
+static bool mqtt_send_param(const MqttMsg &msg)
+{
+    if (!mqtt_connected())
+        return false;
+    char line[192];
+    const int n = snprintf(line, sizeof(line), "event,device=%s,dpm=%d,type=param_change,%s\n",
+                           DEVICE_HOST.c_str(), msg.id, msg.message);
+    const String topic = String(App::BASE_TOPIC) + "/" + DEVICE_HOST + "/influx";
+    return mqtt.publish(topic.c_str(), (const uint8_t *)line,
+                        n < (int)sizeof(line) ? n : sizeof(line) - 1, false);
+}
+
 // ===========================================================
 // [SECTION MQTT]  Disconnect Handler
 // ============================================================
@@ -332,93 +416,138 @@ void mqtt_disconnect()
     }
 }
 // ===========================================================
-// [SECTION MQTT] Subscribe and Connect Handler
+// [SECTION MQTT] Connect Handler
 // ===========================================================
-void mqtt_try_connect_with_backoff(bool /*immediate*/)
+// The connection itself is driven by mqtt.loop() (see mqtt_client.h);
+// this only cuts the backoff wait short, e.g. when the link came up.
+void mqtt_try_connect_with_backoff(bool immediate)
 {
-    static uint32_t lastAttempt = 0;
-    uint32_t now = millis();
+    if (immediate && !mqtt.connected())
+        mqtt.reconnectNow();
+}
 
-    // --- Throttle retry interval ---
-    if (now - lastAttempt < 3000)
-        return;
-    lastAttempt = now;
+// ===========================================================
+// [SECTION MQTT Subscribe] Topics + birth (on every new session)
+// ===========================================================
+static void mqtt_on_connected()
+{
+    DBG_INFO("[MQTT] ✅ Connected to %s:%u as '%s' via %s\n",
+             net_cfg().mqtt_host, net_cfg().mqtt_port, MQTT_CLIENT_ID.c_str(),
+             net_path_name(g_mqttPath));
 
-    // --- Skip if already connected ---
-    if (mqtt.connected())
-        return;
+    const String base = String(App::BASE_TOPIC);
+
+    // 1) Subscribe to relay controls (per-channel + batch)
+    relay_if_mqtt_subscribe(mqtt, base, DEVICE_HOST);
+    line_group_mqtt_subscribe(mqtt, base);
+
+    bool ok = true;
+    ok &= mqtt.subscribe((base + "/" + DEVICE_HOST + "/cmd/#").c_str(), 1);
+    ok &= mqtt.subscribe((base + "/" + DEVICE_HOST + "/settings").c_str(), 1);
+    DBG_INFO("[MQTT] subs %s\n", ok ? "OK" : "FAIL");
+
+    // 2) Publish LWT 'online' (birth) retained message
+    mqtt.publish(T_LWT.c_str(), (const uint8_t *)"online", 6, true);
+
+    // 3) Current relay states (retained, all channels + bitmask)
+    relay_if_mqtt_publish_states(mqtt, true);
 
-    // --- Ensure network ready ---
-    if (!eth_connected())
+    // 4) Announce firmware/version as an event (non-retained)
+    mqtt_send_event("firmware_version", 0, 0, "Boot", FW_VERSION_STRING);
+
+    // 5) Path switch: report how long MQTT was away
+    NetPath from = NET_NONE;
+    const uint32_t dt = net_mgr_session_up(g_mqttPath, &from);
+    if (dt)
     {
-        static bool firstMsg = true;
-        if (firstMsg)
-        {
-            DBG_WARN("[MQTT] 💤 Waiting for network connection...\n");
-            firstMsg = false;
-        }
-        return;
+        char msg[48];
+        snprintf(msg, sizeof(msg), "%s->%s in %lu ms",
+                 net_path_name(from), net_path_name(g_mqttPath), (unsigned long)dt);
+        mqtt_send_event("net_failover", 0, 0, net_path_name(g_mqttPath), msg);
     }
 
-    // --- Ensure client ID is valid (avoid rc=-2 on startup) ---
-    if (MQTT_CLIENT_ID.isEmpty() || DEVICE_HOST.isEmpty())
+    g_mqttConnectedMs = millis();
+    g_bootBurstPending = true;
+    g_pubFailCount = 0;
+}
+
+// ===========================================================
+// [SECTION MQTT] W5500 socket events (ethTask) → wake mqttTask
+// ===========================================================
+static void mqtt_socket_event(uint8_t sockets)
+{
+    const uint8_t sn = eth_net.getSocketNumber();
+    if (sn >= 8 || !(sockets & (1u << sn)) || s_netWake)
+        return;
+    s_netWake = true;
+    MqttMsg msg = {MSG_NET, false};
+    if (xQueueSend(qMqttPublish, &msg, 0) != pdTRUE)
+        s_netWake = false; // queue busy: mqttTask is awake anyway
+}
+
+// How long mqttTask may sleep on the queue. With the W5500 interrupt a
+// received packet wakes it (MSG_NET), so it only polls for the backoff
+// and keepalive timers; on WiFi / without IRQ it polls as before.
+static TickType_t mqtt_wait_ticks(bool online)
+{
+    uint32_t ms = online ? 20 : 200;
+    if (g_mqttPath == NET_ETH && eth_irq_active() && !g_bootBurstPending && !s_storeCount)
     {
-        static bool firstMsg = true;
-        if (firstMsg)
+        ms = MQTT_IRQ_IDLE_MS;
+        if (mqtt.phase() == MqttClient::OFFLINE)
         {
-            DBG_WARN("[MQTT] 💤 Skipping connect — client ID/host not yet set\n");
-            firstMsg = false;
+            const uint32_t r = mqtt.retryInMs();
+            if (r < ms)
+                ms = r ? r : 1;
         }
-        return;
     }
+    return pdMS_TO_TICKS(ms);
+}
 
-    DBG_INFO("[MQTT] 🔄 Connecting to %s:%u as '%s'...\n",
-             App::MQTT_HOST, App::MQTT_PORT, MQTT_CLIENT_ID.c_str());
-
-    mqtt.setKeepAlive(60);
-    mqtt.setSocketTimeout(12);
-
-    bool ok = mqtt.connect(
-        MQTT_CLIENT_ID.c_str(),
-        App::MQTT_USER, App::MQTT_PASS,
-        T_LWT.c_str(), 1, true, "offline");
+// ===========================================================
+// [SECTION MQTT] Offline store
+// ===========================================================
+// Status / config / relay states are republished by the reconnect
+// burst and influx / line telemetry is a snapshot, so only events, OTA
+// reports and run records are worth keeping while the broker is away.
+static bool store_keeps(MqttMsgType t)
+{
+    return t == MSG_EVENT || t == MSG_OTA || t == MSG_RUN;
+}
 
-    if (ok)
-    {
-        DBG_INFO("[MQTT] ✅ Connected.\n");
-
-        // ===========================================================
-        // [SECTION MQTT Subscribe] Topics
-        // ===========================================================
-       
-        const String base = String(App::BASE_TOPIC);
-
-        // 1) Subscribe to relay controls (per-channel + batch)
-        relay_if_mqtt_subscribe(mqtt, base, DEVICE_HOST);
-
-        bool ok = true;
-        ok &= mqtt.subscribe((base + "/" + DEVICE_HOST + "/cmd/#").c_str(), 1);
-        ok &= mqtt.subscribe((base + "/" + DEVICE_HOST + "/settings").c_str(), 1); 
-        DBG_INFO("[MQTT] subs %s\n", ok ? "OK" : "FAIL");
-        
-        // 2) Publish LWT 'online' (birth) retained message
-        mqtt.publish(T_LWT.c_str(), (const uint8_t *)"online", 6, true);        
-
-        // 3) Announce firmware/version as an event (non-retained)
-        mqtt_publish_event("firmware_version", 0, 0, "Boot", FW_VERSION_STRING);
-        
-        g_mqttConnectedMs = now;
-        g_bootBurstPending = true;
-    }
-    else
+static void store_push(const MqttMsg &msg)
+{
+    if (s_storeCount == MQTT_STORE_EVENTS)
     {
-        // only print first failure or every 5th try to avoid log spam
-        static uint8_t failCount = 0;
-        failCount++;
-        if (failCount == 1 || (failCount % 5 == 0))
-            DBG_WARN("[MQTT] ⚠️ Connect failed (rc=%d), will retry...\n", mqtt.state());
+        s_storeHead = (s_storeHead + 1) % MQTT_STORE_EVENTS; // drop oldest
+        s_storeCount--;
+        s_storeDropped++;
     }
+    s_store[(s_storeHead + s_storeCount) % MQTT_STORE_EVENTS] = msg;
+    s_storeCount++;
+}
+
+// ===========================================================
+// [SECTION MQTT] Topics + will from the alias (init, alias change)
+// ===========================================================
+static void mqtt_set_identity()
+{
+    DEVICE_HOST = get_device_host(); // "TEST_DPM";
+    const String dev = DEVICE_HOST;
+    T_CMD = String(App::BASE_TOPIC) + "/" + dev + "/cmd";
+    T_CONF = String(App::BASE_TOPIC) + "/" + dev + "/config";
+    T_STAT = String(App::BASE_TOPIC) + "/" + dev + "/status";
+    T_EVENT = String(App::BASE_TOPIC) + "/" + dev + "/event";
+    T_LWT = String(App::BASE_TOPIC) + "/" + dev + "/lwt";
+
+    // Client ID / LWT are set from here on: mqttTask may connect. The
+    // client keeps the pointers, so this runs again after T_LWT changed.
+    mqtt.begin(MQTT_CLIENT_ID.c_str(),
+               net_cfg().mqtt_user[0] ? net_cfg().mqtt_user : nullptr,
+               net_cfg().mqtt_pass[0] ? net_cfg().mqtt_pass : nullptr,
+               T_LWT.c_str(), 1, true, "offline");
 }
+
 // ===========================================================
 // [SECTION MQTT] MQTT Init (called once in setup())
 // ===========================================================
@@ -426,78 +555,128 @@ void mqtt_try_connect_with_backoff(bool /*immediate*/)
 void mqtt_init()
 {
 
-    mqtt.setBufferSize(1024);
-    mqtt.setServer(App::MQTT_HOST, App::MQTT_PORT);
+    mqtt.setBufferSize(1024); // incoming packets; outgoing telemetry is streamed
+    mqtt.setServer(net_cfg().mqtt_host, net_cfg().mqtt_port); // Preferences, default app_settings.h
     mqtt.setCallback(onMqttMessage);
     mqtt.setKeepAlive(60);
-    mqtt.setSocketTimeout(12);
+    eth_net.setConnectionTimeout(MQTT_TCP_CONNECT_MS); // bounds the SYN phase
+    wifi_net.setTimeout((MQTT_TCP_CONNECT_MS + 999) / 1000); // seconds
+    gNetClient = &eth_net;
+    eth_on_socket_event(mqtt_socket_event);
 
     String mac = mac_hex12();
-    DEVICE_HOST = get_device_host(); // "TEST_DPM";
     HOSTNAME = "esp-" + mac;
     MQTT_CLIENT_ID = "dpm-" + mac.substring(0, 12);
-
-    const String dev = DEVICE_HOST;
-    T_CMD = String(App::BASE_TOPIC) + "/" + dev + "/cmd";
-    T_CONF = String(App::BASE_TOPIC) + "/" + dev + "/config";
-    T_STAT = String(App::BASE_TOPIC) + "/" + dev + "/status";
-    T_EVENT = String(App::BASE_TOPIC) + "/" + dev + "/event";
-    T_LWT = String(App::BASE_TOPIC) + "/" + dev + "/lwt";
+    mqtt_set_identity();
     DBG_INFO("[ID] ✅ HOST=%s CID=%s\n", HOSTNAME.c_str(), MQTT_CLIENT_ID.c_str());
 }
+
+// ===========================================================
+// [SECTION MQTT] Device alias changed (MSG_RECONNECT, mqttTask)
+// ===========================================================
+static void mqtt_apply_alias()
+{
+    if (mqtt.connected())
+    {
+        mqtt.publish(T_LWT.c_str(), (const uint8_t *)"offline", 7, true); // old namespace
+        mqtt.disconnect();
+    }
+    mqtt_set_identity(); // new topics + will, then connect at once
+    mqtt.reconnectNow();
+    DBG_INFO("[MQTT] Topic changed to: %s\n", DEVICE_HOST.c_str());
+}
 // ==================================================================================
 // [SECTION MQTT Publish] Centralized MQTT task (only this task calls mqtt.publish())
 // ==================================================================================
+static bool mqtt_publish_msg(const MqttMsg &msg)
+{
+    switch (msg.type)
+    {
+    case MSG_STATUS:
+        return mqtt_publish_status(msg.retained);
+    case MSG_INFLUX:
+        return mqtt_publish_influx();
+    case MSG_CONFIG:
+        return mqtt_publish_config();
+    case MSG_LINE:
+        return line_group_publish_telemetry(mqtt);
+    case MSG_RELAY:
+        relay_if_mqtt_publish_states(mqtt);
+        return true;
+    case MSG_OTA:
+        return update_mgr_mqtt_publish(msg.eventType, msg.value);
+    case MSG_NET: // wake-up only: mqtt.loop() runs on the next pass
+        return true;
+    case MSG_DIAG:
+        return diag_mqtt_publish(mqtt);
+    case MSG_RUN:
+        return mqtt_send_run((uint32_t)msg.value);
+    case MSG_PARAM:
+        return mqtt_send_param(msg);
+    case MSG_RECONNECT: // handled in mqttTask before the online check
+        return true;
+    case MSG_EVENT:
+        return mqtt_send_event(
+            msg.eventType[0] ? msg.eventType : "unknown",
+            msg.user,     // numeric user id
+            msg.id,       // DPM number
+            msg.state,    // optional state
+            msg.message); // optional message/description
+    }
+    return false;
+}
+
 static void mqttTask(void *)
 {
+    // Idle wait up to MQTT_IRQ_IDLE_MS; the TCP connect is bounded by
+    // MQTT_TCP_CONNECT_MS, but a write into a full socket (W5500 TX
+    // buffer, lwIP on WiFi) can hold one pass for several seconds
+    watchdog_register_this_task(MQTT_IRQ_IDLE_MS, 15000);
     for (;;)
     {
         watchdog_feed();
 
-        if (!eth_connected())
-        {
-            vTaskDelay(pdMS_TO_TICKS(200));
-            continue;
-        }
-        if (!mqtt.connected())
-        {
-            mqtt_try_connect_with_backoff(false);
-            vTaskDelay(pdMS_TO_TICKS(200));
-            continue;
-        }
-
-        mqtt.loop();
-
+        // Connect / receive / keepalive: returns without waiting
+        const NetPath path = net_path();
+        mqtt_follow_path(path);
+        if (path != NET_NONE)
+            mqtt.loop();
+        else if (mqtt.connected())
+            mqtt.disconnect();
+
+        const bool online = mqtt.connected();
+        if (online && !g_online)
+            mqtt_on_connected();
+        else if (!online && g_online)
+            DBG_WARN("[MQTT] ⚠️ Connection lost (rc=%d), reconnecting in background\n", mqtt.state());
+        g_online = online;
+
+        // The queue is drained in every state, so producers never block
         MqttMsg msg;
-        if (xQueueReceive(qMqttPublish, &msg, pdMS_TO_TICKS(20)) == pdTRUE)
+        if (xQueueReceive(qMqttPublish, &msg, mqtt_wait_ticks(online)) == pdTRUE)
         {
-            bool ok = false;
-            switch (msg.type)
+            if (msg.type == MSG_NET)
+            {
+                s_netWake = false;
+            }
+            else if (msg.type == MSG_RECONNECT)
             {
-            case MSG_STATUS:
-                ok = mqtt_publish_status(msg.retained);
-                break;
-            case MSG_INFLUX:
-                ok = mqtt_publish_influx();
-                break;
-            case MSG_CONFIG:
-                ok = mqtt_publish_config();
-                break;
-            case MSG_EVENT:
-                const char *eventType = msg.eventType ? msg.eventType : "unknown";
-                const char *stateStr = msg.state ? msg.state : "";    // optional state
-                const char *msgText = msg.message ? msg.message : ""; // optional message/description
-
-                ok = mqtt_publish_event(
-                    eventType,
-                    msg.user, // numeric user id
-                    msg.id,   // DPM number
-                    stateStr,
-                    msgText);
-                break;
+                mqtt_apply_alias();
             }
-            if (!ok)
+            else if (!online)
             {
+                if (store_keeps(msg.type))
+                    store_push(msg);
+            }
+            else if (!mqtt_publish_msg(msg))
+            {
+                // QoS1 window full (broker slow to PUBACK): not a link
+                // failure, the client reconnects itself if PUBACKs stop
+                if (store_keeps(msg.type) && mqtt.inflightFull())
+                {
+                    store_push(msg);
+                    continue;
+                }
                 g_pubFailCount++;
                 if (g_pubFailCount > 5)
                 {
@@ -512,17 +691,38 @@ static void mqttTask(void *)
             }
         }
 
+        // Remote log batches only when no telemetry is waiting
+        log_remote_loop(mqtt, path, !uxQueueMessagesWaiting(qMqttPublish) &&
+                                        (!online || (!g_bootBurstPending && !s_storeCount)));
+
+        if (!mqtt.connected())
+            continue;
+
         if (g_bootBurstPending && (millis() - g_mqttConnectedMs) > 800)
         {
             mqtt_publish_config();
             mqtt_publish_status(true);
-            mqtt_publish_event(
+            mqtt_send_event(
                 "connect",                          // type
                 1,                                  // user (system or initial user)
                 1,                                  // DPM number (1 = DPM1)
                 "OK",                               // state: "OK", "CONNECTED", or "ONLINE"
                 "Device connected to MQTT broker"); // message
             g_bootBurstPending = false;
+            if (s_storeDropped)
+            {
+                DBG_WARN("[MQTT] ⚠️ %lu event(s) dropped while offline\n", (unsigned long)s_storeDropped);
+                s_storeDropped = 0;
+            }
+        }
+        else if (!g_bootBurstPending && s_storeCount)
+        {
+            // One stored message per pass; kept for the next session on failure
+            if (mqtt_publish_msg(s_store[s_storeHead]))
+            {
+                s_storeHead = (s_storeHead + 1) % MQTT_STORE_EVENTS;
+                s_storeCount--;
+            }
         }
     }
 }
@@ -530,32 +730,71 @@ static void mqttTask(void *)
 // -------------------------------------------------------------------
 // [SECTION MQTT] Public API for other tasks (enqueue publish requests)
 // -------------------------------------------------------------------
-void mqtt_request_status(bool retained)
+static void mqtt_request(const MqttMsg &msg, const char *what)
 {
-    MqttMsg msg = {MSG_STATUS, retained, nullptr, 0, 0};
+    if (!qMqttPublish)
+        return;
     if (xQueueSend(qMqttPublish, &msg, 0) != pdTRUE)
-        DBG_WARN("[MQTT] queue full, dropped STATUS\n");
+        DBG_WARN("[MQTT] queue full, dropped %s\n", what);
 }
 
+void mqtt_request_status(bool retained)
+{
+    mqtt_request({MSG_STATUS, retained}, "STATUS");
+}
 void mqtt_request_influx()
 {
-    MqttMsg msg = {MSG_INFLUX, false, nullptr, 0, 0};
-    if (xQueueSend(qMqttPublish, &msg, 0) != pdTRUE)
-        DBG_WARN("[MQTT] queue full, dropped INFLUX\n");
+    mqtt_request({MSG_INFLUX, false}, "INFLUX");
 }
 void mqtt_request_config()
 {
-    MqttMsg msg = {MSG_CONFIG, true, nullptr, 0, 0};
-    if (xQueueSend(qMqttPublish, &msg, 0) != pdTRUE)
-        DBG_WARN("[MQTT] queue full, dropped CONFIG\n");
+    mqtt_request({MSG_CONFIG, true}, "CONFIG");
+}
+void mqtt_request_line()
+{
+    mqtt_request({MSG_LINE, false}, "LINE");
+}
+void mqtt_request_diag()
+{
+    mqtt_request({MSG_DIAG, false}, "DIAG");
+}
+void mqtt_request_relay()
+{
+    mqtt_request({MSG_RELAY, true}, "RELAY");
+}
+void mqtt_request_run(uint32_t seq)
+{
+    MqttMsg msg = {MSG_RUN, false};
+    msg.value = (int)seq;
+    mqtt_request(msg, "RUN");
+}
+void mqtt_request_param(int dpm, const char *fields)
+{
+    MqttMsg msg = {MSG_PARAM, false};
+    msg.id = dpm;
+    snprintf(msg.message, sizeof(msg.message), "%s", fields);
+    mqtt_request(msg, "PARAM");
+}
+void mqtt_request_reconnect()
+{
+    mqtt_request({MSG_RECONNECT, false}, "RECONNECT");
 }
-void mqtt_request_event(const char *type, int user, int id)
+
+bool mqtt_publish_event(const char *type, int user, int dpm,
+                        const char *state, const char *message)
 {
-    MqttMsg msg = {MSG_EVENT, false, type, user, id};
+    if (!qMqttPublish)
+        return false;
+    MqttMsg msg = {MSG_EVENT, false, user, dpm};
+    snprintf(msg.eventType, sizeof(msg.eventType), "%s", type ? type : "");
+    snprintf(msg.state, sizeof(msg.state), "%s", state ? state : "");
+    snprintf(msg.message, sizeof(msg.message), "%s", message ? message : "");
     if (xQueueSend(qMqttPublish, &msg, 0) != pdTRUE)
     {
-        DBG_WARN("[MQTT] queue full, dropped EVENT\n");
+        DBG_WARN("[MQTT] queue full, dropped EVENT %s\n", msg.eventType);
+        return false;
     }
+    return true;
 }
 // -------------------------------------------------------------------
 // [SECTION MQTT] Start the MQTT task (call from start_system_tasks())
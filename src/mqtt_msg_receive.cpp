@@ -6,6 +6,12 @@
 #include "watchdog.h"
 #include "mqtt_if.h"
 #include "debug_log.h"
+#include "log_remote.h"
+#include "run_record.h"
+#include "line_group.h"
+#include "net_cfg.h"
+#include "relay_seq.h"
+#include "eth_bench.h"
 
 // -------------------------------------------------------------------
 // External functions defined in other modules
@@ -61,21 +67,27 @@ static inline String trim_trailing_slash(String s)
 // ===========================================================
 // HANDLER DECLARATIONS
 // ===========================================================
-static bool handle_user(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc);
-static bool handle_reset(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc);
-static bool handle_curve(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc);
-static bool handle_mode(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc);
-static bool handle_line(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc);
-static bool handle_topic(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc);
-static bool handle_settings(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc);
-static bool handle_ota(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc);
+static bool handle_user(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_reset(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_curve(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_mode(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_line(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_topic(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_settings(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_ota(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_thermal(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_net(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_relay(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_ethbench(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_log(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
+static bool handle_diag(const char *topic, byte *payload, unsigned int length, JsonDocument &doc);
 // ===========================================================
 // [SECTION MQTT Receive] Message Topic Dispatcher
 // ===========================================================
 struct TopicHandler
 {
     const char *key;
-    bool (*fn)(const char *, byte *, unsigned int, DynamicJsonDocument &);
+    bool (*fn)(const char *, byte *, unsigned int, JsonDocument &);
 };
 
 static TopicHandler handlers[] = {
@@ -87,6 +99,12 @@ static TopicHandler handlers[] = {
     {"/cmd/Set_Topic", handle_topic},
     {"/cmd/settings", handle_settings},
     {"/cmd/ota", handle_ota},
+    {"/cmd/thermal", handle_thermal},
+    {"/cmd/net", handle_net},
+    {"/cmd/relay", handle_relay},
+    {"/cmd/ethbench", handle_ethbench},
+    {"/cmd/log", handle_log},
+    {"/cmd/diag", handle_diag},
 };
 void dpms_apply_transitions(uint8_t beforeMask, uint8_t afterMask)
 {
@@ -107,49 +125,137 @@ void dpms_apply_transitions(uint8_t beforeMask, uint8_t afterMask)
         }
         else
         {
+            run_record_end(id, RUN_END_ABORTED);        // close open batch, if any
             dpms[id].state = DPMState::Status::DPM_OFF; // ✅ change to off state
             DBG_INFO("[DPM] Relay %d OFF → state=DPM_OFF\n", id);
         }
     }
 }
 // ===========================================================
-// [SECTION MQTT Receive] MAIN MQTT MESSAGE switch Relay
+// [SECTION CMD] Fixed arena for the command JSON document
+// Bump allocator over a static buffer, reset after every command, so
+// neither MQTT nor REST commands allocate heap for the parsed body.
 // ===========================================================
-void onMqttMessage(char *topic, byte *payload, unsigned int length)
+class CmdArena : public ArduinoJson::Allocator
 {
-    uint8_t before = relay_if_read_mask();
-
-    // --- 1️⃣ Relay control ---
-    if (relay_if_mqtt_handle(mqtt, String(App::BASE_TOPIC), DEVICE_HOST,
-                             topic, payload, length))
+public:
+    void *allocate(size_t size) override
     {
-        uint8_t after = relay_if_read_mask();
-        dpms_apply_transitions(before, after);
-        mqtt_publish_status(true);
-        return;
+        size = (size + sizeof(size_t) + 7) & ~(size_t)7;
+        if (used_ + size > sizeof(buf_))
+            return nullptr; // ArduinoJson reports NoMemory
+        size_t *hdr = reinterpret_cast<size_t *>(buf_ + used_);
+        *hdr = size - sizeof(size_t);
+        last_ = used_;
+        used_ += size;
+        return hdr + 1;
     }
+    void deallocate(void *) override {} // freed all at once by reset()
+    void *reallocate(void *ptr, size_t size) override
+    {
+        if (!ptr)
+            return allocate(size);
+        size_t *hdr = reinterpret_cast<size_t *>(ptr) - 1;
+        if (size <= *hdr)
+            return ptr;
+        // last block grows in place, others are copied
+        if (reinterpret_cast<uint8_t *>(hdr) == buf_ + last_)
+        {
+            size_t need = (size + sizeof(size_t) + 7) & ~(size_t)7;
+            if (last_ + need > sizeof(buf_))
+                return nullptr;
+            used_ = last_ + need;
+            *hdr = need - sizeof(size_t);
+            return ptr;
+        }
+        void *p = allocate(size);
+        if (p)
+            memcpy(p, ptr, *hdr);
+        return p;
+    }
+    void reset() { used_ = last_ = 0; }
+    size_t peak() const { return used_; }
+
+private:
+    alignas(8) uint8_t buf_[CMD_ARENA_SIZE];
+    size_t used_ = 0;
+    size_t last_ = 0;
+};
 
-    // --- 2️⃣ Try to parse JSON ---
-    DynamicJsonDocument doc(512);
-    deserializeJson(doc, payload, length); // tolerant parse
+static CmdArena s_arena;
+static SemaphoreHandle_t s_cmdMutex = nullptr;
 
-    
-  // --- 3️⃣ Dispatch ---
+void cmd_init()
+{
+    if (!s_cmdMutex)
+        s_cmdMutex = xSemaphoreCreateMutex();
+}
+
+// ===========================================================
+// [SECTION CMD] Transport-agnostic command entry
+// topic = MQTT topic, or the pseudo-topic built by the REST API
+// ===========================================================
+bool cmd_known(const char *topic)
+{
     for (auto &h : handlers)
-    {
         if (strstr(topic, h.key))
+            return true;
+    return false;
+}
+
+bool cmd_dispatch(const char *topic, const byte *payload, unsigned int length)
+{
+    if (!s_cmdMutex || xSemaphoreTake(s_cmdMutex, pdMS_TO_TICKS(CMD_LOCK_MS)) != pdTRUE)
+    {
+        DBG_WARN("[CMD] busy, dropped %s\n", topic);
+        return false;
+    }
+    bool handled = false;
+    byte *p = const_cast<byte *>(payload);
+
+    // --- 1️⃣ Relay control (sequenced: FSM transitions follow on confirm) ---
+    if (relay_if_mqtt_handle(mqtt, String(App::BASE_TOPIC), DEVICE_HOST,
+                             const_cast<char *>(topic), p, length))
+        handled = true;
+
+    // --- 1b Line-group command (shared by all controllers of a line) ---
+    else if (line_group_mqtt_handle(topic, payload, length))
+        handled = true;
+
+    else
+    {
+        // --- 2️⃣ Try to parse JSON (arena, tolerant parse) ---
+        JsonDocument doc(&s_arena);
+        deserializeJson(doc, payload, length);
+
+        // --- 3️⃣ Dispatch ---
+        for (auto &h : handlers)
         {
-            if (h.fn(topic, payload, length, doc))
-                return;
+            if (strstr(topic, h.key) && h.fn(topic, p, length, doc))
+            {
+                handled = true;
+                break;
+            }
         }
     }
+    s_arena.reset(); // doc is gone, hand the arena back
+    xSemaphoreGive(s_cmdMutex);
+    return handled;
+}
+
+// ===========================================================
+// [SECTION MQTT Receive] MAIN MQTT MESSAGE switch Relay
+// ===========================================================
+void onMqttMessage(char *topic, byte *payload, unsigned int length)
+{
+    cmd_dispatch(topic, payload, length);
 }
 
 // ===========================================================
 //  [SECTION MQTT Receive] Change User HANDLERS
 // ===========================================================
 
-static bool handle_user(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc)
+static bool handle_user(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
 {
     if (!strstr(topic, "/cmd/user/"))
         return false;
@@ -179,7 +285,7 @@ static bool handle_user(const char *topic, byte *payload, unsigned int length, D
 // [SECTION MQTT Receive] Reset Energy Counters HANDLER
 // ===========================================================
 static bool handle_reset(const char *topic, byte *payload,
-                         unsigned int length, DynamicJsonDocument &doc)
+                         unsigned int length, JsonDocument &doc)
 {
     if (!strstr(topic, "/cmd/reset"))
         return false;
@@ -220,7 +326,7 @@ static bool handle_reset(const char *topic, byte *payload,
 // ===========================================================
 // [SECTION MQTT Receive] Change Curve Mode HANDLER
 // ===========================================================
-static bool handle_mode(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc)
+static bool handle_mode(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
 {
     if (!strstr(topic, "/cmd/mode"))
         return false;
@@ -237,15 +343,31 @@ static bool handle_mode(const char *topic, byte *payload, unsigned int length, D
         curve_mode = 2;
     dpms[id].curve_mode = curve_mode;
 
-    DBG_INFO("[MQTT] DPM%d curve_mode set to %s (%u)\n",
-             id, modeStr.c_str(), curve_mode);
+    // Optional: control mode (Time/Energy) + energy controller settings
+    if (doc.containsKey("control"))
+    {
+        String ctl = doc["control"] | "Time";
+        dpms[id].mode = ctl.equalsIgnoreCase("Energy") ? MODE_ENERGY : MODE_TIME;
+    }
+    if (doc.containsKey("target"))
+        dpms[id].energy_target_cfg = doc["target"].as<double>(); // J, 0 = auto
+    if (doc.containsKey("i_min"))
+        dpms[id].ectrl.cur_min = doc["i_min"].as<int>();
+    if (doc.containsKey("i_max"))
+        dpms[id].ectrl.cur_max = doc["i_max"].as<int>();
+    saveConfig();
+
+    DBG_INFO("[MQTT] DPM%d curve_mode set to %s (%u), control=%s target=%.0f J I=[%d..%d] mA\n",
+             id, modeStr.c_str(), curve_mode,
+             dpms[id].mode == MODE_ENERGY ? "Energy" : "Time",
+             dpms[id].energy_target_cfg, dpms[id].ectrl.cur_min, dpms[id].ectrl.cur_max);
     mqtt_publish_event("Mode Set", dpms[id].user, id, "User Change", modeStr.c_str());
     return true;
 }
 // ===========================================================
 // [SECTION MQTT Receive] Change Current Ramp/Curve HANDLER
 // ===========================================================
-static bool handle_curve(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc)
+static bool handle_curve(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
 {
     if (!strstr(topic, "/cmd/curve"))
         return false;
@@ -263,9 +385,13 @@ static bool handle_curve(const char *topic, byte *payload, unsigned int length,
         d.curve.start_cur = doc["start"] | d.cur_set;
         d.curve.end_cur = doc["end"] | d.cur_set;
         d.curve.duration = doc["duration"] | 5000;
+        d.curve.min_step = doc["step"] | DPM_CUR_MIN_STEP_MA;        // mA per write
+        d.curve.min_interval = doc["min_interval"] | 0;             // ms, 0 = no cap
         d.curve.active = true;
-        DBG_INFO("[MQTT] DPM%d curve LinearRamp %d→%d in %lu ms\n",
-                 id, d.curve.start_cur, d.curve.end_cur, d.curve.duration);
+        dpm_curve_begin(id);
+        DBG_INFO("[MQTT] DPM%d curve LinearRamp %d→%d in %lu ms (step %d mA, min %lu ms)\n",
+                 id, d.curve.start_cur, d.curve.end_cur, d.curve.duration,
+                 d.curve.step_size, d.curve.min_interval);
         break;
     case 2:
         d.curve.pulse_high = doc["high"] | d.cur_set;
@@ -286,7 +412,7 @@ static bool handle_curve(const char *topic, byte *payload, unsigned int length,
 // ===========================================================
 // [SECTION MQTT Receive] Change Line (Galvanic id) HANDLER
 // ===========================================================
-static bool handle_line(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc)
+static bool handle_line(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
 {
     if (!strstr(topic, "/cmd/line/"))
         return false;
@@ -308,10 +434,25 @@ static bool handle_line(const char *topic, byte *payload, unsigned int length, D
     DBG_INFO("[MQTT] DPM%d line set to %d\n", id, dpms[id].line_id);
     return true;
 }
+// ====================================================================
+// [SECTION MQTT Receive] Device alias (sub topic): persist + reconnect
+// ====================================================================
+static void apply_alias(const String &newAlias)
+{
+    Preferences prefs;
+    prefs.begin("dpm_cfg", false);
+    prefs.putString("alias", newAlias);
+    prefs.end();
+    mqtt_publish_event("alias_set", 0, 0, "system", newAlias.c_str());
+
+    // mqttTask takes the new alias: topics, will, new session
+    mqtt_request_reconnect();
+}
+
 // ====================================================================
 // [SECTION MQTT Receive] Set (Sub) Topic HANDLER  DPM_Control/SubTopic
 // ====================================================================
-static bool handle_topic(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc)
+static bool handle_topic(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
 {
     if (!strstr(topic, "/cmd/Set_Topic"))
         return false;
@@ -322,37 +463,38 @@ static bool handle_topic(const char *topic, byte *payload, unsigned int length,
         return true;
     }
 
-    Preferences prefs;
-    prefs.begin("dpm_cfg", false);
-    prefs.putString("alias", newAlias);
-    prefs.end();
-    DEVICE_HOST = newAlias;
-    mqtt_publish_event("alias_set", 0, 0, "system", newAlias.c_str());
-    DBG_INFO("[MQTT] Topic changed to: %s\n", newAlias.c_str());
-
-    // Optional: trigger reconnect
-    mqtt_disconnect();
-    delay(500);
-    mqtt_try_connect_with_backoff();
+    apply_alias(newAlias);
     return true;
 }
 
 // ===============================================================
 // [SECTION MQTT Receive] DPM settings Time/A/V and log all changes
 // ===============================================================
-static bool handle_settings(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc)
+static bool handle_settings(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
 {
-    if (!doc["data"].is<JsonArray>())
+    int addr, volt_set, cur_set, runtime, idle_cur, percent;
+    if (doc["data"].is<JsonArray>())
+    {
+        JsonArray data = doc["data"].as<JsonArray>();
+        addr = ja_get_i(data, 0, -1);
+        volt_set = ja_get_i(data, 1, -1);
+        cur_set = ja_get_i(data, 2, -1);
+        runtime = ja_get_i(data, 3, -1);
+        idle_cur = ja_get_i(data, 4, -1);
+        percent = ja_get_i(data, 5, -1);
+    }
+    else if (doc["addr"].is<int>()) // object form (REST /api/dpm)
+    {
+        addr = doc["addr"];
+        volt_set = doc["volt_set"] | -1;
+        cur_set = doc["cur_set"] | -1;
+        runtime = doc["runtime"] | -1;
+        idle_cur = doc["idle_cur"] | -1;
+        percent = doc["percent"] | -1;
+    }
+    else
         return false;
 
-    JsonArray data = doc["data"].as<JsonArray>();
-    const int addr = ja_get_i(data, 0, -1);
-    const int volt_set = ja_get_i(data, 1, -1);
-    const int cur_set = ja_get_i(data, 2, -1);
-    const int runtime = ja_get_i(data, 3, -1);
-    const int idle_cur = ja_get_i(data, 4, -1);
-    const int percent = ja_get_i(data, 5, -1);
-
     if (addr < 0 || addr >= ROWS)
         return false;
 
@@ -363,15 +505,10 @@ static bool handle_settings(const char *topic, byte *payload, unsigned int lengt
     {
         if (oldVal != newVal)
         {
-            String topicInflux = String(App::BASE_TOPIC) + "/" + DEVICE_HOST + "/influx";
-            String payload = "event,device=" + DEVICE_HOST +
-                             ",dpm=" + String(dpmi) +
-                             ",type=param_change,field=" + param +
-                             ",user=" + dpms[dpmi].user +
-                             " old=" + String(oldVal) +
-                             ",new=" + String(newVal) + "\n";
-
-            mqtt.publish(topicInflux.c_str(), payload.c_str(), false);
+            char fields[96];
+            snprintf(fields, sizeof(fields), "field=%s,user=%d old=%d,new=%d",
+                     param, dpms[dpmi].user, oldVal, newVal);
+            mqtt_request_param(dpmi, fields);
             DBG_INFO("[EVENT] DPM%d: %s changed %s from %d → %d\n",
                      dpmi, user.c_str(), param, oldVal, newVal);
         }
@@ -406,7 +543,7 @@ static bool handle_settings(const char *topic, byte *payload, unsigned int lengt
 // ===============================================================
 // [SECTION MQTT Receive] OTA firmware update
 // ===============================================================
-static bool handle_ota(const char *topic, byte *payload, unsigned int length, DynamicJsonDocument &doc)
+static bool handle_ota(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
 {
     if (!strstr(topic, "/cmd/ota"))
         return false;
@@ -421,8 +558,10 @@ static bool handle_ota(const char *topic, byte *payload, unsigned int length, Dy
         o = doc.as<JsonObject>();
 
     String urlS = o["url"] | "";
+    String shaS = o["sha256"] | "";
     String md5S = o["md5"] | "";
     bool reboot = o["reboot"] | false;
+    uint32_t deadline = o["deadline_s"] | (uint32_t)OTA_REBOOT_DEADLINE_S;
 
     if (urlS.isEmpty())
     {
@@ -430,14 +569,173 @@ static bool handle_ota(const char *topic, byte *payload, unsigned int length, Dy
         return true;
     }
 
-    DBG_INFO("[MQTT] OTA start: url=%s, md5=%s, reboot=%s\n",
+    DBG_INFO("[MQTT] OTA request: url=%s, sha256=%s, md5=%s, reboot=%s, deadline=%lus\n",
              urlS.c_str(),
+             shaS.c_str(),
              md5S.c_str(),
-             reboot ? "true" : "false");
+             reboot ? "true" : "false",
+             (unsigned long)deadline);
 
+    // Queued to otaTask, returns immediately (MQTT keeps running)
     update_mgr_begin(urlS.c_str(),
+                     shaS.length() ? shaS.c_str() : nullptr,
                      md5S.length() ? md5S.c_str() : nullptr,
-                     reboot);
+                     reboot, deadline);
+
+    return true;
+}
+// ===============================================================
+// [SECTION MQTT Receive] Thermal thresholds per DPM (persisted)
+// ===============================================================
+static bool handle_thermal(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
+{
+    if (!strstr(topic, "/cmd/thermal"))
+        return false;
+    int id = doc["id"] | extract_dpm_id_from_topic(topic);
+    if (id < 1 || id > ROWS)
+        return true;
+
+    int warn = doc["warn"] | dpms[id].temp_warn;
+    int crit = doc["crit"] | dpms[id].temp_crit;
+    if (warn <= 0 || crit <= warn || crit > 100)
+    {
+        DBG_WARN("[MQTT] DPM%d thermal rejected warn=%d crit=%d\n", id, warn, crit);
+        return true;
+    }
+    dpms[id].temp_warn = warn;
+    dpms[id].temp_crit = crit;
+    saveConfig();
 
+    char text[32];
+    snprintf(text, sizeof(text), "warn=%d crit=%d", warn, crit);
+    mqtt_publish_event("Thermal Set", dpms[id].user, id, "User Change", text);
+    DBG_INFO("[MQTT] DPM%d thermal %s\n", id, text);
+    return true;
+}
+// ===============================================================
+// [SECTION MQTT Receive] Network / broker settings (net_cfg)
+// ===============================================================
+static bool handle_net(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
+{
+    if (!strstr(topic, "/cmd/net"))
+        return false;
+
+    JsonObjectConst o = doc.as<JsonObjectConst>();
+    if (o.isNull() || !net_cfg_from_json(o))
+    {
+        DBG_WARN("[CMD] net settings rejected\n");
+        mqtt_publish_event("net_settings", 0, 0, "REJECTED", "Invalid network settings");
+        return true;
+    }
+    mqtt_publish_event("net_settings", 0, 0, "User Change", "Saved, active after restart");
+
+    String alias = o["device_host"] | "";
+    alias.trim();
+    if (alias.length() && alias != DEVICE_HOST)
+        apply_alias(alias);
+    return true;
+}
+// ===============================================================
+// [SECTION MQTT Receive] W5500 throughput benchmark (eth_bench.h)
+//   {"host":"192.168.1.10","port":5201,"kb":1024,"plain":false}
+// ===============================================================
+static bool handle_ethbench(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
+{
+    if (!strstr(topic, "/cmd/ethbench"))
+        return false;
+
+    const char *host = doc["host"] | "";
+    const uint16_t port = doc["port"] | 5201;
+    const uint32_t kb = doc["kb"] | 1024;
+    const bool plain = doc["plain"] | false;
+    if (!eth_bench_begin(host, port, kb * 1024UL, plain))
+    {
+        DBG_WARN("[CMD] ethbench rejected (busy or bad args)\n");
+        mqtt_publish_event("eth_bench", 0, 0, "REJECTED", "busy or missing host");
+    }
+    return true;
+}
+// ===============================================================
+// [SECTION MQTT Receive] Runtime log levels (debug_log.h)
+//   {"level":2}  or  {"module":"MQTT","level":3}  (level -1: follow "*")
+//   {"remote":{"sink":"mqtt","level":3,"modules":"MQTT,ETH","bps":1024}}
+//   (log_remote.h; "sink":"syslog" needs "host", "off" stops it)
+// ===============================================================
+static bool handle_log(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
+{
+    if (!strstr(topic, "/cmd/log"))
+        return false;
+
+    char text[160];
+    if (doc["remote"].is<JsonObjectConst>())
+    {
+        if (!log_remote_from_json(doc["remote"].as<JsonObjectConst>()))
+        {
+            DBG_WARN("[CMD] remote log rejected\n");
+            mqtt_publish_event("log_remote", 0, 0, "REJECTED", "sink, level, modules, bps or host invalid");
+            return true;
+        }
+        log_remote_describe(text, sizeof(text));
+        mqtt_publish_event("log_remote", 0, 0, "User Change", text);
+        return true;
+    }
+
+    const char *module = doc["module"] | "*";
+    if (!doc["level"].is<int>() || !log_set_level(module, doc["level"].as<int>()))
+    {
+        DBG_WARN("[CMD] log level rejected\n");
+        mqtt_publish_event("log_level", 0, 0, "REJECTED", "module or level invalid");
+        return true;
+    }
+    log_levels(text, sizeof(text));
+    mqtt_publish_event("log_level", 0, 0, "User Change", text);
+    return true;
+}
+// ===============================================================
+// [SECTION MQTT Receive] Diagnostics on request (diag.h): published on
+//   <base>/<dev>/diag, body ignored
+// ===============================================================
+static bool handle_diag(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
+{
+    if (!strstr(topic, "/cmd/diag"))
+        return false;
+    mqtt_request_diag();
+    return true;
+}
+// ===============================================================
+// [SECTION MQTT Receive] Relay command as JSON (REST /api/relay[s])
+//   {"id":n,"state":"on|off|toggle"}  or  {"mask":0..255}
+// ===============================================================
+static bool handle_relay(const char *topic, byte *payload, unsigned int length, JsonDocument &doc)
+{
+    if (!strstr(topic, "/cmd/relay"))
+        return false;
+
+    if (doc["mask"].is<int>())
+    {
+        relay_seq_request_mask((uint8_t)(doc["mask"].as<int>() & 0xFF));
+        return true;
+    }
+
+    int id = doc["id"] | extract_dpm_id_from_topic(topic);
+    if (id < 1 || id > 8)
+        return true;
+    bool on;
+    if (doc["state"].is<bool>())
+        on = doc["state"].as<bool>();
+    else
+    {
+        const char *st = doc["state"] | "";
+        if (!strcasecmp(st, "toggle"))
+            on = !((relay_seq_target_mask() >> (id - 1)) & 1u);
+        else if (!strcasecmp(st, "on") || !strcmp(st, "1"))
+            on = true;
+        else if (!strcasecmp(st, "off") || !strcmp(st, "0"))
+            on = false;
+        else
+            return true; // invalid state
+    }
+    relay_seq_request((uint8_t)id, on);
+    DBG_INFO("[CMD] Relay %d %s requested\n", id, on ? "ON" : "OFF");
     return true;
 }
@@ -0,0 +1,145 @@
+#include "net_cfg.h"
+#include <Preferences.h>
+#include <IPAddress.h>
+#include "app_settings.h"
+#include "mqtt_if.h"
+#include "debug_log.h"
+
+static NetCfg s_cfg;     // active (loaded at boot)
+static NetCfg s_saved;   // last saved, shown in /api/settings
+
+static void copy_str(char *dst, size_t len, const char *src)
+{
+  strncpy(dst, src ? src : "", len - 1);
+  dst[len - 1] = '\0';
+}
+
+// ===========================================================
+// [SECTION NET CFG] Load / access
+// ===========================================================
+void net_cfg_load()
+{
+  Preferences prefs;
+  prefs.begin("net_cfg", true);
+  copy_str(s_cfg.mqtt_host, sizeof(s_cfg.mqtt_host), prefs.getString("mh", App::MQTT_HOST).c_str());
+  s_cfg.mqtt_port = prefs.getUShort("mp", App::MQTT_PORT);
+  copy_str(s_cfg.mqtt_user, sizeof(s_cfg.mqtt_user), prefs.getString("mu", App::MQTT_USER).c_str());
+  copy_str(s_cfg.mqtt_pass, sizeof(s_cfg.mqtt_pass), prefs.getString("mw", App::MQTT_PASS).c_str());
+  s_cfg.dhcp = prefs.getBool("dh", true);
+  s_cfg.ip = prefs.getULong("ip", 0);
+  s_cfg.gw = prefs.getULong("gw", 0);
+  s_cfg.mask = prefs.getULong("nm", (uint32_t)IPAddress(255, 255, 255, 0));
+  s_cfg.dns = prefs.getULong("dn", 0);
+  copy_str(s_cfg.api_user, sizeof(s_cfg.api_user), prefs.getString("au", App::API_USER).c_str());
+  copy_str(s_cfg.api_pass, sizeof(s_cfg.api_pass), prefs.getString("aw", App::API_PASS).c_str());
+  prefs.end();
+  s_saved = s_cfg;
+  DBG_INFO("[CFG] MQTT %s:%u, %s\n", s_cfg.mqtt_host, s_cfg.mqtt_port,
+           s_cfg.dhcp ? "DHCP" : "static IP");
+}
+
+const NetCfg &net_cfg()
+{
+  return s_cfg;
+}
+
+// ===========================================================
+// [SECTION NET CFG] JSON (settings.html field names)
+// ===========================================================
+static const char *ip_str(uint32_t v, char *buf)
+{
+  IPAddress a(v);
+  snprintf(buf, 16, "%u.%u.%u.%u", a[0], a[1], a[2], a[3]);
+  return buf;
+}
+
+void net_cfg_write(JsonStream &w)
+{
+  const NetCfg &c = s_saved;
+  char ip[16];
+  w.obj()
+      .kv("mqtt_host", (const char *)c.mqtt_host)
+      .kv("mqtt_port", (unsigned)c.mqtt_port)
+      .kv("mqtt_user", (const char *)c.mqtt_user)
+      .kv("mqtt_pass", "")                  // write-only
+      .kv("base_topic", App::BASE_TOPIC)    // fixed at build time
+      .kv("device_host", DEVICE_HOST.c_str())
+      .kv("dhcp", c.dhcp)
+      .kv("ip", ip_str(c.ip, ip))
+      .kv("gw", ip_str(c.gw, ip))
+      .kv("mask", ip_str(c.mask, ip))
+      .kv("dns", ip_str(c.dns, ip))
+      .kv("api_user", (const char *)c.api_user)
+      .kv("api_pass", "")                   // write-only
+      .kv("restart_required", memcmp(&s_saved, &s_cfg, sizeof(NetCfg)) != 0)
+      .end();
+}
+
+static bool parse_ip(JsonObjectConst o, const char *key, uint32_t &out)
+{
+  const char *s = o[key] | (const char *)nullptr;
+  if (!s)
+    return true; // keep
+  if (!*s)
+  {
+    out = 0;
+    return true;
+  }
+  IPAddress a;
+  if (!a.fromString(s))
+    return false;
+  out = (uint32_t)a;
+  return true;
+}
+
+bool net_cfg_from_json(JsonObjectConst o)
+{
+  NetCfg c = s_saved;
+  const char *host = o["mqtt_host"] | c.mqtt_host;
+  int port = o["mqtt_port"] | (int)c.mqtt_port;
+  const char *user = o["mqtt_user"] | c.mqtt_user;
+  const char *pass = o["mqtt_pass"] | "";
+  const char *api_user = o["api_user"] | c.api_user;
+  const char *api_pass = o["api_pass"] | "";
+
+  if (!*host || strlen(host) >= sizeof(c.mqtt_host) || port <= 0 || port > 65535 ||
+      strlen(user) >= sizeof(c.mqtt_user) || strlen(pass) >= sizeof(c.mqtt_pass) ||
+      !*api_user || strlen(api_user) >= sizeof(c.api_user) ||
+      strlen(api_pass) >= sizeof(c.api_pass))
+    return false;
+  copy_str(c.mqtt_host, sizeof(c.mqtt_host), host);
+  c.mqtt_port = (uint16_t)port;
+  copy_str(c.mqtt_user, sizeof(c.mqtt_user), user);
+  if (*pass)
+    copy_str(c.mqtt_pass, sizeof(c.mqtt_pass), pass);
+  copy_str(c.api_user, sizeof(c.api_user), api_user);
+  if (*api_pass)
+    copy_str(c.api_pass, sizeof(c.api_pass), api_pass);
+
+  c.dhcp = o["dhcp"] | c.dhcp;
+  if (!parse_ip(o, "ip", c.ip) || !parse_ip(o, "gw", c.gw) ||
+      !parse_ip(o, "mask", c.mask) || !parse_ip(o, "dns", c.dns))
+    return false;
+  if (!c.dhcp && (c.ip == 0 || c.mask == 0))
+    return false; // static needs at least IP + mask
+
+  Preferences prefs;
+  prefs.begin("net_cfg", false);
+  prefs.putString("mh", c.mqtt_host);
+  prefs.putUShort("mp", c.mqtt_port);
+  prefs.putString("mu", c.mqtt_user);
+  prefs.putString("mw", c.mqtt_pass);
+  prefs.putBool("dh", c.dhcp);
+  prefs.putULong("ip", c.ip);
+  prefs.putULong("gw", c.gw);
+  prefs.putULong("nm", c.mask);
+  prefs.putULong("dn", c.dns);
+  prefs.putString("au", c.api_user);
+  prefs.putString("aw", c.api_pass);
+  prefs.end();
+
+  // The active copy stays untouched: MqttClient points at its host
+  s_saved = c;
+  DBG_INFO("[CFG] net settings saved (active after restart)\n");
+  return true;
+}
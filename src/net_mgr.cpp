@@ -0,0 +1,127 @@
+#include "net_mgr.h"
+#include <WiFi.h>
+#include "eth_mgr.h"
+#include "wifi_mgr.h"
+#include "debug_log.h"
+
+// ===========================================================
+// [SECTION NET] State
+//   s_path      written by ethTask only
+//   s_switchAt  switch decided, MQTT not yet up on the new path
+// ===========================================================
+static portMUX_TYPE s_netMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile NetPath s_path = NET_NONE;
+static NetPath s_from = NET_NONE;
+static uint32_t s_switchAt = 0;
+static bool s_switchPending = false;
+static uint32_t s_lastFailoverMs = 0;
+static bool s_ethUp = false;
+static uint32_t s_ethUpSince = 0;
+
+static const char *PATH_NAMES[] = {"none", "eth", "wifi"};
+
+const char *net_path_name(NetPath p)
+{
+  return p <= NET_WIFI ? PATH_NAMES[p] : "?";
+}
+
+NetPath net_path() { return s_path; }
+
+uint32_t net_last_failover_ms() { return s_lastFailoverMs; }
+
+// ===========================================================
+// [SECTION NET] Startup (setup(), after eth_setup())
+// ===========================================================
+void net_mgr_begin()
+{
+  wifi_setup(); // STA next to the service SoftAP (hot standby)
+}
+
+// ===========================================================
+// [SECTION NET] Path selection (ethTask)
+// ===========================================================
+static void switch_to(NetPath want)
+{
+  const NetPath was = s_path;
+  portENTER_CRITICAL(&s_netMux);
+  if (!s_switchPending && was != NET_NONE)
+  {
+    s_from = was;
+    s_switchAt = millis();
+    s_switchPending = true;
+  }
+  s_path = want;
+  portEXIT_CRITICAL(&s_netMux);
+
+  if (want == NET_NONE)
+    DBG_WARN("[NET] ❌ no usable link (was %s)\n", net_path_name(was));
+  else
+    DBG_INFO("[NET] 🔀 path %s → %s\n", net_path_name(was), net_path_name(want));
+}
+
+void net_mgr_loop()
+{
+  eth_loop();
+  wifi_loop();
+
+  const uint32_t now = millis();
+  const bool eth = eth_link_cached() && eth_ip_cached() != IPAddress(0, 0, 0, 0);
+  const bool wifi = wifi_connected();
+  if (eth && !s_ethUp)
+    s_ethUpSince = now;
+  s_ethUp = eth;
+
+  NetPath want = s_path;
+  switch (s_path)
+  {
+  case NET_ETH:
+    if (!eth)
+      want = wifi ? NET_WIFI : NET_NONE;
+    break;
+  case NET_WIFI:
+    // Fail back only to a link that stayed up (cable plug bounces)
+    if (eth && now - s_ethUpSince >= NET_FAILBACK_HOLD_MS)
+      want = NET_ETH;
+    else if (!wifi)
+      want = NET_NONE;
+    break;
+  case NET_NONE:
+    if (eth)
+      want = NET_ETH;
+    else if (wifi)
+      want = NET_WIFI;
+    break;
+  }
+  if (want != s_path)
+    switch_to(want);
+}
+
+// ===========================================================
+// [SECTION NET] Failover timing (mqttTask)
+// ===========================================================
+uint32_t net_mgr_session_up(NetPath p, NetPath *from)
+{
+  uint32_t dt = 0;
+  portENTER_CRITICAL(&s_netMux);
+  if (s_switchPending && p == s_path)
+  {
+    if (s_from != p) // back on the same link: an outage, not a failover
+    {
+      dt = millis() - s_switchAt;
+      if (dt == 0)
+        dt = 1;
+      if (from)
+        *from = s_from;
+    }
+    s_switchPending = false;
+  }
+  portEXIT_CRITICAL(&s_netMux);
+
+  if (dt)
+  {
+    s_lastFailoverMs = dt;
+    DBG_INFO("[NET] ⏱️ failover %s → %s: MQTT back after %lu ms\n",
+             net_path_name(from ? *from : NET_NONE), net_path_name(p), (unsigned long)dt);
+  }
+  return dt;
+}
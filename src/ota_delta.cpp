@@ -0,0 +1,152 @@
+#include "ota_delta.h"
+#include <string.h>
+
+// --------------------------------------------------------------------
+// ✅ NOTE: No Arduino / FreeRTOS includes on purpose – host testable.
+// --------------------------------------------------------------------
+
+enum : uint8_t { OP_END = 0x00, OP_COPY = 0x01, OP_ADD = 0x02, OP_INSERT = 0x03 };
+
+static uint32_t rd32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// =====================================================================
+// [SECTION DELTA] Header
+// =====================================================================
+bool delta_is_patch(const uint8_t *p, size_t n)
+{
+  return n >= 8 && memcmp(p, DELTA_MAGIC, 8) == 0;
+}
+
+bool delta_parse_header(const uint8_t *p, size_t n, DeltaHdr &h)
+{
+  if (n < DELTA_HDR_SIZE || !delta_is_patch(p, n) || rd32(p + 8) != DELTA_VERSION)
+    return false;
+  h.src_size = rd32(p + 12);
+  memcpy(h.src_sha, p + 16, 32);
+  h.dst_size = rd32(p + 48);
+  memcpy(h.dst_sha, p + 52, 32);
+  return true;
+}
+
+// =====================================================================
+// [SECTION DELTA] Op stream
+// =====================================================================
+void DeltaApply::begin(const DeltaHdr &h, ReadSrc rd, WriteOut wr, void *ctx)
+{
+  rd_ = rd;
+  wr_ = wr;
+  ctx_ = ctx;
+  srcSize_ = h.src_size;
+  dstSize_ = h.dst_size;
+  out_ = 0;
+  op_ = 0;
+  hdrLen_ = 0;
+  left_ = 0;
+  done_ = false;
+  err_ = nullptr;
+}
+
+DeltaResult DeltaApply::fail_(const char *why)
+{
+  err_ = why;
+  return DELTA_ERR;
+}
+
+// n source bytes at srcOff_ (+ diff if ADD) → output
+bool DeltaApply::emit_src_(uint32_t n, const uint8_t *diff)
+{
+  if (!rd_(ctx_, srcOff_, tmp_, n))
+    return false;
+  if (diff)
+    for (uint32_t i = 0; i < n; i++)
+      tmp_[i] = (uint8_t)(tmp_[i] + diff[i]);
+  srcOff_ += n;
+  out_ += n;
+  return wr_(ctx_, tmp_, n);
+}
+
+DeltaResult DeltaApply::feed(const uint8_t *p, size_t n)
+{
+  if (err_)
+    return DELTA_ERR;
+
+  while (n || (op_ == OP_COPY && left_))
+  {
+    if (done_)
+      return fail_("data after END");
+
+    // 1) Op header (byte + args), may span feed() calls
+    if (!op_)
+    {
+      hdr_[hdrLen_++] = *p++;
+      n--;
+      const uint8_t need = hdr_[0] == OP_END ? 1 : hdr_[0] == OP_INSERT ? 5 : 9;
+      if (hdr_[0] > OP_INSERT)
+        return fail_("bad op");
+      if (hdrLen_ < need)
+        continue;
+      hdrLen_ = 0;
+
+      if (hdr_[0] == OP_END)
+      {
+        done_ = true;
+        if (out_ != dstSize_)
+          return fail_("size mismatch");
+        continue;
+      }
+      if (hdr_[0] == OP_INSERT)
+      {
+        left_ = rd32(hdr_ + 1);
+      }
+      else
+      {
+        srcOff_ = rd32(hdr_ + 1);
+        left_ = rd32(hdr_ + 5);
+        if (srcOff_ > srcSize_ || left_ > srcSize_ - srcOff_)
+          return fail_("source range");
+      }
+      if (left_ > dstSize_ - out_)
+        return fail_("output overrun");
+      op_ = left_ ? hdr_[0] : 0;
+      continue;
+    }
+
+    // 2) Op payload
+    uint32_t k = left_;
+    bool ok = true;
+    switch (op_)
+    {
+    case OP_COPY: // no payload in the stream
+      if (k > sizeof(tmp_))
+        k = sizeof(tmp_);
+      ok = emit_src_(k, nullptr);
+      break;
+    case OP_ADD:
+      if (k > n)
+        k = (uint32_t)n;
+      if (k > sizeof(tmp_))
+        k = sizeof(tmp_);
+      ok = emit_src_(k, p);
+      p += k;
+      n -= k;
+      break;
+    default: // OP_INSERT
+      if (k > n)
+        k = (uint32_t)n;
+      ok = wr_(ctx_, p, k);
+      out_ += k;
+      p += k;
+      n -= k;
+      break;
+    }
+    if (!ok)
+      return fail_("read/write");
+    left_ -= k;
+    if (!left_)
+      op_ = 0;
+  }
+  return done_ ? DELTA_DONE : DELTA_MORE;
+}
@@ -5,6 +5,8 @@
 #include "config.h"
 #include "app_settings.h"
 #include "debug_log.h"
+#include "relay_seq.h"
+#include "watchdog.h"
 // --------------------------------------------------------------------
 // ✅ NOTE: This module is independent of DPMState and its enum class.
 // It works unchanged with the new DPMState::Status type in config.h.
@@ -17,15 +19,27 @@
 #define REG_POLARITY 0x02
 #define REG_CONFIG 0x03
 
+// Coalesce window + I2C write / readback (+ 100 ms bus retry) on top of
+// the verify period
+#define RELAY_WD_LATENCY_MS 1000
+
 // ===========================================================
-// [SECTION Relay] Set Relay Inverted Logic
+// [SECTION Relay] Driver state
 // ===========================================================
+// g_want  : requested mask (bit=1 => ON), written by any task
+// g_hw    : mask last written + verified on the expander (driver task only)
+// g_pub   : mask last published via MQTT (MQTT task only)
+static uint8_t g_want = 0x00;
+static uint8_t g_hw = 0x00;
+static uint8_t g_pub = 0x00;
+static bool g_pubValid = false;
+static volatile bool g_forceWrite = true; // rewrite even if g_want == g_hw
+static bool g_inverted = true;            // Relay inverted logic?
+static uint32_t g_faults = 0;
+static TaskHandle_t s_relayTask = nullptr;
+static portMUX_TYPE s_relayMux = portMUX_INITIALIZER_UNLOCKED;
 
-// Local state
-static uint8_t g_mask = 0x00;  // bit=1 => ON
-static bool g_inverted = true; // Relay inverted logic?
-
-// Small helpers
+// Small helpers (driver task only)
 static bool i2cWriteReg(uint8_t reg, uint8_t val)
 {
   Wire.beginTransmission(TCA9554_ADDR);
@@ -34,42 +48,229 @@ static bool i2cWriteReg(uint8_t reg, uint8_t val)
   return (Wire.endTransmission(true) == 0);
 }
 
+static bool i2cReadReg(uint8_t reg, uint8_t &val)
+{
+  Wire.beginTransmission(TCA9554_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0)
+    return false;
+  if (Wire.requestFrom((uint8_t)TCA9554_ADDR, (uint8_t)1) != 1)
+    return false;
+  val = (uint8_t)Wire.read();
+  return true;
+}
+
 static inline uint8_t applyInvert(uint8_t mask)
 {
   return g_inverted ? (uint8_t)(~mask) : mask;
 }
 
-// Public API
+static inline void wake_driver()
+{
+  if (s_relayTask)
+    xTaskNotifyGive(s_relayTask);
+}
+
+// ===========================================================
+// [SECTION Relay] Expander setup (also used after a detected reset)
+// ===========================================================
+static bool expander_configure(uint8_t mask)
+{
+  // Output register first, so pins come up in the right state
+  bool ok = i2cWriteReg(REG_OUTPUT, applyInvert(mask));
+  ok &= i2cWriteReg(REG_POLARITY, 0x00); // hardware: active-HIGH
+  ok &= i2cWriteReg(REG_CONFIG, 0x00);   // 0=output
+  return ok;
+}
+
+// Faults are counted on every occurrence but reported (log + queued
+// event) on edges only: once when set, once as "<type>_clear" when the
+// next good write / readback shows it gone. A dead bus retried every
+// 100 ms stays one event. (driver task only)
+enum : uint8_t
+{
+  FAULT_BUS = 1 << 0,     // relay_bus_fault
+  FAULT_RESET = 1 << 1,   // relay_expander_reset
+  FAULT_MISMATCH = 1 << 2 // relay_mismatch
+};
+static uint8_t s_faultActive = 0;
+static const char *const FAULT_TYPES[] = {"relay_bus_fault", "relay_expander_reset", "relay_mismatch"};
+// Longest event name: "<type>_clear" must reach the consumers unshortened
+static_assert(sizeof("relay_expander_reset_clear") <= sizeof(MqttMsg::eventType),
+              "MqttMsg::eventType too small for the relay fault events");
+
+static void relay_fault(uint8_t bit, const char *text)
+{
+  g_faults++;
+  if (s_faultActive & bit)
+    return;
+  s_faultActive |= bit;
+  const char *type = FAULT_TYPES[__builtin_ctz(bit)];
+  DBG_ERROR("[RELAY] ❌ %s: %s\n", type, text);
+  mqtt_publish_event(type, 0, 0, "ALERT", text);
+}
+
+static void relay_fault_clear(uint8_t bits)
+{
+  bits &= s_faultActive;
+  s_faultActive &= (uint8_t)~bits;
+  for (uint8_t k = 0; bits; k++, bits >>= 1)
+  {
+    if (!(bits & 1))
+      continue;
+    char type[sizeof(MqttMsg::eventType)];
+    snprintf(type, sizeof(type), "%s_clear", FAULT_TYPES[k]);
+    DBG_INFO("[RELAY] ✅ %s\n", type);
+    mqtt_publish_event(type, 0, 0, "INFO", "");
+  }
+}
+
+// ===========================================================
+// [SECTION Relay] Readback: detect expander resets / bus faults
+// ===========================================================
+static void relay_verify()
+{
+  uint8_t cfg = 0, out = 0, in = 0;
+  if (!i2cReadReg(REG_CONFIG, cfg) || !i2cReadReg(REG_OUTPUT, out) ||
+      !i2cReadReg(REG_INPUT, in))
+  {
+    relay_fault(FAULT_BUS, "TCA9554 readback failed");
+    g_forceWrite = true;
+    return;
+  }
+
+  if (cfg != 0x00) // power-on default is 0xFF (all inputs)
+  {
+    relay_fault(FAULT_RESET, "TCA9554 config lost, restoring outputs");
+    g_forceWrite = true;
+    return;
+  }
+
+  if (out != applyInvert(g_hw))
+  {
+    char text[48];
+    snprintf(text, sizeof(text), "output 0x%02X != expected 0x%02X", out, applyInvert(g_hw));
+    relay_fault(FAULT_MISMATCH, text);
+    g_forceWrite = true;
+    return;
+  }
+  relay_fault_clear(FAULT_BUS | FAULT_RESET | FAULT_MISMATCH); // readback all good
+
+  // Input register mirrors the pin level; a difference means a pin is
+  // held against its driver (short / overload)
+  static uint8_t lastPinFault = 0;
+  uint8_t pinFault = (uint8_t)(in ^ out);
+  if (pinFault != lastPinFault)
+  {
+    if (pinFault)
+      DBG_WARN("[RELAY] ⚠️ pin level mismatch mask=0x%02X\n", pinFault);
+    lastPinFault = pinFault;
+  }
+}
+
+// ===========================================================
+// [SECTION Relay] Driver task: owns the I2C bus
+// ===========================================================
+static void relayTask(void *)
+{
+  // Critical: a hung I2C bus leaves the outputs unsupervised
+  watchdog_register_this_task(RELAY_VERIFY_MS, RELAY_WD_LATENCY_MS);
+  TickType_t lastVerify = xTaskGetTickCount();
+  for (;;)
+  {
+    // Wait for a request (or the verify period)
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RELAY_VERIFY_MS)) > 0)
+    {
+      // Coalesce: everything requested inside the window → one write
+      vTaskDelay(pdMS_TO_TICKS(RELAY_COALESCE_MS));
+      ulTaskNotifyTake(pdTRUE, 0);
+    }
+    watchdog_feed();
+
+    if (xTaskGetTickCount() - lastVerify >= pdMS_TO_TICKS(RELAY_VERIFY_MS))
+    {
+      relay_verify();
+      lastVerify = xTaskGetTickCount();
+    }
+
+    portENTER_CRITICAL(&s_relayMux);
+    uint8_t want = g_want;
+    portEXIT_CRITICAL(&s_relayMux);
+
+    if (want == g_hw && !g_forceWrite)
+      continue;
+
+    bool ok = g_forceWrite ? expander_configure(want)
+                           : i2cWriteReg(REG_OUTPUT, applyInvert(want));
+    if (!ok)
+    {
+      relay_fault(FAULT_BUS, "TCA9554 write failed");
+      vTaskDelay(pdMS_TO_TICKS(100)); // retry on next loop
+      xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+      continue;
+    }
+    g_forceWrite = false;
+    relay_fault_clear(FAULT_BUS);
+    if (want != g_hw)
+    {
+      g_hw = want;
+      mqtt_request_relay(); // publish on actual change only
+    }
+  }
+}
+
+// ===========================================================
+// [SECTION Relay] Public API
+// ===========================================================
 void relay_if_set_inverted(bool inverted)
 {
   g_inverted = inverted;
-  // If you prefer hardware inversion, write REG_POLARITY instead:
-  // i2cWriteReg(REG_POLARITY, inverted ? 0xFF : 0x00);
+  // If you prefer hardware inversion, write REG_POLARITY instead.
   // For now we keep hardware POL=0 and do it in software.
-  i2cWriteReg(REG_OUTPUT, applyInvert(g_mask));
+  g_forceWrite = true;
+  wake_driver();
 }
+
 // ===========================================================
 // [SECTION Relay] Relay init  ON/OFF at Strtup
 // ===========================================================
-
-void relay_if_init()
+void relay_if_init(uint8_t mask)
 {
-  // All pins outputs, no polarity inversion, all off
-  i2cWriteReg(REG_CONFIG, 0x00);   // 0=output
-  i2cWriteReg(REG_POLARITY, 0x00); // hardware: active-HIGH
-  g_mask = 0xff;  // If polarity invertet, all off is 0xFF
-  i2cWriteReg(REG_OUTPUT, applyInvert(g_mask)); // Relay Set Output
+  portENTER_CRITICAL(&s_relayMux);
+  g_want = mask; // If polarity invertet, all off is 0xFF
+  portEXIT_CRITICAL(&s_relayMux);
+  g_forceWrite = true;
+
+  if (!s_relayTask)
+    xTaskCreatePinnedToCore(relayTask, "relayTask", 3072, nullptr, 3, &s_relayTask, 1);
+  wake_driver();
 }
 
 bool relay_if_write_mask(uint8_t mask)
 {
-  g_mask = mask & 0x00;
-  return i2cWriteReg(REG_OUTPUT, applyInvert(g_mask));
+  portENTER_CRITICAL(&s_relayMux);
+  g_want = mask;
+  portEXIT_CRITICAL(&s_relayMux);
+  wake_driver();
+  return true;
 }
 
 uint8_t relay_if_read_mask()
 {
-  return g_mask;
+  portENTER_CRITICAL(&s_relayMux);
+  uint8_t m = g_want;
+  portEXIT_CRITICAL(&s_relayMux);
+  return m;
+}
+
+uint8_t relay_if_hw_mask()
+{
+  return g_hw;
+}
+
+uint32_t relay_if_fault_count()
+{
+  return g_faults;
 }
 
 bool relay_if_set(uint8_t relay, bool on)
@@ -77,19 +278,25 @@ bool relay_if_set(uint8_t relay, bool on)
   if (relay < 1 || relay > 8)
     return false;
   uint8_t bit = (1u << (relay - 1));
+  portENTER_CRITICAL(&s_relayMux);
   if (on)
-    g_mask |= bit;
+    g_want |= bit;
   else
-    g_mask &= (uint8_t)~bit;
-  return i2cWriteReg(REG_OUTPUT, applyInvert(g_mask));
+    g_want &= (uint8_t)~bit;
+  portEXIT_CRITICAL(&s_relayMux);
+  wake_driver();
+  return true;
 }
 
 bool relay_if_toggle(uint8_t relay)
 {
   if (relay < 1 || relay > 8)
     return false;
-  g_mask ^= (1u << (relay - 1));
-  return i2cWriteReg(REG_OUTPUT, applyInvert(g_mask));
+  portENTER_CRITICAL(&s_relayMux);
+  g_want ^= (1u << (relay - 1));
+  portEXIT_CRITICAL(&s_relayMux);
+  wake_driver();
+  return true;
 }
 
 // ===== MQTT glue =====
@@ -106,7 +313,7 @@ static String topic_relays_set(const String &base, const String &dev)
   return base + "/" + dev + "/relays/set";
 }
 
-void relay_if_mqtt_subscribe(PubSubClient &mqtt,
+void relay_if_mqtt_subscribe(MqttClient &mqtt,
                              const String &baseTopic,
                              const String &deviceHost)
 {
@@ -117,22 +324,38 @@ void relay_if_mqtt_subscribe(PubSubClient &mqtt,
   mqtt.subscribe(topic_relays_set(baseTopic, deviceHost).c_str());
 }
 
-void relay_if_mqtt_publish_states(PubSubClient &mqtt)
+static String topic_relays_state(const String &base, const String &dev)
 {
-  // Not used directly; publishing is done in onConnect path,
-  // but keeping the symbol to allow future reuse if needed.
+  return base + "/" + dev + "/relays";
 }
 
-// Internals for parsing/publishing
-static inline void publish_all(PubSubClient &mqtt,
-                               const String &baseTopic,
-                               const String &deviceHost)
+void relay_if_mqtt_publish_states(MqttClient &mqtt, bool all)
 {
+  if (!mqtt.connected())
+    return;
+  const String base(App::BASE_TOPIC);
+  const uint8_t hw = g_hw;
+  const uint8_t changed = (all || !g_pubValid) ? 0xFF : (uint8_t)(hw ^ g_pub);
+  if (!changed)
+    return;
+
+  bool ok = true;
   for (uint8_t i = 1; i <= 8; i++)
   {
-    bool on = ((g_mask >> (i - 1)) & 1u) != 0;
-    mqtt.publish(topic_relay_state(baseTopic, deviceHost, i).c_str(),
-                 on ? "ON" : "OFF", true);
+    if (!(changed & (1u << (i - 1))))
+      continue;
+    bool on = ((hw >> (i - 1)) & 1u) != 0;
+    ok &= mqtt.publish(topic_relay_state(base, DEVICE_HOST, i).c_str(),
+                       on ? "ON" : "OFF", true);
+  }
+  char val[4];
+  snprintf(val, sizeof(val), "%u", hw);
+  ok &= mqtt.publish(topic_relays_state(base, DEVICE_HOST).c_str(), val, true);
+
+  if (ok)
+  {
+    g_pub = hw;
+    g_pubValid = true;
   }
 }
 
@@ -177,7 +400,7 @@ static bool parse_boolish(const String &in, bool &out, bool &isToggle)
   return false;
 }
 
-bool relay_if_mqtt_handle(PubSubClient &mqtt,
+bool relay_if_mqtt_handle(MqttClient &mqtt,
                           const String &baseTopic,
                           const String &deviceHost,
                           char *topic, byte *payload, unsigned int len)
@@ -197,8 +420,7 @@ bool relay_if_mqtt_handle(PubSubClient &mqtt,
       val = strtoul(p.c_str(), nullptr, 16);
     else
       val = strtoul(p.c_str(), nullptr, 10);
-    relay_if_write_mask((uint8_t)(val & 0xFF));
-    publish_all(mqtt, baseTopic, deviceHost);
+    relay_seq_request_mask((uint8_t)(val & 0xFF)); // sequenced, state published by driver
     return true;
   }
 
@@ -211,26 +433,12 @@ bool relay_if_mqtt_handle(PubSubClient &mqtt,
       bool v = false, isToggle = false;
       if (!parse_boolish(p, v, isToggle))
         return true; // handled (invalid payload)
-      bool ok = isToggle ? relay_if_toggle(i) : relay_if_set(i, v);
-      (void)ok;
-      // --- Publish retained relay state ---
-      bool now = ((g_mask >> (i - 1)) & 1u) != 0;
-      mqtt.publish(topic_relay_state(baseTopic, deviceHost, i).c_str(),
-              now ? "ON" : "OFF", true);
-
-// --- Publish unified event (handled by mqtt_publish_event) ---
-        mqtt_publish_event(
-            "relay_switched",                       // type
-            (i <= ROWS) ? dpms[i].user : 0,         // user id
-            i,                                      // DPM number
-            now ? "ON" : "OFF",                     // state
-            now ? "Relay switched ON" : "Relay switched OFF" // message
-        );
-
-        DBG_INFO("[MQTT] Relay %d switched %s (event published)\n",
-                 i, now ? "ON" : "OFF");
-
-        return true; // stop after handling this channel
+      if (isToggle)
+        v = !((relay_seq_target_mask() >> (i - 1)) & 1u);
+      relay_seq_request(i, v);
+      // relay_switched event + retained state follow once the plan confirms
+      DBG_INFO("[MQTT] Relay %d %s requested\n", i, v ? "ON" : "OFF");
+      return true; // stop after handling this channel
     }
   }
 
@@ -0,0 +1,264 @@
+#include "relay_seq.h"
+#include "config.h"
+#include "mqtt_if.h"
+#include "mqtt_msg_receive.h"
+#include "run_record.h"
+#include "debug_log.h"
+
+// ===========================================================
+// [SECTION RSEQ] Plan state (owned by stateTask)
+// ===========================================================
+enum RelayStep : uint8_t
+{
+  RSEQ_NONE = 0,
+  RSEQ_RAMPDOWN,   // current 0 written, waiting for the current to drop
+  RSEQ_OUTPUT_OFF, // ramp-down missed, DPM output forced off
+  RSEQ_SWITCH,     // relay requested, waiting for the expander
+};
+
+struct RelayPlan
+{
+  RelayStep step = RSEQ_NONE;
+  bool on = false;           // target relay state
+  uint32_t start_ms = 0;     // plan start
+  uint32_t deadline_ms = 0;  // deadline of the current step
+};
+
+static RelayPlan s_plan[8];
+
+// Requests from other tasks, picked up by relay_seq_tick()
+static uint8_t s_reqValid = 0;
+static uint8_t s_reqOn = 0;
+static uint8_t s_target = 0; // last requested target per relay
+static bool s_targetInit = false;
+static portMUX_TYPE s_seqMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *STEP_NAMES[] = {"none", "ramp-down", "output-off", "switch"};
+
+// ===========================================================
+// [SECTION RSEQ] Request API (any task)
+// ===========================================================
+bool relay_seq_request(uint8_t relay, bool on)
+{
+  if (relay < 1 || relay > 8)
+    return false;
+  const uint8_t bit = (uint8_t)(1u << (relay - 1));
+  portENTER_CRITICAL(&s_seqMux);
+  if (!s_targetInit)
+  {
+    s_target = relay_if_read_mask();
+    s_targetInit = true;
+  }
+  s_reqValid |= bit;
+  if (on)
+  {
+    s_reqOn |= bit;
+    s_target |= bit;
+  }
+  else
+  {
+    s_reqOn &= (uint8_t)~bit;
+    s_target &= (uint8_t)~bit;
+  }
+  portEXIT_CRITICAL(&s_seqMux);
+  return true;
+}
+
+bool relay_seq_request_mask(uint8_t mask)
+{
+  for (uint8_t i = 1; i <= 8; i++)
+    relay_seq_request(i, (mask >> (i - 1)) & 1u);
+  return true;
+}
+
+uint8_t relay_seq_target_mask()
+{
+  portENTER_CRITICAL(&s_seqMux);
+  uint8_t m = s_targetInit ? s_target : relay_if_read_mask();
+  portEXIT_CRITICAL(&s_seqMux);
+  return m;
+}
+
+bool relay_seq_busy(uint8_t relay)
+{
+  if (relay < 1 || relay > 8)
+    return false;
+  return s_plan[relay - 1].step != RSEQ_NONE;
+}
+
+// ===========================================================
+// [SECTION RSEQ] Helpers
+// ===========================================================
+static inline bool hw_is(uint8_t relay, bool on)
+{
+  return (((relay_if_hw_mask() >> (relay - 1)) & 1u) != 0) == on;
+}
+
+static inline bool has_dpm(uint8_t relay)
+{
+  return relay <= ROWS;
+}
+
+// Current is low, or cannot be measured (no DPM / DPM offline)
+static bool current_low(uint8_t relay)
+{
+  if (!has_dpm(relay) || !dpms[relay].valid)
+    return true;
+  return dpms[relay].cur_act < RSEQ_CUR_LOW_MA;
+}
+
+static void seq_event(uint8_t relay, const char *type, const char *state, const char *text)
+{
+  int user = has_dpm(relay) ? dpms[relay].user : 0;
+  mqtt_publish_event(type, user, relay, state, text);
+}
+
+static void step_late(uint8_t relay, const RelayPlan &p)
+{
+  char text[64];
+  snprintf(text, sizeof(text), "Relay %u %s deadline missed (%d mA)",
+           relay, STEP_NAMES[p.step], has_dpm(relay) ? dpms[relay].cur_act : 0);
+  seq_event(relay, "relay_seq_late", "WARN", text);
+  DBG_WARN("[RSEQ] ⚠️ %s\n", text);
+}
+
+static void go_switch(uint8_t relay, RelayPlan &p, uint32_t now)
+{
+  relay_if_set(relay, p.on);
+  p.step = RSEQ_SWITCH;
+  p.deadline_ms = now + RSEQ_CONFIRM_MS;
+}
+
+// ===========================================================
+// [SECTION RSEQ] Plan start: park the DPM, take the load off the output
+// ===========================================================
+// OFF ramps to 0 mA, not to idle_cur: a loaded bath would keep drawing
+// the idle current (default 300 mA) and never pass RSEQ_CUR_LOW_MA.
+// ON keeps the output off until the relay is confirmed closed.
+static void plan_begin(uint8_t relay, bool on, uint32_t now)
+{
+  RelayPlan &p = s_plan[relay - 1];
+  const bool replan = p.step != RSEQ_NONE;
+  p.on = on;
+  p.start_ms = now;
+
+  if (has_dpm(relay))
+  {
+    DPMState &d = dpms[relay];
+    if (!on)
+      run_record_end(relay, RUN_END_ABORTED); // the run ends when load is pulled
+    d.curve.active = false;
+    d.state = DPMState::Status::CHECK_CONTACT; // FSM no-op while sequencing
+    const int cur = on ? d.idle_cur : 0;
+    if (on && !hw_is(relay, true))
+      dpm_write_state(relay, false); // no live output onto closing contacts
+    dpm_write_current(relay, (uint16_t)cur);
+    d.curve.last_written = cur;
+  }
+
+  if (on)
+    go_switch(relay, p, now); // output off + idle current are queued ahead of the relay
+  else
+  {
+    p.step = RSEQ_RAMPDOWN;
+    p.deadline_ms = now + RSEQ_RAMPDOWN_MS;
+  }
+  DBG_INFO("[RSEQ] Relay %u → %s%s\n", relay, on ? "ON" : "OFF", replan ? " (re-planned)" : "");
+}
+
+// ===========================================================
+// [SECTION RSEQ] Plan end: hand the DPM back to the FSM
+// ===========================================================
+static void plan_done(uint8_t relay, RelayPlan &p, uint32_t now)
+{
+  const uint8_t bit = (uint8_t)(1u << (relay - 1));
+  if (has_dpm(relay))
+    dpms_apply_transitions(p.on ? 0 : bit, p.on ? bit : 0); // WAIT_CURRENT / DPM_OFF
+
+  char text[48];
+  snprintf(text, sizeof(text), "Relay switched %s (%lu ms)",
+           p.on ? "ON" : "OFF", (unsigned long)(now - p.start_ms));
+  seq_event(relay, "relay_switched", p.on ? "ON" : "OFF", text);
+  DBG_INFO("[RSEQ] Relay %u %s\n", relay, text);
+  mqtt_request_status(true);
+  p.step = RSEQ_NONE;
+}
+
+static void plan_fault(uint8_t relay, RelayPlan &p)
+{
+  char text[48];
+  snprintf(text, sizeof(text), "Relay %u not confirmed %s", relay, p.on ? "ON" : "OFF");
+  seq_event(relay, "relay_seq_fault", "ALERT", text);
+  DBG_ERROR("[RSEQ] ❌ %s\n", text);
+  if (has_dpm(relay))
+  {
+    dpm_write_state(relay, false);
+    dpms[relay].state = DPMState::Status::ERROR_STATE;
+  }
+  p.step = RSEQ_NONE;
+}
+
+// ===========================================================
+// [SECTION RSEQ] Tick: take new requests, advance every plan
+// ===========================================================
+void relay_seq_tick()
+{
+  const uint32_t now = millis();
+
+  portENTER_CRITICAL(&s_seqMux);
+  uint8_t valid = s_reqValid, reqOn = s_reqOn;
+  s_reqValid = 0;
+  portEXIT_CRITICAL(&s_seqMux);
+
+  for (uint8_t relay = 1; relay <= 8; relay++)
+  {
+    const uint8_t bit = (uint8_t)(1u << (relay - 1));
+    RelayPlan &p = s_plan[relay - 1];
+
+    if (valid & bit)
+    {
+      const bool on = (reqOn & bit) != 0;
+      if (p.step != RSEQ_NONE ? p.on != on : !hw_is(relay, on))
+        plan_begin(relay, on, now);
+    }
+
+    switch (p.step)
+    {
+    case RSEQ_NONE:
+      break;
+
+    case RSEQ_RAMPDOWN:
+      if (current_low(relay))
+        go_switch(relay, p, now);
+      else if ((int32_t)(now - p.deadline_ms) >= 0)
+      {
+        step_late(relay, p);
+        dpm_write_state(relay, false); // last resort before opening
+        p.step = RSEQ_OUTPUT_OFF;
+        p.deadline_ms = now + RSEQ_OUTPUT_OFF_MS;
+      }
+      break;
+
+    case RSEQ_OUTPUT_OFF:
+      if (current_low(relay))
+        go_switch(relay, p, now);
+      else if ((int32_t)(now - p.deadline_ms) >= 0)
+      {
+        step_late(relay, p);
+        go_switch(relay, p, now); // an OFF request is never refused
+      }
+      break;
+
+    case RSEQ_SWITCH:
+      if (hw_is(relay, p.on))
+      {
+        if (p.on && has_dpm(relay))
+          dpm_write_state(relay, true); // contacts closed: now the output
+        plan_done(relay, p, now);
+      }
+      else if ((int32_t)(now - p.deadline_ms) >= 0)
+        plan_fault(relay, p);
+      break;
+    }
+  }
+}
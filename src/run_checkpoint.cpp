@@ -0,0 +1,251 @@
+#include "run_checkpoint.h"
+#include <Preferences.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+#include "mqtt_if.h"
+#include "debug_log.h"
+#include "relay_if.h"
+#include "relay_seq.h"
+#include "run_record.h"
+#include "thermal_mgr.h"
+
+// ===========================================================
+// [SECTION CKPT] Storage: Preferences "ckpt"
+//   magic, size  written last → checkpoint complete
+//   relays       relay_if_read_mask() at save time
+//   ids          bit id = DPM id has a "d<id>" blob
+// ===========================================================
+static const uint32_t CKPT_MAGIC = 0x434B5031; // "CKP1"
+static_assert(DPMS_SIZE <= 16, "ids bitmask is 16 bit");
+
+struct DpmCkpt
+{
+  uint8_t state;          // DPMState::Status
+  uint8_t resume;         // thermal.resume (OVERHEAT pause)
+  uint32_t elapsed_ms;    // millis() - last_ms
+  uint32_t lost_ms;       // thermal runtime extension
+  double energy_temp;
+  double energy_target;
+  int32_t cur_set;
+  int32_t ectrl_out;
+  double ectrl_integ;
+  DPMState::CurveControl curve; // start_ms stored as elapsed
+  RunRecord rec;                // start_ms stored as age
+};
+
+static bool s_pending = false;
+static uint8_t s_relays = 0xFF;
+static uint16_t s_ids = 0;
+
+// Snapshot: requested by checkpoint_save (otaTask), filled by stateTask
+struct CkptSnapshot
+{
+  uint16_t ids;
+  uint8_t relays;
+  DpmCkpt dpm[DPMS_SIZE];
+};
+static CkptSnapshot s_snap;
+static volatile bool s_snapWanted = false;
+static SemaphoreHandle_t s_snapDone = nullptr;
+
+static void ckpt_key(char *key, size_t len, int id)
+{
+  snprintf(key, len, "d%d", id);
+}
+
+// ===========================================================
+// [SECTION CKPT] Readiness
+// ===========================================================
+int checkpoint_runs_open()
+{
+  int n = 0;
+  for (int id = 1; id <= ROWS; id++)
+    if (run_record_current(id).active)
+      n++;
+  return n;
+}
+
+bool checkpoint_relays_busy()
+{
+  for (uint8_t r = 1; r <= 8; r++)
+    if (relay_seq_busy(r))
+      return true;
+  return false;
+}
+
+// ===========================================================
+// [SECTION CKPT] Snapshot (stateTask, between two FSM steps)
+// ===========================================================
+static void snapshot_take()
+{
+  const uint32_t now = millis();
+  s_snap.ids = 0;
+  for (int id = 1; id <= ROWS; id++)
+  {
+    RunRecord rec;
+    if (!run_record_snapshot(id, rec))
+      continue;
+    const DPMState &d = dpms[id];
+    DpmCkpt &c = s_snap.dpm[id];
+    c.state = static_cast<uint8_t>(d.state);
+    c.resume = static_cast<uint8_t>(d.thermal.resume);
+    c.elapsed_ms = now - d.last_ms;
+    c.lost_ms = d.thermal.lost_ms;
+    c.energy_temp = d.energy_temp;
+    c.energy_target = d.energy_target;
+    c.cur_set = d.cur_set;
+    c.ectrl_out = d.ectrl.out;
+    c.ectrl_integ = d.ectrl.integ;
+    c.curve = d.curve;
+    c.curve.start_ms = now - d.curve.start_ms;
+    c.rec = rec;
+    c.rec.start_ms = now - rec.start_ms;
+    s_snap.ids |= (uint16_t)(1u << id);
+  }
+  s_snap.relays = relay_if_read_mask();
+}
+
+void checkpoint_tick()
+{
+  if (!s_snapWanted)
+    return;
+  snapshot_take();
+  s_snapWanted = false;
+  xSemaphoreGive(s_snapDone);
+}
+
+// ===========================================================
+// [SECTION CKPT] Save (otaTask, right before the restart)
+// ===========================================================
+int checkpoint_save()
+{
+  Preferences prefs;
+  if (!prefs.begin("ckpt", false))
+    return 0;
+  prefs.clear();
+
+  if (!s_snapDone)
+  {
+    prefs.end();
+    return 0;
+  }
+  xSemaphoreTake(s_snapDone, 0); // drop a late answer of an earlier request
+  s_snapWanted = true;
+  if (xSemaphoreTake(s_snapDone, pdMS_TO_TICKS(CKPT_SNAPSHOT_MS)) != pdTRUE)
+  {
+    s_snapWanted = false;
+    prefs.end();
+    DBG_ERROR("[CKPT] ❌ no snapshot from stateTask, runs not saved\n");
+    return 0;
+  }
+
+  uint16_t ids = 0;
+  int n = 0;
+  for (int id = 1; id <= ROWS; id++)
+  {
+    if (!(s_snap.ids & (1u << id)))
+      continue;
+    char key[8];
+    ckpt_key(key, sizeof(key), id);
+    if (prefs.putBytes(key, &s_snap.dpm[id], sizeof(DpmCkpt)) == sizeof(DpmCkpt))
+    {
+      ids |= (uint16_t)(1u << id);
+      n++;
+    }
+  }
+  prefs.putUChar("relays", s_snap.relays);
+  prefs.putUShort("ids", ids);
+  prefs.putUInt("size", sizeof(DpmCkpt));
+  prefs.putUInt("magic", CKPT_MAGIC);
+  prefs.end();
+  DBG_INFO("[CKPT] 💾 saved %d run(s), relays=0x%02X\n", n, s_snap.relays);
+  return n;
+}
+
+// ===========================================================
+// [SECTION CKPT] Boot: load + restore (task_system_start)
+// ===========================================================
+bool checkpoint_load()
+{
+  if (!s_snapDone)
+    s_snapDone = xSemaphoreCreateBinary();
+  Preferences prefs;
+  if (!prefs.begin("ckpt", false))
+    return false;
+  s_pending = esp_reset_reason() == ESP_RST_SW &&
+              prefs.getUInt("magic", 0) == CKPT_MAGIC &&
+              prefs.getUInt("size", 0) == sizeof(DpmCkpt);
+  if (s_pending)
+  {
+    s_relays = prefs.getUChar("relays", 0xFF);
+    s_ids = prefs.getUShort("ids", 0);
+    DBG_INFO("[CKPT] 📥 checkpoint found: ids=0x%04X relays=0x%02X\n", s_ids, s_relays);
+  }
+  else
+  {
+    prefs.clear(); // stale (power cycle, crash) or other firmware layout
+  }
+  prefs.end();
+  return s_pending;
+}
+
+uint8_t checkpoint_relay_mask()
+{
+  return s_pending ? s_relays : 0xFF;
+}
+
+int checkpoint_restore()
+{
+  if (!s_pending)
+    return 0;
+  s_pending = false;
+
+  Preferences prefs;
+  if (!prefs.begin("ckpt", false))
+    return 0;
+
+  // millis() restarted at 0 with the reboot: timestamps "0 - elapsed"
+  // make the time since boot count as run time
+  const uint32_t now = millis();
+  int n = 0;
+  for (int id = 1; id <= ROWS; id++)
+  {
+    if (!(s_ids & (1u << id)))
+      continue;
+    DpmCkpt c;
+    char key[8];
+    ckpt_key(key, sizeof(key), id);
+    if (prefs.getBytes(key, &c, sizeof(c)) != sizeof(c))
+      continue;
+
+    DPMState &d = dpms[id];
+    d.energy_temp = c.energy_temp;
+    d.energy_target = c.energy_target;
+    d.last_energy_ms = 0; // gap energy is not measured
+    d.cur_set = c.cur_set;
+    d.last_ms = 0UL - c.elapsed_ms;
+    thermal_run_begin(id);
+    d.thermal.lost_ms = c.lost_ms;
+    d.thermal.resume = static_cast<DPMState::Status>(c.resume);
+    energy_ctrl_reset(d.ectrl, c.ectrl_out, now);
+    d.ectrl.integ = c.ectrl_integ;
+    d.curve = c.curve;
+    d.curve.start_ms = 0UL - c.curve.start_ms;
+    d.curve.last_write_ms = now;
+    d.curve.last_written = -1; // rewrite the setpoint once
+
+    c.rec.start_ms = 0UL - c.rec.start_ms;
+    c.rec.last_sample_ms = now;
+    run_record_resume(id, c.rec);
+    d.state = static_cast<DPMState::Status>(c.state); // last: FSM takes over
+
+    mqtt_publish_event("run_resume", d.user, id, "INFO", "Run resumed after reboot");
+    DBG_INFO("[CKPT] ✅ DPM%d resumed at %lu s\n", id, (unsigned long)(c.elapsed_ms / 1000));
+    n++;
+  }
+  prefs.clear();
+  prefs.end();
+  return n;
+}
@@ -0,0 +1,391 @@
+#include "run_record.h"
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <math.h>
+#include "mqtt_if.h"
+#include "debug_log.h"
+#include <freertos/semphr.h>
+
+// =====================================================================
+// Storage layout: /runs.bin = header + RUN_HISTORY_MAX fixed slots (ring)
+// =====================================================================
+static const char *RUN_FILE = "/runs.bin";
+static const uint32_t RUN_MAGIC = 0x52554E31; // "RUN1"
+
+struct RunFileHeader
+{
+  uint32_t magic;
+  uint32_t next_seq; // sequence number of the next record
+  uint16_t head;     // slot of the next write
+  uint16_t count;    // valid slots
+};
+
+static RunRecord s_live[DPMS_SIZE];   // open record per DPM
+// s_live: sampled by modbusTask, opened / closed by stateTask, mqttTask
+// and httpTask, copied for the OTA checkpoint. Only whole-record copies
+// happen under the lock; the statistics are computed outside of it.
+static portMUX_TYPE s_liveMux = portMUX_INITIALIZER_UNLOCKED;
+static RunFileHeader s_hdr = {0, 1, 0, 0};
+static bool s_hdrLoaded = false;
+
+// s_hdr and /runs.bin: written by stateTask, read by httpTask (/api/runs)
+// and mqttTask. LittleFS calls may block, so a mutex, not a spinlock.
+static SemaphoreHandle_t s_fileMutex = nullptr;
+
+#ifndef RUN_LOCK_MS
+#define RUN_LOCK_MS 500
+#endif
+#ifndef RUN_PENDING_MAX
+#define RUN_PENDING_MAX 4       // closed records waiting for the file lock
+#endif
+#ifndef RUN_RETRY_MS
+#define RUN_RETRY_MS 1000
+#endif
+
+// Closed records not yet in /runs.bin (lock timeout), oldest first.
+// Added by whoever ends a run, stored by stateTask (run_record_tick);
+// whole-record copies under s_liveMux.
+static RunRecord s_pending[RUN_PENDING_MAX];
+static uint8_t s_pendingCount = 0;
+static uint32_t s_retryMs = 0;
+
+static const char *STATE_NAMES[RUN_STATE_COUNT] = {
+    "IDLE", "INIT", "WAIT_CURRENT", "WAIT_REMOVE", "RUN", "ADJUST_VOLTAGE",
+    "CHECK_CONTACT", "ERROR", "DPM_OFF", "DEFECT", "TEMP_HIGH", "OVERHEAT",
+    "CHECK_ENERGY"};
+
+static const char *END_NAMES[] = {"done", "energy_late", "energy_timeout", "aborted"};
+
+// =====================================================================
+// [SECTION RUN] History file helpers (callers hold s_fileMutex)
+// =====================================================================
+void run_record_init()
+{
+  if (!s_fileMutex)
+    s_fileMutex = xSemaphoreCreateMutex();
+}
+
+static bool file_lock()
+{
+  if (s_fileMutex && xSemaphoreTake(s_fileMutex, pdMS_TO_TICKS(RUN_LOCK_MS)) == pdTRUE)
+    return true;
+  DBG_WARN("[RUN] ⚠️ %s busy\n", RUN_FILE);
+  return false;
+}
+
+static void file_unlock()
+{
+  xSemaphoreGive(s_fileMutex);
+}
+
+static bool hdr_load()
+{
+  if (s_hdrLoaded)
+    return true;
+  File f = LittleFS.open(RUN_FILE, "r");
+  if (f)
+  {
+    RunFileHeader h;
+    if (f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == RUN_MAGIC &&
+        h.head < RUN_HISTORY_MAX && h.count <= RUN_HISTORY_MAX)
+      s_hdr = h;
+    f.close();
+  }
+  s_hdr.magic = RUN_MAGIC;
+  s_hdrLoaded = true;
+  return true;
+}
+
+static bool history_append(RunRecord &r)
+{
+  hdr_load();
+  r.seq = s_hdr.next_seq++;
+
+  // "r+" keeps existing slots; create the file on first use
+  File f = LittleFS.exists(RUN_FILE) ? LittleFS.open(RUN_FILE, "r+")
+                                     : LittleFS.open(RUN_FILE, "w+");
+  if (!f)
+  {
+    DBG_ERROR("[RUN] ❌ cannot open %s\n", RUN_FILE);
+    return false;
+  }
+  bool ok = f.seek(sizeof(RunFileHeader) + (size_t)s_hdr.head * sizeof(RunRecord)) &&
+            f.write((const uint8_t *)&r, sizeof(r)) == sizeof(r);
+
+  s_hdr.head = (s_hdr.head + 1) % RUN_HISTORY_MAX;
+  if (s_hdr.count < RUN_HISTORY_MAX)
+    s_hdr.count++;
+  ok = ok && f.seek(0) && f.write((const uint8_t *)&s_hdr, sizeof(s_hdr)) == sizeof(s_hdr);
+  f.close();
+  return ok;
+}
+
+size_t run_record_history_count()
+{
+  if (!file_lock())
+    return 0;
+  hdr_load();
+  const size_t n = s_hdr.count;
+  file_unlock();
+  return n;
+}
+
+bool run_record_history_get(size_t idx, RunRecord &out)
+{
+  if (!file_lock())
+    return false;
+  hdr_load();
+  bool ok = false;
+  if (idx < s_hdr.count)
+  {
+    size_t slot = (s_hdr.head + RUN_HISTORY_MAX - 1 - idx) % RUN_HISTORY_MAX;
+    File f = LittleFS.open(RUN_FILE, "r");
+    if (f)
+    {
+      ok = f.seek(sizeof(RunFileHeader) + slot * sizeof(RunRecord)) &&
+           f.read((uint8_t *)&out, sizeof(out)) == sizeof(out);
+      f.close();
+    }
+  }
+  file_unlock();
+  return ok;
+}
+
+bool run_record_history_find(uint32_t seq, RunRecord &out)
+{
+  if (!file_lock())
+    return false;
+  hdr_load();
+  bool ok = false;
+  File f = LittleFS.open(RUN_FILE, "r");
+  for (size_t idx = 0; f && !ok && idx < s_hdr.count; idx++)
+  {
+    size_t slot = (s_hdr.head + RUN_HISTORY_MAX - 1 - idx) % RUN_HISTORY_MAX;
+    ok = f.seek(sizeof(RunFileHeader) + slot * sizeof(RunRecord)) &&
+         f.read((uint8_t *)&out, sizeof(out)) == sizeof(out) && out.seq == seq;
+  }
+  if (f)
+    f.close();
+  file_unlock();
+  return ok;
+}
+
+// =====================================================================
+// [SECTION RUN] Lifecycle
+// =====================================================================
+void run_record_begin(int id)
+{
+  if (id < 1 || id >= DPMS_SIZE)
+    return;
+  RunRecord r;
+  r.dpm = (uint8_t)id;
+  r.mode = (uint8_t)dpms[id].mode;
+  r.user = dpms[id].user;
+  r.line_id = dpms[id].line_id;
+  r.start_ms = millis();
+  r.last_sample_ms = r.start_ms;
+  r.last_set = dpm_live_cur_set(id);
+  r.energy_target = dpms[id].energy_target;
+  r.active = 1;
+  portENTER_CRITICAL(&s_liveMux);
+  s_live[id] = r;
+  portEXIT_CRITICAL(&s_liveMux);
+}
+
+void run_record_resume(int id, const RunRecord &r)
+{
+  if (id < 1 || id >= DPMS_SIZE)
+    return;
+  RunRecord c = r;
+  c.dpm = (uint8_t)id;
+  c.active = 1;
+  portENTER_CRITICAL(&s_liveMux);
+  s_live[id] = c;
+  portEXIT_CRITICAL(&s_liveMux);
+}
+
+void run_record_sample(int id)
+{
+  if (id < 1 || id >= DPMS_SIZE)
+    return;
+  RunRecord r;
+  if (!run_record_snapshot(id, r))
+    return;
+
+  const DPMState &d = dpms[id];
+  uint32_t now = millis();
+  double dt_h = (now - r.last_sample_ms) / 3600000.0;
+  int st = static_cast<int>(d.state);
+  if (st >= 0 && st < RUN_STATE_COUNT)
+    r.state_ms[st] += now - r.last_sample_ms;
+  r.last_sample_ms = now;
+
+  // --- Welford running mean / variance of the current ---
+  r.samples++;
+  double x = (double)d.cur_act;
+  double delta = x - r.cur_mean;
+  r.cur_mean += delta / (double)r.samples;
+  r.cur_m2 += delta * (x - r.cur_mean);
+
+  // --- Extremes ---
+  if (d.cur_act < r.cur_min) r.cur_min = d.cur_act;
+  if (d.cur_act > r.cur_max) r.cur_max = d.cur_act;
+  if (d.volt_act < r.volt_min) r.volt_min = d.volt_act;
+  if (d.volt_act > r.volt_max) r.volt_max = d.volt_act;
+  if (d.temp_act > r.temp_max) r.temp_max = d.temp_act;
+
+  // --- Charge / energy (mA, mV → A, V) ---
+  double amps = d.cur_act / 1000.0;
+  r.ah += amps * dt_h;
+  r.wh += amps * (d.volt_act / 1000.0) * dt_h;
+
+  const int set = dpm_live_cur_set(id);
+  if (set != r.last_set)
+  {
+    r.setpoint_changes++;
+    r.last_set = set;
+  }
+
+  // Write back unless the run was closed / replaced meanwhile
+  portENTER_CRITICAL(&s_liveMux);
+  if (s_live[id].active && s_live[id].start_ms == r.start_ms)
+    s_live[id] = r;
+  portEXIT_CRITICAL(&s_liveMux);
+}
+
+// History + publish; false if the file is busy (record not stored)
+static bool record_store(RunRecord &r, bool wait)
+{
+  if (wait ? !file_lock() : !(s_fileMutex && xSemaphoreTake(s_fileMutex, 0) == pdTRUE))
+    return false;
+  const bool stored = history_append(r); // assigns r.seq
+  file_unlock();
+  if (stored)
+    mqtt_request_run(r.seq); // mqttTask reads it back from the ring
+  else
+    DBG_ERROR("[RUN] ❌ DPM%u record not stored, not published\n", r.dpm);
+  return true;
+}
+
+static void pending_add(const RunRecord &r)
+{
+  bool full;
+  portENTER_CRITICAL(&s_liveMux);
+  full = s_pendingCount == RUN_PENDING_MAX;
+  if (!full)
+    s_pending[s_pendingCount++] = r;
+  portEXIT_CRITICAL(&s_liveMux);
+  if (full)
+    DBG_ERROR("[RUN] ❌ DPM%u record dropped: %d records wait for %s\n",
+              r.dpm, RUN_PENDING_MAX, RUN_FILE);
+  else
+    DBG_WARN("[RUN] ⚠️ DPM%u record kept, stored when %s is free\n", r.dpm, RUN_FILE);
+}
+
+void run_record_tick()
+{
+  if (!s_pendingCount || millis() - s_retryMs < RUN_RETRY_MS)
+    return;
+  s_retryMs = millis();
+  for (;;)
+  {
+    RunRecord r;
+    portENTER_CRITICAL(&s_liveMux);
+    const bool any = s_pendingCount > 0;
+    if (any)
+      r = s_pending[0];
+    portEXIT_CRITICAL(&s_liveMux);
+    if (!any || !record_store(r, false))
+      return; // still busy: next retry in RUN_RETRY_MS
+    portENTER_CRITICAL(&s_liveMux);
+    memmove(s_pending, s_pending + 1, --s_pendingCount * sizeof(s_pending[0]));
+    portEXIT_CRITICAL(&s_liveMux);
+  }
+}
+
+void run_record_end(int id, RunEnd reason)
+{
+  if (id < 1 || id >= DPMS_SIZE)
+    return;
+  RunRecord r;
+  portENTER_CRITICAL(&s_liveMux);
+  const bool active = s_live[id].active;
+  if (active)
+  {
+    s_live[id].active = 0;
+    r = s_live[id];
+  }
+  portEXIT_CRITICAL(&s_liveMux);
+  if (!active)
+    return;
+  r.end_reason = reason;
+  r.duration_ms = millis() - r.start_ms;
+
+  // Behind older pending records, so the sequence stays in end order
+  portENTER_CRITICAL(&s_liveMux);
+  const bool queued = s_pendingCount > 0;
+  portEXIT_CRITICAL(&s_liveMux);
+  if (queued || !record_store(r, true))
+    pending_add(r);
+  DBG_INFO("[RUN] DPM%d #%lu %s: %lus, %.3f Ah, %.3f Wh, %lu samples\n",
+           id, (unsigned long)r.seq, END_NAMES[reason], r.duration_ms / 1000UL,
+           r.ah, r.wh, (unsigned long)r.samples);
+}
+
+const RunRecord &run_record_current(int id)
+{
+  if (id < 1 || id >= DPMS_SIZE)
+    id = 0;
+  return s_live[id];
+}
+
+bool run_record_snapshot(int id, RunRecord &out)
+{
+  if (id < 1 || id >= DPMS_SIZE)
+    return false;
+  portENTER_CRITICAL(&s_liveMux);
+  out = s_live[id];
+  portEXIT_CRITICAL(&s_liveMux);
+  return out.active;
+}
+
+// =====================================================================
+// [SECTION RUN] Compact JSON (MQTT message + /api/runs)
+// =====================================================================
+size_t run_record_to_json(const RunRecord &r, char *buf, size_t len)
+{
+  StaticJsonDocument<768> doc;
+  doc["seq"] = r.seq;
+  doc["dpm"] = r.dpm;
+  doc["user"] = r.user;
+  doc["line"] = r.line_id;
+  doc["mode"] = r.mode == MODE_ENERGY ? "energy" : "time";
+  doc["end"] = END_NAMES[r.end_reason < 4 ? r.end_reason : RUN_END_ABORTED];
+  doc["t"] = r.duration_ms / 1000UL;
+  doc["n"] = r.samples;
+
+  bool any = r.samples > 0;
+  JsonArray i = doc["i"].to<JsonArray>(); // [mean, sd, min, max] mA
+  i.add(any ? roundf(r.cur_mean * 10) / 10 : 0);
+  i.add(r.samples > 1 ? roundf(sqrt(r.cur_m2 / (r.samples - 1)) * 10) / 10 : 0);
+  i.add(any ? r.cur_min : 0);
+  i.add(any ? r.cur_max : 0);
+  JsonArray v = doc["v"].to<JsonArray>(); // [min, max] mV
+  v.add(any ? r.volt_min : 0);
+  v.add(any ? r.volt_max : 0);
+  doc["tmax"] = any ? r.temp_max : 0;
+  doc["ah"] = roundf(r.ah * 10000) / 10000;
+  doc["wh"] = roundf(r.wh * 1000) / 1000;
+  if (r.mode == MODE_ENERGY)
+    doc["target_j"] = r.energy_target;
+  doc["sp"] = r.setpoint_changes;
+
+  JsonObject st = doc["st"].to<JsonObject>(); // seconds per FSM state
+  for (int k = 0; k < RUN_STATE_COUNT; k++)
+    if (r.state_ms[k] >= 1000)
+      st[STATE_NAMES[k]] = r.state_ms[k] / 1000UL;
+
+  if (measureJson(doc) >= len)
+    return 0;
+  return serializeJson(doc, buf, len);
+}
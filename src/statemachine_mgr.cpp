@@ -3,15 +3,20 @@
 #include <Arduino.h>
 #include "mqtt_if.h"
 #include "debug_log.h"
+#include "run_record.h"
+#include "thermal_mgr.h"
 
 // =====================================================================
 // [SECTION STATE ] Initialize all DPMS into INIT state (ready for setup)
 // IMPORTANT: dpms[] is 1-based → valid range is [1..ROWS]
+// Runs resumed from a reboot checkpoint keep their state.
 // =====================================================================
 void initStatemachine()
 {
   for (int id = 1; id <= ROWS; id++)
   {
+    if (run_record_current(id).active)
+      continue;
     dpms[id].state = DPMState::Status::INIT; // ✅ updated
   }
   DBG_INFO("[CFG] ROWS=%d DPMS_SIZE=%d (dpms is 1-based)\n", ROWS, DPMS_SIZE);
@@ -51,6 +56,63 @@ void dpm_calc_target_energy(int id)
   DBG_INFO("[CFG] DPM%d energy_target=%.2f J (%.2f V × %.2f A × %lus)\n",
            id, dpms[id].energy_target, volt, curr, dpms[id].runtime);
 }
+// =====================================================================
+// [SECTION STATE] Current write helper: only send when the value changes
+// Counts writes per curve so run_stop can report the Modbus traffic.
+// Thermal derating is applied here, so a derate step alone triggers a write.
+// A failed enqueue leaves last_written stale (retried on the next tick);
+// an unchanged value is re-sent every DPM_CUR_REFRESH_MS, which repairs
+// a write lost after the queue (Modbus error, bus lock timeout).
+// =====================================================================
+static bool writeCurrentIfChanged(int id, int value)
+{
+  DPMState::CurveControl &c = dpms[id].curve;
+  value = thermal_apply(id, value); // active derating (100% = unchanged)
+  if (value == c.last_written && millis() - c.last_write_ms < DPM_CUR_REFRESH_MS)
+    return true;
+  if (!safeWriteCurrent(id, value))
+    return false;
+  c.last_written = value;
+  c.last_write_ms = millis();
+  c.writes++;
+  return true;
+}
+
+// =====================================================================
+// [SECTION STATE] Ramp quantisation
+// Level k (0..step_count) is start_cur + dir*k*step_size. It becomes due
+// at elapsed = ceil(k * step_size * duration / |end - start|), so the ramp
+// only touches Modbus when the integer mA value actually moves by a step.
+// =====================================================================
+static unsigned long ramp_level_ms(const DPMState::CurveControl &c, uint32_t k)
+{
+  uint32_t span = (uint32_t)abs(c.end_cur - c.start_cur);
+  if (span == 0 || k > c.step_count)
+    return c.duration;
+  uint64_t num = (uint64_t)k * (uint64_t)c.step_size * (uint64_t)c.duration;
+  return (unsigned long)((num + span - 1) / span);
+}
+
+void dpm_curve_begin(int id)
+{
+  DPMState::CurveControl &c = dpms[id].curve;
+  c.start_ms = millis();
+  c.writes = 0;
+  c.last_written = -1;
+
+  // step is at least one DPM LSB and a whole multiple of it
+  int step = c.min_step < DPM_CUR_RES_MA ? DPM_CUR_RES_MA : c.min_step;
+  step = (step / DPM_CUR_RES_MA) * DPM_CUR_RES_MA;
+  c.step_size = step;
+  c.step_count = (uint32_t)abs(c.end_cur - c.start_cur) / (uint32_t)step;
+  c.step_k = 0; // level 0 (start_cur) is due immediately
+  c.next_ms = 0;
+
+  if (c.type == 1)
+    DBG_INFO("[CURVE] DPM%d ramp %d→%d mA, %lu levels of %d mA over %lu ms\n",
+             id, c.start_cur, c.end_cur, (unsigned long)c.step_count, step, c.duration);
+}
+
 // =====================================================================
 // [SECTION STATE] Ramp up Current or Pulse mode processing (PWM-like)
 // =====================================================================
@@ -67,21 +129,46 @@ void dpm_update_curve(int id)
   switch (d.curve.type)
   {
   case 1:
-  { // --- Linear ramp ---
-    if (elapsed >= d.curve.duration)
+  { // --- Linear ramp (quantised) ---
+    DPMState::CurveControl &c = d.curve;
+    if (elapsed >= c.duration)
     {
       // ✅ Reached the end of ramp
-      d.cur_set = d.curve.end_cur;
-      safeWriteCurrent(id, d.cur_set); // ensure final target is sent once
-      d.curve.active = false;          // mark curve complete
+      d.cur_set = c.end_cur;
+      writeCurrentIfChanged(id, d.cur_set); // ensure final target is sent once
+      c.active = false;                     // mark curve complete
+      DBG_INFO("[CURVE] DPM%d ramp done, %u writes\n", id, c.writes);
+      break;
     }
-    else
+
+    // Nothing to do until the next quantised level is due
+    if (c.step_k > c.step_count || elapsed < c.next_ms)
+      break;
+
+    // Optional per-DPM rate cap: postpone, the catch-up below skips levels
+    if (c.min_interval > 0 && c.writes > 0 &&
+        now - c.last_write_ms < c.min_interval)
     {
-      // intermediate ramp step
-      float t = (float)elapsed / (float)d.curve.duration;
-      d.cur_set = d.curve.start_cur + (int)((d.curve.end_cur - d.curve.start_cur) * t);
-      safeWriteCurrent(id, d.cur_set); // send ramp update
+      c.next_ms = (c.last_write_ms + c.min_interval) - c.start_ms;
+      break;
     }
+
+    // Highest level already due (ticks may have skipped several)
+    uint32_t span = (uint32_t)abs(c.end_cur - c.start_cur);
+    uint32_t k = (uint32_t)(((uint64_t)elapsed * span) /
+                            ((uint64_t)c.step_size * c.duration));
+    if (k < c.step_k)
+      k = c.step_k;
+    if (k > c.step_count)
+      k = c.step_count;
+
+    int dir = (c.end_cur >= c.start_cur) ? 1 : -1;
+    d.cur_set = c.start_cur + dir * (int)(k * (uint32_t)c.step_size);
+    if (!writeCurrentIfChanged(id, d.cur_set)) // send ramp update
+      break;                                  // queue full: same level next tick
+
+    c.step_k = k + 1;
+    c.next_ms = ramp_level_ms(c, c.step_k);
     break;
   }
 
@@ -89,12 +176,8 @@ void dpm_update_curve(int id)
   { // --- Pulse mode ---
     unsigned long phase = elapsed % d.curve.pulse_period;
     unsigned long half = d.curve.pulse_period / 2;
-    int new_cur = (phase < half) ? d.curve.pulse_high : d.curve.pulse_low;
-    if (new_cur != d.cur_set)
-    {
-      d.cur_set = new_cur;
-      safeWriteCurrent(id, d.cur_set); // only send on change
-    }
+    d.cur_set = (phase < half) ? d.curve.pulse_high : d.curve.pulse_low;
+    writeCurrentIfChanged(id, d.cur_set); // only sends on change (or retry)
     break;
   }
 
@@ -103,6 +186,85 @@ void dpm_update_curve(int id)
   }
 }
 
+// =====================================================================
+// [SECTION STATE] run_stop event incl. current writes of this run
+// =====================================================================
+static void publish_run_stop(int id)
+{
+  char text[48];
+  snprintf(text, sizeof(text), "Process stopped (%u current writes)",
+           dpms[id].curve.writes);
+  mqtt_publish_event("run_stop", dpms[id].user, id, "INFO", text);
+}
+
+// =====================================================================
+// [SECTION ENERGY] Energy mode: reset batch + arm the controller
+// =====================================================================
+// =====================================================================
+// [SECTION STATE] Run time elapsed, minus the thermal runtime extension
+// =====================================================================
+static uint32_t dpm_run_elapsed(int id)
+{
+  return (millis() - dpms[id].last_ms) - dpms[id].thermal.lost_ms;
+}
+
+static void dpm_energy_begin(int id)
+{
+  DPMState &d = dpms[id];
+  d.energy_temp = 0.0;
+  d.last_energy_ms = 0;
+  if (d.energy_target_cfg > 0.0)
+    d.energy_target = d.energy_target_cfg;
+  else
+    dpm_calc_target_energy(id); // no explicit target → plan from V × I × t
+  energy_ctrl_reset(d.ectrl, d.cur_set, millis());
+}
+
+// =====================================================================
+// [SECTION ENERGY] Energy mode: adapt current to finish on time
+// The controller output stays in ectrl.out: cur_set is the operator's
+// setpoint (saved, and the base of the next run's target / start).
+// =====================================================================
+static bool dpm_energy_owns(const DPMState &d)
+{
+  return d.mode == MODE_ENERGY &&
+         (d.state == DPMState::Status::RUN || d.state == DPMState::Status::CHECK_ENERGY) &&
+         !(d.curve.active && d.curve.type != 0); // explicit ramp/pulse has priority
+}
+
+int dpm_live_cur_set(int id)
+{
+  const DPMState &d = dpms[id];
+  return dpm_energy_owns(d) ? d.ectrl.out : d.cur_set;
+}
+
+// Returns true while the controller owns the current setpoint
+static bool dpm_energy_control(int id)
+{
+  DPMState &d = dpms[id];
+  if (!dpm_energy_owns(d))
+    return false;
+
+  uint32_t now = millis();
+  EnergyCtrlInput in;
+  in.now_ms = now;
+  in.elapsed_ms = dpm_run_elapsed(id);
+  in.runtime_ms = d.runtime * 1000UL;
+  in.energy_j = d.energy_temp;
+  in.target_j = d.energy_target;
+  in.volt_mv = d.volt_act;
+  in.cur_ma = thermal_unscale(id, d.cur_act); // derating is not a shortfall
+
+  if (energy_ctrl_update(d.ectrl, in))
+  {
+    DBG_INFO("[ECTRL] DPM%d I=%d mA (%.0f / %.0f J, %lu s left)\n",
+             id, d.ectrl.out, d.energy_temp, d.energy_target,
+             (in.runtime_ms > in.elapsed_ms) ? (in.runtime_ms - in.elapsed_ms) / 1000UL : 0UL);
+  }
+  writeCurrentIfChanged(id, d.ectrl.out); // status / telemetry / run record: dpm_live_cur_set()
+  return true;
+}
+
 // =====================================================================
 // [SECTION ENERGY] Calculate Energy
 // =====================================================================
@@ -155,10 +317,17 @@ void handleOff(int id)
 }
 // =====================================================================
 // [SECTION STATE] Overheat temperature is too high
+// Output off until thermal_mgr clears OVERHEAT; the run is paused, not
+// aborted (runtime is extended by the pause).
 // =====================================================================
 void handleOverheat(int id)
 {
-  // dpms[id].remain_time = 0;
+  DPMState &d = dpms[id];
+  if (!d.thermal.out_off && safeWriteState(id, false))
+  {
+    d.thermal.out_off = true;
+    d.curve.last_written = -1; // forces a current write on resume
+  }
 }
 
 // ====================================================================
@@ -197,14 +366,22 @@ void handleWaitCurrent(int id)
 {
   if (debounceCheck(dpms[id].dpm_state == 2, dpms[id].waitTimer, 2000))
   {
+    const int start_cur = thermal_apply(id, dpms[id].cur_set); // derating kept across runs
     if (safeWriteVoltage(id, dpms[id].volt_set) &&
-        safeWriteCurrent(id, dpms[id].cur_set) &&
+        safeWriteCurrent(id, start_cur) &&
         safeWriteState(id, true))
     {
-      // dpm_calc_target_energy(id);
+      if (dpms[id].mode == MODE_ENERGY)
+        dpm_energy_begin(id);
       mqtt_publish_event("run_start", dpms[id].user, id, "INFO", "Process started");
+      run_record_begin(id);
+      thermal_run_begin(id);
       dpms[id].curve.active = true;              // enable curve processing
       dpms[id].curve.end_cur = dpms[id].cur_set; // ensure end_cur is set
+      dpm_curve_begin(id);                       // restart curve clock + steps
+      dpms[id].curve.last_written = start_cur;   // written above: no second write
+      dpms[id].curve.last_write_ms = millis();
+      dpms[id].curve.writes = 1;
       dpms[id].last_ms = millis();               // mark start of run
       dpms[id].waitTimer = millis();
       dpms[id].state = DPMState::Status::RUN; // ✅ updated
@@ -235,14 +412,14 @@ void handleRun(int id)
   dpm_update_energy(id);
   dpm_update_curve(id);
 
-  // If no curve active → hold last current
-  if (!dpms[id].curve.active)
-  {
-    safeWriteCurrent(id, dpms[id].cur_set);
-  }
+  // Energy mode controller owns the setpoint, otherwise cur_set (held,
+  // or moved by the ramp / pulse above) is written every tick: the
+  // derating is applied there, so a derate step reaches the DPM on the
+  // next tick, not with the next curve level (sent only on change)
+  if (!dpm_energy_control(id))
+    writeCurrentIfChanged(id, dpms[id].cur_set);
 
-  uint32_t now = millis();
-  uint32_t elapsed = now - dpms[id].last_ms;
+  uint32_t elapsed = dpm_run_elapsed(id); // extended while derated
   uint32_t elapsed_s = elapsed / 1000;
   long remain = (long)dpms[id].runtime - (long)elapsed_s;
   if (remain < 0)
@@ -256,7 +433,8 @@ void handleRun(int id)
     // Normal energy reached before time
     if (dpms[id].energy_temp >= dpms[id].energy_target)
     {
-      mqtt_publish_event("run_stop", dpms[id].user, id, "INFO", "Process stopped");
+      publish_run_stop(id);
+      run_record_end(id, RUN_END_DONE);
       safeWriteCurrent(id, dpms[id].idle_cur);
       dpms[id].state = DPMState::Status::WAIT_REMOVE; // ✅ updated
       dpms[id].remain_time = 0;
@@ -280,7 +458,8 @@ void handleRun(int id)
   if (dpms[id].mode == MODE_TIME &&
       elapsed >= dpms[id].runtime * 1000UL)
   {
-    mqtt_publish_event("run_stop", dpms[id].user, id, "INFO", "Process stopped");
+    publish_run_stop(id);
+    run_record_end(id, RUN_END_DONE);
     safeWriteCurrent(id, dpms[id].idle_cur);
     dpms[id].state = DPMState::Status::WAIT_REMOVE; // ✅ updated
     dpms[id].remain_time = 0;
@@ -312,6 +491,7 @@ bool debounceCheck(bool condition, unsigned long &timer, unsigned long delayMs)
 void handleCheckEnergy(int id)
 {
   dpm_update_energy(id);
+  dpm_energy_control(id); // keep pushing (bounded) until target or timeout
 
   // Check if energy target finally reached
   if (dpms[id].energy_temp >= dpms[id].energy_target)
@@ -319,6 +499,7 @@ void handleCheckEnergy(int id)
     DBG_INFO("[CHK] DPM %d energy reached after correction (%.1f J)\n",
              id, dpms[id].energy_temp);
     mqtt_publish_event("energy_reached_late", dpms[id].user, id, "INFO", "Energy target reached (late)");
+    run_record_end(id, RUN_END_ENERGY_LATE);
     safeWriteCurrent(id, dpms[id].idle_cur);
     dpms[id].state = DPMState::Status::WAIT_REMOVE;
     dpms[id].remain_time = 0;
@@ -327,12 +508,16 @@ void handleCheckEnergy(int id)
   }
 
   // Timeout guard: if extra correction exceeds 10% of planned time
-  unsigned long extra = millis() - (dpms[id].last_ms + dpms[id].runtime * 1000UL);
+  uint32_t run_el = dpm_run_elapsed(id);
+  unsigned long extra = (run_el > dpms[id].runtime * 1000UL)
+                            ? run_el - dpms[id].runtime * 1000UL
+                            : 0;
   if (extra > dpms[id].runtime * 100UL)
   { // 10% more time
     DBG_INFO("[CHK] DPM %d timeout (energy not reached, %.1f / %.1f J)\n",
              id, dpms[id].energy_temp, dpms[id].energy_target);
     mqtt_publish_event("energy_timeout", dpms[id].user, id, "", "Energy timeout reached");
+    run_record_end(id, RUN_END_ENERGY_TIMEOUT);
     safeWriteCurrent(id, dpms[id].idle_cur);
     dpms[id].state = DPMState::Status::WAIT_REMOVE;
     // saveEnergyTotals();
@@ -370,9 +555,11 @@ void handle_StateMachine()
     case DPMState::Status::CHECK_ENERGY:
       handleCheckEnergy(id);
       break; // ✅ updated
-    case DPMState::Status::TEMP_HIGH:
+    case DPMState::Status::OVERHEAT:
       handleOverheat(id);
       break;                              // ✅ updated
+    case DPMState::Status::TEMP_HIGH:     /* replaced by derating */
+      break;
     case DPMState::Status::CHECK_CONTACT: /* future */
       break;                              // ✅ updated
     case DPMState::Status::ERROR_STATE:   /* log error */
@@ -3,7 +3,14 @@
 #include "modbus_if.h"
 #include "mqtt_if.h"
 #include "eth_mgr.h"
+#include "net_mgr.h"
 #include "watchdog.h"
+#include "relay_seq.h"
+#include "update_mgr.h"
+#include "diag.h"
+#include "run_checkpoint.h"
+#include "run_record.h"
+#include "line_group.h"
 
 // --------------------------------------------------------------------
 // ✅ NOTE: This file does not reference DPMState::Status directly.
@@ -21,6 +28,14 @@
 #define INFLUX_PERIOD_MS    5000   // 1 sample / 5s
 #define DPM_STATUS_PERIOD_MS 1000  // 1 sample / 1s
 
+// Latency a task may add to its period before the supervisor counts a
+// deadline miss (watchdog.h); critical tasks hold back the hardware WDT
+#define HTTP_WD_LATENCY_MS    2000
+#define ETH_WD_LATENCY_MS    65000   // Ethernet.begin() DHCP blocks up to 60 s
+#define MODBUS_WD_LATENCY_MS  5000   // full read cycle + queued writes
+#define STATE_WD_LATENCY_MS   1000
+#define PUB_WD_LATENCY_MS     1000   // status / influx enqueue tasks
+
 // -------------------------------------------------------------------
 // Externs (from other modules)
 // -------------------------------------------------------------------
@@ -37,6 +52,7 @@ SemaphoreHandle_t mModbus;
 // HTTP task
 // -------------------------------------------------------------------
 static void httpTask(void*) {
+  watchdog_register_this_task(HTTP_PERIOD_MS, HTTP_WD_LATENCY_MS, false);
   TickType_t last = xTaskGetTickCount();
   for (;;) {
     http_poll();
@@ -46,14 +62,14 @@ static void httpTask(void*) {
 }
 
 // -------------------------------------------------------------------
-// Ethernet task
+// Ethernet task (+ WiFi standby and path selection)
 // -------------------------------------------------------------------
 static void ethTask(void*) {
-  TickType_t last = xTaskGetTickCount();
+  watchdog_register_this_task(ETH_PERIOD_MS, ETH_WD_LATENCY_MS);
   for (;;) {
-    eth_loop();
+    eth_wait_event(ETH_PERIOD_MS);   // W5500 IRQ or period
+    net_mgr_loop();
     watchdog_feed();
-    vTaskDelayUntil(&last, pdMS_TO_TICKS(ETH_PERIOD_MS));
   }
 }
 
@@ -61,20 +77,25 @@ static void ethTask(void*) {
 // Status publisher task (enqueue request every 1s)
 // -------------------------------------------------------------------
 static void statusTask(void*) {
+  watchdog_register_this_task(DPM_STATUS_PERIOD_MS, PUB_WD_LATENCY_MS, false);
   TickType_t last = xTaskGetTickCount();
   for (;;) {
     mqtt_request_status(true);   // enqueue status publish
+    watchdog_feed();
     vTaskDelayUntil(&last, pdMS_TO_TICKS(DPM_STATUS_PERIOD_MS));
   }
 }
 
 // -------------------------------------------------------------------
-// Influx publisher task (enqueue request every 5s)
+// Influx + line telemetry publisher task (enqueue request every 5s)
 // -------------------------------------------------------------------
 static void influxTask(void*) {
+  watchdog_register_this_task(INFLUX_PERIOD_MS, PUB_WD_LATENCY_MS, false);
   TickType_t last = xTaskGetTickCount();
   for (;;) {
     mqtt_request_influx();       // enqueue influx publish
+    mqtt_request_line();         // enqueue line-group telemetry
+    watchdog_feed();
     vTaskDelayUntil(&last, pdMS_TO_TICKS(INFLUX_PERIOD_MS));
   }
 }
@@ -83,6 +104,7 @@ static void influxTask(void*) {
 // Modbus task
 // -------------------------------------------------------------------
 static void modbusTask(void*) {
+  watchdog_register_this_task(MODBUS_PERIOD_MS, MODBUS_WD_LATENCY_MS);
   init_modbus_async_begin();      // non-blocking scanner
 
   TickType_t lastRead = xTaskGetTickCount();
@@ -122,6 +144,7 @@ static void modbusTask(void*) {
       lastRead = xTaskGetTickCount();
     }
 
+    watchdog_feed();
     vTaskDelay(pdMS_TO_TICKS(5));
   }
 }
@@ -130,21 +153,30 @@ static void modbusTask(void*) {
 // State machine task
 // -------------------------------------------------------------------
 static void stateTask(void*) {
+  watchdog_register_this_task(STATE_PERIOD_MS, STATE_WD_LATENCY_MS);
   TickType_t last = xTaskGetTickCount();
   for (;;) {
-    handle_StateMachine();       // FSM from config.h
+    relay_seq_tick();            // relay plans before the FSM
+    if (line_group_lock(portMAX_DELAY)) {
+      handle_StateMachine();     // FSM from config.h; line "set" waits for the pass
+      line_group_unlock();
+    }
+    checkpoint_tick();           // OTA reboot snapshot, between FSM steps
+    run_record_tick();           // closed runs the history file refused
     watchdog_feed();
     vTaskDelayUntil(&last, pdMS_TO_TICKS(STATE_PERIOD_MS));
   }
 }
 
 // -------------------------------------------------------------------
-// Watchdog feed task
+// Watchdog supervisor task (feeds the hardware WDT while healthy).
+// Highest application priority: a busy lower-priority task must not
+// delay the check and get blamed for a stall it did not cause.
 // -------------------------------------------------------------------
 static void watchdogTask(void*) {
   TickType_t last = xTaskGetTickCount();
   for (;;) {
-    watchdog_feed();
+    watchdog_supervise();
     vTaskDelayUntil(&last, pdMS_TO_TICKS(WDT_PERIOD_MS));
   }
 }
@@ -155,6 +187,7 @@ static void watchdogTask(void*) {
 void start_system_tasks() {
   qModbusCmd = xQueueCreate(16, sizeof(ModbusCmd));
   mModbus    = xSemaphoreCreateMutex();
+  line_group_init();             // before the tasks that run line commands
 // ✅ Create publish queue early
   qMqttPublish = xQueueCreate(32, sizeof(MqttMsg));
   xTaskCreatePinnedToCore(httpTask,     "httpTask",     4096, nullptr, 2, nullptr, 0);
@@ -166,6 +199,8 @@ void start_system_tasks() {
   xTaskCreatePinnedToCore(statusTask,   "statusTask",   4096, nullptr, 2, nullptr, 1);
   xTaskCreatePinnedToCore(modbusTask,   "modbusTask",   6144, nullptr, 4, nullptr, 1);
   xTaskCreatePinnedToCore(stateTask,    "stateTask",    4096, nullptr, 2, nullptr, 1);
-  xTaskCreatePinnedToCore(watchdogTask, "watchdogTask", 2048, nullptr, 1, nullptr, 1);
+  xTaskCreatePinnedToCore(watchdogTask, "watchdogTask", 2048, nullptr, 5, nullptr, 1);
   xTaskCreatePinnedToCore(influxTask,   "influxTask",   4096, nullptr, 2, nullptr, 1);
+  update_mgr_start_task();       // OTA downloads + post-update health check
+  diag_start_task();             // task / queue / heap sampling
 }
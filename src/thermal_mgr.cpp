@@ -0,0 +1,150 @@
+#include "thermal_mgr.h"
+#include <Arduino.h>
+#include "mqtt_if.h"
+#include "debug_log.h"
+
+// =====================================================================
+// [SECTION THERMAL] Helpers
+// =====================================================================
+static inline bool is_run_state(DPMState::Status s)
+{
+  return s == DPMState::Status::RUN || s == DPMState::Status::CHECK_ENERGY;
+}
+
+int thermal_time_to_crit(int id)
+{
+  const DPMState &d = dpms[id];
+  if (d.thermal.slope <= 0.001f)
+    return -1;
+  float s = (d.temp_crit - d.thermal.temp_f) / d.thermal.slope;
+  return s < 0 ? 0 : (int)s;
+}
+
+int thermal_apply(int id, int cur)
+{
+  return (int)((long)cur * dpms[id].thermal.derate_pct / 100);
+}
+
+int thermal_unscale(int id, int cur)
+{
+  uint8_t pct = dpms[id].thermal.derate_pct;
+  return pct ? (int)((long)cur * 100 / pct) : cur;
+}
+
+void thermal_run_begin(int id)
+{
+  dpms[id].thermal.lost_ms = 0;
+  dpms[id].thermal.lost_frac = 0.0f;
+}
+
+static void derate_event(int id, const char *type, const char *state)
+{
+  const DPMState &d = dpms[id];
+  char text[64];
+  snprintf(text, sizeof(text), "I=%u%% T=%.1fC ttc=%ds ext=%lus",
+           d.thermal.derate_pct, d.thermal.temp_f, thermal_time_to_crit(id),
+           d.thermal.lost_ms / 1000UL);
+  mqtt_publish_event(type, d.user, id, state, text);
+  DBG_WARN("[THERM] DPM%d %s %s\n", id, type, text);
+}
+
+// =====================================================================
+// [SECTION THERMAL] Sample processing
+// =====================================================================
+void thermal_on_sample(int id)
+{
+  DPMState &d = dpms[id];
+  DPMState::ThermalState &t = d.thermal;
+  unsigned long now = millis();
+
+  if (t.last_ms == 0)
+  {
+    t.temp_f = (float)d.temp_act;
+    t.slope = 0.0f;
+    t.last_ms = now;
+    t.step_ms = now;
+    return;
+  }
+
+  unsigned long dt = now - t.last_ms;
+  if (dt == 0)
+    return;
+  t.last_ms = now;
+
+  // --- Filtered temperature + slope (°C/s) ---
+  float prev = t.temp_f;
+  t.temp_f += THERM_ALPHA * ((float)d.temp_act - t.temp_f);
+  float inst = (t.temp_f - prev) * 1000.0f / (float)dt;
+  t.slope += THERM_SLOPE_ALPHA * (inst - t.slope);
+
+  // --- Runtime extension for charge lost while derated / paused ---
+  if (is_run_state(d.state) ||
+      (d.state == DPMState::Status::OVERHEAT && is_run_state(t.resume)))
+  {
+    uint8_t pct = (d.state == DPMState::Status::OVERHEAT) ? 0 : t.derate_pct;
+    t.lost_frac += dt * (100 - pct) / 100.0f;
+    unsigned long whole = (unsigned long)t.lost_frac;
+    t.lost_ms += whole;
+    t.lost_frac -= whole;
+  }
+
+  // --- Hard limit: OVERHEAT (last resort) ---
+  if (d.temp_act >= d.temp_crit && d.state != DPMState::Status::OVERHEAT)
+  {
+    t.resume = d.state;
+    t.derate_pct = THERM_MIN_PCT;
+    t.out_off = false; // handleOverheat() switches the output off
+    d.state = DPMState::Status::OVERHEAT;
+    derate_event(id, "overheat", "ALERT");
+    return;
+  }
+  if (d.state == DPMState::Status::OVERHEAT)
+  {
+    if (d.temp_act < d.temp_warn - THERM_HYST_C)
+    {
+      t.step_ms = now;
+      t.out_off = false;
+      if (is_run_state(t.resume))
+      {
+        d.state = t.resume; // continue batch (runtime already extended)
+        dpm_write_state((uint8_t)id, true);
+      }
+      else if (t.resume == DPMState::Status::WAIT_REMOVE)
+      {
+        // batch done: idle current again until the load is removed
+        dpm_write_current((uint8_t)id, (uint16_t)d.idle_cur);
+        dpm_write_state((uint8_t)id, true);
+        d.state = t.resume;
+      }
+      else
+      {
+        d.state = DPMState::Status::INIT; // no batch: restart with safe V/I
+      }
+      derate_event(id, "overheat_clear", "INFO");
+    }
+    return;
+  }
+
+  if (now - t.step_ms < THERM_STEP_MS)
+    return;
+
+  // --- Predictive derating ---
+  int ttc = thermal_time_to_crit(id);
+  bool hot = t.temp_f >= d.temp_warn || (ttc >= 0 && ttc < THERM_HORIZON_S);
+  bool cool = t.temp_f < d.temp_warn - THERM_HYST_C && t.slope <= 0.0f;
+
+  if (hot && t.derate_pct > THERM_MIN_PCT)
+  {
+    t.derate_pct = (t.derate_pct - THERM_STEP_PCT < THERM_MIN_PCT)
+                       ? THERM_MIN_PCT
+                       : t.derate_pct - THERM_STEP_PCT;
+    t.step_ms = now;
+    derate_event(id, "thermal_derate", "WARN");
+  }
+  else if (cool && t.derate_pct < 100)
+  {
+    t.derate_pct = (t.derate_pct + THERM_STEP_PCT > 100) ? 100 : t.derate_pct + THERM_STEP_PCT;
+    t.step_ms = now;
+    derate_event(id, "thermal_recover", "INFO");
+  }
+}
@@ -1,19 +1,32 @@
 #include "update_mgr.h"
-#include "mqtt_if.h"          // mqtt_publish_event(type, pct, retained=false)
+#include "mqtt_if.h"          // mqtt_send_event(), qMqttPublish
 #include <Arduino.h>
-#include <Update.h>
-#include <MD5Builder.h>
 #include <cstring>
+#include <sdkconfig.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/md5.h>
+#if CONFIG_IDF_TARGET_ESP32S3
+  #include <esp32s3/rom/miniz.h>   // tinfl in ROM
+#elif CONFIG_IDF_TARGET_ESP32
+  #include <esp32/rom/miniz.h>
+#else
+  #error "update_mgr: no ROM miniz include for this target"
+#endif
 #include "config.h"
 #include "watchdog.h"   // watchdog_feed()
+#include "ota_delta.h"      // DPMDELTA patches
+#include "run_checkpoint.h" // reboot gating + run checkpoint
 #include <ArduinoHttpClient.h>
+#include <Preferences.h>
 #include "debug_log.h"
 // ---------- Select your transport ----------
 #define USE_ETHERNET 1   // set 1 for W5500, 0 for Wi-Fi
 
 #if USE_ETHERNET
-  #include <Ethernet.h>
-  static EthernetClient httpSock;
+  #include "w5500_client.h"
+  static W5500Client httpSock;      // burst SPI data path
 #else
   #include <WiFi.h>
   #include <WiFiClient.h>
@@ -21,25 +34,109 @@
 #endif
 
 // -------------------------------------------------------------------
-// OTA event helper — unified MQTT event publisher
+// Job handed from update_mgr_begin() (any task) to otaTask
 // -------------------------------------------------------------------
-static inline void ota_evt(const char *type, float pct = 0.0f, const char *msg = nullptr)
+struct OtaJob
 {
-    char text[64];
+  char url[256];
+  uint8_t sha[32];
+  bool haveSha;
+  char md5[33];
+  bool reboot;
+  uint32_t deadlineS;  // reboot waits for idle DPMs at most this long
+};
+
+static OtaJob s_job;
+static TaskHandle_t s_otaTask = nullptr;
+// Running image not confirmed yet (trial boot): no new OTA until then
+static volatile bool s_verifyPending = false;
+static uint32_t s_verifyT0 = 0;
+static void ota_trial_arm(const esp_partition_t *next);
+static volatile bool s_busy = false;
+static portMUX_TYPE s_otaMux = portMUX_INITIALIZER_UNLOCKED;
+
+// -------------------------------------------------------------------
+// Double-buffered flash writer: otaTask fills one buffer from the
+// socket while flashTask erases/programs the other (other core)
+// -------------------------------------------------------------------
+#define OTA_SECTOR     SPI_FLASH_SEC_SIZE
+#define OTA_BLK_FLUSH  0xFF   // block index: drain marker
+#define OTA_BLK_WAKE   0xFE   // block index: start erasing ahead
+
+struct OtaBlock { uint8_t idx; uint16_t len; };
+
+static uint8_t s_bufs[2][OTA_BUF_SIZE];
+static QueueHandle_t s_qFull = nullptr;   // OtaBlock, otaTask → flashTask
+static QueueHandle_t s_qFree = nullptr;   // buffer index, flashTask → otaTask
+static SemaphoreHandle_t s_drained = nullptr;
 
-    if (pct > 0.0f && pct < 100.0f)
-        snprintf(text, sizeof(text), "Progress %.1f%%", pct);
-    else if (pct >= 100.0f)
-        snprintf(text, sizeof(text), "Complete");
-    else if (msg)
-        snprintf(text, sizeof(text), "%s", msg);
-    else
-        snprintf(text, sizeof(text), "Processing");
+// Writer state: set by otaTask while flashTask is idle, then owned by
+// flashTask until the drain marker is acknowledged
+struct OtaFlash
+{
+  const esp_partition_t *part = nullptr;
+  size_t off = 0;        // next write offset
+  size_t erased = 0;     // [0, erased) is erased (sector aligned)
+  size_t limit = 0;      // erase-ahead stops here
+  esp_err_t err = ESP_OK;
+  bool md5 = false;
+  uint32_t busyMs = 0;   // time spent in erase + program
+  mbedtls_sha256_context sha;
+  mbedtls_md5_context md5ctx;
+};
+static OtaFlash s_fw;
+
+// Producer side (otaTask)
+static int s_cur = -1;      // buffer being filled, -1 = none
+static size_t s_fill = 0;
+static uint32_t s_waitMs = 0; // time otaTask waited for a free buffer
+
+// Last result, read by mqttTask for ota_complete
+struct OtaResult { uint32_t bytes, ms, flashMs, waitMs; };
+static OtaResult s_result;
 
-    // Using user=0, DPM=0 since this is a system-level event
-    mqtt_publish_event(type, 0, 0, "OTA", text);
+// -------------------------------------------------------------------
+// OTA event helper — queued to mqttTask
+// -------------------------------------------------------------------
+static void ota_post(const char *type, int value = 0)
+{
+  DBG_INFO("[OTA] %s %d\n", type, value);
+  if (!qMqttPublish)
+    return;
+  MqttMsg msg = {MSG_OTA, false, 0, 0, value};
+  snprintf(msg.eventType, sizeof(msg.eventType), "%s", type);
+  if (xQueueSend(qMqttPublish, &msg, 0) != pdTRUE)
+    DBG_WARN("[MQTT] queue full, dropped OTA %s\n", type);
 }
 
+bool update_mgr_mqtt_publish(const char *type, int value)
+{
+  char text[96];
+  if (!strcmp(type, "ota_progress"))
+    snprintf(text, sizeof(text), "Progress %d%%", value);
+  else if (!strcmp(type, "ota_resume"))
+    snprintf(text, sizeof(text), "Resume at %d bytes", value);
+  else if (!strcmp(type, "ota_reboot_wait"))
+    snprintf(text, sizeof(text), "Reboot waits for %d open run(s)", value);
+  else if (!strcmp(type, "ota_reboot"))
+    snprintf(text, sizeof(text), "Rebooting, %d open run(s) checkpointed", value);
+  else if (!strcmp(type, "ota_http_err"))
+    snprintf(text, sizeof(text), "HTTP error %d", value);
+  else if (!strcmp(type, "ota_complete")) {
+    const OtaResult r = s_result;
+    const uint32_t bps = r.ms ? (uint32_t)((uint64_t)r.bytes * 1000 / r.ms) : 0;
+    snprintf(text, sizeof(text), "Complete %u B in %u ms, %u.%u kB/s (flash %u ms, buf wait %u ms)",
+             (unsigned)r.bytes, (unsigned)r.ms, (unsigned)(bps / 1000), (unsigned)(bps % 1000 / 100),
+             (unsigned)r.flashMs, (unsigned)r.waitMs);
+  }
+  else if (!strcmp(type, "firmware_version"))
+    snprintf(text, sizeof(text), "FW %s", FW_VERSION_STRING);
+  else
+    snprintf(text, sizeof(text), "%s", type);
+
+  // Using user=0, DPM=0 since this is a system-level event
+  return mqtt_send_event(type, 0, 0, "OTA", text);
+}
 
 // Parse "http://host[:port]/path"
 static bool parseHttpUrl(const char* url, String& host, uint16_t& port, String& path) {
@@ -63,160 +160,826 @@ static bool parseHttpUrl(const char* url, String& host, uint16_t& port, String&
   }
   return host.length() > 0;
 }
+
+// 2*n hex chars → n bytes
+static bool parseHex(const char *s, uint8_t *out, size_t n)
+{
+  if (strlen(s) != n * 2)
+    return false;
+  for (size_t i = 0; i < n * 2; i++)
+  {
+    char c = s[i];
+    int v = (c >= '0' && c <= '9') ? c - '0'
+          : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+          : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+    if (v < 0)
+      return false;
+    out[i / 2] = (uint8_t)((i & 1) ? (out[i / 2] | v) : (v << 4));
+  }
+  return true;
+}
+
 // ===========================================================
-// [SECTION OTA] Start OTA Update from given URL
+// [SECTION OTA] Queue an update (any task)
 // ===========================================================
+bool update_mgr_begin(const char *url, const char *sha256, const char *md5, bool reboot,
+                      uint32_t deadline_s)
+{
+  if (!url || strncmp(url, "http://", 7) != 0 || strlen(url) >= sizeof(s_job.url)) {
+    ota_post("ota_bad_url");
+    return false;
+  }
 
-void update_mgr_begin(const char* url, const char* md5, bool reboot)
+  OtaJob job = {};
+  strcpy(job.url, url);
+  job.reboot = reboot;
+  job.deadlineS = deadline_s;
+  if (sha256 && *sha256) {
+    if (!parseHex(sha256, job.sha, sizeof(job.sha))) {
+      ota_post("ota_sha_invalid");
+      return false;
+    }
+    job.haveSha = true;
+  }
+  if (md5 && *md5) {
+    uint8_t tmp[16];
+    if (!parseHex(md5, tmp, sizeof(tmp))) {
+      // ❌ Invalid MD5 provided → abort OTA early
+      ota_post("ota_md5_invalid");
+      return false;
+    }
+    strcpy(job.md5, md5);
+  }
+
+  if (s_verifyPending) {
+    ota_post("ota_verify_pending"); // the running image is not confirmed yet
+    return false;
+  }
+
+  portENTER_CRITICAL(&s_otaMux);
+  const bool busy = s_busy || !s_otaTask;
+  if (!busy) {
+    s_job = job;
+    s_busy = true;
+  }
+  portEXIT_CRITICAL(&s_otaMux);
+
+  if (busy) {
+    ota_post("ota_busy");
+    return false;
+  }
+  xTaskNotifyGive(s_otaTask);
+  return true;
+}
+
+bool update_mgr_busy() { return s_busy; }
+
+// ===========================================================
+// [SECTION OTA] Flash writer task (erase-ahead, program, hash)
+// ===========================================================
+static void fw_erase_to(size_t end)
 {
-  if (!url || !url[0]) {
-    ota_evt("ota_bad_url", 0, "Bad OTA URL");
+  while (s_fw.err == ESP_OK && s_fw.erased < end) {
+    s_fw.err = esp_partition_erase_range(s_fw.part, s_fw.erased, OTA_SECTOR);
+    s_fw.erased += OTA_SECTOR;
+  }
+}
+
+static void flashTask(void *)
+{
+  // Tracked only, like otaTask; idle it wakes once a second to check in
+  watchdog_register_this_task(1000, 5000, false);
+  for (;;) {
+    watchdog_feed();
+    // Nothing queued: erase the next sector(s) ahead of the writes
+    const bool ahead = s_fw.part && s_fw.err == ESP_OK &&
+                       s_fw.erased < s_fw.off + OTA_ERASE_AHEAD * OTA_SECTOR &&
+                       s_fw.erased < s_fw.limit;
+    OtaBlock b;
+    if (xQueueReceive(s_qFull, &b, pdMS_TO_TICKS(ahead ? 0 : 1000)) != pdTRUE) {
+      if (!ahead)
+        continue;
+      const uint32_t t0 = millis();
+      fw_erase_to(s_fw.erased + OTA_SECTOR);
+      s_fw.busyMs += millis() - t0;
+      continue;
+    }
+    if (b.idx == OTA_BLK_WAKE)
+      continue;
+    if (b.idx == OTA_BLK_FLUSH) {
+      s_fw.part = nullptr;            // idle until the next download
+      xSemaphoreGive(s_drained);
+      continue;
+    }
+
+    const uint8_t *p = s_bufs[b.idx];
+    if (s_fw.err == ESP_OK && s_fw.off + b.len > s_fw.part->size)
+      s_fw.err = ESP_ERR_INVALID_SIZE;
+    if (s_fw.err == ESP_OK) {
+      const uint32_t t0 = millis();
+      fw_erase_to((s_fw.off + b.len + OTA_SECTOR - 1) & ~(size_t)(OTA_SECTOR - 1));
+      if (s_fw.err == ESP_OK)
+        s_fw.err = esp_partition_write(s_fw.part, s_fw.off, p, b.len);
+      s_fw.busyMs += millis() - t0;
+      mbedtls_sha256_update_ret(&s_fw.sha, p, b.len);
+      if (s_fw.md5)
+        mbedtls_md5_update_ret(&s_fw.md5ctx, p, b.len);
+    }
+    s_fw.off += b.len;
+    xQueueSend(s_qFree, &b.idx, portMAX_DELAY);
+  }
+}
+
+// -------------------------------------------------------------------
+// Producer side (otaTask)
+// -------------------------------------------------------------------
+static bool fw_begin(long total, bool md5)
+{
+  const esp_partition_t *part = esp_ota_get_next_update_partition(nullptr);
+  if (!part || (total > 0 && (size_t)total > part->size))
+    return false;
+
+  s_fw.off = 0;
+  s_fw.erased = 0;
+  s_fw.err = ESP_OK;
+  s_fw.busyMs = 0;
+  s_fw.md5 = md5;
+  s_fw.limit = total > 0 ? ((size_t)total + OTA_SECTOR - 1) & ~(size_t)(OTA_SECTOR - 1) : part->size;
+  mbedtls_sha256_init(&s_fw.sha);
+  mbedtls_sha256_starts_ret(&s_fw.sha, 0);
+  mbedtls_md5_init(&s_fw.md5ctx);
+  mbedtls_md5_starts_ret(&s_fw.md5ctx);
+  s_cur = -1;
+  s_fill = 0;
+  s_waitMs = 0;
+
+  // Both buffers free; publishing 'part' lets flashTask erase ahead
+  xQueueReset(s_qFree);
+  for (uint8_t i = 0; i < 2; i++)
+    xQueueSend(s_qFree, &i, 0);
+  s_fw.part = part;
+  OtaBlock wake = {OTA_BLK_WAKE, 0};
+  xQueueSend(s_qFull, &wake, portMAX_DELAY);
+  DBG_INFO("[OTA] writing to %s @0x%x (%u bytes)\n", part->label, (unsigned)part->address, (unsigned)part->size);
+  return true;
+}
+
+// Free space in the buffer being filled (takes a free buffer if needed)
+static uint8_t *fw_space(size_t &room)
+{
+  if (s_cur < 0) {
+    uint8_t idx;
+    const uint32_t t0 = millis();
+    xQueueReceive(s_qFree, &idx, portMAX_DELAY); // flash is the bottleneck
+    s_waitMs += millis() - t0;
+    s_cur = idx;
+    s_fill = 0;
+  }
+  room = OTA_BUF_SIZE - s_fill;
+  return s_bufs[s_cur] + s_fill;
+}
+
+static void fw_handoff()
+{
+  if (s_cur < 0)
     return;
+  OtaBlock b = {(uint8_t)s_cur, (uint16_t)s_fill};
+  xQueueSend(s_qFull, &b, portMAX_DELAY);
+  s_cur = -1;
+}
+
+// n bytes were appended at fw_space(); full buffers go to flashTask
+static bool fw_commit(size_t n)
+{
+  s_fill += n;
+  if (s_fill >= OTA_BUF_SIZE)
+    fw_handoff();
+  return s_fw.err == ESP_OK;
+}
+
+// Hand off the last partial buffer and wait until flashTask is idle
+static bool fw_finish(uint8_t sha[32], uint8_t md5[16])
+{
+  if (s_fill)
+    fw_handoff();
+  s_cur = -1;   // an empty buffer is simply dropped (fw_begin refills s_qFree)
+  OtaBlock flush = {OTA_BLK_FLUSH, 0};
+  xQueueSend(s_qFull, &flush, portMAX_DELAY);
+  xSemaphoreTake(s_drained, portMAX_DELAY);
+
+  mbedtls_sha256_finish_ret(&s_fw.sha, sha);
+  mbedtls_sha256_free(&s_fw.sha);
+  mbedtls_md5_finish_ret(&s_fw.md5ctx, md5);
+  mbedtls_md5_free(&s_fw.md5ctx);
+  if (s_fw.err != ESP_OK)
+    DBG_ERROR("[OTA] ❌ flash error %s at %u\n", esp_err_to_name(s_fw.err), (unsigned)s_fw.off);
+  return s_fw.err == ESP_OK;
+}
+
+// Copy into the writer's buffers (delta output, header bytes)
+static bool fw_write(const uint8_t *p, size_t n)
+{
+  while (n) {
+    size_t room;
+    uint8_t *dst = fw_space(room);
+    const size_t k = n < room ? n : room;
+    memcpy(dst, p, k);
+    p += k;
+    n -= k;
+    if (!fw_commit(k))
+      return false;
   }
+  return s_fw.err == ESP_OK;
+}
 
-  // Optional MD5 (32 hex)
-  char wanted_md5[33] = {0};
-  bool want_check = false;
+// ===========================================================
+// [SECTION OTA] Delta patches: inflate + apply against the running app
+// ===========================================================
+struct OtaDelta
+{
+  const esp_partition_t *src = nullptr;
+  tinfl_decompressor *inf = nullptr;
+  uint8_t *dict = nullptr;        // TINFL_LZ_DICT_SIZE output ring
+  size_t dictOfs = 0;
+  DeltaHdr hdr;
+  DeltaApply apply;
+  DeltaResult state = DELTA_MORE;
+};
+static OtaDelta s_delta; // otaTask only
+
+static bool delta_read_src(void *, uint32_t off, uint8_t *dst, size_t n)
+{
+  return esp_partition_read(s_delta.src, off, dst, n) == ESP_OK;
+}
 
-  if (md5 && *md5) {
-    size_t n = strlen(md5);
+static bool delta_write_out(void *, const uint8_t *p, size_t n)
+{
+  return fw_write(p, n);
+}
 
-    if (n == 32) {
-      strncpy(wanted_md5, md5, 32);
-      wanted_md5[32] = 0;
-      want_check = true;
-    } else {
-      // ❌ Invalid MD5 provided → abort OTA early
-      ota_evt("ota_md5_invalid", 0, "MD5 invalid length");
-      mqtt_publish_event("ota_abort_invalid_md5", 0, 0, "OTA", md5);
-      return;   // stop before doing anything
+static void delta_end()
+{
+  free(s_delta.inf);
+  free(s_delta.dict);
+  s_delta.inf = nullptr;
+  s_delta.dict = nullptr;
+}
+
+// The patch must have been made against exactly the running image
+static bool delta_base_ok(const DeltaHdr &h)
+{
+  const esp_partition_t *run = esp_ota_get_running_partition();
+  if (!run || h.src_size > run->size)
+    return false;
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  uint8_t *buf = s_bufs[0]; // free: fw_begin() has not run yet
+  for (size_t off = 0; off < h.src_size; off += OTA_BUF_SIZE) {
+    const size_t n = (h.src_size - off) < OTA_BUF_SIZE ? (h.src_size - off) : OTA_BUF_SIZE;
+    if (esp_partition_read(run, off, buf, n) != ESP_OK)
+      break;
+    mbedtls_sha256_update_ret(&sha, buf, n);
+    watchdog_feed();
+  }
+  uint8_t got[32];
+  mbedtls_sha256_finish_ret(&sha, got);
+  mbedtls_sha256_free(&sha);
+  s_delta.src = run;
+  return memcmp(got, h.src_sha, sizeof(got)) == 0;
+}
+
+static bool delta_begin(const DeltaHdr &h)
+{
+  s_delta.hdr = h;
+  s_delta.inf = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+  s_delta.dict = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+  if (!s_delta.inf || !s_delta.dict) {
+    delta_end();
+    return false;
+  }
+  tinfl_init(s_delta.inf);
+  s_delta.dictOfs = 0;
+  s_delta.state = DELTA_MORE;
+  s_delta.apply.begin(h, delta_read_src, delta_write_out, nullptr);
+  return true;
+}
+
+// Compressed patch bytes → inflate → ops → flash writer
+static bool delta_feed(const uint8_t *p, size_t n)
+{
+  OtaDelta &d = s_delta;
+  for (;;) {
+    size_t inBytes = n;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - d.dictOfs;
+    tinfl_status st = tinfl_decompress(d.inf, p, &inBytes, d.dict, d.dict + d.dictOfs,
+                                       &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+    p += inBytes;
+    n -= inBytes;
+    if (outBytes) {
+      d.state = d.apply.feed(d.dict + d.dictOfs, outBytes);
+      d.dictOfs = (d.dictOfs + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+      if (d.state == DELTA_ERR) {
+        DBG_ERROR("[OTA] ❌ delta: %s at %u\n", d.apply.error(), (unsigned)d.apply.out());
+        return false;
+      }
     }
+    if (st < TINFL_STATUS_DONE) {
+      DBG_ERROR("[OTA] ❌ delta: inflate status %d\n", (int)st);
+      return false;
+    }
+    if (st == TINFL_STATUS_DONE || (st == TINFL_STATUS_NEEDS_MORE_INPUT && !n))
+      return true;
   }
+}
 
+// ===========================================================
+// [SECTION OTA] One HTTP request: stream from offset 'written'
+// ===========================================================
+enum OtaStep { OTA_STEP_DONE, OTA_STEP_RETRY, OTA_STEP_FATAL };
+enum OtaMode : uint8_t { OTA_MODE_UNKNOWN, OTA_MODE_FULL, OTA_MODE_DELTA };
+
+struct OtaDl
+{
   String host, path;
   uint16_t port = 80;
-  if (!parseHttpUrl(url, host, port, path)) {
-    ota_evt("ota_bad_url", 0, "Bad OTA URL");
-    return;
+  size_t written = 0;   // body bytes consumed (Range offset)
+  long total = -1;      // body size, -1 = unknown
+  bool begun = false;   // fw_begin() done
+  OtaMode mode = OTA_MODE_UNKNOWN;
+  uint8_t head[DELTA_HDR_SIZE]; // first body bytes until the mode is known
+  size_t headLen = 0;
+  int lastPct = -1;
+};
+
+static uint8_t s_in[1024]; // body bytes that do not go straight to flash
+
+static bool ota_delta_feed(const uint8_t *p, size_t n)
+{
+  if (delta_feed(p, n))
+    return true;
+  ota_post(s_fw.err != ESP_OK ? "ota_write_err" : "ota_delta_err");
+  return false;
+}
+
+// First body bytes decide: full image or DPMDELTA patch.
+// Posts its own error event when it returns false.
+static bool ota_consume(OtaDl &dl, const OtaJob &job, const uint8_t *p, size_t n)
+{
+  if (dl.mode == OTA_MODE_DELTA)
+    return ota_delta_feed(p, n);
+
+  size_t k = DELTA_HDR_SIZE - dl.headLen;
+  if (k > n) k = n;
+  memcpy(dl.head + dl.headLen, p, k);
+  dl.headLen += k;
+  p += k;
+  n -= k;
+  if (dl.headLen < 8 || (delta_is_patch(dl.head, dl.headLen) && dl.headLen < DELTA_HDR_SIZE))
+    return true; // need more
+
+  if (!delta_is_patch(dl.head, dl.headLen)) {
+    if (!fw_begin(dl.total, job.md5[0] != 0)) {
+      ota_post("ota_begin_fail");
+      return false;
+    }
+    dl.begun = true;
+    dl.mode = OTA_MODE_FULL;
+    if (fw_write(dl.head, dl.headLen) && fw_write(p, n))
+      return true;
+    ota_post("ota_write_err");
+    return false;
   }
 
-  if (!path.startsWith("/")) path = "/" + path;
+  DeltaHdr h;
+  if (!delta_parse_header(dl.head, dl.headLen, h)) {
+    ota_post("ota_delta_err");
+    return false;
+  }
+  if (!delta_base_ok(h)) {
+    ota_post("ota_delta_base"); // patch made for another firmware
+    return false;
+  }
+  if (!delta_begin(h)) {
+    ota_post("ota_nomem");
+    return false;
+  }
+  if (!fw_begin(h.dst_size, job.md5[0] != 0)) {
+    ota_post("ota_begin_fail");
+    return false;
+  }
+  DBG_INFO("[OTA] delta patch: %u → %u bytes\n", (unsigned)h.src_size, (unsigned)h.dst_size);
+  dl.begun = true;
+  dl.mode = OTA_MODE_DELTA;
+  return ota_delta_feed(p, n);
+}
 
-  ota_evt("ota_start", 0, "OTA Start");
+// "bytes <start>-<end>/<total>"
+static bool parseContentRange(const String &v, size_t &start, long &total)
+{
+  unsigned long s = 0, e = 0, t = 0;
+  if (sscanf(v.c_str(), "bytes %lu-%lu/%lu", &s, &e, &t) != 3)
+    return false;
+  start = s;
+  total = (long)t;
+  return true;
+}
 
-  HttpClient http(httpSock, host.c_str(), port);
-  http.connectionKeepAlive();
+static OtaStep ota_stream(OtaDl &dl, const OtaJob &job)
+{
+  HttpClient http(httpSock, dl.host.c_str(), dl.port);
+  http.setHttpResponseTimeout(OTA_READ_TIMEOUT_MS);
 
-  int err = http.get(path.c_str());
-  if (err != 0) {
-    ota_evt("ota_http_err", 0, "GET failed");
+  http.beginRequest();
+  if (http.get(dl.path.c_str()) != 0) {
     http.stop();
-    return;
+    return OTA_STEP_RETRY;
   }
+  if (dl.written) {
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%u-", (unsigned)dl.written);
+    http.sendHeader("Range", range);
+  }
+  http.endRequest();
 
-  int status = http.responseStatusCode();
-  DBG_INFO("[OTA] HTTP status = %d for %s:%u%s\n",
-           status, host.c_str(), port, path.c_str());
-
-  if (status != 200) {
-    ota_evt("ota_http_err", 0, ("HTTP error " + String(status)).c_str());
+  const int status = http.responseStatusCode();
+  DBG_INFO("[OTA] HTTP status = %d for %s:%u%s (from %u)\n",
+           status, dl.host.c_str(), dl.port, dl.path.c_str(), (unsigned)dl.written);
+  if (status < 0) {
     http.stop();
-    return;
+    return OTA_STEP_RETRY;
   }
-
-  // --- Continue with existing code below (Update.begin, loop, MD5 compare, etc.) ---
-
-  // Content length (-1 if unknown or chunked)
-  int total = http.contentLength();
-  // Ensure the body is positioned correctly
-  http.skipResponseHeaders();
-
-  // Begin Update
-  size_t begin_len = (total > 0) ? (size_t)total : (size_t)UPDATE_SIZE_UNKNOWN;
-  if (!Update.begin(begin_len)) {
-    ota_evt("ota_begin_fail", 0, "Update begin failed");
+  if (status != 200 && status != 206) {
+    ota_post("ota_http_err", status);
     http.stop();
-    return;
+    return status >= 500 ? OTA_STEP_RETRY : OTA_STEP_FATAL;
   }
 
-  MD5Builder md5b; if (want_check) md5b.begin();
+  // Headers: Content-Range tells where a 206 body starts
+  size_t start = 0;
+  long total = -1;
+  bool haveRange = false;
+  while (http.headerAvailable()) {
+    String name = http.readHeaderName();
+    String value = http.readHeaderValue();
+    if (name.equalsIgnoreCase("Content-Range"))
+      haveRange = parseContentRange(value, start, total);
+  }
+  const long len = http.contentLength();
+  if (status == 200) {
+    start = 0;
+    total = len;
+  } else if (!haveRange) {
+    total = (len >= 0) ? (long)dl.written + len : -1;
+    start = dl.written;
+  }
 
-  const size_t BUF = 4096;
-  uint8_t buf[BUF];
-  size_t written = 0;
-  uint32_t lastMs = 0;
+  if (start > dl.written || (dl.total >= 0 && total >= 0 && total != dl.total)) {
+    DBG_ERROR("[OTA] ❌ resume mismatch: start=%u have=%u size=%ld/%ld\n",
+              (unsigned)start, (unsigned)dl.written, total, dl.total);
+    http.stop();
+    return OTA_STEP_FATAL; // file changed on the server
+  }
+  if (dl.total < 0)
+    dl.total = total;
+
+  // Server ignored Range (200) → discard what is already consumed
+  size_t skip = dl.written - start;
+  uint32_t lastData = millis();
+
+  // Full image: socket data goes straight into the writer's free buffer;
+  // the header and delta patches go through s_in
+  while (dl.total < 0 || dl.written < (size_t)dl.total) {
+    int avail = http.available();
+    if (avail <= 0) {
+      if (!http.connected() || (millis() - lastData) > OTA_READ_TIMEOUT_MS)
+        break;
+      vTaskDelay(pdMS_TO_TICKS(1));
+      continue;
+    }
+    const bool direct = dl.mode == OTA_MODE_FULL;
+    size_t room = sizeof(s_in);
+    uint8_t *p = direct ? fw_space(room) : s_in;
+    int n = http.read(p, (size_t)avail < room ? (size_t)avail : room);
+    if (n <= 0)
+      break;
+    lastData = millis();
+
+    if (skip) {
+      size_t k = (size_t)n < skip ? (size_t)n : skip;
+      skip -= k;
+      n -= (int)k;
+      memmove(p, p + k, (size_t)n);
+      if (!n)
+        continue;
+    }
 
-  while (http.connected() || http.available()) {
-    int n = http.readBytes((char*)buf, BUF);
-    if (n < 0) { // read error
-      ota_evt("ota_write_err", 0, "Write error");
-      Update.abort();
+    if (direct ? !fw_commit((size_t)n) : !ota_consume(dl, job, p, (size_t)n)) {
+      if (direct)
+        ota_post("ota_write_err");
       http.stop();
-      return;
+      return OTA_STEP_FATAL;
     }
-    if (n == 0) { delay(1); continue; }
+    dl.written += (size_t)n;
 
-    if (want_check) md5b.add(buf, n);
+    if (dl.total > 0) {
+      int pct = (int)((uint64_t)dl.written * 100 / (uint64_t)dl.total);
+      if (pct / OTA_PROGRESS_STEP != dl.lastPct / OTA_PROGRESS_STEP) {
+        ota_post("ota_progress", pct);
+        dl.lastPct = pct;
+      }
+    }
+    watchdog_feed();
+  }
+  http.stop();
 
-    size_t w = Update.write(buf, (size_t)n);
-    if (w != (size_t)n) {
-      ota_evt("ota_write_err", 0, "Write error");
-      Update.abort();
-      http.stop();
-      return;
+  if (dl.total >= 0)
+    return dl.written == (size_t)dl.total ? OTA_STEP_DONE : OTA_STEP_RETRY;
+  // Unknown length: the server closing the connection ends the body
+  // (a short image is caught by the hash / image check)
+  return skip == 0 && dl.written > 0 ? OTA_STEP_DONE : OTA_STEP_RETRY;
+}
+
+// ===========================================================
+// [SECTION OTA] Reboot in a safe window
+// Waits until no run is open (or the deadline passed) and no relay
+// plan is switching; open runs are checkpointed and resume after boot.
+// ===========================================================
+static void ota_reboot_when_safe(const OtaJob &job, uint32_t t0)
+{
+  int lastOpen = -1;
+  for (;;) {
+    const int open = checkpoint_runs_open();
+    const bool late = millis() - t0 >= job.deadlineS * 1000UL;
+    if (!checkpoint_relays_busy() && (open == 0 || late))
+      break;
+    if (open != lastOpen) {
+      ota_post("ota_reboot_wait", open);
+      lastOpen = open;
     }
+    watchdog_feed();
+    vTaskDelay(pdMS_TO_TICKS(OTA_REBOOT_POLL_MS));
+  }
 
-    written += w;
+  ota_post("ota_reboot", checkpoint_runs_open());
+  vTaskDelay(pdMS_TO_TICKS(1000)); // let mqttTask drain the events
+  checkpoint_save();               // last, so no FSM step is missed
+  ESP.restart();
+}
 
-    if (total > 0) {
-      uint32_t now = millis();
-      if ((int32_t)(now - lastMs) >= 150) {
-        float pct = (written * 100.0f) / (float)total;
-        if (pct < 0) pct = 0; if (pct > 100) pct = 100;
-        ota_evt("ota_progress", pct);
-        watchdog_feed(); 
-        lastMs = now;
-      }
+// ===========================================================
+// [SECTION OTA] Download, verify, activate
+// ===========================================================
+static void ota_run(const OtaJob &job)
+{
+  OtaDl dl;
+  if (!parseHttpUrl(job.url, dl.host, dl.port, dl.path)) {
+    ota_post("ota_bad_url");
+    return;
+  }
+  if (!dl.path.startsWith("/")) dl.path = "/" + dl.path;
+
+  ota_post("ota_start");
+  const uint32_t t0 = millis();
+
+  OtaStep r = OTA_STEP_RETRY;
+  for (int attempt = 0; attempt <= OTA_MAX_RESUMES; attempt++) {
+    if (attempt) {
+      ota_post("ota_resume", (int)dl.written);
+      vTaskDelay(pdMS_TO_TICKS(OTA_RETRY_DELAY_MS));
     }
-    yield();
+    r = ota_stream(dl, job);
+    if (r != OTA_STEP_RETRY)
+      break;
   }
-  http.stop();
 
-  // MD5 verify (if provided)
-  if (want_check) {
-    md5b.calculate();
-    String got = md5b.toString(); // lowercase hex
-
-    auto hexEq = [](const char* a, const char* b){
-      for (int i=0;i<32;i++){
-        char ca=a[i], cb=b[i];
-        if (!ca || !cb) return false;
-        if (ca>='A'&&ca<='F') ca = ca - 'A' + 'a';
-        if (cb>='A'&&cb<='F') cb = cb - 'A' + 'a';
-        if (ca!=cb) return false;
-      }
-      return true;
-    };
+  if (!dl.begun) {
+    delta_end();
+    if (r != OTA_STEP_FATAL)
+      ota_post("ota_download_fail", (int)dl.written);
+    return;
+  }
+
+  // Always drain the writer, also on failure (it owns the buffers)
+  uint8_t sha[32], md5[16];
+  const bool flashed = fw_finish(sha, md5);
+  const bool delta = dl.mode == OTA_MODE_DELTA;
+  delta_end();
 
-    if (!hexEq(got.c_str(), wanted_md5)) {
-      mqtt_publish_event("ota_md5_mismatch", 1, 1, "Update", "Update Fail");      
-      Update.abort();
+  if (r != OTA_STEP_DONE) {
+    if (r == OTA_STEP_RETRY)
+      ota_post("ota_download_fail", (int)dl.written);
+    return;
+  }
+  if (!flashed) {
+    ota_post("ota_write_err");
+    return;
+  }
+  // Patch fully applied and the result is the image it promised
+  if (delta && (s_delta.state != DELTA_DONE ||
+                memcmp(sha, s_delta.hdr.dst_sha, sizeof(sha)) != 0)) {
+    ota_post("ota_delta_err");
+    return;
+  }
+  if (job.haveSha && memcmp(sha, job.sha, sizeof(sha)) != 0) {
+    ota_post("ota_sha_mismatch");
+    return;
+  }
+  if (job.md5[0]) {
+    uint8_t want[16];
+    parseHex(job.md5, want, sizeof(want));
+    if (memcmp(md5, want, sizeof(want)) != 0) {
+      ota_post("ota_md5_mismatch");
       return;
     }
-    
   }
 
-  if (!Update.end(true)) {
-    ota_evt("ota_end_err", 0, "End failed");
+  // Validates the image (header, segments, checksum) and selects the slot
+  const esp_partition_t *part = esp_ota_get_next_update_partition(nullptr);
+  esp_err_t err = esp_ota_set_boot_partition(part);
+  if (err != ESP_OK) {
+    DBG_ERROR("[OTA] ❌ set boot partition: %s\n", esp_err_to_name(err));
+    ota_post("ota_end_err");
+    return;
+  }
+  ota_trial_arm(part);
+
+  s_result = {(uint32_t)dl.written, millis() - t0, s_fw.busyMs, s_waitMs};
+  DBG_INFO("[OTA] ✅ %u bytes in %u ms (flash busy %u ms, waited for buffer %u ms)\n",
+           (unsigned)s_result.bytes, (unsigned)s_result.ms,
+           (unsigned)s_result.flashMs, (unsigned)s_result.waitMs);
+  ota_post("ota_complete", (int)dl.written);
+  // Publish version info (for Grafana dashboard)
+  ota_post("firmware_version");
+
+  if (job.reboot)
+    ota_reboot_when_safe(job, t0);
+}
+
+// ===========================================================
+// [SECTION OTA] Rollback: confirm a freshly booted image
+// With CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE the bootloader keeps the
+// image in PENDING_VERIFY. The prebuilt arduino-esp32 libraries have
+// it off, so the stock build runs a software trial boot instead:
+// Preferences "ota" holds the new slot ("trial"), the slot to return
+// to ("prev") and a boot counter. A failed check (or a crash loop)
+// selects "prev" again and restarts.
+// ===========================================================
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+// Keep the Arduino core from marking the image valid in initArduino()
+extern "C" bool verifyRollbackLater() { return true; }
+#else
+#ifndef OTA_TRIAL_BOOTS_MAX
+#define OTA_TRIAL_BOOTS_MAX 3   // boots of an unconfirmed image before rollback
+#endif
+
+static const esp_partition_t *s_trialPrev = nullptr;
+
+static void ota_trial_clear()
+{
+  Preferences prefs;
+  if (!prefs.begin("ota", false))
+    return;
+  prefs.clear();
+  prefs.end();
+}
+
+// Back to the previous slot; esp_ota_set_boot_partition() validates it
+static void ota_trial_rollback(const char *why)
+{
+  ota_trial_clear(); // one attempt: never bounce between two bad slots
+  const esp_err_t err = s_trialPrev ? esp_ota_set_boot_partition(s_trialPrev)
+                                    : ESP_ERR_NOT_FOUND;
+  if (err != ESP_OK) {
+    DBG_ERROR("[OTA] ❌ rollback (%s) failed: %s, keeping this image\n", why, esp_err_to_name(err));
+    s_verifyPending = false;
+    ota_post("ota_rollback_err");
+    return;
+  }
+  DBG_ERROR("[OTA] ❌ rolling back to %s (%s)\n", s_trialPrev->label, why);
+  checkpoint_save(); // runs continue on the old image
+  ESP.restart();
+}
+#endif
+
+// Called after a new image was selected for the next boot
+static void ota_trial_arm(const esp_partition_t *next)
+{
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+  (void)next; // the bootloader tracks the trial itself
+#else
+  Preferences prefs;
+  if (!prefs.begin("ota", false)) {
+    DBG_WARN("[OTA] ⚠️ trial flag not stored, new image boots without rollback\n");
+    return;
+  }
+  prefs.putString("trial", next->label);
+  prefs.putString("prev", esp_ota_get_running_partition()->label);
+  prefs.putUChar("boots", 0);
+  prefs.end();
+#endif
+}
+
+// Checked once at task start: is this image waiting for confirmation?
+static void ota_health_begin()
+{
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+  esp_ota_img_states_t st;
+  if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &st) != ESP_OK ||
+      st != ESP_OTA_IMG_PENDING_VERIFY)
+    return;
+#else
+  Preferences prefs;
+  if (!prefs.begin("ota", false))
+    return;
+  const String trial = prefs.getString("trial", "");
+  const String prev = prefs.getString("prev", "");
+  const uint8_t boots = prefs.getUChar("boots", 0) + 1;
+  if (trial.length() == 0) {
+    prefs.end();
+    return;
+  }
+  if (trial != esp_ota_get_running_partition()->label) {
+    // The bootloader refused the new slot and kept the old one
+    DBG_WARN("[OTA] ⚠️ trial image %s not booted, flag cleared\n", trial.c_str());
+    prefs.clear();
+    prefs.end();
     return;
+  }
+  prefs.putUChar("boots", boots);
+  prefs.end();
+  s_trialPrev = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY,
+                                         prev.c_str());
+  if (boots > OTA_TRIAL_BOOTS_MAX) {
+    ota_trial_rollback("boot loop");
+    return;
+  }
+#endif
+  DBG_WARN("[OTA] ⚠️ new image pending verify (%u s)\n", (unsigned)(OTA_HEALTH_TIMEOUT_MS / 1000));
+  s_verifyT0 = millis();
+  s_verifyPending = true;
 }
 
-ota_evt("ota_complete", 100.0f, "ota_complete");
+// One step per otaTask loop pass (≤ 1 s apart): confirm or roll back
+static void ota_health_poll()
+{
+  if (!s_verifyPending)
+    return;
+  const uint32_t elapsed = millis() - s_verifyT0;
+  if (g_modbusScanDone && g_foundCount > 0 && mqtt_connected()) {
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    esp_ota_mark_app_valid_cancel_rollback();
+#else
+    ota_trial_clear();
+#endif
+    s_verifyPending = false;
+    DBG_INFO("[OTA] ✅ image confirmed after %lu ms\n", (unsigned long)elapsed);
+    ota_post("ota_verified", (int)elapsed);
+    return;
+  }
+  if (elapsed < OTA_HEALTH_TIMEOUT_MS)
+    return;
+  DBG_ERROR("[OTA] ❌ health check failed (modbus=%d mqtt=%d), rolling back\n",
+            g_foundCount, mqtt_connected());
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+  checkpoint_save(); // runs continue on the old image
+  esp_ota_mark_app_invalid_rollback_and_reboot();
+#else
+  ota_trial_rollback("health check");
+#endif
+}
 
-// Publish version info (for Grafana dashboard)
-mqtt_publish_event("firmware_version", 0, 0, "OTA",
-                   (String("FW ") + FW_VERSION_STRING).c_str());
+// ===========================================================
+// [SECTION OTA] Task
+// ===========================================================
+static void otaTask(void *)
+{
+  // Tracked only: a stalled download is retried / rolled back by itself
+  watchdog_register_this_task(1000, OTA_READ_TIMEOUT_MS + 5000, false);
+  ota_health_begin();
+  for (;;) {
+    const bool queued = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000)) != 0;
+    watchdog_feed();
+    ota_health_poll();
+    if (!queued)
+      continue;
+    OtaJob job;
+    portENTER_CRITICAL(&s_otaMux);
+    job = s_job;
+    portEXIT_CRITICAL(&s_otaMux);
+
+    DBG_INFO("[OTA] start: url=%s sha256=%s reboot=%d\n",
+             job.url, job.haveSha ? "yes" : "no", job.reboot);
+    ota_run(job);
+    s_busy = false;
+  }
+}
 
-   delay(250);
-   if(reboot) ESP.restart(); 
+void update_mgr_start_task()
+{
+  s_qFull = xQueueCreate(3, sizeof(OtaBlock));
+  s_qFree = xQueueCreate(2, sizeof(uint8_t));
+  s_drained = xSemaphoreCreateBinary();
+  xTaskCreatePinnedToCore(flashTask, "otaFlash", 4096, nullptr, 1, nullptr, 1);
+  xTaskCreatePinnedToCore(otaTask, "otaTask", 6144, nullptr, 1, &s_otaTask, 0);
 }
@@ -0,0 +1,268 @@
+#include "w5500_client.h"
+#include <SPI.h>
+#include "eth_mgr.h"
+
+// ===========================================================
+// [SECTION W5500] Registers (datasheet ch. 4.2, socket register block)
+// ===========================================================
+static constexpr uint16_t SN_CR = 0x0001;
+static constexpr uint16_t SN_IR = 0x0002;
+static constexpr uint16_t SN_SR = 0x0003;
+static constexpr uint16_t SN_TX_FSR = 0x0020;
+static constexpr uint16_t SN_TX_WR = 0x0024;
+static constexpr uint16_t SN_RX_RSR = 0x0026;
+static constexpr uint16_t SN_RX_RD = 0x0028;
+
+static constexpr uint8_t CMD_SEND = 0x20;
+static constexpr uint8_t CMD_RECV = 0x40;
+static constexpr uint8_t IR_TIMEOUT = 0x08;
+static constexpr uint8_t IR_SEND_OK = 0x10;
+static constexpr uint8_t SR_ESTABLISHED = 0x17;
+static constexpr uint8_t SR_CLOSE_WAIT = 0x1C;
+
+// Block select: socket n registers / TX buffer / RX buffer
+static constexpr uint8_t BLK_REG = 1, BLK_TX = 2, BLK_RX = 3;
+
+// Commit the RX read pointer at least every this many bytes (half of
+// the 2 KB socket buffer the library configures for 8 sockets)
+static constexpr uint16_t RX_COMMIT = 1024;
+
+// SEND_OK polls inside one bus transaction before giving the bus away
+static constexpr int SEND_OK_SPINS = 200;
+
+static const SPISettings W5500_BURST(W5500_SPI_HZ, MSBFIRST, SPI_MODE0);
+
+// ===========================================================
+// [SECTION W5500] Frames: 3-byte header + data, one CS cycle
+// ===========================================================
+static void frame(uint8_t s, uint8_t blk, uint16_t addr, bool wr,
+                  const uint8_t *out, uint8_t *in, size_t n)
+{
+  const uint8_t hdr[3] = {(uint8_t)(addr >> 8), (uint8_t)addr,
+                          (uint8_t)(((s * 4 + blk) << 3) | (wr ? 0x04 : 0x00))};
+  digitalWrite(ETH_PIN_CS, LOW);
+  SPI.writeBytes(hdr, sizeof(hdr));
+  if (wr)
+    SPI.writeBytes(out, n);
+  else
+    SPI.transferBytes(nullptr, in, n);
+  digitalWrite(ETH_PIN_CS, HIGH);
+}
+
+static uint8_t rd8(uint8_t s, uint16_t reg)
+{
+  uint8_t v;
+  frame(s, BLK_REG, reg, false, nullptr, &v, 1);
+  return v;
+}
+
+static void wr8(uint8_t s, uint16_t reg, uint8_t v)
+{
+  frame(s, BLK_REG, reg, true, &v, nullptr, 1);
+}
+
+static uint16_t rd16(uint8_t s, uint16_t reg)
+{
+  uint8_t b[2];
+  frame(s, BLK_REG, reg, false, nullptr, b, 2);
+  return (uint16_t)((b[0] << 8) | b[1]);
+}
+
+static void wr16(uint8_t s, uint16_t reg, uint16_t v)
+{
+  const uint8_t b[2] = {(uint8_t)(v >> 8), (uint8_t)v};
+  frame(s, BLK_REG, reg, true, b, nullptr, 2);
+}
+
+// FSR / RSR change while they are read: take two equal reads
+static uint16_t rd16_stable(uint8_t s, uint16_t reg)
+{
+  uint16_t a, b = rd16(s, reg);
+  do
+  {
+    a = b;
+    b = rd16(s, reg);
+  } while (a != b);
+  return a;
+}
+
+static void command(uint8_t s, uint8_t cmd)
+{
+  wr8(s, SN_CR, cmd);
+  while (rd8(s, SN_CR))
+  {
+  }
+}
+
+// ===========================================================
+// [SECTION W5500] Connection (library) + local state
+// ===========================================================
+void W5500Client::reset_()
+{
+  sending_ = false;
+  rxAvail_ = 0;
+  rxUncommitted_ = 0;
+}
+
+bool W5500Client::sock_(uint8_t &s) const
+{
+  s = getSocketNumber();
+  return s < MAX_SOCK_NUM;
+}
+
+int W5500Client::connect(IPAddress ip, uint16_t port)
+{
+  reset_();
+  return EthernetClient::connect(ip, port);
+}
+
+int W5500Client::connect(const char *host, uint16_t port)
+{
+  reset_();
+  return EthernetClient::connect(host, port);
+}
+
+void W5500Client::stop()
+{
+  EthernetClient::stop();
+  reset_();
+}
+
+// ===========================================================
+// [SECTION W5500] TX
+// ===========================================================
+size_t W5500Client::write(uint8_t b)
+{
+  return write(&b, 1);
+}
+
+size_t W5500Client::write(const uint8_t *buf, size_t size)
+{
+  uint8_t s;
+  if (!sock_(s))
+  {
+    setWriteError();
+    return 0;
+  }
+
+  size_t done = 0;
+  while (done < size)
+  {
+    SPI.beginTransaction(W5500_BURST);
+    const uint8_t sr = rd8(s, SN_SR);
+    if (sr != SR_ESTABLISHED && sr != SR_CLOSE_WAIT)
+    {
+      SPI.endTransaction();
+      break;
+    }
+
+    // The previous SEND must be out before the next one is issued
+    if (sending_)
+    {
+      uint8_t ir = 0;
+      for (int i = 0; i < SEND_OK_SPINS && !(ir & (IR_SEND_OK | IR_TIMEOUT)); i++)
+        ir = rd8(s, SN_IR);
+      if (ir & IR_TIMEOUT)
+      {
+        wr8(s, SN_IR, IR_SEND_OK | IR_TIMEOUT); // peer gone, socket closes
+        sending_ = false;
+        SPI.endTransaction();
+        break;
+      }
+      if (!(ir & IR_SEND_OK))
+      {
+        SPI.endTransaction();
+        delay(1);
+        continue;
+      }
+      wr8(s, SN_IR, IR_SEND_OK);
+      sending_ = false;
+    }
+
+    uint16_t n = rd16_stable(s, SN_TX_FSR);
+    if (n == 0) // window full: wait for the peer's ACKs
+    {
+      SPI.endTransaction();
+      delay(1);
+      continue;
+    }
+    if (n > size - done)
+      n = (uint16_t)(size - done);
+
+    const uint16_t wp = rd16(s, SN_TX_WR);
+    frame(s, BLK_TX, wp, true, buf + done, nullptr, n); // chip wraps the buffer
+    wr16(s, SN_TX_WR, (uint16_t)(wp + n));
+    command(s, CMD_SEND);
+    sending_ = true;
+    SPI.endTransaction();
+    done += n;
+  }
+
+  if (done < size)
+    setWriteError();
+  return done;
+}
+
+// ===========================================================
+// [SECTION W5500] RX
+// ===========================================================
+void W5500Client::commitRx_(uint8_t s)
+{
+  wr16(s, SN_RX_RD, rxRd_);
+  command(s, CMD_RECV);
+  rxUncommitted_ = 0;
+}
+
+int W5500Client::available()
+{
+  uint8_t s;
+  if (!sock_(s))
+    return 0;
+  if (rxAvail_)
+    return rxAvail_;
+
+  SPI.beginTransaction(W5500_BURST);
+  if (rxUncommitted_)
+    commitRx_(s);
+  rxAvail_ = rd16_stable(s, SN_RX_RSR);
+  if (rxAvail_)
+    rxRd_ = rd16(s, SN_RX_RD);
+  SPI.endTransaction();
+  return rxAvail_;
+}
+
+int W5500Client::read(uint8_t *buf, size_t size)
+{
+  uint8_t s;
+  if (!sock_(s) || !size || !available())
+    return -1;
+
+  const uint16_t n = size < rxAvail_ ? (uint16_t)size : rxAvail_;
+  SPI.beginTransaction(W5500_BURST);
+  frame(s, BLK_RX, rxRd_, false, nullptr, buf, n);
+  rxRd_ += n;
+  rxAvail_ -= n;
+  rxUncommitted_ += n;
+  if (!rxAvail_ || rxUncommitted_ >= RX_COMMIT)
+    commitRx_(s);
+  SPI.endTransaction();
+  return n;
+}
+
+int W5500Client::read()
+{
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int W5500Client::peek()
+{
+  uint8_t s;
+  if (!sock_(s) || !available())
+    return -1;
+  uint8_t b;
+  SPI.beginTransaction(W5500_BURST);
+  frame(s, BLK_RX, rxRd_, false, nullptr, &b, 1);
+  SPI.endTransaction();
+  return b;
+}
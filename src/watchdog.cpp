@@ -1,38 +1,200 @@
 #include "watchdog.h"
+#include <Arduino.h>
+#include <esp_attr.h>    // RTC_NOINIT_ATTR
+#include <esp_system.h>  // esp_reset_reason()
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "debug_log.h"
 #ifdef WDT_ENABLE
   #include <esp_task_wdt.h>
 #endif
 
 static bool s_wdt_started = false;
+static bool s_wdt_added = false;   // supervisor task subscribed to the task WDT
 
+// ===========================================================
+// [SECTION WDT] Supervised tasks
+// ===========================================================
+struct WdEntry {
+  TaskHandle_t task;                 // nullptr: free slot
+  uint32_t periodMs, limitMs;
+  bool critical;
+  bool late;                         // supervisor: overdue reported
+  volatile uint32_t lastMs;          // last check-in (owner task)
+  // owner task only
+  uint32_t checkins, maxMs, misses, worstMs;
+  uint64_t sumMs;
+};
+
+static WdEntry s_wd[WDT_MAX_TASKS];
+static uint8_t s_wdCount = 0;
+static portMUX_TYPE s_wdMux = portMUX_INITIALIZER_UNLOCKED;
+
+// ===========================================================
+// [SECTION WDT] Stall record in RTC memory (survives the WDT reset)
+// ===========================================================
+static const uint32_t WD_RTC_MAGIC = 0x57445331; // "WDS1"
+
+struct WdRtc {
+  uint32_t magic;                    // set only while a critical task is overdue
+  uint32_t stalledMs;
+  uint32_t uptimeMs;
+  char task[16];
+};
+
+RTC_NOINIT_ATTR static WdRtc s_rtc;
+static WdRtc s_last = {};            // previous boot's record (magic = valid)
+
+static void rtc_take_previous() {
+  const esp_reset_reason_t r = esp_reset_reason();
+  if (s_rtc.magic == WD_RTC_MAGIC && r != ESP_RST_POWERON) {
+    s_last = s_rtc;
+    s_last.task[sizeof(s_last.task) - 1] = 0;
+    DBG_ERROR("[WDT] 💥 reset (reason %d): %s stalled for %lu ms at uptime %lu s\n",
+              (int)r, s_last.task, (unsigned long)s_last.stalledMs,
+              (unsigned long)(s_last.uptimeMs / 1000));
+  }
+  s_rtc.magic = 0;
+}
+
+bool watchdog_last_stall(char *task, size_t len, uint32_t *stalledMs) {
+  if (s_last.magic != WD_RTC_MAGIC) return false;
+  if (task && len) snprintf(task, len, "%s", s_last.task);
+  if (stalledMs) *stalledMs = s_last.stalledMs;
+  return true;
+}
+
+// ===========================================================
+// [SECTION WDT] Start / register / check-in
+// ===========================================================
 void watchdog_start(uint32_t timeout_sec, bool panic) {
+  rtc_take_previous();
 #ifdef WDT_ENABLE
   if (s_wdt_started) return;
   // Start Task WDT. 'panic=true' will print backtrace and reset on timeout.
+  // (Already running from the IDF startup: timeout + panic are updated.)
   esp_task_wdt_init(timeout_sec, panic);
   s_wdt_started = true;
 #endif
 }
 
-void watchdog_register_this_task() {
-#ifdef WDT_ENABLE
-  if (!s_wdt_started) return;
-  // NULL means "current task"
-  esp_task_wdt_add(NULL);
-#endif
+void watchdog_register_this_task(uint32_t period_ms, uint32_t max_latency_ms, bool critical) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  WdEntry *e = nullptr;
+  portENTER_CRITICAL(&s_wdMux);
+  for (uint8_t i = 0; i < s_wdCount && !e; i++)
+    if (s_wd[i].task == self || !s_wd[i].task) e = &s_wd[i];
+  if (!e && s_wdCount < WDT_MAX_TASKS) e = &s_wd[s_wdCount++];
+  if (e) {
+    *e = WdEntry{};
+    e->periodMs = period_ms;
+    e->limitMs = period_ms + max_latency_ms;
+    e->critical = critical;
+    e->lastMs = millis();
+    e->task = self;
+  }
+  portEXIT_CRITICAL(&s_wdMux);
+  if (!e)
+    DBG_ERROR("[WDT] ❌ %s not supervised: raise WDT_MAX_TASKS\n", pcTaskGetName(self));
 }
 
 void watchdog_unregister_this_task() {
-#ifdef WDT_ENABLE
-  if (!s_wdt_started) return;
-  esp_task_wdt_delete(NULL);
-#endif
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  portENTER_CRITICAL(&s_wdMux);
+  for (uint8_t i = 0; i < s_wdCount; i++)
+    if (s_wd[i].task == self) s_wd[i].task = nullptr;
+  portEXIT_CRITICAL(&s_wdMux);
+}
+
+static WdEntry *entry_of(TaskHandle_t t) {
+  for (uint8_t i = 0; i < s_wdCount; i++)
+    if (s_wd[i].task == t) return &s_wd[i];
+  return nullptr;
 }
 
 void watchdog_feed() {
+  WdEntry *e = entry_of(xTaskGetCurrentTaskHandle());
+  if (!e) return;
+  const uint32_t now = millis();
+  const uint32_t gap = now - e->lastMs;
+  e->lastMs = now;
+  e->checkins++;
+  e->sumMs += gap;
+  if (gap > e->maxMs) e->maxMs = gap;
+  if (gap > e->limitMs) {
+    e->misses++;
+    if (gap - e->limitMs > e->worstMs) e->worstMs = gap - e->limitMs;
+  }
+}
+
+// ===========================================================
+// [SECTION WDT] Supervisor (watchdogTask)
+// ===========================================================
+void watchdog_supervise() {
 #ifdef WDT_ENABLE
-  if (!s_wdt_started) return;
-  // Resets WDT *for the current task only*
-  esp_task_wdt_reset();
+  if (s_wdt_started && !s_wdt_added)
+    s_wdt_added = esp_task_wdt_add(NULL) == ESP_OK;
 #endif
+  const uint32_t now = millis();
+  WdEntry *stalled = nullptr;
+  uint32_t stalledAge = 0;
+
+  for (uint8_t i = 0; i < s_wdCount; i++) {
+    WdEntry &e = s_wd[i];
+    if (!e.task) continue;
+    const uint32_t age = now - e.lastMs;
+    if (age > e.limitMs) {
+      if (!e.late) {
+        if (e.critical)
+          DBG_ERROR("[WDT] ⏰ %s overdue: %lu ms since check-in (limit %lu)\n",
+                    pcTaskGetName(e.task), (unsigned long)age, (unsigned long)e.limitMs);
+        else
+          DBG_WARN("[WDT] ⏰ %s overdue: %lu ms since check-in (limit %lu)\n",
+                   pcTaskGetName(e.task), (unsigned long)age, (unsigned long)e.limitMs);
+      }
+      e.late = true;
+      if (e.critical && age - e.limitMs >= stalledAge) {
+        stalled = &e;
+        stalledAge = age - e.limitMs;
+      }
+    } else if (e.late) {
+      e.late = false;
+      DBG_INFO("[WDT] %s checking in again\n", pcTaskGetName(e.task));
+    }
+  }
+
+  if (stalled) {
+    // Updated every pass: at the reset it holds the last known duration
+    snprintf(s_rtc.task, sizeof(s_rtc.task), "%s", pcTaskGetName(stalled->task));
+    s_rtc.stalledMs = now - stalled->lastMs;
+    s_rtc.uptimeMs = now;
+    s_rtc.magic = WD_RTC_MAGIC;
+    return; // no feed: the task WDT resets the chip
+  }
+  s_rtc.magic = 0;
+#ifdef WDT_ENABLE
+  if (s_wdt_added) esp_task_wdt_reset();
+#endif
+}
+
+uint8_t watchdog_stats(WdStats *out, uint8_t max) {
+  const uint32_t now = millis();
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < s_wdCount && n < max; i++) {
+    const WdEntry &e = s_wd[i];
+    if (!e.task) continue;
+    WdStats &s = out[n++];
+    snprintf(s.name, sizeof(s.name), "%s", pcTaskGetName(e.task));
+    s.periodMs = e.periodMs;
+    s.limitMs = e.limitMs;
+    s.critical = e.critical;
+    s.late = e.late;
+    s.ageMs = now - e.lastMs;
+    s.checkins = e.checkins;
+    s.meanMs = e.checkins ? (uint32_t)(e.sumMs / e.checkins) : 0;
+    s.maxMs = e.maxMs;
+    s.misses = e.misses;
+    s.worstMs = e.worstMs;
+  }
+  return n;
 }
@@ -0,0 +1,231 @@
+#include "web_api.h"
+#include "app_settings.h"
+#include "config.h"
+#include "mqtt_if.h"
+#include "mqtt_msg_receive.h"
+#include "net_cfg.h"
+#include "relay_if.h"
+#include "relay_seq.h"
+#include "web_json.h"
+#include "debug_log.h"
+#include "diag.h"
+
+// ===========================================================
+// [SECTION API] Request slots: filled in AsyncTCP, run in httpTask
+// ===========================================================
+enum SlotState : uint8_t
+{
+  SLOT_FREE = 0,
+  SLOT_FILLING, // body arriving (AsyncTCP)
+  SLOT_QUEUED   // waiting for / running in httpTask
+};
+
+struct ApiSlot
+{
+  volatile SlotState state;
+  AsyncWebServerRequest *req;
+  uint32_t t;
+  uint16_t len;
+  char topic[96];
+  uint8_t body[API_BODY_MAX];
+};
+
+static ApiSlot s_slots[API_SLOTS];
+static QueueHandle_t s_q = nullptr;
+
+static ApiSlot *slot_alloc(AsyncWebServerRequest *req)
+{
+  const uint32_t now = millis();
+  for (auto &s : s_slots)
+  {
+    if (s.state == SLOT_FILLING && now - s.t > API_SLOT_TTL_MS)
+      s.state = SLOT_FREE; // upload was aborted
+    if (s.state == SLOT_FREE)
+    {
+      s.state = SLOT_FILLING;
+      s.req = req;
+      s.t = now;
+      s.len = 0;
+      return &s;
+    }
+  }
+  return nullptr;
+}
+
+static ApiSlot *slot_find(AsyncWebServerRequest *req)
+{
+  for (auto &s : s_slots)
+    if (s.state == SLOT_FILLING && s.req == req)
+      return &s;
+  return nullptr;
+}
+
+// ===========================================================
+// [SECTION API] Body + request callbacks
+// ===========================================================
+// Basic auth against the boot-time copy of net_cfg (never written
+// after net_cfg_load, so safe to read from the AsyncTCP task)
+static bool authorized(AsyncWebServerRequest *req)
+{
+  const NetCfg &c = net_cfg();
+  return req->authenticate(c.api_user, c.api_pass);
+}
+
+static void onBody(AsyncWebServerRequest *req, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  if (total > API_BODY_MAX || !authorized(req))
+    return; // answered with 413 / 401 in the request handler
+  ApiSlot *s = index == 0 ? slot_alloc(req) : slot_find(req);
+  if (!s || index + len > API_BODY_MAX)
+    return;
+  memcpy(s->body + index, data, len);
+  s->len = (uint16_t)(index + len);
+}
+
+// Queue the body for <base>/<dev>/cmd<suffix>
+static void enqueue(AsyncWebServerRequest *req, const char *suffix)
+{
+  if (!authorized(req))
+  {
+    DBG_WARN("[HTTP] ⚠️ unauthorized POST %s\n", req->url().c_str());
+    req->requestAuthentication(nullptr, false); // 401, Basic
+    return;
+  }
+  if (req->contentLength() > API_BODY_MAX)
+  {
+    req->send(413, "application/json", "{\"error\":\"body too large\"}");
+    return;
+  }
+  ApiSlot *s = slot_find(req);
+  if (!s && req->contentLength() == 0)
+    s = slot_alloc(req);
+  if (!s)
+  {
+    req->send(503, "application/json", "{\"error\":\"busy\"}");
+    return;
+  }
+
+  snprintf(s->topic, sizeof(s->topic), "%s/%s/cmd%s",
+           App::BASE_TOPIC, DEVICE_HOST.c_str(), suffix);
+  if (!cmd_known(s->topic))
+  {
+    s->state = SLOT_FREE;
+    req->send(404, "application/json", "{\"error\":\"unknown command\"}");
+    return;
+  }
+
+  uint8_t idx = (uint8_t)(s - s_slots);
+  s->req = nullptr; // request is answered now
+  s->state = SLOT_QUEUED;
+  if (xQueueSend(s_q, &idx, 0) != pdTRUE)
+  {
+    s->state = SLOT_FREE;
+    req->send(503, "application/json", "{\"error\":\"busy\"}");
+    return;
+  }
+  req->send(202, "application/json", "{\"queued\":true}");
+}
+
+static void on_post(AsyncWebServer &srv, const char *uri, const char *suffix)
+{
+  srv.on(uri, HTTP_POST, [suffix](AsyncWebServerRequest *req) { enqueue(req, suffix); },
+         nullptr, onBody);
+}
+
+// ===========================================================
+// [SECTION API] Read-only endpoints (answered directly)
+// ===========================================================
+static void handleSettingsGet(AsyncWebServerRequest *req)
+{
+  web_json_send(req, [](JsonStream &w) {
+    net_cfg_write(w);
+    return false;
+  });
+}
+
+static void handleRelaysGet(AsyncWebServerRequest *req)
+{
+  web_json_send(req, [](JsonStream &w) {
+    w.obj()
+        .kv("mask", (unsigned)relay_if_hw_mask())
+        .kv("target", (unsigned)relay_seq_target_mask())
+        .kv("faults", (unsigned long)relay_if_fault_count())
+        .end();
+    return false;
+  });
+}
+
+// Task stats, queue depths, heap + history (diag.h); the cursor holds
+// one sample for all pieces of the response. It is too large to
+// allocate per request, so one response at a time owns the static one
+// (AsyncTCP task only) and a second request gets 503. The lease ends
+// with the last piece; a response whose client stopped reading is
+// reclaimed API_SLOT_TTL_MS after its last piece (and then ends).
+static DiagCursor s_diagCursor;
+static uint32_t s_diagLease = 0; // owning response, 0: free
+static uint32_t s_diagLeaseT = 0;
+static uint32_t s_diagGen = 0;
+
+static void handleDiagGet(AsyncWebServerRequest *req)
+{
+  const uint32_t now = millis();
+  if (s_diagLease && now - s_diagLeaseT < API_SLOT_TTL_MS)
+  {
+    req->send(503, "application/json", "{\"error\":\"busy\"}");
+    return;
+  }
+  if (!++s_diagGen)
+    s_diagGen = 1;
+  const uint32_t lease = s_diagLease = s_diagGen;
+  s_diagLeaseT = now;
+  diag_cursor_begin(s_diagCursor, true);
+  web_json_send(req, [lease](JsonStream &w) {
+    if (s_diagLease != lease)
+      return false; // reclaimed by a newer request
+    s_diagLeaseT = millis();
+    const bool more = diag_json(w, s_diagCursor);
+    if (!more)
+      s_diagLease = 0;
+    return more;
+  });
+}
+
+// ===========================================================
+// [SECTION API] Registration + execution
+// ===========================================================
+void web_api_begin(AsyncWebServer &srv)
+{
+  if (!s_q)
+    s_q = xQueueCreate(API_SLOTS, sizeof(uint8_t));
+
+  srv.on("/api/settings", HTTP_GET, handleSettingsGet);
+  srv.on("/api/relays", HTTP_GET, handleRelaysGet);
+  srv.on("/api/diag", HTTP_GET, handleDiagGet);
+  on_post(srv, "/api/settings", "/net");
+  on_post(srv, "/api/relay", "/relay");
+  on_post(srv, "/api/relays", "/relay");
+  on_post(srv, "/api/dpm", "/settings");
+
+  // Generic: /api/cmd/<name>[/<id>] → cmd/<name>[/<id>]
+  srv.on("/api/cmd", HTTP_POST, [](AsyncWebServerRequest *req) {
+    const String &url = req->url();
+    if (url.length() <= 8 || url.length() - 8 >= 48)
+    {
+      req->send(404, "application/json", "{\"error\":\"unknown command\"}");
+      return;
+    }
+    enqueue(req, url.c_str() + 8); // "/api/cmd/curve/3" → "/curve/3"
+  }, nullptr, onBody);
+}
+
+void web_api_poll()
+{
+  uint8_t idx;
+  while (s_q && xQueueReceive(s_q, &idx, 0) == pdTRUE)
+  {
+    ApiSlot &s = s_slots[idx];
+    bool ok = cmd_dispatch(s.topic, s.body, s.len);
+    DBG_INFO("[HTTP] REST %s (%u bytes) %s\n", s.topic, s.len, ok ? "done" : "not handled");
+    s.state = SLOT_FREE;
+  }
+}
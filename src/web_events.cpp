@@ -0,0 +1,156 @@
+#include "web_events.h"
+#include "config.h"
+#include "eth_mgr.h"
+#include "net_mgr.h"
+#include "relay_if.h"
+#include "json_stream.h"
+#include "debug_log.h"
+
+// One SSE endpoint shared by all pages
+static AsyncEventSource s_events("/api/events");
+
+// Fields pushed per DPM (see web_events.h for the order)
+#define WEV_FIELDS 11
+typedef long WevRow[WEV_FIELDS];
+
+static WevRow s_last[DPMS_SIZE];   // last state pushed (httpTask only)
+static bool s_lastValid = false;
+static int s_lastRelays = -1;
+static uint32_t s_lastPush = 0;
+
+// Worst case: MAX_DPMS × ("DPMn":[11 numbers]) + header
+#define WEV_BUF_SIZE (96 + MAX_DPMS * (10 + WEV_FIELDS * 12))
+static char s_delta[WEV_BUF_SIZE];    // httpTask
+static char s_snapshot[WEV_BUF_SIZE]; // AsyncTCP task (onConnect)
+
+// ===========================================================
+// [SECTION WEB EVENTS] Row capture + formatting
+// ===========================================================
+static void capture(int id, WevRow &r)
+{
+  const DPMState &d = dpms[id];
+  r[0] = static_cast<int>(d.state);
+  r[1] = d.dpm_state;
+  r[2] = d.volt_act;
+  r[3] = d.cur_act;
+  r[4] = d.temp_act;
+  r[5] = (long)d.remain_time;
+  r[6] = d.volt_set;
+  r[7] = dpm_live_cur_set(id);
+  r[8] = d.idle_cur;
+  r[9] = (long)d.last_ms;
+  r[10] = (long)d.runtime;
+}
+
+// Writes "DPMn":[..] into the current object
+static void write_row(JsonStream &w, int id, const WevRow &r)
+{
+  char key[8];
+  snprintf(key, sizeof(key), "DPM%d", id);
+  w.arr(key);
+  for (int k = 0; k < WEV_FIELDS; k++)
+    w.val(r[k]);
+  w.end();
+}
+
+// Did anything but the sample timestamp change?
+static bool row_changed(const WevRow &a, const WevRow &b)
+{
+  for (int k = 0; k < WEV_FIELDS; k++)
+    if (k != 9 && a[k] != b[k])
+      return true;
+  return false;
+}
+
+// ===========================================================
+// [SECTION WEB EVENTS] Snapshot on connect
+// ===========================================================
+static void send_snapshot(AsyncEventSourceClient *client)
+{
+  char ip[16];
+  IPAddress a = eth_ip_cached();
+  snprintf(ip, sizeof(ip), "%u.%u.%u.%u", a[0], a[1], a[2], a[3]);
+
+  JsonStream w(s_snapshot, sizeof(s_snapshot) - 1);
+  w.obj()
+      .kv("ip", (const char *)ip)
+      .kv("link", eth_link_cached())
+      .kv("net", net_path_name(net_path()))
+      .kv("failover_ms", (unsigned)net_last_failover_ms())
+      .kv("relays", (unsigned)relay_if_hw_mask());
+  const int n = (ROWS < MAX_DPMS) ? ROWS : MAX_DPMS;
+  for (int id = 1; id <= n; id++)
+  {
+    WevRow r;
+    capture(id, r);
+    write_row(w, id, r);
+  }
+  w.end();
+  if (w.overflow())
+  {
+    DBG_ERROR("[HTTP] ❌ SSE snapshot too large\n");
+    return;
+  }
+  s_snapshot[w.size()] = '\0';
+  client->send(s_snapshot, "snapshot", millis(), WEB_EVENTS_RETRY_MS);
+}
+
+void web_events_begin(AsyncWebServer &srv)
+{
+  s_events.onConnect([](AsyncEventSourceClient *client) {
+    send_snapshot(client);
+    DBG_INFO("[HTTP] 📡 SSE client connected (%u)\n", (unsigned)s_events.count());
+  });
+  srv.addHandler(&s_events);
+}
+
+// ===========================================================
+// [SECTION WEB EVENTS] Diff against the last push, send once
+// ===========================================================
+void web_events_poll()
+{
+  const uint32_t now = millis();
+  if (now - s_lastPush < WEB_EVENTS_PERIOD_MS)
+    return;
+  s_lastPush = now;
+
+  // No listeners: skip the diff, next client gets a snapshot anyway
+  if (s_events.count() == 0)
+  {
+    s_lastValid = false;
+    s_lastRelays = -1;
+    return;
+  }
+
+  const int n = (ROWS < MAX_DPMS) ? ROWS : MAX_DPMS;
+  JsonStream w(s_delta, sizeof(s_delta) - 1);
+  w.obj();
+  bool any = false;
+  for (int id = 1; id <= n; id++)
+  {
+    WevRow r;
+    capture(id, r);
+    if (s_lastValid && !row_changed(r, s_last[id]))
+      continue;
+    write_row(w, id, r);
+    memcpy(s_last[id], r, sizeof(WevRow));
+    any = true;
+  }
+  w.end();
+  s_lastValid = true;
+
+  if (any && !w.overflow())
+  {
+    s_delta[w.size()] = '\0';
+    s_events.send(s_delta, "dpm", now); // one message, shared by all clients
+  }
+
+  const int relays = relay_if_hw_mask();
+  if (relays != s_lastRelays)
+  {
+    s_lastRelays = relays;
+    char buf[24];
+    snprintf(buf, sizeof(buf), "{\"relays\":%d}", relays);
+    s_events.send(buf, "relays", now);
+  }
+}
@@ -0,0 +1,55 @@
+#include "web_json.h"
+#include <memory>
+#include "debug_log.h"
+
+// One per response: fixed piece buffer + writer + generator
+struct WebJsonState
+{
+  char buf[WEB_JSON_BUF];
+  JsonStream w{buf, sizeof(buf)};
+  WebJsonGen gen;
+  size_t off = 0;   // drained bytes of the current piece
+  bool more = true; // generator has more pieces
+};
+
+// ===========================================================
+// [SECTION WEB JSON] Chunked sender
+// ===========================================================
+void web_json_send(AsyncWebServerRequest *req, WebJsonGen gen, int code)
+{
+  auto st = std::make_shared<WebJsonState>();
+  st->gen = std::move(gen);
+
+  AsyncWebServerResponse *resp = req->beginChunkedResponse("application/json",
+      [st](uint8_t *out, size_t maxLen, size_t) -> size_t {
+        size_t n = 0;
+        while (n < maxLen)
+        {
+          if (st->off >= st->w.size())
+          {
+            if (!st->more)
+              break;
+            st->w.clear();
+            st->off = 0;
+            st->more = st->gen(st->w);
+            if (st->w.overflow())
+            {
+              DBG_ERROR("[HTTP] ❌ JSON piece > %u bytes, response cut\n", (unsigned)WEB_JSON_BUF);
+              st->more = false;
+              st->w.clear();
+              break;
+            }
+            continue;
+          }
+          size_t k = st->w.size() - st->off;
+          if (k > maxLen - n)
+            k = maxLen - n;
+          memcpy(out + n, st->w.data() + st->off, k);
+          st->off += k;
+          n += k;
+        }
+        return n; // 0 = end of chunked body
+      });
+  resp->setCode(code);
+  req->send(resp);
+}
@@ -1,10 +1,16 @@
 #include <Arduino.h>
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
 #include <LittleFS.h>     // NEW: filesystem support
 #include "config.h"
 #include "debug_log.h"
-// WebServer on port 80
-static WebServer http(80);
+#include "run_record.h"
+#include "web_modbus.h"
+#include "web_events.h"
+#include "web_api.h"
+#include "web_json.h"
+// Async server on port 80 (requests are handled in the AsyncTCP task,
+// no polling; several clients are served concurrently)
+static AsyncWebServer http(80);
 
 // Extern scan/telemetry tables
 extern int8_t     g_cfgForId[DPMS_SIZE];
@@ -26,66 +32,200 @@ static uint8_t bitcount(uint32_t x) {
 
 // --------------------------------------------------------------------
 // JSON API endpoint: return Modbus status
+// Streamed: one piece per config name / device (constant memory)
 // --------------------------------------------------------------------
-static void handleStatusJson() {
-  String out = "{\"cfgNames\":[";
-  for (int i = 0; i < modbus_cfg_count(); ++i) {
-    if (i) out += ',';
-    out += '"'; out += modbus_cfg_name(i); out += '"';
-  }
-  out += "],\"devices\":[";
-
-  bool first = true;
-  for (int i = 0; i < g_foundCount; ++i) {
-    uint8_t id = g_foundIds[i];
-    if (id == 0 || id >= DPMS_SIZE) continue;
-
-    if (!first) out += ',';
-    first = false;
-
-    int8_t cfg = g_cfgForId[id];
-    uint32_t mask = g_cfgMaskForId[id];
-    bool multi = (bitcount(mask) > 1);
-
-    out += "{\"id\":" + String(id);
-    out += ",\"valid\":" + String(dpms[id].valid ? "true":"false");
-    out += ",\"cfg\":" + String(cfg);
-    out += ",\"cfgName\":\"" + String(modbus_cfg_name(cfg)) + "\"";
-    out += ",\"mask\":" + String(mask);
-    out += ",\"multi\":" + String(multi ? "true":"false");
-    out += ",\"dpm_state\":" + String(dpms[id].dpm_state);
-    out += ",\"volt_act\":"  + String(dpms[id].volt_act);
-    out += ",\"cur_act\":"   + String(dpms[id].cur_act);
-    out += ",\"temp_act\":"  + String(dpms[id].temp_act);
-    out += ",\"last_ms\":"   + String(dpms[id].last_ms);
-    out += "}";
-  }
-  out += "]}";
+static void handleStatusJson(AsyncWebServerRequest *req) {
+  int phase = 0, i = 0;
+  web_json_send(req, [phase, i](JsonStream &w) mutable -> bool {
+    switch (phase) {
+    case 0:
+      w.obj().arr("cfgNames");
+      phase = 1;
+      return true;
+    case 1:
+      if (i < modbus_cfg_count()) {
+        w.val(modbus_cfg_name(i++));
+        return true;
+      }
+      w.end().arr("devices");
+      phase = 2;
+      i = 0;
+      return true;
+    default:
+      while (i < g_foundCount) {
+        uint8_t id = g_foundIds[i++];
+        if (id == 0 || id >= DPMS_SIZE) continue;
 
-  http.send(200, "application/json", out);
+        int8_t cfg = g_cfgForId[id];
+        uint32_t mask = g_cfgMaskForId[id];
+        const DPMState &d = dpms[id];
+        w.obj()
+            .kv("id", (int)id)
+            .kv("valid", (bool)d.valid)
+            .kv("cfg", (int)cfg)
+            .kv("cfgName", modbus_cfg_name(cfg))
+            .kv("mask", (unsigned long)mask)
+            .kv("multi", bitcount(mask) > 1)
+            .kv("dpm_state", d.dpm_state)
+            .kv("volt_act", d.volt_act)
+            .kv("cur_act", d.cur_act)
+            .kv("temp_act", d.temp_act)
+            .kv("last_ms", (unsigned long)d.last_ms)
+            .end();
+        return true;
+      }
+      w.end().end();
+      return false;
+    }
+  });
 }
 
 // --------------------------------------------------------------------
-// Static file serving from LittleFS
+// JSON API endpoint: run history (newest first)
+//   /api/runs?dpm=<n>&limit=<k>
+// --------------------------------------------------------------------
+static void handleRunsJson(AsyncWebServerRequest *req) {
+  int dpm   = req->hasParam("dpm")   ? req->getParam("dpm")->value().toInt()   : 0;
+  int limit = req->hasParam("limit") ? req->getParam("limit")->value().toInt() : 10;
+  if (limit <= 0 || limit > RUN_HISTORY_MAX) limit = RUN_HISTORY_MAX;
+
+  bool open = false;
+  size_t idx = 0;   // history position (0 = newest)
+  int sent = 0;
+  web_json_send(req, [=](JsonStream &w) mutable -> bool {
+    if (!open) {
+      w.arr();
+      open = true;
+      return true;
+    }
+    RunRecord r;
+    char buf[512];
+    while (sent < limit && idx < run_record_history_count() &&
+           run_record_history_get(idx++, r)) {
+      if (dpm > 0 && r.dpm != dpm) continue;
+      size_t n = run_record_to_json(r, buf, sizeof(buf));
+      if (!n) continue;
+      w.raw(buf, n);
+      sent++;
+      return true;
+    }
+    w.end();
+    return false;
+  });
+}
+
 // --------------------------------------------------------------------
-static String guessContentType(const String& path) {
+// Static assets from LittleFS (gzip-precompressed at build time)
+// --------------------------------------------------------------------
+// The table is built once at http_begin(): no LittleFS.exists() per
+// request. ETag = CRC32 + size from the gzip trailer, so it changes
+// exactly when the asset content changes. Only files below WEB_ROOT
+// are indexed: run history, checkpoints etc. are never served.
+#define WEB_ROOT "/www"
+
+struct WebAsset {
+  char path[32];         // request path, e.g. "/app.js"
+  char file[40];         // file on LittleFS, e.g. "/www/app.js.gz"
+  char etag[24];         // "\"crc-size\""
+  const char *type;
+  bool gz;
+};
+static WebAsset s_assets[HTTP_ASSETS_MAX];
+static int s_assetCount = 0;
+
+static const char *guessContentType(const String& path) {
   if (path.endsWith(".html")) return "text/html";
   if (path.endsWith(".css"))  return "text/css";
   if (path.endsWith(".js"))   return "application/javascript";
   if (path.endsWith(".json")) return "application/json";
+  if (path.endsWith(".svg"))  return "image/svg+xml";
+  if (path.endsWith(".png"))  return "image/png";
+  if (path.endsWith(".ico"))  return "image/x-icon";
   return "text/plain";
 }
 
-static void handleFile(const String& path) {
-  String actual = path;
-  if (actual == "/") actual = "/index.html";   // default page
-  if (LittleFS.exists(actual)) {
-    File f = LittleFS.open(actual, "r");
-    http.streamFile(f, guessContentType(actual));
-    f.close();
-  } else {
-    http.send(404, "text/plain", "Not found");
+static void assetsScan() {
+  s_assetCount = 0;
+  File root = LittleFS.open(WEB_ROOT);
+  if (!root || !root.isDirectory()) {
+    DBG_WARN("[HTTP] ⚠️ no %s on LittleFS (pio run -t uploadfs)\n", WEB_ROOT);
+    return;
+  }
+  for (File f = root.openNextFile(); f && s_assetCount < HTTP_ASSETS_MAX; f = root.openNextFile()) {
+    if (f.isDirectory()) continue;
+    String name = f.name();
+    const int slash = name.lastIndexOf('/');        // core 2.x returns the bare name
+    if (slash >= 0) name = name.substring(slash + 1);
+
+    WebAsset &a = s_assets[s_assetCount];
+    a.gz = name.endsWith(".gz");
+    String path = "/" + (a.gz ? name.substring(0, name.length() - 3) : name);
+    String file = String(WEB_ROOT "/") + name;
+    if (path.length() >= sizeof(a.path) || file.length() >= sizeof(a.file)) continue;
+    strcpy(a.path, path.c_str());
+    strcpy(a.file, file.c_str());
+    a.type = guessContentType(path);
+
+    uint32_t crc = 0, isize = (uint32_t)f.size();
+    if (a.gz && f.size() >= 18 && f.seek(f.size() - 8)) {
+      uint8_t t[8];
+      if (f.read(t, 8) == 8) {
+        crc   = t[0] | (t[1] << 8) | (t[2] << 16) | ((uint32_t)t[3] << 24);
+        isize = t[4] | (t[5] << 8) | (t[6] << 16) | ((uint32_t)t[7] << 24);
+      }
+    } else {
+      crc = (uint32_t)f.getLastWrite();             // plain file: mtime as version
+    }
+    snprintf(a.etag, sizeof(a.etag), "\"%08lx-%lx\"", (unsigned long)crc, (unsigned long)isize);
+    s_assetCount++;
   }
+  DBG_INFO("[HTTP] %d static assets indexed\n", s_assetCount);
+}
+
+static const WebAsset *assetFind(const String &path) {
+  for (int i = 0; i < s_assetCount; ++i)
+    if (path == s_assets[i].path) return &s_assets[i];
+  return nullptr;
+}
+
+static void handleFile(AsyncWebServerRequest *req) {
+  String path = req->url();
+  if (path == "/") path = "/index.html";   // default page
+  const WebAsset *a = assetFind(path);
+  if (!a) {
+    req->send(404, "text/plain", "Not found");
+    return;
+  }
+
+  // HTML revalidates every load (cheap 304), scripts/styles are cached
+  const bool html = strcmp(a->type, "text/html") == 0;
+  char cache[40];
+  if (html) strcpy(cache, "no-cache");
+  else snprintf(cache, sizeof(cache), "public, max-age=%d", HTTP_ASSET_MAX_AGE_S);
+
+  // Only the gzip copy is stored: a client that cannot decode it gets 406
+  if (a->gz && !(req->hasHeader("Accept-Encoding") &&
+                 req->header("Accept-Encoding").indexOf("gzip") >= 0)) {
+    req->send(406, "text/plain", "gzip required");
+    return;
+  }
+
+  if (req->hasHeader("If-None-Match") && req->header("If-None-Match") == a->etag) {
+    AsyncWebServerResponse *resp = req->beginResponse(304);
+    resp->addHeader("ETag", a->etag);
+    resp->addHeader("Cache-Control", cache);
+    req->send(resp);
+    return;
+  }
+
+  AsyncWebServerResponse *resp = req->beginResponse(LittleFS, a->file, a->type);
+  if (a->gz) {
+    resp->addHeader("Content-Encoding", "gzip");
+    resp->addHeader("Vary", "Accept-Encoding");
+  }
+  resp->addHeader("ETag", a->etag);
+  resp->addHeader("Cache-Control", cache);
+  req->send(resp);
 }
 
 // --------------------------------------------------------------------
@@ -99,21 +239,25 @@ void http_begin() {
     Serial.println("[FS] LittleFS mounted");
   }
 
-  http.on("/", []() { handleFile("/index.html"); });
-  http.on("/modbus/status.json", handleStatusJson);
-  http.on("/api/status", handleStatusJson);   // <-- NEW alias
-  http.on("/api/modbus/status", handleStatusJson);
-  // Static file fallback
-  http.onNotFound([]() {
-    handleFile(http.uri());
-  });
+  assetsScan();
+
+  http.on("/modbus/status.json", HTTP_GET, handleStatusJson);
+  http.on("/api/status", HTTP_GET, handleStatusJson);   // <-- NEW alias
+  http.on("/api/modbus/status", HTTP_GET, handleStatusJson);
+  http.on("/api/runs", HTTP_GET, handleRunsJson);
+  web_events_begin(http);                       // /api/events (SSE)
+  web_api_begin(http);                          // REST control (cmd layer)
+  // Static files (incl. "/") from the asset table
+  http.onNotFound(handleFile);
 
   http.begin();
 }
 
 // --------------------------------------------------------------------
-// Poll loop → must be called often in task
+// Periodic HTTP work from httpTask. The async server itself needs no
+// polling; this is the hook for work that must not run in AsyncTCP.
 // --------------------------------------------------------------------
 void http_poll() {
-  http.handleClient();
+  web_events_poll();   // live telemetry deltas
+  web_api_poll();      // queued REST commands
 }
@@ -34,9 +34,11 @@ static uint8_t  s_bestBssid[6]   = {0};
 static int32_t  s_bestChannel    = 0;
 static int      s_bestRssi       = -127;
 static uint32_t s_bootScanAt = 0;   // when to kick the first async scan
-// ---- weak hooks ----
-extern "C" void onWifiUp()   { mqtt_try_connect_with_backoff(true); }
-extern "C" void onWifiDown() { mqtt_disconnect(); }
+// ---- hooks ----
+// The MQTT path (ETH / WiFi) is chosen by net_mgr_loop(); the session
+// must not be touched from the WiFi event task.
+extern "C" void onWifiUp()   { DBG_INFO("[WiFi] ✅ STA up: %s\n", WiFi.localIP().toString().c_str()); }
+extern "C" void onWifiDown() { DBG_WARN("[WiFi] ⚠️ STA down\n"); }
 // ---------------- Helpers ----------------
 static void start_async_scan() {
   if (s_scanInProgress) return;
@@ -153,7 +155,7 @@ void wifi_setup() {
   WiFi.setScanMethod(WIFI_ALL_CHANNEL_SCAN);         // scan all channels during connect
   WiFi.setSortMethod(WIFI_CONNECT_AP_BY_SIGNAL);     // prefer strongest BSSID for the SSID
   WiFi.persistent(false);
-  WiFi.mode(WIFI_STA);
+  WiFi.mode(WiFi.getMode() == WIFI_AP ? WIFI_AP_STA : WIFI_STA);  // keep a running SoftAP
   WiFi.setAutoReconnect(true);      // retry last AP
   WiFi.setHostname(WIFI_HOSTNAME);
   WiFi.onEvent(onEvent);
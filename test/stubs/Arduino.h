@@ -0,0 +1,42 @@
+#pragma once
+// -------------------------------------------------------------------
+// Host stand-ins for the Arduino core (native test env only)
+// -------------------------------------------------------------------
+// Just what the sources included by the tests use. Serial collects its
+// output for the test to inspect; millis() / delay() come from the
+// test (usually a fake clock).
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+uint32_t millis();
+void delay(uint32_t ms);
+
+struct HostSerial
+{
+  std::string out; // everything written since the test cleared it
+
+  size_t write(const uint8_t *p, size_t n)
+  {
+    out.append((const char *)p, n);
+    return n;
+  }
+
+  size_t printf(const char *fmt, ...)
+  {
+    char b[512];
+    va_list a;
+    va_start(a, fmt);
+    const int n = vsnprintf(b, sizeof(b), fmt, a);
+    va_end(a);
+    return n > 0 ? write((const uint8_t *)b, (size_t)n < sizeof(b) ? n : sizeof(b) - 1) : 0;
+  }
+
+  void setTxTimeoutMs(uint32_t) {}
+};
+
+inline HostSerial Serial;
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+#include "esp_system.h"
+
+// From the test (counts the resets the supervisor gives the hardware WDT)
+esp_err_t esp_task_wdt_init(uint32_t timeout_s, bool panic);
+esp_err_t esp_task_wdt_add(void *task);
+esp_err_t esp_task_wdt_delete(void *task);
+esp_err_t esp_task_wdt_reset();
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef void *TaskHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// Spinlock as on the device: the tests run producers on host threads
+struct portMUX_TYPE
+{
+  std::atomic_flag f = ATOMIC_FLAG_INIT;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void portENTER_CRITICAL(portMUX_TYPE *m)
+{
+  while (m->f.test_and_set(std::memory_order_acquire))
+  {
+  }
+}
+
+inline void portEXIT_CRITICAL(portMUX_TYPE *m) { m->f.clear(std::memory_order_release); }
@@ -0,0 +1,14 @@
+#pragma once
+#include "FreeRTOS.h"
+
+// Tasks are not started on the host: the test calls the task body's
+// pieces itself
+inline BaseType_t xTaskCreatePinnedToCore(void (*)(void *), const char *, uint32_t, void *,
+                                          unsigned, TaskHandle_t *, int)
+{
+  return pdPASS;
+}
+inline void vTaskDelay(TickType_t) {}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(); // from the test
+const char *pcTaskGetName(TaskHandle_t task);
@@ -0,0 +1,245 @@
+// -------------------------------------------------------------------
+// Host test of the DBG_* record path (src/debug_log.cpp)
+// -------------------------------------------------------------------
+// Runs the producers (DBG_* macros) and the consumer (log_drain /
+// log_sweep, as logTask calls them) against the Arduino stand-ins in
+// test/stubs, with a fake millis().
+//
+// Checks: printf conversions over the encoded arguments, module
+// levels, the per call site rate limit (suppressed records take no
+// ring slot and end in one summary line), overflow counting, the RTC
+// post-mortem copy and a lossless ring under concurrent producers.
+//
+//   pio test -e native -f test_debug_log
+// -------------------------------------------------------------------
+#define DEBUG_LEVEL 3 // INFO call sites compiled in
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "../../src/debug_log.cpp"
+
+static std::atomic<uint32_t> g_ms{0};
+uint32_t millis() { return g_ms.load(); }
+void delay(uint32_t) {}
+
+static esp_reset_reason_t g_reset = ESP_RST_SW;
+esp_reset_reason_t esp_reset_reason() { return g_reset; }
+
+// logTask is compiled but not run here: no supervisor
+void watchdog_register_this_task(uint32_t, uint32_t, bool) {}
+void watchdog_feed() {}
+
+static bool printed(const char *s) { return Serial.out.find(s) != std::string::npos; }
+
+void setUp()
+{
+  log_drain(true); // nothing left over from the previous test
+  Serial.out.clear();
+  g_ms += 10 * LOG_RATE_WINDOW_MS;
+}
+void tearDown() {}
+
+static void test_format()
+{
+  enum class E { A = 3 };
+  const char *dyn = "dyn";
+  char arr[8] = "arr";
+  DBG_INFO("[MQTT] a=%d b=%u c=%ld e=%.2f f=%s g=%s h=%c i=%05.1f j=%x k=%-4d| l=%lld m=%p n=%%\n",
+           -5, 7u, -9L, 3.14159, dyn, arr, 'Z', 2.25f, 255, 42, (long long)-1234567890123LL,
+           (void *)0x1234);
+  DBG_WARN("no newline %s", "x");
+  DBG_ERROR("[ETH] enum %d bool %d\n", E::A, true);
+  DBG_INFO("[OTA] missing %d %s\n", 1);
+  log_drain(true);
+  TEST_ASSERT_TRUE(printed("[INFO ] [MQTT] a=-5 b=7 c=-9 e=3.14 f=dyn g=arr h=Z i=002.2 j=ff "
+                           "k=42  | l=-1234567890123 m=0x1234 n=%\n"));
+  TEST_ASSERT_TRUE(printed("[WARN ] no newline x"));
+  TEST_ASSERT_TRUE(printed("[ERROR] [ETH] enum 3 bool 1\n"));
+  TEST_ASSERT_TRUE(printed("[INFO ] [OTA] missing 1 ?\n"));
+}
+
+static void test_levels()
+{
+  log_set_level("mqtt", 1);
+  DBG_INFO("[MQTT] hidden\n");
+  DBG_ERROR("[MQTT] shown\n");
+  DBG_INFO("[ETH] eth info\n");
+  log_drain(true);
+  TEST_ASSERT_FALSE(printed("hidden"));
+  TEST_ASSERT_TRUE(printed("shown"));
+  TEST_ASSERT_TRUE(printed("eth info"));
+
+  char lv[64];
+  log_levels(lv, sizeof(lv));
+  TEST_ASSERT_EQUAL_STRING("*=3 MQTT=1", lv);
+
+  log_set_level("*", 1);
+  DBG_INFO("[ETH] now hidden\n");
+  log_set_level("MQTT", -1);
+  log_set_level("*", -1);
+  log_drain(true);
+  TEST_ASSERT_FALSE(printed("now hidden"));
+}
+
+static uint32_t ring_used() { return s_head.load() - s_tail; }
+
+static void test_rate_limit()
+{
+  const uint32_t used0 = ring_used();
+  for (int i = 0; i < 50; i++)
+    DBG_INFO("[SCAN] same %d\n", 1);
+  TEST_ASSERT_EQUAL_UINT32(used0 + 1, ring_used()); // repeats never queued
+  for (int i = 0; i < 30; i++)
+    DBG_INFO("[SCAN] vary %d\n", i);
+  TEST_ASSERT_EQUAL_UINT32(used0 + 1 + LOG_RATE_BURST, ring_used());
+  log_drain(true);
+  TEST_ASSERT_TRUE(printed("[SCAN] vary 9\n"));
+  TEST_ASSERT_FALSE(printed("[SCAN] vary 10\n"));
+
+  // Quiet sites: the summary comes from the sweep once the window ended
+  log_sweep();
+  log_drain(true);
+  TEST_ASSERT_FALSE(printed("suppressed"));
+  g_ms += LOG_RATE_WINDOW_MS;
+  log_sweep();
+  log_drain(true);
+  TEST_ASSERT_TRUE(printed("[INFO ] [LOG] ↳ 49× suppressed: [SCAN] same %d\n"));
+  TEST_ASSERT_TRUE(printed("[INFO ] [LOG] ↳ 20× suppressed: [SCAN] vary %d\n"));
+  TEST_ASSERT_EQUAL_UINT32(0, s_pendingCount);
+
+  // Active site: the summary precedes the next window's first record
+  Serial.out.clear();
+  for (int i = 0; i <= LOG_RATE_BURST + 3; i++)
+  {
+    if (i == LOG_RATE_BURST + 3)
+      g_ms += LOG_RATE_WINDOW_MS;
+    DBG_WARN("[SCAN] again %d\n", i == LOG_RATE_BURST + 3 ? 99 : i);
+  }
+  log_drain(true);
+  const size_t sum = Serial.out.find("[WARN ] [LOG] ↳ 3× suppressed: [SCAN] again");
+  TEST_ASSERT_TRUE(sum != std::string::npos);
+  TEST_ASSERT_TRUE(sum < Serial.out.find("[SCAN] again 99"));
+}
+
+static void test_dropped()
+{
+  // Distinct call sites (no rate limit): more records than slots
+  const uint32_t d0 = log_dropped();
+  for (int i = 0; i < LOG_RING_SLOTS / 4 + 8; i++)
+  {
+    DBG_INFO("[FLOOD] a %d\n", i % LOG_RATE_BURST);
+    DBG_INFO("[FLOOD] b %d\n", i % LOG_RATE_BURST);
+    DBG_INFO("[FLOOD] c %d\n", i % LOG_RATE_BURST);
+    DBG_INFO("[FLOOD] d %d\n", i % LOG_RATE_BURST);
+    DBG_INFO("[FLOOD] e %d\n", i % LOG_RATE_BURST);
+    DBG_INFO("[FLOOD] f %d\n", i % LOG_RATE_BURST);
+    DBG_INFO("[FLOOD] g %d\n", i % LOG_RATE_BURST);
+    DBG_INFO("[FLOOD] h %d\n", i % LOG_RATE_BURST);
+  }
+  TEST_ASSERT_TRUE(log_dropped() > d0);
+  log_drain(true);
+  log_sweep();
+  TEST_ASSERT_TRUE(printed("record(s) dropped (ring full)"));
+}
+
+static void test_postmortem()
+{
+  rtc_take_previous();
+  DBG_ERROR("[PM] last words %d\n", 7);
+  log_drain(true);
+
+  free(s_pm);
+  s_pm = nullptr;
+  s_pmCount = 0;
+  g_reset = ESP_RST_PANIC;
+  rtc_take_previous();
+  static std::string last;
+  TEST_ASSERT_EQUAL_INT(1, log_postmortem([](const char *l) { last = l; }));
+  TEST_ASSERT_EQUAL_STRING("[ERROR] [PM] last words 7", last.c_str());
+
+  g_reset = ESP_RST_POWERON; // RTC memory is random after power-on
+  rtc_take_previous();
+  TEST_ASSERT_EQUAL_INT(0, s_rtc.count);
+  g_reset = ESP_RST_SW;
+}
+
+// Four producers, one consumer: every record arrives or is counted as dropped
+static void test_ring_concurrent()
+{
+  const uint32_t d0 = log_dropped();
+  std::atomic<bool> stop{false};
+  uint32_t got = 0;
+  std::thread consumer([&] {
+    for (;;)
+    {
+      const bool last = stop;
+      while (ring_peek())
+      {
+        got++;
+        ring_pop();
+      }
+      if (last)
+        break;
+    }
+  });
+  std::vector<std::thread> producers;
+  for (int t = 0; t < 4; t++)
+    producers.emplace_back([] {
+      for (int i = 0; i < 100000; i++)
+      {
+        uint32_t pos;
+        if (LogRec *r = log_claim(pos))
+        {
+          r->len = 0;
+          log_commit(pos);
+        }
+      }
+    });
+  for (auto &p : producers)
+    p.join();
+  stop = true;
+  consumer.join();
+  TEST_ASSERT_EQUAL_UINT32(400000, got + log_dropped() - d0);
+}
+
+// One call site hit from four threads in one window: exactly one burst
+// is admitted, everything else is counted on the site
+static void test_admit_concurrent()
+{
+  static LogSite site;
+  site.level = 3;
+  std::atomic<uint32_t> admitted{0};
+  std::vector<std::thread> producers;
+  for (int t = 0; t < 4; t++)
+    producers.emplace_back([&admitted, t] {
+      for (int i = 0; i < 10000; i++)
+      {
+        const int32_t v = t * 10000 + i;
+        uint8_t args[5] = {'i'};
+        memcpy(args + 1, &v, 4);
+        if (log_admit(site, millis(), args, sizeof(args)))
+          admitted++;
+      }
+    });
+  for (auto &p : producers)
+    p.join();
+  TEST_ASSERT_EQUAL_UINT32(LOG_RATE_BURST, admitted.load());
+  TEST_ASSERT_EQUAL_UINT32(40000 - LOG_RATE_BURST, site.suppressed);
+  g_ms += LOG_RATE_WINDOW_MS;
+  rate_sweep(millis());
+  TEST_ASSERT_EQUAL_UINT32(0, site.suppressed);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_format);
+  RUN_TEST(test_levels);
+  RUN_TEST(test_rate_limit);
+  RUN_TEST(test_dropped);
+  RUN_TEST(test_postmortem);
+  RUN_TEST(test_ring_concurrent);
+  RUN_TEST(test_admit_concurrent);
+  return UNITY_END();
+}
@@ -0,0 +1,236 @@
+// -------------------------------------------------------------------
+// Host simulation of the MODE_ENERGY controller (src/energy_ctrl.cpp)
+// -------------------------------------------------------------------
+// Drives energy_ctrl_update() the way stateTask does (100 ms ticks,
+// Modbus samples every 200 ms, a written setpoint takes effect with the
+// next Modbus cycle) against modelled galvanic loads:
+//
+//   V = E0 + I·R(t), capped at the DPM voltage limit (CV → less current)
+//   I = min(setpoint · gain, I_limit)
+//
+// Each case checks that the batch reaches its energy target close to
+// the planned runtime, that the setpoint stays inside [cur_min, cur_max],
+// that writes stay rare and that the integral does not wind up while
+// the output is saturated.
+//
+//   pio test -e native -f test_energy_ctrl
+// -------------------------------------------------------------------
+#include <unity.h>
+#include <stdio.h>
+#include <math.h>
+#include "../../src/energy_ctrl.cpp"
+
+#define TICK_MS 100   // stateTask period
+#define SAMPLE_MS 200 // Modbus read period
+
+struct Load
+{
+  double e0_v;              // back EMF (V)
+  double r0_ohm, r1_ohm;    // bath resistance at start / end of the run
+  double v_max;             // DPM voltage limit (V)
+  double gain;              // delivered / commanded current
+  double limit_ma;          // DPM current limit (mA), 0 = none
+  uint32_t cv_until_ms;     // v_max only applies before this (0 = always)
+};
+
+struct SimResult
+{
+  uint32_t done_ms;         // energy target reached (0 = not within 2 × runtime)
+  double energy_j;
+  int out_min, out_max;
+  uint16_t adjustments;
+  double integ_peak;        // largest |integ| seen
+};
+
+static double resistance(const Load &l, uint32_t t, uint32_t runtime_ms)
+{
+  double f = t >= runtime_ms ? 1.0 : (double)t / runtime_ms;
+  return l.r0_ohm + (l.r1_ohm - l.r0_ohm) * f;
+}
+
+// Delivered current / voltage for a commanded setpoint
+static void plant(const Load &l, uint32_t t, uint32_t runtime_ms, int set_ma,
+                  int &cur_ma, int &volt_mv)
+{
+  double i = set_ma * l.gain / 1000.0;
+  if (l.limit_ma > 0 && i > l.limit_ma / 1000.0)
+    i = l.limit_ma / 1000.0;
+  const double r = resistance(l, t, runtime_ms);
+  double v = l.e0_v + i * r;
+  if ((!l.cv_until_ms || t < l.cv_until_ms) && v > l.v_max)
+  {
+    v = l.v_max;
+    i = (l.v_max - l.e0_v) / r;
+  }
+  cur_ma = (int)(i * 1000.0 + 0.5);
+  volt_mv = (int)(v * 1000.0 + 0.5);
+}
+
+static SimResult simulate(const Load &l, EnergyCtrl c, int start_ma, double target_j,
+                          uint32_t runtime_ms)
+{
+  SimResult r = {0, 0.0, 1 << 30, -(1 << 30), 0, 0.0};
+  energy_ctrl_reset(c, start_ma, 0);
+  int written = c.out, applied = c.out; // setpoint in the queue / in the DPM
+  int cur = 0, volt = 0;
+
+  for (uint32_t t = TICK_MS; t <= 2 * runtime_ms; t += TICK_MS)
+  {
+    if (t % SAMPLE_MS == 0)
+    {
+      applied = written; // queued write handled by the next Modbus cycle
+      plant(l, t, runtime_ms, applied, cur, volt);
+    }
+    r.energy_j += (volt / 1000.0) * (cur / 1000.0) * (TICK_MS / 1000.0);
+    if (r.energy_j >= target_j)
+    {
+      r.done_ms = t;
+      break;
+    }
+
+    EnergyCtrlInput in;
+    in.now_ms = t;
+    in.elapsed_ms = t;
+    in.runtime_ms = runtime_ms;
+    in.energy_j = r.energy_j;
+    in.target_j = target_j;
+    in.volt_mv = volt;
+    in.cur_ma = cur;
+    if (energy_ctrl_update(c, in))
+      written = c.out;
+
+    if (c.out < r.out_min) r.out_min = c.out;
+    if (c.out > r.out_max) r.out_max = c.out;
+    if (fabs(c.integ) > r.integ_peak) r.integ_peak = fabs(c.integ);
+  }
+  r.adjustments = c.adjustments;
+  return r;
+}
+
+static void report(const char *name, const SimResult &r, uint32_t runtime_ms, double target_j)
+{
+  char msg[200];
+  snprintf(msg, sizeof(msg), "%s: done %.1f s of %.1f s (%+.2f%%), %.0f / %.0f J, I %d..%d mA, %u writes, |integ| <= %.0f mA",
+           name, r.done_ms / 1000.0, runtime_ms / 1000.0,
+           r.done_ms ? 100.0 * ((double)r.done_ms - runtime_ms) / runtime_ms : 100.0,
+           r.energy_j, target_j, r.out_min, r.out_max, r.adjustments, r.integ_peak);
+  TEST_MESSAGE(msg);
+}
+
+static EnergyCtrl bounds(int lo, int hi)
+{
+  EnergyCtrl c;
+  c.cur_min = lo;
+  c.cur_max = hi;
+  return c;
+}
+
+static void check_on_time(const SimResult &r, uint32_t runtime_ms, const EnergyCtrl &c)
+{
+  TEST_ASSERT_TRUE_MESSAGE(r.done_ms > 0, "energy target not reached");
+  TEST_ASSERT_INT_WITHIN_MESSAGE(runtime_ms / 50, runtime_ms, r.done_ms, "finish not within 2% of the runtime");
+  TEST_ASSERT_GREATER_OR_EQUAL(c.cur_min, r.out_min);
+  TEST_ASSERT_LESS_OR_EQUAL(c.cur_max, r.out_max);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(runtime_ms / ECTRL_PERIOD_MS, r.adjustments, "more writes than controller periods");
+}
+
+// ===================================================================
+// Cases
+// ===================================================================
+void setUp() {}
+void tearDown() {}
+
+// Load matches the plan: only small trims (start-up sample delay, the
+// last seconds where the horizon is clamped)
+static void test_steady_load()
+{
+  const Load l = {2.0, 2.0, 2.0, 30.0, 1.0, 0, 0};
+  const EnergyCtrl c = bounds(100, 10000);
+  const uint32_t rt = 600000;
+  const double target = 12.0 * 5.0 * 600; // 12 V × 5 A × 600 s
+  SimResult r = simulate(l, c, 5000, target, rt);
+  report("steady", r, rt, target);
+  check_on_time(r, rt, c);
+  TEST_ASSERT_LESS_OR_EQUAL(rt / ECTRL_PERIOD_MS / 5, r.adjustments);
+}
+
+// Bath warms up, resistance falls by 30 %: fixed current would end short
+static void test_resistance_drift()
+{
+  const Load l = {2.0, 2.0, 1.4, 30.0, 1.0, 0, 0};
+  const EnergyCtrl c = bounds(100, 10000);
+  const uint32_t rt = 900000;
+  const double target = 12.0 * 5.0 * 900;
+  SimResult r = simulate(l, c, 5000, target, rt);
+  report("drift", r, rt, target);
+  check_on_time(r, rt, c);
+  TEST_ASSERT_GREATER_THAN(5000, r.out_max); // had to raise the current
+}
+
+// DPM delivers only 90 % of the setpoint: the integral trims it
+static void test_current_shortfall()
+{
+  const Load l = {2.0, 2.0, 2.0, 30.0, 0.9, 0, 0};
+  const EnergyCtrl c = bounds(100, 10000);
+  const uint32_t rt = 600000;
+  const double target = 12.0 * 5.0 * 600;
+  SimResult r = simulate(l, c, 5000, target, rt);
+  report("shortfall", r, rt, target);
+  check_on_time(r, rt, c);
+}
+
+// Voltage limit caps the current for the first 5 minutes; after that the
+// controller must catch up without an overshoot from a wound-up integral
+static void test_voltage_limit_antiwindup()
+{
+  const Load l = {2.0, 2.0, 2.0, 10.0, 1.0, 0, 300000}; // CV: 4 A max until 300 s
+  const EnergyCtrl c = bounds(100, 8000);
+  const uint32_t rt = 1200000;
+  const double target = 12.0 * 5.0 * 1200;
+  SimResult r = simulate(l, c, 5000, target, rt);
+  report("cv-limit", r, rt, target);
+  check_on_time(r, rt, c);
+  TEST_ASSERT_LESS_OR_EQUAL(c.cur_max - c.cur_min, r.integ_peak); // clamp held
+}
+
+// Target not reachable inside cur_max: output pinned at the bound, the
+// integral stays bounded and the FSM gets a late finish (CHECK_ENERGY)
+static void test_infeasible_target()
+{
+  const Load l = {2.0, 2.0, 2.0, 30.0, 1.0, 0, 0};
+  const EnergyCtrl c = bounds(100, 4000);
+  const uint32_t rt = 600000;
+  const double target = 12.0 * 5.0 * 600;
+  SimResult r = simulate(l, c, 5000, target, rt);
+  report("infeasible", r, rt, target);
+  TEST_ASSERT_EQUAL_INT(c.cur_max, r.out_max);
+  TEST_ASSERT_LESS_OR_EQUAL(c.cur_max - c.cur_min, r.integ_peak);
+  TEST_ASSERT_TRUE(r.done_ms == 0 || r.done_ms > rt);
+}
+
+// Hard DPM current limit below the plan, lifted never: same as above but
+// the measured current (not the bound) is the constraint
+static void test_dpm_current_limit()
+{
+  const Load l = {2.0, 2.0, 2.0, 30.0, 1.0, 4500, 0};
+  const EnergyCtrl c = bounds(100, 10000);
+  const uint32_t rt = 600000;
+  const double target = 12.0 * 5.0 * 600;
+  SimResult r = simulate(l, c, 5000, target, rt);
+  report("dpm-limit", r, rt, target);
+  TEST_ASSERT_LESS_OR_EQUAL(c.cur_max, r.out_max);
+  TEST_ASSERT_LESS_OR_EQUAL(c.cur_max - c.cur_min, r.integ_peak);
+  TEST_ASSERT_LESS_OR_EQUAL(rt / ECTRL_PERIOD_MS, r.adjustments);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_load);
+  RUN_TEST(test_resistance_drift);
+  RUN_TEST(test_current_shortfall);
+  RUN_TEST(test_voltage_limit_antiwindup);
+  RUN_TEST(test_infeasible_target);
+  RUN_TEST(test_dpm_current_limit);
+  return UNITY_END();
+}
@@ -0,0 +1,205 @@
+// -------------------------------------------------------------------
+// Before/after measurement of the JSON responses (src/json_stream.cpp)
+// -------------------------------------------------------------------
+// Builds the /api/modbus/status device list (16 DPMs) twice: the old
+// way (std::string concatenation, as String did on the device) and with
+// JsonStream over a fixed buffer that is drained after every device, as
+// web_json_send() does. operator new is counted, so the allocations per
+// request stand for the heap churn the old code caused in AsyncTCP.
+//
+// Checks: identical output, no heap allocation in the streamed path,
+// escaping and sticky overflow. Allocations, bytes and µs per request
+// of both variants are printed (host numbers: compare, don't quote).
+//
+//   pio test -e native -f test_json_stream
+// -------------------------------------------------------------------
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include "../../src/json_stream.cpp"
+
+static size_t g_allocs = 0, g_bytes = 0;
+void *operator new(size_t n)
+{
+  g_allocs++;
+  g_bytes += n;
+  void *p = malloc(n);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+#define DEVICES 16
+#define REPEAT 20000
+
+static const char *NAMES[] = {"DPM8624", "DPM8605"};
+static char s_out[8192]; // what the client receives
+
+// ===================================================================
+// Before: one growing string per response
+// ===================================================================
+static std::string num(long v) { return std::to_string(v); }
+
+static size_t build_legacy()
+{
+  std::string out = "{\"cfgNames\":[";
+  for (int i = 0; i < 2; i++)
+  {
+    if (i) out += ',';
+    out += '"';
+    out += NAMES[i];
+    out += '"';
+  }
+  out += "],\"devices\":[";
+  for (int id = 1; id <= DEVICES; id++)
+  {
+    if (id > 1) out += ',';
+    out += "{\"id\":" + num(id);
+    out += ",\"valid\":" + std::string("true");
+    out += ",\"cfg\":" + num(0);
+    out += ",\"cfgName\":\"" + std::string(NAMES[0]) + "\"";
+    out += ",\"mask\":" + num(1);
+    out += ",\"multi\":" + std::string("false");
+    out += ",\"dpm_state\":" + num(1);
+    out += ",\"volt_act\":" + num(24000 + id);
+    out += ",\"cur_act\":" + num(1500 + id);
+    out += ",\"temp_act\":" + num(35);
+    out += ",\"last_ms\":" + num(123456789L);
+    out += "}";
+  }
+  out += "]}";
+  memcpy(s_out, out.data(), out.size());
+  return out.size();
+}
+
+// ===================================================================
+// After: fixed buffer, drained per device (chunked response)
+// ===================================================================
+static size_t build_streamed()
+{
+  char buf[768];
+  JsonStream w(buf, sizeof(buf));
+  size_t n = 0;
+  auto drain = [&] {
+    memcpy(s_out + n, w.data(), w.size());
+    n += w.size();
+    w.clear();
+  };
+  w.obj().arr("cfgNames");
+  for (int i = 0; i < 2; i++)
+    w.val(NAMES[i]);
+  w.end().arr("devices");
+  drain();
+  for (int id = 1; id <= DEVICES; id++)
+  {
+    w.obj()
+        .kv("id", id)
+        .kv("valid", true)
+        .kv("cfg", 0)
+        .kv("cfgName", NAMES[0])
+        .kv("mask", 1UL)
+        .kv("multi", false)
+        .kv("dpm_state", 1)
+        .kv("volt_act", 24000 + id)
+        .kv("cur_act", 1500 + id)
+        .kv("temp_act", 35)
+        .kv("last_ms", 123456789UL)
+        .end();
+    drain();
+  }
+  w.end().end();
+  drain();
+  return n;
+}
+
+struct Measure
+{
+  size_t len;
+  double allocs, bytes, us; // per request
+};
+
+static Measure measure(size_t (*build)())
+{
+  Measure m = {0, 0, 0, 0};
+  const size_t a0 = g_allocs, b0 = g_bytes;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < REPEAT; r++)
+    m.len = build();
+  auto t1 = std::chrono::steady_clock::now();
+  m.allocs = (double)(g_allocs - a0) / REPEAT;
+  m.bytes = (double)(g_bytes - b0) / REPEAT;
+  m.us = std::chrono::duration<double, std::micro>(t1 - t0).count() / REPEAT;
+  return m;
+}
+
+// ===================================================================
+// Cases
+// ===================================================================
+void setUp() {}
+void tearDown() {}
+
+static void test_same_output()
+{
+  static char legacy[sizeof(s_out)];
+  const size_t n = build_legacy();
+  memcpy(legacy, s_out, n);
+  TEST_ASSERT_EQUAL(n, build_streamed());
+  TEST_ASSERT_TRUE(memcmp(legacy, s_out, n) == 0);
+}
+
+static void test_before_after()
+{
+  build_legacy(); // warm up
+  build_streamed();
+  const Measure before = measure(build_legacy);
+  const Measure after = measure(build_streamed);
+
+  char msg[200];
+  snprintf(msg, sizeof(msg), "before: %zu B, %.1f allocs / %.0f B heap per request, %.2f us",
+           before.len, before.allocs, before.bytes, before.us);
+  TEST_MESSAGE(msg);
+  snprintf(msg, sizeof(msg), "after:  %zu B, %.1f allocs / %.0f B heap per request, %.2f us",
+           after.len, after.allocs, after.bytes, after.us);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_TRUE(before.allocs > DEVICES); // several temporaries per device
+  TEST_ASSERT_TRUE(after.allocs == 0);
+}
+
+static void test_escape()
+{
+  char buf[64];
+  JsonStream w(buf, sizeof(buf));
+  w.obj().kv("s", "a\"b\\c\n").kv("n", (const char *)nullptr).end();
+  const char want[] = "{\"s\":\"a\\\"b\\\\c\\u000a\",\"n\":null}"; // controls as \u00xx
+  TEST_ASSERT_EQUAL(strlen(want), w.size());
+  TEST_ASSERT_TRUE(memcmp(want, w.data(), w.size()) == 0);
+}
+
+// Too small a buffer: no partial document, the flag stays set
+static void test_overflow_sticky()
+{
+  char buf[16];
+  JsonStream w(buf, sizeof(buf));
+  w.obj().kv("long_key_name", 123456789L).kv("x", 1).end();
+  TEST_ASSERT_TRUE(w.overflow());
+  w.clear();
+  w.val(1);
+  TEST_ASSERT_TRUE(w.overflow());
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_same_output);
+  RUN_TEST(test_before_after);
+  RUN_TEST(test_escape);
+  RUN_TEST(test_overflow_sticky);
+  return UNITY_END();
+}
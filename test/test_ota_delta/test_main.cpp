@@ -0,0 +1,354 @@
+// -------------------------------------------------------------------
+// Delta OTA end to end on the host (src/ota_delta.cpp)
+// -------------------------------------------------------------------
+// Builds synthetic "relinked" firmware pairs, lets scripts/make_delta.py
+// write the patch, then does what update_mgr does with a download:
+// checks the header against the source image, raw-inflates the op
+// stream in random piece sizes (as TCP delivers it), feeds DeltaApply
+// in random piece sizes and compares the SHA-256 of the output with the
+// one in the header. Broken patches must be refused by DeltaApply or
+// by that hash check, never end in a wrong image.
+//
+//   pio test -e native -f test_ota_delta     (needs python3 and zlib)
+// -------------------------------------------------------------------
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include "../../src/ota_delta.cpp"
+
+#ifndef DELTA_PYTHON
+#define DELTA_PYTHON "python3"
+#endif
+
+typedef std::vector<uint8_t> Bytes;
+
+// ===================================================================
+// SHA-256 (FIPS 180-4); the device uses mbedtls
+// ===================================================================
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t ror(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static void sha256(const Bytes &msg, uint8_t out[32])
+{
+  uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  Bytes m(msg);
+  const uint64_t bits = (uint64_t)msg.size() * 8;
+  m.push_back(0x80);
+  while (m.size() % 64 != 56)
+    m.push_back(0);
+  for (int i = 7; i >= 0; i--)
+    m.push_back((uint8_t)(bits >> (i * 8)));
+
+  for (size_t blk = 0; blk < m.size(); blk += 64)
+  {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+      w[i] = (uint32_t)m[blk + 4 * i] << 24 | (uint32_t)m[blk + 4 * i + 1] << 16 |
+             (uint32_t)m[blk + 4 * i + 2] << 8 | m[blk + 4 * i + 3];
+    for (int i = 16; i < 64; i++)
+    {
+      const uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      const uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++)
+    {
+      const uint32_t t1 = k + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K256[i] + w[i];
+      const uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      k = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+  }
+  for (int i = 0; i < 8; i++)
+    for (int j = 0; j < 4; j++)
+      out[4 * i + j] = (uint8_t)(h[i] >> (24 - 8 * j));
+}
+
+// ===================================================================
+// Synthetic images (same idea as make_delta.py --selftest)
+// ===================================================================
+static uint32_t s_rng = 1;
+static uint32_t rnd(uint32_t n)
+{
+  s_rng = s_rng * 1103515245u + 12345u;
+  return (s_rng >> 8) % n;
+}
+
+static Bytes random_bytes(size_t n)
+{
+  Bytes b(n);
+  for (auto &x : b)
+    x = (uint8_t)rnd(256);
+  return b;
+}
+
+// Code-like image: "instructions" drawn from a small vocabulary
+static Bytes make_image(size_t size)
+{
+  std::vector<Bytes> words;
+  for (int i = 0; i < 2000; i++)
+    words.push_back(random_bytes(4 + rnd(20)));
+  Bytes img;
+  while (img.size() < size)
+  {
+    const Bytes &w = words[rnd((uint32_t)words.size())];
+    img.insert(img.end(), w.begin(), w.end());
+  }
+  img.resize(size);
+  return img;
+}
+
+// Functions inserted / removed, pointers shifted by the relink
+static Bytes relink(const Bytes &base)
+{
+  Bytes img(base);
+  for (int i = 0; i < 30; i++)
+  {
+    const size_t at = rnd((uint32_t)img.size());
+    const size_t n = 1 + rnd(400);
+    if (rnd(2))
+    {
+      const Bytes ins = random_bytes(n);
+      img.insert(img.begin() + at, ins.begin(), ins.end());
+    }
+    else
+      img.erase(img.begin() + at, img.begin() + std::min(img.size(), at + n));
+  }
+  for (size_t w = 0; w + 4 < img.size(); w += 64)
+    if (rnd(10) < 3)
+      img[w + 1] = (uint8_t)(img[w + 1] + 1); // +0x100 on a LE word
+  return img;
+}
+
+// ===================================================================
+// Patch via the host tool, apply like update_mgr
+// ===================================================================
+static char s_dir[] = "/tmp/dpmdeltaXXXXXX";
+
+static bool write_file(const std::string &path, const Bytes &b)
+{
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f)
+    return false;
+  const bool ok = fwrite(b.data(), 1, b.size(), f) == b.size();
+  fclose(f);
+  return ok;
+}
+
+static Bytes read_file(const std::string &path)
+{
+  Bytes b;
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return b;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    b.insert(b.end(), buf, buf + n);
+  fclose(f);
+  return b;
+}
+
+static Bytes make_delta(const Bytes &oldImg, const Bytes &newImg)
+{
+  const std::string dir = s_dir;
+  if (!write_file(dir + "/old.bin", oldImg) || !write_file(dir + "/new.bin", newImg))
+    return Bytes();
+  const std::string cmd = std::string(DELTA_PYTHON " scripts/make_delta.py ") + dir +
+                          "/old.bin " + dir + "/new.bin -o " + dir + "/new.dpmdelta > /dev/null";
+  if (system(cmd.c_str()) != 0)
+    return Bytes();
+  return read_file(dir + "/new.dpmdelta");
+}
+
+struct Sink
+{
+  const Bytes *src;
+  Bytes out;
+};
+
+static bool read_src(void *ctx, uint32_t off, uint8_t *dst, size_t n)
+{
+  const Bytes &s = *((Sink *)ctx)->src;
+  if ((size_t)off + n > s.size())
+    return false;
+  memcpy(dst, s.data() + off, n);
+  return true;
+}
+
+static bool write_out(void *ctx, const uint8_t *p, size_t n)
+{
+  Bytes &o = ((Sink *)ctx)->out;
+  o.insert(o.end(), p, p + n);
+  return true;
+}
+
+// Header check + inflate + apply; result of the last feed()
+static DeltaResult apply(const Bytes &src, const Bytes &patch, Bytes &out, DeltaHdr &h)
+{
+  if (!delta_is_patch(patch.data(), patch.size()) ||
+      !delta_parse_header(patch.data(), patch.size(), h))
+    return DELTA_ERR;
+  uint8_t sha[32];
+  sha256(src, sha);
+  if (h.src_size != src.size() || memcmp(sha, h.src_sha, 32) != 0)
+    return DELTA_ERR; // update_mgr: "not for the running image"
+
+  Sink sink = {&src, Bytes()};
+  DeltaApply a;
+  a.begin(h, read_src, write_out, &sink);
+  z_stream z = {};
+  if (inflateInit2(&z, -15) != Z_OK) // raw deflate, 32 KB window
+    return DELTA_ERR;
+
+  DeltaResult r = DELTA_MORE;
+  size_t pos = DELTA_HDR_SIZE;
+  uint8_t buf[1024];
+  int zr = Z_OK;
+  while (pos < patch.size() && r == DELTA_MORE && zr != Z_STREAM_END)
+  {
+    const size_t k = std::min<size_t>(1 + rnd(1460), patch.size() - pos);
+    z.next_in = const_cast<uint8_t *>(patch.data() + pos);
+    z.avail_in = (uInt)k;
+    pos += k;
+    do
+    {
+      z.next_out = buf;
+      z.avail_out = 1 + rnd(sizeof(buf));
+      const uInt cap = z.avail_out;
+      zr = inflate(&z, Z_NO_FLUSH);
+      if (zr != Z_OK && zr != Z_STREAM_END && zr != Z_BUF_ERROR)
+        r = DELTA_ERR;
+      else if (cap != z.avail_out)
+        r = a.feed(buf, cap - z.avail_out);
+      // a damaged stream may end early: the op stream then lacks END
+    } while (r == DELTA_MORE && zr != Z_STREAM_END && (z.avail_in || z.avail_out == 0));
+  }
+  inflateEnd(&z);
+  out = sink.out;
+  return r;
+}
+
+static void check_roundtrip(const char *name, const Bytes &oldImg, const Bytes &newImg)
+{
+  const Bytes patch = make_delta(oldImg, newImg);
+  TEST_ASSERT_TRUE_MESSAGE(patch.size() > DELTA_HDR_SIZE, "make_delta.py failed");
+
+  Bytes out;
+  DeltaHdr h;
+  TEST_ASSERT_EQUAL(DELTA_DONE, apply(oldImg, patch, out, h));
+  TEST_ASSERT_EQUAL(newImg.size(), h.dst_size);
+  TEST_ASSERT_EQUAL(h.dst_size, out.size());
+  uint8_t sha[32];
+  sha256(out, sha);
+  TEST_ASSERT_TRUE_MESSAGE(memcmp(sha, h.dst_sha, 32) == 0, "output hash differs from header");
+  TEST_ASSERT_TRUE(out == newImg);
+
+  char msg[120];
+  snprintf(msg, sizeof(msg), "%s: %zu B image, patch %zu B", name, newImg.size(), patch.size());
+  TEST_MESSAGE(msg);
+}
+
+// ===================================================================
+// Cases
+// ===================================================================
+static Bytes s_base;
+
+void setUp() {}
+void tearDown() {}
+
+static void test_sha256_known()
+{
+  const char *abc = "abc";
+  uint8_t sha[32];
+  sha256(Bytes(abc, abc + 3), sha);
+  const uint8_t want[4] = {0xba, 0x78, 0x16, 0xbf};
+  TEST_ASSERT_TRUE(memcmp(sha, want, 4) == 0 && sha[31] == 0xad);
+}
+
+static void test_identical() { check_roundtrip("identical", s_base, s_base); }
+static void test_relinked() { check_roundtrip("relinked", s_base, relink(s_base)); }
+static void test_unrelated() { check_roundtrip("unrelated", s_base, random_bytes(20000)); }
+
+// Patch made for another image: refused on the header hash
+static void test_wrong_source()
+{
+  const Bytes patch = make_delta(s_base, relink(s_base));
+  Bytes other(s_base);
+  other[100] ^= 0x55;
+  Bytes out;
+  DeltaHdr h;
+  TEST_ASSERT_EQUAL(DELTA_ERR, apply(other, patch, out, h));
+}
+
+// Damaged op stream: DeltaApply errors out, or the output hash check
+// of update_mgr (DELTA_DONE + dst_sha256) refuses it. A flipped byte in
+// literal / ADD data keeps the op stream valid, so only the hash sees it.
+static void test_corrupt_and_truncated()
+{
+  const Bytes newImg = relink(s_base);
+  const Bytes good = make_delta(s_base, newImg);
+  Bytes out;
+  DeltaHdr h;
+  int byApply = 0, byHash = 0;
+  for (int i = 0; i < 40; i++)
+  {
+    Bytes bad(good);
+    bad[DELTA_HDR_SIZE + rnd((uint32_t)(bad.size() - DELTA_HDR_SIZE))] ^= (uint8_t)(1 + rnd(255));
+    if (apply(s_base, bad, out, h) != DELTA_DONE)
+    {
+      byApply++;
+      continue;
+    }
+    uint8_t sha[32];
+    sha256(out, sha);
+    const bool accepted = memcmp(sha, h.dst_sha, 32) == 0;
+    TEST_ASSERT_TRUE_MESSAGE(!accepted || out == newImg, "corrupt patch accepted with a wrong image");
+    byHash += !accepted;
+  }
+  char msg[96];
+  snprintf(msg, sizeof(msg), "40 corrupt patches: %d refused by DeltaApply, %d by the hash", byApply, byHash);
+  TEST_MESSAGE(msg);
+
+  Bytes cut(good.begin(), good.begin() + good.size() / 2);
+  TEST_ASSERT_TRUE(apply(s_base, cut, out, h) != DELTA_DONE);
+}
+
+int main(int, char **)
+{
+  if (!mkdtemp(s_dir))
+    return 1;
+  s_base = make_image(200000);
+  UNITY_BEGIN();
+  RUN_TEST(test_sha256_known);
+  RUN_TEST(test_identical);
+  RUN_TEST(test_relinked);
+  RUN_TEST(test_unrelated);
+  RUN_TEST(test_wrong_source);
+  RUN_TEST(test_corrupt_and_truncated);
+  const int rc = UNITY_END();
+  const std::string dir = s_dir;
+  unlink((dir + "/old.bin").c_str());
+  unlink((dir + "/new.bin").c_str());
+  unlink((dir + "/new.dpmdelta").c_str());
+  rmdir(s_dir);
+  return rc;
+}
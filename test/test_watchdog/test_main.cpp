@@ -0,0 +1,185 @@
+// -------------------------------------------------------------------
+// Host test of the task supervisor (src/watchdog.cpp)
+// -------------------------------------------------------------------
+// Fake clock, fake "current task" and a fake task WDT that counts its
+// resets. Tasks check in the way their loops do, the test calls
+// watchdog_supervise() the way watchdogTask does.
+//
+// Checks: the hardware WDT is fed while every critical task is within
+// period + latency; a late non-critical task is only tracked; a stalled
+// critical task stops the feeding and is kept in RTC memory, reported
+// after the (simulated) reset; a late check-in counts as a miss.
+//
+//   pio test -e native -f test_watchdog
+// -------------------------------------------------------------------
+#define WDT_ENABLE
+#include <unity.h>
+#include "../../src/watchdog.cpp"
+
+static uint32_t g_ms = 0;
+uint32_t millis() { return g_ms; }
+void delay(uint32_t ms) { g_ms += ms; }
+
+// Tasks are plain handles
+#define MQTT ((TaskHandle_t)1)
+#define HTTP ((TaskHandle_t)2)
+#define SUPERVISOR ((TaskHandle_t)3)
+static TaskHandle_t g_cur = SUPERVISOR;
+TaskHandle_t xTaskGetCurrentTaskHandle() { return g_cur; }
+const char *pcTaskGetName(TaskHandle_t t)
+{
+  return t == MQTT ? "mqttTask" : t == HTTP ? "httpTask" : "watchdogTask";
+}
+
+static int g_resets = 0;
+static uint32_t g_timeoutS = 0;
+esp_err_t esp_task_wdt_init(uint32_t timeout_s, bool)
+{
+  g_timeoutS = timeout_s;
+  return ESP_OK;
+}
+esp_err_t esp_task_wdt_add(void *) { return ESP_OK; }
+esp_err_t esp_task_wdt_delete(void *) { return ESP_OK; }
+esp_err_t esp_task_wdt_reset()
+{
+  g_resets++;
+  return ESP_OK;
+}
+
+static esp_reset_reason_t g_reset = ESP_RST_POWERON;
+esp_reset_reason_t esp_reset_reason() { return g_reset; }
+
+// Log output is not checked: every record is filtered out
+bool log_enabled(LogSite &, uint8_t, const char *) { return false; }
+bool log_admit(LogSite &, uint32_t, const uint8_t *, size_t) { return false; }
+LogRec *log_claim(uint32_t &) { return nullptr; }
+void log_commit(uint32_t) {}
+
+static void checkin(TaskHandle_t t)
+{
+  g_cur = t;
+  watchdog_feed();
+  g_cur = SUPERVISOR;
+}
+
+static void supervise()
+{
+  g_cur = SUPERVISOR;
+  watchdog_supervise();
+}
+
+// Empty name: not supervised
+static WdStats stats_of(TaskHandle_t t)
+{
+  WdStats st[WDT_MAX_TASKS];
+  const uint8_t n = watchdog_stats(st, WDT_MAX_TASKS);
+  for (uint8_t i = 0; i < n; i++)
+    if (!strcmp(st[i].name, pcTaskGetName(t)))
+      return st[i];
+  return WdStats{};
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_start_and_register()
+{
+  s_rtc.magic = 0; // RTC_NOINIT: random at power-on
+  watchdog_start(WDT_TIMEOUT_S);
+  TEST_ASSERT_EQUAL_UINT32(WDT_TIMEOUT_S, g_timeoutS);
+
+  g_cur = MQTT;
+  watchdog_register_this_task(1000, 15000, true);
+  g_cur = HTTP;
+  watchdog_register_this_task(50, 2000, false);
+  g_cur = SUPERVISOR;
+  TEST_ASSERT_EQUAL_STRING("mqttTask", stats_of(MQTT).name);
+  TEST_ASSERT_EQUAL_STRING("httpTask", stats_of(HTTP).name);
+  TEST_ASSERT_TRUE(stats_of(MQTT).critical);
+  TEST_ASSERT_FALSE(stats_of(HTTP).critical);
+  TEST_ASSERT_EQUAL_UINT32(16000, stats_of(MQTT).limitMs);
+}
+
+static void test_healthy_feeds()
+{
+  const int r0 = g_resets;
+  for (int i = 0; i < 10; i++)
+  {
+    g_ms += 1000;
+    checkin(MQTT);
+    checkin(HTTP);
+    supervise();
+  }
+  TEST_ASSERT_EQUAL_INT(r0 + 10, g_resets);
+  TEST_ASSERT_EQUAL_UINT32(10, stats_of(MQTT).checkins);
+  TEST_ASSERT_EQUAL_UINT32(1000, stats_of(MQTT).meanMs);
+}
+
+static void test_noncritical_late_still_feeds()
+{
+  const int r0 = g_resets;
+  g_ms += 5000; // httpTask 5 s silent (limit 2050 ms), mqttTask within 16 s
+  supervise();
+  TEST_ASSERT_EQUAL_INT(r0 + 1, g_resets);
+  TEST_ASSERT_TRUE(stats_of(HTTP).late);
+  TEST_ASSERT_FALSE(stats_of(MQTT).late);
+}
+
+static void test_critical_stall_stops_feeding()
+{
+  const int r0 = g_resets;
+  g_ms += 12000; // mqttTask 17 s silent
+  supervise();
+  TEST_ASSERT_EQUAL_INT(r0, g_resets);
+  TEST_ASSERT_EQUAL_UINT32(WD_RTC_MAGIC, s_rtc.magic);
+  TEST_ASSERT_EQUAL_STRING("mqttTask", s_rtc.task);
+  TEST_ASSERT_EQUAL_UINT32(17000, s_rtc.stalledMs);
+}
+
+static void test_stall_reported_after_reset()
+{
+  // What the next boot sees: the record survived in RTC memory
+  g_reset = ESP_RST_TASK_WDT;
+  s_last = WdRtc{};
+  rtc_take_previous();
+  char task[16];
+  uint32_t ms = 0;
+  TEST_ASSERT_TRUE(watchdog_last_stall(task, sizeof(task), &ms));
+  TEST_ASSERT_EQUAL_STRING("mqttTask", task);
+  TEST_ASSERT_EQUAL_UINT32(17000, ms);
+  TEST_ASSERT_EQUAL_UINT32(0, s_rtc.magic);
+
+  // After power-on the RTC content is not trusted
+  s_rtc.magic = WD_RTC_MAGIC;
+  s_last = WdRtc{};
+  g_reset = ESP_RST_POWERON;
+  rtc_take_previous();
+  TEST_ASSERT_FALSE(watchdog_last_stall(task, sizeof(task), &ms));
+}
+
+static void test_recovery_counts_miss()
+{
+  const int r0 = g_resets;
+  s_rtc.magic = WD_RTC_MAGIC; // still overdue from the stall
+  checkin(MQTT);
+  checkin(HTTP);
+  supervise();
+  TEST_ASSERT_EQUAL_INT(r0 + 1, g_resets);
+  TEST_ASSERT_EQUAL_UINT32(0, s_rtc.magic);
+  const WdStats m = stats_of(MQTT);
+  TEST_ASSERT_EQUAL_UINT32(1, m.misses);
+  TEST_ASSERT_EQUAL_UINT32(1000, m.worstMs); // 17 s gap, 16 s limit
+  TEST_ASSERT_FALSE(m.late);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_start_and_register);
+  RUN_TEST(test_healthy_feeds);
+  RUN_TEST(test_noncritical_late_still_feeds);
+  RUN_TEST(test_critical_stall_stops_feeding);
+  RUN_TEST(test_stall_reported_after_reset);
+  RUN_TEST(test_recovery_counts_miss);
+  return UNITY_END();
+}